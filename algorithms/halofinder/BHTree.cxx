@@ -47,78 +47,20 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <sstream>
 #include <iomanip>
 #include <set>
+#include <string.h>
 #include <math.h>
+#include <limits>
 
 #include "Partition.h"
 #include "BHTree.h"
+#include "Profiler.h"
 
 using namespace std;
+using cosmotk::Profiler;
+using cosmotk::ProfilerRegion;
 
 namespace cosmologytools {
 
-
-/////////////////////////////////////////////////////////////////////////
-//
-// SPHParticle contains information about FOF halo particles
-//
-/////////////////////////////////////////////////////////////////////////
-
-SPHParticle::SPHParticle()
-{
-  this->density = 0.0;
-  this->smoothingLength = 0.0;
-  this->parent = -1;
-  this->nextNode = -1;
-}
-
-/////////////////////////////////////////////////////////////////////////
-//
-// SPHNode is a region of physical space divided into octants
-//
-/////////////////////////////////////////////////////////////////////////
-
-SPHNode::SPHNode(POSVEL_T* minLoc, POSVEL_T* maxLoc)
-{
-  for (int dim = 0; dim < DIMENSION; dim++) {
-    this->length[dim] = maxLoc[dim] - minLoc[dim];
-    this->center[dim] = minLoc[dim] + this->length[dim] * 0.5;
-
-  }
-  for (int i = 0; i < NUM_CHILDREN; i++)
-    this->node.child[i] = -1;
-}
-
-/////////////////////////////////////////////////////////////////////////
-//
-// SPHNode constructed from an octant of a parent node
-//
-/////////////////////////////////////////////////////////////////////////
-
-SPHNode::SPHNode(SPHNode* parent, int oindx)
-{
-  for (int dim = 0; dim < DIMENSION; dim++) {
-    this->length[dim] = parent->length[dim] * 0.5;
-  }
-
-  if (oindx & 1)
-    this->center[0] = parent->center[0] + this->length[0] * 0.5;
-  else
-    this->center[0] = parent->center[0] - this->length[0] * 0.5;
-
-  if (oindx & 2)
-    this->center[1] = parent->center[1] + this->length[1] * 0.5;
-  else
-    this->center[1] = parent->center[1] - this->length[1] * 0.5;
-
-  if (oindx & 4)
-    this->center[2] = parent->center[2] + this->length[2] * 0.5;
-  else
-    this->center[2] = parent->center[2] - this->length[2] * 0.5;
-
-  for (int i = 0; i < NUM_CHILDREN; i++)
-    this->node.child[i] = -1;
-}
-
 /////////////////////////////////////////////////////////////////////////
 //
 // Barnes Hut Tree
@@ -133,11 +75,20 @@ BHTree::BHTree(
 		POSVEL_T* yLoc,
 		POSVEL_T* zLoc,
 		POSVEL_T* ms,
-		POSVEL_T avgMass)
+		POSVEL_T avgMass,
+		BigChunkArena* treeArena)
 {
   this->minRange = new POSVEL_T[DIMENSION];
   this->maxRange = new POSVEL_T[DIMENSION];
 
+  // Use the caller's arena so memory is reused across halos
+  this->ownArena = 0;
+  if (treeArena == 0) {
+    this->ownArena = new BigChunkArena();
+    treeArena = this->ownArena;
+  }
+  this->arena = treeArena;
+
   // Extract the contiguous data block from a vector pointer
   this->particleCount = count;
   this->xx = xLoc;
@@ -146,6 +97,13 @@ BHTree::BHTree(
   this->mass = ms;
   this->particleMass = avgMass;
 
+  this->cacheWidth = 0;
+  this->cacheMaxBytes = 0;
+  this->neighborWidth = 0;
+  this->neighborCount = 0;
+  this->neighborIndex = 0;
+  this->neighborDist = 0;
+
   // Find the grid size of this chaining mesh
   for (int dim = 0; dim < DIMENSION; dim++) {
     this->minRange[dim] = minLoc[dim];
@@ -165,10 +123,9 @@ BHTree::BHTree(
 
 BHTree::~BHTree()
 {
-  for (ID_T i = 0; i < this->particleCount; i++)
-    delete this->sphParticle[i];
-  for (ID_T i = 0; i < this->nodeCount; i++)
-    delete this->sphNode[i];
+  delete [] this->minRange;
+  delete [] this->maxRange;
+  if (this->ownArena != 0) delete this->ownArena;
 }
 
 /////////////////////////////////////////////////////////////////////////
@@ -180,20 +137,29 @@ BHTree::~BHTree()
 
 void BHTree::createBHTree()
 {
-  // Create the SPHParticles
+  // Create the SPH particle arrays
+  this->density = this->arena->allocate<POSVEL_T>(this->particleCount);
+  this->smoothingLength = this->arena->allocate<POSVEL_T>(this->particleCount);
+  this->parent = this->arena->allocate<ID_T>(this->particleCount);
+  this->nextNode = this->arena->allocate<ID_T>(this->particleCount);
   for (ID_T p = 0; p < this->particleCount; p++) {
-    SPHParticle* particle = new SPHParticle;
-    this->sphParticle.push_back(particle);
+    this->density[p] = 0.0;
+    this->smoothingLength[p] = 0.0;
+    this->parent[p] = -1;
+    this->nextNode[p] = -1;
   }
 
+  // Node pool for building, grown if the tree is deeper than expected
+  this->nodeCount = 0;
+  this->nodeCapacity = 0;
+  growNodePool();
+
   // Create the root node of the BH tree
-  SPHNode* root = new SPHNode(this->minRange, this->maxRange);
-  this->sphNode.push_back(root);
-  ID_T nodeIndex = 0;
+  addNode(-1, 0);
 
   // Iterate on all particles placing them in the BH tree
-  // Child slots in the tree contain the index of the SPHParticle or
-  // the index of the SPHNode offset by the number of particles
+  // Child slots in the tree contain the index of the particle or
+  // the index of the node offset by the number of particles
   // This is so we can use an integer instead of pointers
   // Otherwise we would need a generic pointer to cast as node or particle
   // and a field to indicate type
@@ -205,21 +171,22 @@ void BHTree::createBHTree()
     // tindx is index into the BH tree nodes
     // oindx is index into the octant of the tree node
     ID_T tindx = 0;
-    int oindx = getChildIndex(this->sphNode[tindx], pindx);
+    int oindx = getChildIndex(tindx, pindx);
 
-    while (this->sphNode[tindx]->node.child[oindx] != -1) {
+    while (this->nodeChild[tindx * NUM_CHILDREN + oindx] != -1) {
+      ID_T child = this->nodeChild[tindx * NUM_CHILDREN + oindx];
 
-      // Child slot in tree contains another SPHNode so go there
-      if (this->sphNode[tindx]->node.child[oindx] > this->particleCount) {
-        tindx = this->sphNode[tindx]->node.child[oindx] - this->particleCount;
-        oindx = getChildIndex(this->sphNode[tindx], pindx);
+      // Child slot in tree contains another node so go there
+      if (child >= this->particleCount) {
+        tindx = child - this->particleCount;
+        oindx = getChildIndex(tindx, pindx);
       }
 
-      // Otherwise there is a particle in the slot and we make a new SPHNode
+      // Otherwise there is a particle in the slot and we make a new node
       else {
 
         // Get the particle index of particle already in the node
-        ID_T pindx2 = this->sphNode[tindx]->node.child[oindx];
+        ID_T pindx2 = child;
         if (this->xx[pindx] == this->xx[pindx2] &&
             this->yy[pindx] == this->yy[pindx2] &&
             this->zz[pindx] == this->zz[pindx2]) {
@@ -227,42 +194,140 @@ void BHTree::createBHTree()
           break;
         }
         
-        SPHNode* node = new SPHNode(this->sphNode[tindx], oindx);
-        this->sphNode.push_back(node);
-        nodeIndex++;
-        ID_T tindx2 = nodeIndex;
+        ID_T tindx2 = addNode(tindx, oindx);
         
         // Place the node that was sitting there already
-        int oindx2 = getChildIndex(this->sphNode[tindx2], pindx2);
-        this->sphNode[tindx2]->node.child[oindx2] = pindx2;
+        int oindx2 = getChildIndex(tindx2, pindx2);
+        this->nodeChild[tindx2 * NUM_CHILDREN + oindx2] = pindx2;
 
-        // Add the new SPHNode to the BHTree
-        this->sphNode[tindx]->node.child[oindx] = tindx2 + this->particleCount;
+        // Add the new node to the BHTree
+        this->nodeChild[tindx * NUM_CHILDREN + oindx] =
+          tindx2 + this->particleCount;
 
         // Set to new node
         tindx = tindx2;
-        oindx = getChildIndex(this->sphNode[tindx], pindx);
+        oindx = getChildIndex(tindx, pindx);
       }
     }
     // Place the current particle in the BH tree
-    this->sphNode[tindx]->node.child[oindx] = pindx;
+    this->nodeChild[tindx * NUM_CHILDREN + oindx] = pindx;
+  }
+
+  // Arrays filled in when threading, sized to the final node count
+  ID_T n = this->nodeCount;
+  for (int dim = 0; dim < DIMENSION; dim++) {
+    this->nodeMin[dim] = this->arena->allocate<POSVEL_T>(n);
+    this->nodeMax[dim] = this->arena->allocate<POSVEL_T>(n);
+    this->nodeS[dim] = this->arena->allocate<POSVEL_T>(n);
+  }
+  this->nodeMass = this->arena->allocate<POSVEL_T>(n);
+  this->nodeSibling = this->arena->allocate<ID_T>(n);
+  this->nodeNext = this->arena->allocate<ID_T>(n);
+  this->nodeParent = this->arena->allocate<ID_T>(n);
+
+  for (ID_T i = 0; i < n; i++) {
+    for (int dim = 0; dim < DIMENSION; dim++) {
+      this->nodeMin[dim][i] = 
+        this->nodeCenter[dim][i] - 0.5 * this->nodeLength[dim][i];
+      this->nodeMax[dim][i] = 
+        this->nodeCenter[dim][i] + 0.5 * this->nodeLength[dim][i];
+    }
+    this->nodeNext[i] = -1;
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////
+//
+// Add a node to the pool.  The root covers the bounding box and every
+// other node covers one octant of its parent.
+//
+/////////////////////////////////////////////////////////////////////////
+
+ID_T BHTree::addNode(ID_T parentNode, int oindx)
+{
+  if (this->nodeCount == this->nodeCapacity)
+    growNodePool();
+
+  ID_T indx = this->nodeCount++;
+  if (parentNode < 0) {
+    for (int dim = 0; dim < DIMENSION; dim++) {
+      this->nodeLength[dim][indx] = this->maxRange[dim] - this->minRange[dim];
+      this->nodeCenter[dim][indx] = 
+        this->minRange[dim] + this->nodeLength[dim][indx] * 0.5;
+    }
+  } else {
+    for (int dim = 0; dim < DIMENSION; dim++) {
+      this->nodeLength[dim][indx] = this->nodeLength[dim][parentNode] * 0.5;
+
+      // Bit dim of the octant index selects the upper half on that axis
+      if (oindx & (1 << dim))
+        this->nodeCenter[dim][indx] = this->nodeCenter[dim][parentNode] +
+                                      this->nodeLength[dim][indx] * 0.5;
+      else
+        this->nodeCenter[dim][indx] = this->nodeCenter[dim][parentNode] -
+                                      this->nodeLength[dim][indx] * 0.5;
+    }
   }
-  this->nodeCount = this->sphNode.size();
+
+  for (int i = 0; i < NUM_CHILDREN; i++)
+    this->nodeChild[indx * NUM_CHILDREN + i] = -1;
+  return indx;
 }
 
 /////////////////////////////////////////////////////////////////////////
 //
-// Update the SPHNode vector by walking using a depth first recursion
-// Set parent and sibling indices which can replace the child[8] already
-// there, and supply extra information about center of mass and avg velocity
-// Enters recursion with the root sphNode and walks depth first through child
+// Start the build arrays at a size which holds most halos and double
+// them if needed.  Old arrays stay in the arena until it is reset, and
+// the arena's high water mark makes the next halo start large enough.
+//
+/////////////////////////////////////////////////////////////////////////
+
+void BHTree::growNodePool()
+{
+  ID_T capacity = this->nodeCapacity * 2;
+  if (capacity == 0)
+    capacity = this->particleCount / 2 + 1;
+
+  POSVEL_T* center[DIMENSION];
+  POSVEL_T* length[DIMENSION];
+  for (int dim = 0; dim < DIMENSION; dim++) {
+    center[dim] = this->arena->allocate<POSVEL_T>(capacity);
+    length[dim] = this->arena->allocate<POSVEL_T>(capacity);
+  }
+  ID_T* child = this->arena->allocate<ID_T>(capacity * NUM_CHILDREN);
+
+  if (this->nodeCount > 0) {
+    for (int dim = 0; dim < DIMENSION; dim++) {
+      memcpy(center[dim], this->nodeCenter[dim],
+             this->nodeCount * sizeof(POSVEL_T));
+      memcpy(length[dim], this->nodeLength[dim],
+             this->nodeCount * sizeof(POSVEL_T));
+    }
+    memcpy(child, this->nodeChild,
+           this->nodeCount * NUM_CHILDREN * sizeof(ID_T));
+  }
+
+  for (int dim = 0; dim < DIMENSION; dim++) {
+    this->nodeCenter[dim] = center[dim];
+    this->nodeLength[dim] = length[dim];
+  }
+  this->nodeChild = child;
+  this->nodeCapacity = capacity;
+}
+
+/////////////////////////////////////////////////////////////////////////
+//
+// Update the node arrays by walking using a depth first recursion
+// Set parent and sibling indices which replace the children
+// and supply extra information about center of mass and avg velocity
+// Enters recursion with the root node and walks depth first through child
 //
 /////////////////////////////////////////////////////////////////////////
 
 void BHTree::threadBHTree(
 			ID_T curIndx,
 			ID_T sibling,
-			ID_T parent,
+			ID_T parentIndx,
 			ID_T* lastIndx)
 {
   ID_T offset = this->particleCount;
@@ -271,23 +336,21 @@ void BHTree::threadBHTree(
   // Particles and nodes are threaded together so all are touched in iteration
   if (*lastIndx >= 0) {
     if (*lastIndx >= offset) {
-      this->sphNode[(*lastIndx - offset)]->node.info.nextNode = curIndx;
+      this->nodeNext[*lastIndx - offset] = curIndx;
     } else {
-      this->sphParticle[*lastIndx]->nextNode = curIndx;
+      this->nextNode[*lastIndx] = curIndx;
     }
   }
   *lastIndx = curIndx;
  
-  // SPHParticle saves only the parent SPHNode
+  // Particle saves only the parent node
   if (curIndx < offset) {
-      this->sphParticle[curIndx]->parent = parent;
+      this->parent[curIndx] = parentIndx;
 
-  // SPHNode recurses on each of the children
+  // Node recurses on each of the children
   } else {
-    ID_T child[NUM_CHILDREN];
-    for (int j = 0; j < NUM_CHILDREN; j++) {
-      child[j] = this->sphNode[curIndx-offset]->node.child[j];
-    }
+    ID_T nindx = curIndx - offset;
+    ID_T* child = &this->nodeChild[nindx * NUM_CHILDREN];
 
     POSVEL_T totalMass = 0.0;
     POSVEL_T s[DIMENSION];
@@ -321,15 +384,15 @@ void BHTree::threadBHTree(
         // Return from recursion on childIndx which is a particle or a node
         if (childIndx >= offset) {
 
-          // SPHNode
-          totalMass += this->sphNode[childIndx-offset]->node.info.mass;
+          // Node
+          ID_T cindx = childIndx - offset;
+          totalMass += this->nodeMass[cindx];
           for (int dim = 0; dim < DIMENSION; dim++) {
-            s[dim] += this->sphNode[childIndx-offset]->node.info.mass * 
-                      this->sphNode[childIndx-offset]->node.info.s[dim];
+            s[dim] += this->nodeMass[cindx] * this->nodeS[dim][cindx];
           }
 
         } else {
-          // SPHParticle
+          // Particle
           totalMass += this->particleMass;
           s[0] += this->particleMass * this->xx[childIndx];
           s[1] += this->particleMass * this->yy[childIndx];
@@ -344,16 +407,16 @@ void BHTree::threadBHTree(
       }
     } else {
       for (int dim = 0; dim < DIMENSION; dim++) {
-        s[dim] = this->sphNode[curIndx-offset]->center[dim];
+        s[dim] = this->nodeCenter[dim][nindx];
       }
     }
     for (int dim = 0; dim < DIMENSION; dim++) {
-      this->sphNode[curIndx-offset]->node.info.s[dim] = s[dim];
+      this->nodeS[dim][nindx] = s[dim];
     }
 
-    this->sphNode[curIndx-offset]->node.info.mass = totalMass;
-    this->sphNode[curIndx-offset]->node.info.sibling = sibling;
-    this->sphNode[curIndx-offset]->node.info.parent = parent;
+    this->nodeMass[nindx] = totalMass;
+    this->nodeSibling[nindx] = sibling;
+    this->nodeParent[nindx] = parentIndx;
   }
 }
 
@@ -377,50 +440,51 @@ void BHTree::printBHTree()
   while (curIndex != -1) {
 
     // Get the parent of the current index
-    ID_T parent;
+    ID_T parentIndx;
     if (curIndex >= offset)
-      parent = this->sphNode[curIndex - offset]->node.info.parent;
+      parentIndx = this->nodeParent[curIndex - offset];
     else
-      parent = this->sphParticle[curIndex]->parent;
+      parentIndx = this->parent[curIndex];
 
     // Pop the stack of parents until the level is right
-    while (parent != parents[parentIndex]) {
+    while (parentIndx != parents[parentIndex]) {
       parents.pop_back();
       parentIndex--;
     }
 
-    // Print SPHNode
+    // Print node
     if (curIndex >= offset) {
+      ID_T nindx = curIndex - offset;
       cout << parentIndex << ":" << setw(parentIndex) << " ";
       cout << "N " << curIndex 
-           << " next " << this->sphNode[curIndex-offset]->node.info.nextNode 
-           << " parent " << this->sphNode[curIndex-offset]->node.info.parent 
-           << " (" << this->sphNode[curIndex-offset]->node.info.s[0] 
-           << " ," << this->sphNode[curIndex-offset]->node.info.s[1] 
-           << " ," << this->sphNode[curIndex-offset]->node.info.s[2]
-           << ") MASS " << this->sphNode[curIndex-offset]->node.info.mass
+           << " next " << this->nodeNext[nindx] 
+           << " parent " << this->nodeParent[nindx] 
+           << " (" << this->nodeS[0][nindx] 
+           << " ," << this->nodeS[1][nindx] 
+           << " ," << this->nodeS[2][nindx]
+           << ") MASS " << this->nodeMass[nindx]
            << endl;
         
-      // Push back the new SPHNode which will have children
+      // Push back the new node which will have children
       parents.push_back(curIndex);
       parentIndex++;
 
       // Walk to next node (either particle or node)
-      curIndex = this->sphNode[curIndex-offset]->node.info.nextNode;
+      curIndex = this->nodeNext[nindx];
     }
 
-    // Print SPHParticle
+    // Print particle
     else {
       cout << parentIndex << ":" << setw(parentIndex) << " ";
       cout << "P " << curIndex 
-           << " next " << this->sphParticle[curIndex]->nextNode 
-           << " parent " << this->sphParticle[curIndex]->parent
+           << " next " << this->nextNode[curIndex] 
+           << " parent " << this->parent[curIndex]
            << " (" << xx[curIndex]
            << " ," << yy[curIndex]
            << " ," << zz[curIndex] << ")" << endl;
 
       // Walk to next node (either particle or node)
-      curIndex = this->sphParticle[curIndex]->nextNode;
+      curIndex = this->nextNode[curIndex];
     }
   }
 }
@@ -433,16 +497,16 @@ void BHTree::printBHTree()
 // Some formulations will choose h such that a constant # particles is within
 // This formulation chooses h such that
 //   (4*PI)/3 * h^3 * est_density = DesNumNgb * particleMass
-//   (4*PI)/3 * h^3 * (sphNode.mass / sphNode.len^3) = DesNumNgb * particleMass
+//   (4*PI)/3 * h^3 * (node.mass / node.len^3) = DesNumNgb * particleMass
 //
 // Initial guess is found by walking up the parent nodes until finding a
-// SPHNode that has at least the minimum number of neighbors in it.  The
-// estimated density is based on the cube which is an sphNode.  We just want
+// node that has at least the minimum number of neighbors in it.  The
+// estimated density is based on the cube which is a node.  We just want
 // the initial guess to be larger than the actual smoothing length which
 // will be calculated in calculateDensity().
 //
-// h = cube_root(3/(4*PI) * DesNumNgb * particleMass / sphNode.mass) * 
-//               sphNode.len
+// h = cube_root(3/(4*PI) * DesNumNgb * particleMass / node.mass) * 
+//               node.len
 //
 /////////////////////////////////////////////////////////////////////////
 
@@ -456,36 +520,52 @@ void BHTree::calculateInitialSmoothingLength(int numberOfNeighbors)
   POSVEL_T maxMass = (POSVEL_T) this->particleCount * this->particleMass;
   minMass = min(minMass, maxMass);
 
-  // SPHNodes start numbering after the last particle index number
+  // Nodes start numbering after the last particle index number
   POSVEL_T factor1 = 3.0 / (4.0 * M_PI) * 
                      numberOfNeighbors * this->particleMass;
   POSVEL_T onethird = 1.0 / 3.0;
   
   // Calculate smoothing length guess h_i for each particle p_i
+  // Each particle only reads the tree so the loop is split across threads
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
   for (ID_T p = 0; p < this->particleCount; p++) {
-    ID_T parent = this->sphParticle[p]->parent;
+    ID_T parentIndx = this->parent[p];
 
     // Move up parent tree until we have enough neighbors for smoothing
     // Find more neighbors than we actually need
-    ID_T node = parent;
+    ID_T node = parentIndx;
     while (node >= this->particleCount && node != -1 &&
-         minMass > this->sphNode[parent-this->particleCount]->node.info.mass) { 
-      parent = node;
-      node = this->sphNode[parent-this->particleCount]->node.info.parent;
+         minMass > this->nodeMass[parentIndx-this->particleCount]) { 
+      parentIndx = node;
+      node = this->nodeParent[parentIndx-this->particleCount];
     }
 
     // Get the mass and volume of the parent containing enough particles
-    POSVEL_T pLen = max(
-                      max(
-                        this->sphNode[parent-this->particleCount]->length[0],
-                        this->sphNode[parent-this->particleCount]->length[1]),
-                      this->sphNode[parent-this->particleCount]->length[2]);
-    POSVEL_T pMass = this->sphNode[parent-this->particleCount]->node.info.mass;
-
-    sphParticle[p]->smoothingLength = pow((factor1 / pMass), onethird) * pLen;
+    ID_T nindx = parentIndx - this->particleCount;
+    POSVEL_T pLen = max(max(this->nodeLength[0][nindx],
+                            this->nodeLength[1][nindx]),
+                        this->nodeLength[2][nindx]);
+    POSVEL_T pMass = this->nodeMass[nindx];
+
+    this->smoothingLength[p] = pow((factor1 / pMass), onethird) * pLen;
   }
 }
 
+/////////////////////////////////////////////////////////////////////////
+//
+// Request the neighbor cache.  Memory is only taken from the arena when
+// calculateDensity() runs, and only if the whole cache fits in maxBytes.
+//
+/////////////////////////////////////////////////////////////////////////
+
+void BHTree::setNeighborCache(int width, size_t maxBytes)
+{
+  this->cacheWidth = width;
+  this->cacheMaxBytes = maxBytes;
+}
+
 /////////////////////////////////////////////////////////////////////////
 //
 // Calculate the local density for each particle i in the halo
@@ -509,6 +589,9 @@ void BHTree::calculateInitialSmoothingLength(int numberOfNeighbors)
 
 void BHTree::calculateDensity(int numberOfClosest)
 {
+  static int densityRegion = Profiler::GetCountedRegion("BHTree Neighbors");
+  ProfilerRegion timed(densityRegion);
+
   // When calculating density must have a constant mass within the
   // smoothing length sphere.  Use a number slightly bigger than the
   // number of neighbors required for creating subgroups
@@ -525,8 +608,39 @@ void BHTree::calculateDensity(int numberOfClosest)
   POSVEL_T h0, h, h2, hinv, hinv3, hinv4;
   POSVEL_T rho, divv, weighted_numngb, dhsmlrho;
 
+  // Neighbor search scratch, copied to each thread
+  vector<ValueInfo> neighborList;
+  vector<ID_T> stack;
+
+  // A search returns at most numberOfClosest neighbors, so the rows of the
+  // neighbor cache are laid out before the parallel loop at that length
+  // and each particle records how many of its row it filled
+  int rowLength = (int) min((ID_T) min(numberOfClosest, this->cacheWidth),
+                            this->particleCount - 1);
+  size_t cacheBytes = 
+    (size_t) this->particleCount * sizeof(int) +
+    (size_t) this->particleCount * rowLength * (sizeof(int) + sizeof(POSVEL_T));
+  this->neighborWidth = 0;
+  this->neighborCount = 0;
+  if (rowLength > 0 && cacheBytes <= this->cacheMaxBytes) {
+    ID_T size = this->particleCount * rowLength;
+    this->neighborWidth = rowLength;
+    this->neighborCount = this->arena->allocate<int>(this->particleCount);
+    this->neighborIndex = this->arena->allocate<int>(size);
+    this->neighborDist = this->arena->allocate<POSVEL_T>(size);
+  }
+
   // Calculate the density for every particle using smoothing length to
   // locate enough neighbor particles in the BH tree
+  // The tree is only read and each particle writes its own values, so
+  // particles are independent and are shared out dynamically because
+  // the search costs more in the dense core
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 256) \
+        private(h0, h, h2, hinv, hinv3, hinv4) \
+        private(rho, divv, weighted_numngb, dhsmlrho) \
+        firstprivate(neighborList, stack)
+#endif
   for (ID_T p = 0; p < this->particleCount; p++) {
 
     POSVEL_T pos[DIMENSION];
@@ -535,19 +649,34 @@ void BHTree::calculateDensity(int numberOfClosest)
     pos[2] = this->zz[p];
 
     // Initial guess at smoothing length which will be refined
-    h0 = this->sphParticle[p]->smoothingLength;
+    h0 = this->smoothingLength[p];
 
     // Find the neighbors of particle within radius of smoothing length h
     // which are ordered by increasing distance
-    vector<ValueInfo> neighborList;
     getClosestNeighbors(numberOfClosest, p, pos, h0, startNode, 
-                        neighborList);
+                        neighborList, stack);
+    int numberOfNeighbors = neighborList.size();
+
+    // Save the closest neighbors for the subhalo grouping, a search may
+    // find fewer than the row holds or none at all
+    if (this->neighborCount != 0) {
+      int count = min(rowLength, numberOfNeighbors);
+      ID_T start = p * rowLength;
+      for (int n = 0; n < count; n++) {
+        this->neighborIndex[start + n] = neighborList[n].particleId;
+        this->neighborDist[start + n] = neighborList[n].value;
+      }
+      this->neighborCount[p] = count;
+    }
+
+    if (numberOfNeighbors == 0)
+      continue;
 
     // Reset the smoothing length of this particle
-    this->sphParticle[p]->smoothingLength = 
-      neighborList[numberOfClosest-1].value;
+    this->smoothingLength[p] = 
+      neighborList[numberOfNeighbors-1].value;
 
-    h = this->sphParticle[p]->smoothingLength;
+    h = this->smoothingLength[p];
     h2 = h * h;
     hinv = 1.0 / h;
     hinv3 = hinv * hinv * hinv;
@@ -559,7 +688,7 @@ void BHTree::calculateDensity(int numberOfClosest)
     dhsmlrho = 0;
 
     // Iterate over the closest neighbors, distance was already calculated
-    for (int n = 0; n < numberOfClosest; n++) {
+    for (int n = 0; n < numberOfNeighbors; n++) {
   
       POSVEL_T r = neighborList[n].value;
 
@@ -588,31 +717,30 @@ void BHTree::calculateDensity(int numberOfClosest)
         dhsmlrho += -particleMass * (DIMENSION * hinv * wk + u * dwk);
       }
     }
-    this->sphParticle[p]->density = rho;
+    this->density[p] = rho;
   }
 }
 
 /////////////////////////////////////////////////////////////////////////////
 //
 // Fetch the closest N neighbors of a particle and return ordered
-// Use the smoothing length hsml of the particle for an initial guess and
-// call getNeighborList to return all particles within a box of
-// hsml in each direction from the particle.
-//
-// Since hsml marks a sphere and not a box, not all particles returned 
-// will meet the criteria and will be discarded.  We must return the
-// requested N neighbors.  If the initial hsml does not get enough neighbors
-// multiply it by a factor and try again until at least N particles are
-// within hsml.
-//
-// We want no more than N neighbors so calculate the distances to each
-// neighbor, sort by distance and take the N closest to return.  The
+//
+// The tree below startNode is walked depth first, visiting the children
+// of a node closest first, while the N closest particles seen so far are
+// kept in a max heap on distance.  Once the heap is full its top is the
+// pruning radius and any node whose box is farther away is skipped, so
+// the radius shrinks as closer particles are found.
+//
+// The smoothing length hsml of the particle is used as the initial
+// pruning radius.  The guess from calculateInitialSmoothingLength() is
+// larger than the final smoothing length so this almost always holds
+// N particles, otherwise the walk is repeated without a radius.  The
 // hsml for the given particle will be set to the distance to the Nth 
 // neighbor in the calling calculateDensity() method.
 //
-// This code can also be used by the subhalo grouping method with a
-// smaller N and in this case hsml will not be reset.  Might think about
-// saving the closest N neighbors to save recalculation is memory exists.
+// This code is also used by the subhalo grouping method with a
+// smaller N and in this case hsml will not be reset.  If the halo has
+// fewer than N other particles all of them are returned.
 //
 /////////////////////////////////////////////////////////////////////////////
 
@@ -624,108 +752,194 @@ void BHTree::getClosestNeighbors(
 			ID_T startNode,
 			vector<ValueInfo>& hsmlList)
 {
-  // Loop until number of neighbors is greater than required amount
-  while ((int) hsmlList.size() < numberOfClosest) {
+  vector<ID_T> stack;
+  getClosestNeighbors(numberOfClosest, me, pos, hsml, startNode,
+                      hsmlList, stack);
+}
 
-    // Find the neighbors of particle within radius of smoothing length h
-    // Can return too many or not enough
-    vector<int> neighborList;
-    getNeighborList(me, pos, hsml, startNode, neighborList);
+/////////////////////////////////////////////////////////////////////////////
+//
+// Search with a caller supplied node stack so that a thread can reuse
+// its scratch for every particle.  The tree is not modified so any number
+// of threads may search at once.
+//
+/////////////////////////////////////////////////////////////////////////////
 
-    // Collect neigbors from hsml box which are also inside hsml sphere
-    for (int n = 0; n < (int) neighborList.size(); n++) {
-  
-      int neighbor = neighborList[n];
-      POSVEL_T dx = pos[0] - this->xx[neighbor];
-      POSVEL_T dy = pos[1] - this->yy[neighbor];
-      POSVEL_T dz = pos[2] - this->zz[neighbor];
-      POSVEL_T r = sqrt(dx * dx + dy * dy + dz * dz);
-  
-      // Neighbor has to be within the smoothing distance of the particle
-      // in order to contribute to density of particle
-      if (r < hsml) {
-        ValueInfo info;
-        info.value = r;
-        info.particleId = neighbor;
-        hsmlList.push_back(info); 
+void BHTree::getClosestNeighbors(
+			int numberOfClosest,
+			ID_T me,
+			POSVEL_T pos[DIMENSION],
+			POSVEL_T hsml,
+			ID_T startNode,
+			vector<ValueInfo>& hsmlList,
+			vector<ID_T>& stack)
+{
+  ID_T offset = this->particleCount;
+  int maxNeighbors = (int) min((ID_T) numberOfClosest, this->particleCount - 1);
+  POSVEL_T bound2 = hsml * hsml;
+
+  // Stack of nodes still to be visited, closest child on top
+  for (int pass = 0; pass < 2; pass++) {
+    hsmlList.clear();
+    stack.clear();
+    stack.push_back(startNode);
+
+    while (!stack.empty()) {
+      ID_T nindx = stack.back() - offset;
+      stack.pop_back();
+
+      // Heap may have filled since this node was pushed
+      POSVEL_T radius2 = ((int) hsmlList.size() == maxNeighbors) ?
+                         hsmlList[0].value : bound2;
+      if (boxDistance2(nindx, pos) >= radius2)
+        continue;
+
+      // Particles go straight to the heap, nodes are ordered by distance
+      ValueInfo nodeChild[NUM_CHILDREN];
+      int numNodes = 0;
+      for (int j = 0; j < NUM_CHILDREN; j++) {
+        ID_T child = this->nodeChild[nindx * NUM_CHILDREN + j];
+        if (child < 0 || child == me)
+          continue;
+
+        if (child < offset) {
+          POSVEL_T dx = pos[0] - this->xx[child];
+          POSVEL_T dy = pos[1] - this->yy[child];
+          POSVEL_T dz = pos[2] - this->zz[child];
+          POSVEL_T r2 = dx * dx + dy * dy + dz * dz;
+
+          if ((int) hsmlList.size() < maxNeighbors) {
+            if (r2 < bound2) {
+              ValueInfo info;
+              info.value = r2;
+              info.particleId = child;
+              hsmlList.push_back(info);
+              push_heap(hsmlList.begin(), hsmlList.end(), ValueLT());
+            }
+          } else if (r2 < hsmlList[0].value) {
+            pop_heap(hsmlList.begin(), hsmlList.end(), ValueLT());
+            hsmlList.back().value = r2;
+            hsmlList.back().particleId = child;
+            push_heap(hsmlList.begin(), hsmlList.end(), ValueLT());
+          }
+        } else {
+          ValueInfo info;
+          info.value = boxDistance2(child - offset, pos);
+          info.particleId = child;
+          nodeChild[numNodes++] = info;
+        }
       }
+
+      // Push farthest first so the closest node is visited next
+      sort(nodeChild, nodeChild + numNodes, ValueGT());
+      radius2 = ((int) hsmlList.size() == maxNeighbors) ?
+                hsmlList[0].value : bound2;
+      for (int j = 0; j < numNodes; j++)
+        if (nodeChild[j].value < radius2)
+          stack.push_back(nodeChild[j].particleId);
     }
-    // If there aren't enough neighbors widen the smoothing length
-    if ((int) hsmlList.size() < numberOfClosest) {
-      hsml *= 1.25;
-      hsmlList.clear();
-    }
+
+    // Initial radius held enough neighbors
+    if ((int) hsmlList.size() == maxNeighbors)
+      break;
+
+    // Otherwise search again without a bound
+    bound2 = numeric_limits<POSVEL_T>::max();
   }
 
-  // Sort the neighbors within hsml by increasing distance
-  // Return with closest neighbor in vector
-  sort(hsmlList.begin(), hsmlList.end(), ValueLT());
+  // Return with closest neighbor first and distances instead of squares
+  sort_heap(hsmlList.begin(), hsmlList.end(), ValueLT());
+  for (int n = 0; n < (int) hsmlList.size(); n++)
+    hsmlList[n].value = sqrt(hsmlList[n].value);
 }
 
 /////////////////////////////////////////////////////////////////////////////
 //
-// Returns neighbors with distance <= hsml and returns them in Ngblist. 
-// Actually, particles in a box of half side length hsml are
-// returned, i.e. the reduction to a sphere still needs to be done in the
-// calling routine.
+// Squared distance from a position to the closest point of a node's box,
+// zero if the position is inside
 //
 /////////////////////////////////////////////////////////////////////////////
 
-void BHTree::getNeighborList(
-			int me,
-			POSVEL_T searchcenter[DIMENSION],
-			POSVEL_T hsml,
-			ID_T startNode,
-			vector<int>& neighborList)
+POSVEL_T BHTree::boxDistance2(ID_T node, POSVEL_T pos[DIMENSION])
 {
-  ID_T no = startNode;
-  ID_T offset = this->particleCount;
-
-  POSVEL_T searchmin[DIMENSION], searchmax[DIMENSION];
+  POSVEL_T dist2 = 0.0;
   for (int dim = 0; dim < DIMENSION; dim++) {
-    searchmin[dim] = searchcenter[dim] - hsml;
-    searchmax[dim] = searchcenter[dim] + hsml;
+    POSVEL_T d = 0.0;
+    if (pos[dim] < this->nodeMin[dim][node])
+      d = this->nodeMin[dim][node] - pos[dim];
+    else if (pos[dim] > this->nodeMax[dim][node])
+      d = pos[dim] - this->nodeMax[dim][node];
+    dist2 += d * d;
   }
+  return dist2;
+}
 
-  while (no >= 0) {
-    if (no < this->particleCount) {
-      // SPHParticles
-      ID_T p = no;
-      no = this->sphParticle[no]->nextNode;
-  
-      if (p != me &&
-          this->xx[p] >= searchmin[0] && this->xx[p] <= searchmax[0] &&
-          this->yy[p] >= searchmin[1] && this->yy[p] <= searchmax[1] &&
-          this->zz[p] >= searchmin[2] && this->zz[p] <= searchmax[2]) {
-        neighborList.push_back(p);
+/////////////////////////////////////////////////////////////////////////////
+//
+// Tree code potential of every particle in units of particle mass
+//   pot_i = - Sum_over_j (1 / r_ij)
+//
+// The threaded tree is walked from the root for each particle.  A node
+// whose largest side is less than theta times the distance to its center
+// of mass, and whose box does not hold the particle, is taken as a single
+// mass and its children are skipped.  Otherwise the walk goes into the
+// node.  Particles at zero distance do not contribute, as in the direct
+// pair sum.
+//
+/////////////////////////////////////////////////////////////////////////////
+
+void BHTree::calculatePotential(POSVEL_T theta, POTENTIAL_T* pot)
+{
+  ID_T offset = this->particleCount;
+  POSVEL_T theta2 = theta * theta;
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 256)
+#endif
+  for (ID_T p = 0; p < this->particleCount; p++) {
+    POSVEL_T pos[DIMENSION];
+    pos[0] = this->xx[p];
+    pos[1] = this->yy[p];
+    pos[2] = this->zz[p];
+
+    double lpot = 0.0;
+    ID_T no = offset;
+    while (no >= 0) {
+      if (no < offset) {
+        // Particle
+        ID_T j = no;
+        no = this->nextNode[j];
+        if (j != p) {
+          POSVEL_T dx = pos[0] - this->xx[j];
+          POSVEL_T dy = pos[1] - this->yy[j];
+          POSVEL_T dz = pos[2] - this->zz[j];
+          POSVEL_T r = sqrt(dx * dx + dy * dy + dz * dz);
+          if (r != 0.0)
+            lpot -= 1.0 / r;
+        }
       }
-    }
 
-    else {
-      // SPHNode
-      ID_T nodeIndx = no - offset;
-      // Follow the sibling if the entire tree under this node is out of range
-      no = this->sphNode[nodeIndx]->node.info.sibling;
-
-      if ((this->sphNode[nodeIndx]->center[0] + 
-             0.5 * this->sphNode[nodeIndx]->length[0]) >= searchmin[0] &&
-          (this->sphNode[nodeIndx]->center[0] - 
-             0.5 * this->sphNode[nodeIndx]->length[0]) <= searchmax[0] &&
-
-          (this->sphNode[nodeIndx]->center[1] + 
-             0.5 * this->sphNode[nodeIndx]->length[1]) >= searchmin[1] &&
-          (this->sphNode[nodeIndx]->center[1] - 
-             0.5 * this->sphNode[nodeIndx]->length[1]) <= searchmax[1] &&
-
-          (this->sphNode[nodeIndx]->center[2] + 
-             0.5 * this->sphNode[nodeIndx]->length[2]) >= searchmin[2] &&
-          (this->sphNode[nodeIndx]->center[2] - 
-             0.5 * this->sphNode[nodeIndx]->length[2]) <= searchmax[2]) {
-
-        // Node has area which intersects the search area
-        no = this->sphNode[nodeIndx]->node.info.nextNode;
+      else {
+        // Node
+        ID_T nindx = no - offset;
+        POSVEL_T dx = pos[0] - this->nodeS[0][nindx];
+        POSVEL_T dy = pos[1] - this->nodeS[1][nindx];
+        POSVEL_T dz = pos[2] - this->nodeS[2][nindx];
+        POSVEL_T r2 = dx * dx + dy * dy + dz * dz;
+        POSVEL_T len = max(max(this->nodeLength[0][nindx],
+                               this->nodeLength[1][nindx]),
+                           this->nodeLength[2][nindx]);
+
+        if (len * len < theta2 * r2 && boxDistance2(nindx, pos) > 0.0) {
+          // Far enough away to use the mass of the whole node
+          lpot -= (this->nodeMass[nindx] / this->particleMass) / sqrt(r2);
+          no = this->nodeSibling[nindx];
+        } else {
+          no = this->nodeNext[nindx];
+        }
       }
     }
+    pot[p] = (POTENTIAL_T) lpot;
   }
 }
 
@@ -735,14 +949,14 @@ void BHTree::getNeighborList(
 //
 /////////////////////////////////////////////////////////////////////////
 
-int BHTree::getChildIndex(SPHNode* node, ID_T pindx)
+int BHTree::getChildIndex(ID_T node, ID_T pindx)
 {
   int index = 0;
-  if (this->xx[pindx] > node->center[0]) 
+  if (this->xx[pindx] > this->nodeCenter[0][node]) 
     index += 1;
-  if (this->yy[pindx] > node->center[1]) 
+  if (this->yy[pindx] > this->nodeCenter[1][node]) 
     index += 2;
-  if (this->zz[pindx] > node->center[2]) 
+  if (this->zz[pindx] > this->nodeCenter[2][node]) 
     index += 4;
   return index;
 }
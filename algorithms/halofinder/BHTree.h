@@ -41,7 +41,6 @@ OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
 ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
                                                                                 
 =========================================================================*/
-
 // .NAME BHTree - Create a Barnes Hut tree from the given particles
 //
 // .SECTION Description
@@ -62,16 +61,26 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 // also the parent, so that it is possible to represent the recursive tree
 // by paying attention to parents.
 //
-// SPHParticle is indexed from 0 to number of particles - 1 and the created 
-// nodes are numbered from (number of particles) within the tree.  Particles
-// and Nodes are maintained in separate vectors so the node can be located
-// using the index - number of particles.
+// Particles are indexed from 0 to number of particles - 1 and the created 
+// nodes are numbered from (number of particles) within the tree.  Particle
+// and node information is kept as structure of arrays so the node can be
+// located using the index - number of particles.
+//
+// The density pass can also keep the closest neighbors of every particle
+// in a compressed row neighbor cache so that subhalo grouping, which wants
+// a prefix of the same sorted list, does not search the tree again.
+//
+// All of the arrays are carved out of a BigChunkArena.  An arena can be
+// handed to successive trees (one per FOF halo) so that after the first
+// few halos no further heap allocation is done for the tree.
 //
 
 #ifndef BHTree_h
 #define BHTree_h
 
 #include "Definition.h"
+#include "bigchunk.h"
+#include <stddef.h>
 #include <vector>
 #include <algorithm>
 
@@ -108,59 +117,16 @@ public:
 
 /////////////////////////////////////////////////////////////////////////
 //
-// SPH (Smoothed Particle Hydrodynamics) Particles
+// Barnes Hut octree of SPH (Smoothed Particle Hydrodynamics) particles
+// and nodes threaded
 //
-/////////////////////////////////////////////////////////////////////////
-
-class SPHParticle {
-public:
-  SPHParticle();
-
-  POSVEL_T density;
-  POSVEL_T smoothingLength;
-
-  ID_T      parent;		// Parent SPHNode
-  ID_T      nextNode;		// Next node in iteration, particle or node
-};
-
-/////////////////////////////////////////////////////////////////////////
-//
-// SPH (Smoothed Particle Hydrodynamics) Nodes
-//
-// Barnes Hut octree structure for N-body is represented by vector
-// of SPHNodes which divide space into octants which are filled with one
-// particle or one branching node.  As the tree is built the child[8]
-// array is used.  Afterwards the tree is walked linking the nodes and
-// replacing the child structure with data about the tree.  When building
-// the tree child information is an integer which is the index of the
-// halo particle which was put into a vector of SPHParticle, or the index
-// of the SPHNode offset by the number of particles
-//
-/////////////////////////////////////////////////////////////////////////
-
-class SPHNode {
-public:
-  SPHNode(POSVEL_T* minLoc, POSVEL_T* maxLoc);
-  SPHNode(SPHNode* parent, int child);
-
-  POSVEL_T length[DIMENSION];		// Length of octant on each side
-  POSVEL_T center[DIMENSION];		// Physical center of octant
-
-  union {
-    ID_T  child[NUM_CHILDREN];		// Index of particle or node
-    struct Info {
-      POSVEL_T mass;
-      POSVEL_T s[DIMENSION];
-      ID_T     sibling;
-      ID_T     nextNode;
-      ID_T     parent;
-    } info;
-  } node;
-};
-
-/////////////////////////////////////////////////////////////////////////
-//
-// Barnes Hut octree of SPHParticles and SPHNodes threaded
+// The octree divides space into octants which are filled with one
+// particle or one branching node.  As the tree is built the child
+// array (NUM_CHILDREN per node) is used.  Afterwards the tree is walked
+// linking the nodes and filling in the mass, center of mass, sibling,
+// next and parent arrays.  When building the tree child information is an
+// integer which is the index of the halo particle, or the index of the node
+// offset by the number of particles
 //
 /////////////////////////////////////////////////////////////////////////
 
@@ -174,7 +140,8 @@ public:
         POSVEL_T* yLoc,
         POSVEL_T* zLoc,
 	POSVEL_T* mass,		// Mass of each particle
-	POSVEL_T avgMass);	// Average mass for estimation
+	POSVEL_T avgMass,	// Average mass for estimation
+	BigChunkArena* arena = 0);// Storage, private arena if not given
 
   ~BHTree();
 
@@ -202,20 +169,50 @@ public:
 	ID_T startNode,
 	vector<ValueInfo>& hsmlList);
 
-  void getNeighborList(
-	int me,
-	POSVEL_T searchcenter[DIMENSION],
+  void getClosestNeighbors(
+	int numberOfClosest,
+	ID_T me,
+	POSVEL_T pos[DIMENSION],
 	POSVEL_T hsml,
 	ID_T startNode,
-	vector<int>& neighborList);
-
-  vector<SPHParticle*>& getSPHParticle()	{ return this->sphParticle; }
-  vector<SPHNode*>& getSPHNode()		{ return this->sphNode; }
+	vector<ValueInfo>& hsmlList,
+	vector<ID_T>& stack);	// Scratch for the tree walk
+
+  // Potential of each particle from all others using opening angle theta
+  void calculatePotential(
+	POSVEL_T theta,
+	POTENTIAL_T* pot);
+
+  // Keep the first width neighbors found by calculateDensity() if the
+  // cache fits within maxBytes, must be set before calculateDensity()
+  void setNeighborCache(int width, size_t maxBytes);
+
+  // Cached neighbors of a particle ordered by increasing distance
+  bool hasNeighborCache()			{ return this->neighborCount != 0; }
+  int getCachedNeighborCount(ID_T p)
+		{ return this->neighborCount[p]; }
+  int* getCachedNeighbors(ID_T p)
+		{ return &this->neighborIndex[p * this->neighborWidth]; }
+  POSVEL_T* getCachedNeighborDistances(ID_T p)
+		{ return &this->neighborDist[p * this->neighborWidth]; }
+
+  POSVEL_T* getDensity()			{ return this->density; }
+  POSVEL_T* getSmoothingLength()		{ return this->smoothingLength; }
   ID_T getParticleCount()			{ return this->particleCount; }
+  ID_T getNodeCount()				{ return this->nodeCount; }
 
-  int getChildIndex(SPHNode* node, ID_T pindx);
+  int getChildIndex(ID_T node, ID_T pindx);
 
 private:
+  // Add a node for octant oindx of parent, or the root if parent is -1
+  ID_T addNode(ID_T parent, int oindx);
+
+  // Grow the node arrays used while building when the pool is full
+  void growNodePool();
+
+  // Squared distance from a position to a node's box
+  POSVEL_T boxDistance2(ID_T node, POSVEL_T pos[DIMENSION]);
+
   int    myProc;                // My processor number
   int    numProc;               // Total number of processors
 
@@ -225,6 +222,7 @@ private:
 
   ID_T   particleCount;         // Total particles
   ID_T   nodeCount;             // Total nodes
+  ID_T   nodeCapacity;          // Nodes allocated in the build arrays
   POSVEL_T particleMass;	// Average particle mass
 
   POSVEL_T* xx;                 // X location for particles on this processor
@@ -235,8 +233,37 @@ private:
   POSVEL_T* minRange;           // Physical range of data
   POSVEL_T* maxRange;           // Physical range of data
 
-  vector<SPHParticle*> sphParticle;
-  vector<SPHNode*>     sphNode;
+  BigChunkArena* arena;		// Storage for all arrays below
+  BigChunkArena* ownArena;	// Arena allocated when none was given
+
+  // Particles
+  POSVEL_T* density;		// SPH density
+  POSVEL_T* smoothingLength;	// SPH smoothing length
+  ID_T*     parent;		// Parent node
+  ID_T*     nextNode;		// Next node in iteration, particle or node
+
+  // Neighbor cache, row p starts at p * neighborWidth and holds the first
+  // neighborCount[p] neighbors found for particle p
+  int       cacheWidth;		// Neighbors requested per particle
+  size_t    cacheMaxBytes;	// Cache is skipped if it needs more
+  int       neighborWidth;	// Length of every row
+  int*      neighborCount;	// Neighbors in each row, 0 when no cache
+  int*      neighborIndex;	// Particle index of neighbor
+  POSVEL_T* neighborDist;	// Distance to neighbor
+
+  // Nodes, used while building
+  POSVEL_T* nodeCenter[DIMENSION];	// Physical center of octant
+  POSVEL_T* nodeLength[DIMENSION];	// Length of octant on each side
+  ID_T*     nodeChild;			// NUM_CHILDREN particle or node indices
+
+  // Nodes, filled in by threading
+  POSVEL_T* nodeMin[DIMENSION];		// Bounds of octant for tree walks
+  POSVEL_T* nodeMax[DIMENSION];
+  POSVEL_T* nodeMass;			// Mass below node
+  POSVEL_T* nodeS[DIMENSION];		// Center of mass below node
+  ID_T*     nodeSibling;		// Next node skipping children
+  ID_T*     nodeNext;			// Next node in iteration
+  ID_T*     nodeParent;			// Parent node
 };
 
 } /* end namespace cosmology tools */
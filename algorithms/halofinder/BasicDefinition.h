@@ -104,6 +104,10 @@ const int    MIN_SUBHALO_SIZE	= 20;
 const int    MIN_FOF_SUBHALO	= 2000;
                                 // Smallest FOF halo which will have
                                 // subhalo finding run on it
+const int    MIN_SHIP_SUBHALO	= 20000;
+                                // Smallest FOF halo which may be sent to
+                                // another processor for subhalo finding
+                                // to balance the work across processors
 
 // Constants for speeding up unbind calculation on very large subhalos
 const int    MAX_UNBIND_1	= 100;
@@ -120,23 +124,24 @@ const int    MAX_UNBIND_3	= 40000;
                                 // number of particles in subgroup remove
                                 // remove (1 / FACTOR_UNBIND_2) total positive
                                 // energy particles before running unbind again
-                                // Also maximum subhalo candidate for unbinding
-                                // Used for development because that stage
-                                // takes so long and normally this is only
-                                // the main subhalo and all particles unbound
-                                // would go to fuzz
+                                // Also largest subhalo candidate for which
+                                // potential is summed over all pairs, above
+                                // this a tree code potential is used
 const int    FACTOR_UNBIND_1	= 4;
         // Between MAX_UNBIND_1 and MAX_UNBIND_2
                                 // remove 25% of the positive total energy
                                 // particles
 const int    FACTOR_UNBIND_2	= 2;
-        // Betweend MAX_UNBIND_2 and MAX_UNBIND_3
+        // Above MAX_UNBIND_2
                                 // remove 50% of the positive total energy
                                 // particles
 const int    MAX_UNBIND_DELETE	= 20;
                                 // To speed up unbinding when large candidate
                                 // reaches this number of particles with
                                 // positive total energy just quit
+const float  UNBIND_TREE_THETA	= 0.5;
+                                // Opening angle for the tree code potential
+                                // on candidates above MAX_UNBIND_3
 
 
 // Cosmology record data in .cosmo format
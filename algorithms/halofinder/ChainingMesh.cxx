@@ -53,6 +53,7 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "Partition.h"
 #include "ChainingMesh.h"
+#include "bigchunk.h"
 
 using namespace std;
 
@@ -187,7 +188,7 @@ ChainingMesh::~ChainingMesh()
   }
   delete [] this->buckets;
   delete [] this->bucketCount;
-  delete [] this->bucketList;
+  bigchunk_page_free(this->bucketList);
   delete [] this->meshSize;
   delete [] this->minRange;
   delete [] this->maxRange;
@@ -223,7 +224,8 @@ void ChainingMesh::createChainingMesh()
   }
 
   // Create the chaining list of particles and initialize to -1
-  this->bucketList = new int[this->particleCount];
+  this->bucketList =
+    (int*) bigchunk_page_malloc(sizeof(int) * this->particleCount);
   for (int p = 0; p < this->particleCount; p++)
     this->bucketList[p] = -1;
 
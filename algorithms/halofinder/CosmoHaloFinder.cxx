@@ -49,6 +49,8 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <algorithm>
 
 #include "CosmoHaloFinder.h"
+#include "Profiler.h"
+#include "bigchunk.h"
 
 
 #ifdef DEBUG
@@ -56,6 +58,7 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #endif
 
 using namespace std;
+using cosmotk::Profiler;
 
 namespace cosmologytools {
 
@@ -323,8 +326,12 @@ void CosmoHaloFinder::Finding()
   t1=tim.tv_sec+(tim.tv_usec/1000000.0);
 #endif
 
-  lbound = new POSVEL_T[npart];
-  ubound = new POSVEL_T[npart];
+  // Interval bounds only live during the search so they are released
+  // from this thread's arena with the phase
+  BigChunkArena* arena = bigchunk_thread_arena();
+  BigChunkPhase phase(arena);
+  lbound = arena->allocate<POSVEL_T>(npart);
+  ubound = arena->allocate<POSVEL_T>(npart);
   POSVEL_T lb1[numDataDims], ub1[numDataDims];
   ComputeLU(0, npart, dataX, lb1, ub1);
 
@@ -348,7 +355,10 @@ void CosmoHaloFinder::Finding()
     nextp[i] = -1;
   }
 
+  static int fofRegion = Profiler::GetCountedRegion("FOF Merge");
+  Profiler::Begin(fofRegion);
   myFOF(0, npart, dataX);
+  Profiler::End(fofRegion);
 
 #ifdef DEBUG
   gettimeofday(&tim, NULL);
@@ -359,8 +369,8 @@ void CosmoHaloFinder::Finding()
   //
   // CLEANUP
   //
-  delete [] lbound;
-  delete [] ubound;
+  lbound = 0;
+  ubound = 0;
   seq.clear();
 
   // done!
@@ -53,6 +53,7 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "Partition.h"
 #include "CosmoHaloFinderP.h"
 #include "GenericIO.h"
+#include "bigchunk.h"
 
 using namespace std;
 using cosmologytools::Partition;
@@ -152,7 +153,7 @@ void CosmoHaloFinderP::clearHaloTag()
   // may be released after tagged particles are written or after
   // all halos are collected for merging
   if (this->haloTag != 0) {
-    delete [] this->haloTag;
+    bigchunk_page_free(this->haloTag);
     this->haloTag = 0;
   }
 }
@@ -163,7 +164,7 @@ void CosmoHaloFinderP::clearHaloStart()
   // used with haloList to locate all particles in a halo
   // may be released after merged halos because info is put in halos vector
   if (this->haloStart != 0) {
-    delete [] this->haloStart;
+    bigchunk_page_free(this->haloStart);
     this->haloStart = 0;
   }
 }
@@ -174,7 +175,7 @@ void CosmoHaloFinderP::clearHaloList()
   // particles in a halo.  It must stay around through all analysis.
   // may be released only on next call to executeHaloFinder
   if (this->haloList != 0) {
-    delete [] this->haloList;
+    bigchunk_page_free(this->haloList);
     this->haloList = 0;
   }
 }
@@ -185,7 +186,7 @@ void CosmoHaloFinderP::clearHaloSize()
   // may be released after tagged particles are written or after
   // all halos are collected for merging
   if (this->haloSize != 0) {
-    delete [] this->haloSize;
+    bigchunk_page_free(this->haloSize);
     this->haloSize = 0;
   }
 }
@@ -322,10 +323,12 @@ void CosmoHaloFinderP::executeHaloFinder()
   clearHaloList();
   clearHaloSize();
 
-  this->haloTag = new int[this->particleCount];
-  this->haloStart = new int[this->particleCount];
-  this->haloList = new int[this->particleCount];
-  this->haloSize = new int[this->particleCount];
+  // Arrays over all particles are large enough to want huge pages
+  size_t haloBytes = sizeof(int) * this->particleCount;
+  this->haloTag = (int*) bigchunk_page_malloc(haloBytes);
+  this->haloStart = (int*) bigchunk_page_malloc(haloBytes);
+  this->haloList = (int*) bigchunk_page_malloc(haloBytes);
+  this->haloSize = (int*) bigchunk_page_malloc(haloBytes);
 
   // Set the input locations for the serial halo finder
   this->haloFinder.setParticleLocations(this->xx, this->yy, this->zz);
@@ -369,7 +372,8 @@ void CosmoHaloFinderP::executeHaloFinder()
 void CosmoHaloFinderP::collectHalos(bool clearTag)
 {
   // Record the halo size of each particle on this processor
-  this->haloAliveSize = new int[this->particleCount];
+  this->haloAliveSize =
+    (int*) bigchunk_page_malloc(sizeof(int) * this->particleCount);
   for (int p = 0; p < this->particleCount; p++) {
     this->haloSize[p] = 0;
     this->haloAliveSize[p] = 0;
@@ -386,7 +390,7 @@ void CosmoHaloFinderP::collectHalos(bool clearTag)
     clearHaloTag();
     clearHaloSize();
   }
-  delete [] this->haloAliveSize;
+  bigchunk_page_free(this->haloAliveSize);
 }
 
 /////////////////////////////////////////////////////////////////////////
@@ -1053,53 +1057,38 @@ void CosmoHaloFinderP::sendMixedHaloResults
 //
 // Write the output of the halo finder in the form of the input .cosmo file
 //
-// Encoded mixed halo VALID or INVALID into the status array such that
-// ALIVE particles that are part of an INVALID mixed array will not write
-// but DEAD particles that are part of a VALID mixed array will be written
+// Every particle is written with the fof_halo_tag of the halo it belongs
+// to, which is the tag of the first particle in the halo particle list.
+// This is the same key written for the halo in .halocatalog and in the
+// .fofproperties and .sodproperties tables, so particles can be joined
+// to their halo directly.  It is not the lowest tag in the halo, because
+// particles are not in tag order on a processor.
 //
-// In order to make the output consistent with the serial output where the
-// lowest tagged particle in a halo owns the halo, work must be done to
-// identify the lowest tag.  This is because as particles are read onto
-// this processor using the round robin read of every particle, those
-// particles are no longer in tag order.  When the serial halo finder is
-// called it has to use the index of the particle on this processor which
-// is no longer the tag.
-//
-//      p    haloTag     tag    haloSize
-//      0          0     523           3
-//      1          0     522           0
-//      2          0     266           0
-//
-// In the above example the halo will be credited to 523 instead of 266
-// because the index of 523 is 0 and the index of 266 is 2.  So we must
-// make a pass to map the indexes.
+// Only halos kept on this processor after mixed halos are merged have a
+// tag.  Particles in smaller halos, in dead halos, or in mixed halos which
+// another processor owns are written with -1 so that no halo is claimed
+// by two processors.
 //
 /////////////////////////////////////////////////////////////////////////
 
 void CosmoHaloFinderP::writeTaggedParticles(int hmin, float ss, bool writePV,
                                             bool clearTag)
 {
-  // Map the index of the particle on this process to the index of the
-  // particle with the lowest tag value so that the written output refers
-  // to the lowest tag as being the owner of the halo
-  int* mapIndex = new int[this->particleCount];
+  // Tag every particle of a kept halo with the tag of its first particle
+  ID_T* fofTag = new ID_T[this->particleCount];
   for (int p = 0; p < this->particleCount; p++)
-    mapIndex[p] = p;
-
-  // If the tag for the first particle of this halo is bigger than the tag
-  // for this particle, change the map to identify this particle as the lowest
-  for (int p = 0; p < this->particleCount; p++) {
-    if (this->tag[mapIndex[this->haloTag[p]]] > this->tag[p])
-      mapIndex[this->haloTag[p]] = p;
+    fofTag[p] = -1;
+
+  for (int halo = 0; halo < (int) this->halos.size(); halo++) {
+    ID_T haloID = this->tag[this->halos[halo]];
+    int p = this->halos[halo];
+    for (int i = 0; i < this->haloCount[halo]; i++) {
+      fofTag[p] = haloID;
+      p = this->haloList[p];
+    }
   }
 
   if (hmin == 0 && ss == 1.0) {
-    ID_T *particleHaloTag = new ID_T[this->particleCount];
-    for (int p = 0; p < this->particleCount; p++) {
-      particleHaloTag[p] = (this->haloSize[this->haloTag[p]] < this->pmin)
-        ? -1: this->tag[this->haloTag[p]];
-    }
-
     // Write the tagged particle file
     GenericIO GIO(Partition::getComm(), outFile + ".haloparticles");
     GIO.setNumElems(this->particleCount);
@@ -1112,10 +1101,8 @@ void CosmoHaloFinderP::writeTaggedParticles(int hmin, float ss, bool writePV,
       GIO.addVariable("vz", this->vz);
     }
     GIO.addVariable("id", this->tag);
-    GIO.addVariable("fof_halo_tag", particleHaloTag);
+    GIO.addVariable("fof_halo_tag", fofTag);
     GIO.write();
-
-    delete [] particleHaloTag;
   } else {
     vector<ID_T> ssTag, ssParticleHaloTag;
     vector<POSVEL_T> ssX, ssY, ssZ, ssVX, ssVY, ssVZ;
@@ -1140,9 +1127,7 @@ void CosmoHaloFinderP::writeTaggedParticles(int hmin, float ss, bool writePV,
         continue;
 
       ssTag.push_back(this->tag[p]);
-      ssParticleHaloTag.push_back(
-        (this->haloSize[this->haloTag[p]] < this->pmin)
-        ? -1: this->tag[this->haloTag[p]]);
+      ssParticleHaloTag.push_back(fofTag[p]);
       if (writePV) {
         ssX.push_back(this->xx[p]);
         ssY.push_back(this->yy[p]);
@@ -1169,7 +1154,7 @@ void CosmoHaloFinderP::writeTaggedParticles(int hmin, float ss, bool writePV,
     GIO.write();
   }
 
-  delete [] mapIndex;
+  delete [] fofTag;
 
   // Clear the data stored in serial halo finder
   if (clearTag) {
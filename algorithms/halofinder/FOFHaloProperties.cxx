@@ -53,7 +53,6 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "FOFHaloProperties.h"
 #include "HaloCenterFinder.h"
 #include "Partition.h"
-#include "Timings.h"
 
 #include "GenericIO.h"
 
@@ -72,6 +71,9 @@ FOFHaloProperties::FOFHaloProperties()
   // Get the number of processors and rank of this processor
   this->numProc = Partition::getNumProc();
   this->myProc = Partition::getMyProc();
+
+  this->numberOfHalos = 0;
+  this->momentsValid = false;
 }
 
 FOFHaloProperties::~FOFHaloProperties()
@@ -94,6 +96,7 @@ void FOFHaloProperties::setHalos(
   this->halos = haloStartIndex;
   this->haloCount = haloParticleCount;
   this->haloList = nextParticleIndex;
+  this->momentsValid = false;
 }
 
 /////////////////////////////////////////////////////////////////////////
@@ -150,6 +153,7 @@ void FOFHaloProperties::setParticles(
   this->tag = &(*id)[0];
   this->mask = &(*maskData)[0];
   this->status = &(*state)[0];
+  this->momentsValid = false;
 }
 
 void FOFHaloProperties::setParticles(
@@ -174,6 +178,7 @@ void FOFHaloProperties::setParticles(
   this->vz = zVel;
   this->mass = pmass;
   this->tag = id;
+  this->momentsValid = false;
 }
 
 /////////////////////////////////////////////////////////////////////////
@@ -209,6 +214,114 @@ void FOFHaloProperties::FOFHaloCenterMinimumPotential(vector<int>* haloCenter)
   }
 }
 
+/////////////////////////////////////////////////////////////////////////
+//
+// Kahan summation accumulator used by the single pass halo kernel
+//
+/////////////////////////////////////////////////////////////////////////
+
+namespace {
+struct KahanSum {
+  double sum;
+  double rem;
+
+  KahanSum() : sum(0.0), rem(0.0) {}
+
+  void add(double value)
+  {
+    double v = value - this->rem;
+    double w = this->sum + v;
+    this->rem = (w - this->sum) - v;
+    this->sum = w;
+  }
+};
+}
+
+/////////////////////////////////////////////////////////////////////////
+//
+// Calculate mass, center of mass, average position, average velocity and
+// the velocity moment for the dispersion of every FOF halo walking each
+// halo's particles once.  Halos are independent and are run in parallel.
+//
+// Sums are compensated and in double.  Velocities are summed relative to
+// the first particle of the halo so that the dispersion does not lose
+// precision by subtracting two large numbers when the halo moves fast.
+//
+// Results are kept until setHalos() or setParticles() is called again.
+//
+/////////////////////////////////////////////////////////////////////////
+
+void FOFHaloProperties::FOFHaloMoments()
+{
+  if (this->momentsValid)
+    return;
+
+  int numberHalos = this->numberOfHalos;
+  this->momentMass.resize(numberHalos);
+  this->momentXCofMass.resize(numberHalos);
+  this->momentYCofMass.resize(numberHalos);
+  this->momentZCofMass.resize(numberHalos);
+  this->momentXPos.resize(numberHalos);
+  this->momentYPos.resize(numberHalos);
+  this->momentZPos.resize(numberHalos);
+  this->momentXVel.resize(numberHalos);
+  this->momentYVel.resize(numberHalos);
+  this->momentZVel.resize(numberHalos);
+  this->momentVel2.resize(numberHalos);
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 64)
+#endif
+  for (int halo = 0; halo < numberHalos; halo++) {
+    KahanSum mSum;
+    KahanSum xmSum, ymSum, zmSum;
+    KahanSum xSum, ySum, zSum;
+    KahanSum vxSum, vySum, vzSum;
+    KahanSum v2Sum;
+
+    int first = this->halos[halo];
+    double vx0 = this->vx[first];
+    double vy0 = this->vy[first];
+    double vz0 = this->vz[first];
+
+    for (int p = first; p != -1; p = this->haloList[p]) {
+      double m = this->mass[p];
+      mSum.add(m);
+
+      xmSum.add(this->xx[p] * m);
+      ymSum.add(this->yy[p] * m);
+      zmSum.add(this->zz[p] * m);
+
+      xSum.add(this->xx[p]);
+      ySum.add(this->yy[p]);
+      zSum.add(this->zz[p]);
+
+      double dvx = this->vx[p] - vx0;
+      double dvy = this->vy[p] - vy0;
+      double dvz = this->vz[p] - vz0;
+      vxSum.add(dvx);
+      vySum.add(dvy);
+      vzSum.add(dvz);
+      v2Sum.add(dvx * dvx + dvy * dvy + dvz * dvz);
+    }
+
+    double count = this->haloCount[halo];
+
+    this->momentMass[halo] = (POSVEL_T) mSum.sum;
+    this->momentXCofMass[halo] = (POSVEL_T) (xmSum.sum / mSum.sum);
+    this->momentYCofMass[halo] = (POSVEL_T) (ymSum.sum / mSum.sum);
+    this->momentZCofMass[halo] = (POSVEL_T) (zmSum.sum / mSum.sum);
+    this->momentXPos[halo] = (POSVEL_T) (xSum.sum / count);
+    this->momentYPos[halo] = (POSVEL_T) (ySum.sum / count);
+    this->momentZPos[halo] = (POSVEL_T) (zSum.sum / count);
+    this->momentXVel[halo] = (POSVEL_T) (vx0 + vxSum.sum / count);
+    this->momentYVel[halo] = (POSVEL_T) (vy0 + vySum.sum / count);
+    this->momentZVel[halo] = (POSVEL_T) (vz0 + vzSum.sum / count);
+    this->momentVel2[halo] = v2Sum.sum / count;
+  }
+  this->momentsValid = true;
+}
+
 /////////////////////////////////////////////////////////////////////////
 //
 // Calculate the mass of every FOF halo accumulating individual mass
@@ -223,14 +336,9 @@ void FOFHaloProperties::FOFHaloCenterMinimumPotential(vector<int>* haloCenter)
 void FOFHaloProperties::FOFHaloMass(
                         vector<POSVEL_T>* haloMass)
 {
-  POSVEL_T lmass;
-  double mKahan;
-
-  for (int halo = 0; halo < this->numberOfHalos; halo++) {
-    mKahan = KahanSummation(halo, this->mass);
-    lmass = (POSVEL_T) mKahan;
-    (*haloMass).push_back(lmass);
-  }
+  FOFHaloMoments();
+  haloMass->insert(haloMass->end(),
+                   this->momentMass.begin(), this->momentMass.end());
 }
 
 /////////////////////////////////////////////////////////////////////////
@@ -249,28 +357,15 @@ void FOFHaloProperties::FOFCenterOfMass(
                         vector<POSVEL_T>* yCenterOfMass,
                         vector<POSVEL_T>* zCenterOfMass)
 {
-  POSVEL_T xCofMass, yCofMass, zCofMass;
-  double xKahan, yKahan, zKahan;
-
-  for (int halo = 0; halo < this->numberOfHalos; halo++) {
-
-    double totalMass = KahanSummation(halo, this->mass);
-
-    xKahan = KahanSummation2(halo, this->xx, this->mass);
-    yKahan = KahanSummation2(halo, this->yy, this->mass);
-    zKahan = KahanSummation2(halo, this->zz, this->mass);
-
-    xCofMass = (POSVEL_T) (xKahan / totalMass);
-    yCofMass = (POSVEL_T) (yKahan / totalMass);
-    zCofMass = (POSVEL_T) (zKahan / totalMass);
-
-    (*xCenterOfMass).push_back(xCofMass);
-    (*yCenterOfMass).push_back(yCofMass);
-    (*zCenterOfMass).push_back(zCofMass);
-  }
+  FOFHaloMoments();
+  xCenterOfMass->insert(xCenterOfMass->end(),
+                   this->momentXCofMass.begin(), this->momentXCofMass.end());
+  yCenterOfMass->insert(yCenterOfMass->end(),
+                   this->momentYCofMass.begin(), this->momentYCofMass.end());
+  zCenterOfMass->insert(zCenterOfMass->end(),
+                   this->momentZCofMass.begin(), this->momentZCofMass.end());
 }
 
-/////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////
 //
 // Calculate the average position of particles of every FOF halo
@@ -287,22 +382,13 @@ void FOFHaloProperties::FOFPosition(
                         vector<POSVEL_T>* yMeanPos,
                         vector<POSVEL_T>* zMeanPos)
 {
-  POSVEL_T xMean, yMean, zMean;
-  double xKahan, yKahan, zKahan;
-
-  for (int halo = 0; halo < this->numberOfHalos; halo++) {
-    xKahan = KahanSummation(halo, this->xx);
-    yKahan = KahanSummation(halo, this->yy);
-    zKahan = KahanSummation(halo, this->zz);
-
-    xMean = (POSVEL_T) (xKahan / this->haloCount[halo]);
-    yMean = (POSVEL_T) (yKahan / this->haloCount[halo]);
-    zMean = (POSVEL_T) (zKahan / this->haloCount[halo]);
-
-    (*xMeanPos).push_back(xMean);
-    (*yMeanPos).push_back(yMean);
-    (*zMeanPos).push_back(zMean);
-  }
+  FOFHaloMoments();
+  xMeanPos->insert(xMeanPos->end(),
+                   this->momentXPos.begin(), this->momentXPos.end());
+  yMeanPos->insert(yMeanPos->end(),
+                   this->momentYPos.begin(), this->momentYPos.end());
+  zMeanPos->insert(zMeanPos->end(),
+                   this->momentZPos.begin(), this->momentZPos.end());
 }
 
 /////////////////////////////////////////////////////////////////////////
@@ -318,6 +404,13 @@ void FOFHaloProperties::FOFPosition(
 
 void FOFHaloProperties::FOFHaloPosition(int halo, POSVEL_T pos[3])
 {
+  if (this->momentsValid) {
+    pos[0] = this->momentXPos[halo];
+    pos[1] = this->momentYPos[halo];
+    pos[2] = this->momentZPos[halo];
+    return;
+  }
+
   double xKahan = KahanSummation(halo,this->xx);
   double yKahan = KahanSummation(halo,this->yy);
   double zKahan = KahanSummation(halo,this->zz);
@@ -343,22 +436,13 @@ void FOFHaloProperties::FOFVelocity(
                         vector<POSVEL_T>* yMeanVel,
                         vector<POSVEL_T>* zMeanVel)
 {
-  POSVEL_T xMean, yMean, zMean;
-  double xKahan, yKahan, zKahan;
-
-  for (int halo = 0; halo < this->numberOfHalos; halo++) {
-    xKahan = KahanSummation(halo, this->vx);
-    yKahan = KahanSummation(halo, this->vy);
-    zKahan = KahanSummation(halo, this->vz);
-
-    xMean = (POSVEL_T) (xKahan / this->haloCount[halo]);
-    yMean = (POSVEL_T) (yKahan / this->haloCount[halo]);
-    zMean = (POSVEL_T) (zKahan / this->haloCount[halo]);
-
-    (*xMeanVel).push_back(xMean);
-    (*yMeanVel).push_back(yMean);
-    (*zMeanVel).push_back(zMean);
-  }
+  FOFHaloMoments();
+  xMeanVel->insert(xMeanVel->end(),
+                   this->momentXVel.begin(), this->momentXVel.end());
+  yMeanVel->insert(yMeanVel->end(),
+                   this->momentYVel.begin(), this->momentYVel.end());
+  zMeanVel->insert(zMeanVel->end(),
+                   this->momentZVel.begin(), this->momentZVel.end());
 }
 
 /////////////////////////////////////////////////////////////////////////
@@ -374,6 +458,13 @@ void FOFHaloProperties::FOFVelocity(
 void FOFHaloProperties::FOFHaloVelocity(
         int halo, POSVEL_T vel[3])
 {
+  if (this->momentsValid) {
+    vel[0] = this->momentXVel[halo];
+    vel[1] = this->momentYVel[halo];
+    vel[2] = this->momentZVel[halo];
+    return;
+  }
+
   double xKahan = KahanSummation(halo, this->vx);
   double yKahan = KahanSummation(halo, this->vy);
   double zKahan = KahanSummation(halo, this->vz);
@@ -394,6 +485,9 @@ void FOFHaloProperties::FOFHaloVelocity(
 //    dot_prod_halo_vel = v_FOF dot v_FOF
 //       v_FOF is the average velocity vector of all particles in the halo
 //
+// Both terms are taken relative to the velocity of the first particle
+// of the halo, which leaves the difference unchanged
+//
 /////////////////////////////////////////////////////////////////////////
 
 void FOFHaloProperties::FOFVelocityDispersion(
@@ -402,27 +496,22 @@ void FOFHaloProperties::FOFVelocityDispersion(
                         vector<POSVEL_T>* zAvgVel,
                         vector<POSVEL_T>* velDisp)
 {
-  for (int halo = 0; halo < this->numberOfHalos; halo++) {
-
-    // First particle in the halo
-    int p = this->halos[halo];
-    POSVEL_T particleDot = 0.0;
+  FOFHaloMoments();
 
-    // Iterate over all particles in the halo collecting dot products
-    while (p != -1) {
-      particleDot += dotProduct(this->vx[p], this->vy[p], this->vz[p]);
-      p = this->haloList[p];
-    }
-
-    // Average of all the dot products
-    particleDot /= this->haloCount[halo];
+  for (int halo = 0; halo < this->numberOfHalos; halo++) {
 
-    // Dot product of the average velocity for the entire halo
-    POSVEL_T haloDot = dotProduct((*xAvgVel)[halo],
-                                  (*yAvgVel)[halo], (*zAvgVel)[halo]);
+    // Average velocity for the entire halo relative to the first particle
+    int first = this->halos[halo];
+    double dvx = (double) (*xAvgVel)[halo] - this->vx[first];
+    double dvy = (double) (*yAvgVel)[halo] - this->vy[first];
+    double dvz = (double) (*zAvgVel)[halo] - this->vz[first];
+    double haloDot = dvx * dvx + dvy * dvy + dvz * dvz;
 
     // Velocity dispersion
-    POSVEL_T vDispersion = (POSVEL_T)sqrt((particleDot - haloDot) / 3.0);
+    double variance = (this->momentVel2[halo] - haloDot) / 3.0;
+    if (variance < 0.0)
+      variance = 0.0;
+    POSVEL_T vDispersion = (POSVEL_T) sqrt(variance);
 
     // Save onto supplied vector
     velDisp->push_back(vDispersion);
@@ -442,43 +531,24 @@ void FOFHaloProperties::FOFAttributes(
     vector<POSVEL_T>* zVel,
     vector<POSVEL_T>* velDisp)
 {
+  // Dispersion uses the average velocities just appended to the vectors
+  size_t offset = xVel->size();
 
-  POSVEL_T avx,avy,avz,haloParticleDot,haloDot,disp;
-  int p;
+  FOFHaloMass(haloMass);
+  FOFVelocity(xVel, yVel, zVel);
 
-  for( int halo=0; halo < this->numberOfHalos; ++halo )
-    {
-    // Compute halo mass
-    haloMass->push_back(
-        static_cast<POSVEL_T>(KahanSummation(halo, this->mass)));
-
-    // Compute average velocity
-    avx = static_cast<POSVEL_T>(
-        KahanSummation(halo,this->vx)/this->haloCount[halo]);
-    avy = static_cast<POSVEL_T>(
-        KahanSummation(halo,this->vy)/this->haloCount[halo]);
-    avz = static_cast<POSVEL_T>(
-        KahanSummation(halo,this->vz)/this->haloCount[halo]);
-    xVel->push_back( avx );
-    yVel->push_back( avy );
-    zVel->push_back( avz );
-
-    // Compute velocity dispersion
-
-    // Compute the dot product of all the particles at the given halo
-    for( p=this->halos[halo]; p != -1; p = this->haloList[p] )
-      {
-      haloParticleDot +=
-          this->dotProduct(this->vx[p],this->vy[p],this->vz[p]);
-      } // END for all halo particles
-
-    // Compute dot product of the average velocity
-    haloDot = this->dotProduct(avx,avy,avz);
-
-    // Compute the velocity dispersion
-    disp = static_cast<POSVEL_T>(sqrt( (haloParticleDot-haloDot)/3.0 ) );
-    velDisp->push_back( disp );
-    } // END for all halos
+  for (int halo = 0; halo < this->numberOfHalos; halo++) {
+    int first = this->halos[halo];
+    double dvx = (double) (*xVel)[offset + halo] - this->vx[first];
+    double dvy = (double) (*yVel)[offset + halo] - this->vy[first];
+    double dvz = (double) (*zVel)[offset + halo] - this->vz[first];
+    double haloDot = dvx * dvx + dvy * dvy + dvz * dvz;
+
+    double variance = (this->momentVel2[halo] - haloDot) / 3.0;
+    if (variance < 0.0)
+      variance = 0.0;
+    velDisp->push_back((POSVEL_T) sqrt(variance));
+  }
 }
 
 /////////////////////////////////////////////////////////////////////////
@@ -162,6 +162,10 @@ public:
         vector<POSVEL_T>* zVel,
         vector<POSVEL_T>* velDisp);
 
+  // Single pass over every halo accumulating all of the above properties
+  // which the individual property calls return from afterwards
+  void FOFHaloMoments();
+
   // Kahan summation of floating point numbers to reduce roundoff error
   POSVEL_T KahanSummation(int halo, POSVEL_T* data);
   POSVEL_T KahanSummation2(int halo, POSVEL_T* data1, POSVEL_T* data2);
@@ -240,6 +244,20 @@ private:
   int* halos;                   // First particle index into haloList
   int* haloCount;               // Size of each halo
   int* haloList;                // Indices of next particle in halo
+
+  // Halo properties from the single pass kernel
+  bool momentsValid;            // Cleared when halos or particles change
+  vector<POSVEL_T> momentMass;
+  vector<POSVEL_T> momentXCofMass;
+  vector<POSVEL_T> momentYCofMass;
+  vector<POSVEL_T> momentZCofMass;
+  vector<POSVEL_T> momentXPos;
+  vector<POSVEL_T> momentYPos;
+  vector<POSVEL_T> momentZPos;
+  vector<POSVEL_T> momentXVel;
+  vector<POSVEL_T> momentYVel;
+  vector<POSVEL_T> momentZVel;
+  vector<double> momentVel2;    // Mean (v - v_first)^2 for the dispersion
 };
 
 }
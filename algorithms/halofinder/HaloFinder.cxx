@@ -52,13 +52,14 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 // Uses CosmoHaloFinderP to locate the halos on each processor and merge
 // Uses FOFHaloProperties to calculate data on FOF halos
 // Uses SODHalo to calculate data on SOD halos
+// Uses SphereExchange to complete SOD halos reaching past the dead zone
 // Uses HaloCenterFinder to find either MCP or MBP particles per FOF halo
 // Uses SubHaloFinder to find subhalos of FOF halos
 //
 
 #include "HaloFinderInput.h"
 #include "Partition.h"
-#include "Timings.h"
+#include "Profiler.h"
 
 #include "ParticleDistribute.h"
 #include "ParticleExchange.h"
@@ -71,16 +72,97 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "SODHalo.h"
 #include "ChainingMesh.h"
+#include "SphereExchange.h"
+#include "bigchunk.h"
+
+#include "GenericIO.h"
 
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <map>
+#include <algorithm>
+#include <math.h>
 
 #include <mpi.h>
 
 using namespace std;
+using cosmotk::Profiler;
+using cosmotk::ProfilerRegion;
 
 namespace cosmologytools {
+
+// Message tags for moving halos between processors for subhalo finding
+static const int SUBHALO_PARTICLE_TAG = 100;
+static const int SUBHALO_RESULT_TAG = 101;
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// FOF halo given to a processor for subhalo finding
+//
+/////////////////////////////////////////////////////////////////////////////
+
+struct SubhaloTask {
+  int owner;			// Processor holding the FOF halo
+  int halo;			// Index of FOF halo on the owner
+  int count;			// Particles in the FOF halo
+  int worker;			// Processor running the subhalo finder
+  double cost;			// Estimated work
+};
+
+// Largest cost first, ordered by owner and halo otherwise so that every
+// processor sorts to the same plan
+class SubhaloTaskGT {
+public:
+  bool operator() (const SubhaloTask& p, const SubhaloTask& q) const
+  {
+    if (p.cost != q.cost)
+      return p.cost > q.cost;
+    if (p.owner != q.owner)
+      return p.owner < q.owner;
+    return p.halo < q.halo;
+  }
+};
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Subhalos of one FOF halo in the form used by FOFHaloProperties
+//
+/////////////////////////////////////////////////////////////////////////////
+
+struct SubhaloResult {
+  int numberOfSubhalos;
+  vector<int> subhaloCount;	// Particles in each subhalo
+  vector<int> subhalos;		// First particle of each subhalo
+  vector<int> particleList;	// Next particle in the same subhalo
+  vector<int> membership;	// Subhalo of each particle, fuzz is last
+};
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Subhalo properties and particles of all FOF halos on a processor
+// gathered for one collective write per step
+//
+/////////////////////////////////////////////////////////////////////////////
+
+struct SubhaloCatalog {
+  // One entry per subhalo
+  vector<ID_T> fofTag;		// Tag of the FOF halo
+  vector<int> subhaloTag;	// Index of subhalo within the FOF halo
+  vector<int> count;
+  vector<POSVEL_T> mass;
+  vector<POSVEL_T> xCofMass, yCofMass, zCofMass;
+  vector<POSVEL_T> xPos, yPos, zPos;
+  vector<POSVEL_T> xVel, yVel, zVel;
+  vector<POSVEL_T> velDisp;
+
+  // One entry per particle in a FOF halo with subhalo finding
+  vector<POSVEL_T> x, y, z, vx, vy, vz;
+  vector<ID_T> id;
+  vector<ID_T> particleFofTag;
+  vector<int> particleSubhaloTag;	// Fuzz particles are -1
+};
+
 /////////////////////////////////////////////////////////////////////////////
 //
 // Class for testing cosmology code
@@ -132,6 +214,32 @@ public:
   // and building of a Barnes Hut tree of those particles
   void FOFSubHaloFinding();
 
+  // Assign large FOF halos to processors to balance subhalo finding
+  void PlanSubhaloTasks(vector<SubhaloTask>& tasks);
+
+  // Find the subhalos of one halo's particles wherever they came from
+  void SubHaloCalculation(
+  long particleCount,
+  POSVEL_T* xLocHalo,
+  POSVEL_T* yLocHalo,
+  POSVEL_T* zLocHalo,
+  POSVEL_T* xVelHalo,
+  POSVEL_T* yVelHalo,
+  POSVEL_T* zVelHalo,
+  POSVEL_T* massHalo,
+  ID_T* id,
+  BigChunkArena* treeArena,
+  SubhaloResult* result);
+
+  // Subhalo properties and particles for a halo owned by this processor
+  void SubHaloProperties(
+  int halo,
+  SubhaloResult* result,
+  SubhaloCatalog* catalog);
+
+  // Collective write of subhalo properties and particles
+  void SubHaloCatalog(SubhaloCatalog* catalog);
+
   // Write the halo catalog which is same .cosmo format as particles
   // Each halo has one entry with mass being the size of the halo and
   // location being the halo center.  Can be visualized as particle data is.
@@ -140,9 +248,24 @@ public:
   // Using the FOF halo center, calculate a spherically over dense halo
   void SODHaloFinding();
 
+  // Collective write of SOD properties and profiles
+  void SODHaloCatalog(vector<SODProperties>& sodTable);
+
+  // Build the SOD halo of one FOF halo in a reusable SODHalo workspace
+  // and copy the results out so that halos may be done concurrently
+  void SODHaloCalculation(
+  SODHalo* sod,
+  int halo,
+  SphereExchange* sphereExchange,
+  int query,
+  SODProperties* props);
+
   // Write a .cosmo file of halos of this size or greater
   void WriteCosmoFiles(int size);
 
+  // Report how large arrays were placed in memory
+  void PageStatistics();
+
   int numProc;			// Number of processors
   int myProc;			// Rank of this processor
 
@@ -289,6 +412,15 @@ HaloFinder::HaloFinder(int argc, char* argv[])
   // and the dead particles must be bundled and shared
   this->distributeType = this->haloIn.getDistributeType();
 
+  // Page placement of the large particle and halo arrays
+  bigchunk_set_page_policy(this->haloIn.getHugePages(),
+                           this->haloIn.getFirstTouch());
+
+  // Phases record the bytes held through bigchunk along with the RSS
+  Profiler::SetMemoryTracker(bigchunk_get_tracked,
+                             bigchunk_get_tracked_peak,
+                             bigchunk_reset_tracked_peak);
+
   // Mass of one particle based on size of problem
   // test4:
   //   rL = 90.1408, hubble = 0.71, omegadm = .27, deut = 0.02218, np = 256
@@ -399,8 +531,8 @@ HaloFinder::~HaloFinder()
 
 void HaloFinder::DistributeParticles()
 {
-  static Timings::TimerRef dtimer = Timings::getTimer("Distribute Particles");
-  Timings::startTimer(dtimer);
+  static int dtimer = Profiler::GetPhaseRegion("Distribute Particles");
+  Profiler::Begin(dtimer);
 
   // Initialize classes for reading, exchanging and calculating
   this->distribute.setParameters(this->inFile, this->rL, this->dataType);
@@ -461,7 +593,7 @@ void HaloFinder::DistributeParticles()
     if ((*this->mass)[i] == 1.0)
       (*this->mass)[i] = this->particleMass;
 
-  Timings::stopTimer(dtimer);
+  Profiler::End(dtimer);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -472,8 +604,8 @@ void HaloFinder::DistributeParticles()
 
 void HaloFinder::FOFHaloFinder()
 {
-  static Timings::TimerRef h1timer = Timings::getTimer("FOF Halo Finder");
-  Timings::startTimer(h1timer);
+  static int h1timer = Profiler::GetPhaseRegion("FOF Halo Finder");
+  Profiler::Begin(h1timer);
 
   this->haloFinder.setParameters(this->outFile, this->rL, this->deadSize,
                                  this->np, this->pmin, this->bb);
@@ -493,7 +625,7 @@ void HaloFinder::FOFHaloFinder()
   if (this->haloIn.getOutputParticles() == 1)
     this->haloFinder.writeTaggedParticles(0, 1.0, true);
 
-  Timings::stopTimer(h1timer);
+  Profiler::End(h1timer);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -504,8 +636,8 @@ void HaloFinder::FOFHaloFinder()
 
 void HaloFinder::BasicFOFHaloProperties()
 {
-  static Timings::TimerRef ftimer = Timings::getTimer("FOF Properties");
-  Timings::startTimer(ftimer);
+  static int ftimer = Profiler::GetPhaseRegion("FOF Properties");
+  Profiler::Begin(ftimer);
 
   if (this->myProc == 0)
     cout << "Run Basic FOF halo properties" << endl;
@@ -551,7 +683,7 @@ void HaloFinder::BasicFOFHaloProperties()
   this->fof.FOFVelocityDispersion(this->fofXVel,
                                 this->fofYVel, this->fofZVel, this->fofVelDisp);
 
-  Timings::stopTimer(ftimer);
+  Profiler::End(ftimer);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -566,6 +698,9 @@ void HaloFinder::BasicFOFHaloProperties()
 
 void HaloFinder::FOFCenterFinding()
 {
+  static int cftimer = Profiler::GetPhaseRegion("FOF Center Finder");
+  ProfilerRegion timed(cftimer);
+
   // Find the index of the particle at the FOF center using potential array
   this->fofCenter = new vector<int>;
   if (this->haloIn.getUseMinimumPotential() == 1) {
@@ -647,8 +782,8 @@ int HaloFinder::MBPCenterFinding(
 
 {
   // Find the index of the particle at the FOF center
-  static Timings::TimerRef cftimer = Timings::getTimer("MBP Center Finder");
-  Timings::startTimer(cftimer);
+  static int cftimer = Profiler::GetRegion("MBP Center Finder");
+  Profiler::Begin(cftimer);
   int centerIndex;
 
   // Create the center finder
@@ -665,7 +800,7 @@ int HaloFinder::MBPCenterFinding(
     centerIndex = centerFinder.mostBoundParticleAStar(minPotential);
   }
 
-  Timings::stopTimer(cftimer);
+  Profiler::End(cftimer);
   return centerIndex;
 }
 
@@ -686,8 +821,8 @@ int HaloFinder::MCPCenterFinding(
 
 {
   // Find the index of the particle at the FOF center
-  static Timings::TimerRef cftimer = Timings::getTimer("MCP Center Finder");
-  Timings::startTimer(cftimer);
+  static int cftimer = Profiler::GetRegion("MCP Center Finder");
+  Profiler::Begin(cftimer);
   int centerIndex = 0;
 
   // Create the center finder
@@ -704,7 +839,7 @@ int HaloFinder::MCPCenterFinding(
   else {
     centerIndex = centerFinder.mostConnectedParticleChainMesh();
   }
-  Timings::stopTimer(cftimer);
+  Profiler::End(cftimer);
   return centerIndex;
 }
 
@@ -716,176 +851,495 @@ int HaloFinder::MCPCenterFinding(
 // be used with any set of particles a user wants processed
 // because they don't iterate over halos and haloList
 //
+// The cost of subhalo finding grows faster than the halo size so the
+// processor holding the largest halo would finish long after the others.
+// Every processor makes the same plan from the sizes of all halos and
+// large halos are sent to the least loaded processor.  The subhalo
+// membership comes back to the owner which computes the properties.
+//
+// All subhalos of all processors are written with one collective
+// GenericIO file for properties and one for particles.
+//
 /////////////////////////////////////////////////////////////////////////////
 
 void HaloFinder::FOFSubHaloFinding()
 {
-  static Timings::TimerRef shtimer = Timings::getTimer("SubHalo Finder");
-  Timings::startTimer(shtimer);
-
-  // Debug output file per processor
-  ostringstream sname;
-  if (numProc == 1) {
-    sname << outFile << ".subhalo";
-  } else {
-    sname << outFile << ".subhalo." << myProc;
-  }
-  ofstream sStream(sname.str().c_str(), ios::out);
-
-  // Get FOF halo information
-  int* fofHaloCount = this->haloFinder.getHaloCount();
-  int* fofHalos = this->haloFinder.getHalos();
+  static int shtimer = Profiler::GetPhaseRegion("SubHalo Finder");
+  Profiler::Begin(shtimer);
 
   if (this->haloIn.getOutputSubhaloProperties() == 1) {
     if (this->myProc == 0)
       cout << "Run Subhalo finder" << endl;
 
-    for (int halo = 0; halo < this->numberOfFOFHalos; halo++) {
+    MPI_Comm comm = Partition::getComm();
 
-      // Allocate arrays which will hold halo particle locations
-      long particleCount = fofHaloCount[halo];
-      if (particleCount > this->haloIn.getMinFOFSubhalo()) {
+    // Decide which processor finds the subhalos of every large FOF halo
+    vector<SubhaloTask> tasks;
+    PlanSubhaloTasks(tasks);
+    int numberOfTasks = tasks.size();
+
+    // Send the particles of halos given to other processors
+    vector<MPI_Request> requests;
+    vector<POSVEL_T*> sendLoc;
+    vector<ID_T*> sendId;
+
+    for (int t = 0; t < numberOfTasks; t++) {
+      if (tasks[t].owner != this->myProc || tasks[t].worker == this->myProc)
+        continue;
+
+      long particleCount = tasks[t].count;
+      POSVEL_T* loc = new POSVEL_T[COSMO_FLOAT * particleCount];
+      ID_T* id = new ID_T[particleCount];
+      int* actualIndx = new int[particleCount];
+
+      this->fof.extractInformation(tasks[t].halo, actualIndx,
+                      &loc[0], &loc[particleCount], &loc[2 * particleCount],
+                      &loc[3 * particleCount], &loc[4 * particleCount],
+                      &loc[5 * particleCount], &loc[6 * particleCount], id);
+      delete [] actualIndx;
+
+      MPI_Request request;
+      MPI_Isend(loc, COSMO_FLOAT * particleCount, MPI_POSVEL_T,
+                tasks[t].worker, SUBHALO_PARTICLE_TAG, comm, &request);
+      requests.push_back(request);
+      MPI_Isend(id, particleCount, MPI_ID_T,
+                tasks[t].worker, SUBHALO_PARTICLE_TAG, comm, &request);
+      requests.push_back(request);
+
+      sendLoc.push_back(loc);
+      sendId.push_back(id);
+    }
+
+    // Run the subhalo finder on every halo planned for this processor
+    // largest first, receiving the particles of other processors' halos
+    // Particles, tree and scratch of one FOF halo are in this thread's
+    // arena and released together, so memory is kept from one to the next
+    BigChunkArena* treeArena = bigchunk_thread_arena();
+    map<int, SubhaloResult> results;
+    vector<int*> sendResult;
+
+    for (int t = 0; t < numberOfTasks; t++) {
+      if (tasks[t].worker != this->myProc)
+        continue;
+
+      BigChunkPhase phase(treeArena);
+
+      long particleCount = tasks[t].count;
+      POSVEL_T* loc =
+        treeArena->allocate<POSVEL_T>(COSMO_FLOAT * particleCount);
+      ID_T* id = treeArena->allocate<ID_T>(particleCount);
+
+      if (tasks[t].owner == this->myProc) {
+        int* actualIndx = treeArena->allocate<int>(particleCount);
+        this->fof.extractInformation(tasks[t].halo, actualIndx,
+                      &loc[0], &loc[particleCount], &loc[2 * particleCount],
+                      &loc[3 * particleCount], &loc[4 * particleCount],
+                      &loc[5 * particleCount], &loc[6 * particleCount], id);
 
         cout << "Rank: " << this->myProc
-             << " Subhalo find on FOF halo " << halo
+             << " Subhalo find on FOF halo " << tasks[t].halo
              << " count " << particleCount << endl;
+      } else {
+        MPI_Status mpistatus;
+        MPI_Recv(loc, COSMO_FLOAT * particleCount, MPI_POSVEL_T,
+                 tasks[t].owner, SUBHALO_PARTICLE_TAG, comm, &mpistatus);
+        MPI_Recv(id, particleCount, MPI_ID_T,
+                 tasks[t].owner, SUBHALO_PARTICLE_TAG, comm, &mpistatus);
 
-        sStream << "FOF Halo: " << halo << endl
-                << "  FOF count = " << fofHaloCount[halo] << endl
-                << "  FOF tag = " << fofHalos[halo] << endl
-                << "  FOF mass = " << (*this->fofMass)[halo] << endl
-                << "  FOF center of mass = ["
-                                   << (*this->fofXCofMass)[halo] << ","
-                                   << (*this->fofYCofMass)[halo] << ","
-                                   << (*this->fofZCofMass)[halo] << "]" << endl
-                << "  FOF avg loc = ["
-                                   << (*this->fofXPos)[halo] << ","
-                                   << (*this->fofYPos)[halo] << ","
-                                   << (*this->fofZPos)[halo] << "]" << endl
-                << "  FOF avg vel = ["
-                                   << (*this->fofXVel)[halo] << ","
-                                   << (*this->fofYVel)[halo] << ","
-                                   << (*this->fofZVel)[halo] << "]" << endl
-                << "  FOF velocity dispersion = "
-                                   << (*this->fofVelDisp)[halo] << endl << endl;
-
-        POSVEL_T* xLocHalo = new POSVEL_T[particleCount];
-        POSVEL_T* yLocHalo = new POSVEL_T[particleCount];
-        POSVEL_T* zLocHalo = new POSVEL_T[particleCount];
-        POSVEL_T* xVelHalo = new POSVEL_T[particleCount];
-        POSVEL_T* yVelHalo = new POSVEL_T[particleCount];
-        POSVEL_T* zVelHalo = new POSVEL_T[particleCount];
-        POSVEL_T* massHalo = new POSVEL_T[particleCount];
-        ID_T* id = new ID_T[particleCount];
-
-        // Map halo index to actual particle index to find locations
-        int* actualIndx = new int[particleCount];
-
-        this->fof.extractInformation(halo, actualIndx,
-                                 xLocHalo, yLocHalo, zLocHalo,
-                                 xVelHalo, yVelHalo, zVelHalo, massHalo, id);
-
-        // Look for subhalos within the FOF halo using extract location arrays
-        SubHaloFinder* subFinder = new SubHaloFinder();
-        subFinder->setParameters(this->particleMass, GRAVITY_C,
-                                 this->alphaFactor, this->betaFactor,
-                                 this->minCandidateSize,
-                                 this->numSPHNeighbors, this->numNeighbors);
-
-        subFinder->setParticles(particleCount, xLocHalo, yLocHalo, zLocHalo,
-                                xVelHalo, yVelHalo, zVelHalo, massHalo, id);
-
-        subFinder->findSubHalos();
-
-        // Retrieve subhalo information suitable for FOFHaloProperties
-        int numberOfSubhalos = subFinder->getNumberOfSubhalos();
-        int* fofSubhalos = subFinder->getSubhalos();
-        int* fofSubhaloCount = subFinder->getSubhaloCount();
-        int* fofSubhaloList = subFinder->getSubhaloList();
-
-        // Construct the FOF properties class
-        FOFHaloProperties subhaloProp;
-        subhaloProp.setHalos(numberOfSubhalos,
-                     fofSubhalos, fofSubhaloCount, fofSubhaloList);
-        subhaloProp.setParameters(this->outFile,
-                                  this->rL, this->deadSize, this->bb);
-        subhaloProp.setParticles(particleCount, xLocHalo, yLocHalo, zLocHalo,
-                         xVelHalo, yVelHalo, zVelHalo, massHalo, id);
-
-        // Run some halo properties on subhalos
-        // Find the mass of every subhalo
-        vector<POSVEL_T> subhaloMass;
-        subhaloProp.FOFHaloMass(&subhaloMass);
-
-        // Find the average position of every subhalo
-        vector<POSVEL_T> subhaloXPos;
-        vector<POSVEL_T> subhaloYPos;
-        vector<POSVEL_T> subhaloZPos;
-        subhaloProp.FOFPosition(
-               &subhaloXPos, &subhaloYPos, &subhaloZPos);
-
-        // Find the center of mass of every subhalo
-        vector<POSVEL_T> subhaloXCofMass;
-        vector<POSVEL_T> subhaloYCofMass;
-        vector<POSVEL_T> subhaloZCofMass;
-        subhaloProp.FOFCenterOfMass(
-               &subhaloXCofMass, &subhaloYCofMass, &subhaloZCofMass);
-
-        // Find the average velocity of every subhalo
-        vector<POSVEL_T> subhaloXVel;
-        vector<POSVEL_T> subhaloYVel;
-        vector<POSVEL_T> subhaloZVel;
-        subhaloProp.FOFVelocity(
-               &subhaloXVel, &subhaloYVel, &subhaloZVel);
-
-        // Find the velocity dispersion of every subhalo
-        vector<POSVEL_T> subhaloVelDisp;
-        subhaloProp.FOFVelocityDispersion(
-               &subhaloXVel, &subhaloYVel, &subhaloZVel, &subhaloVelDisp);
-
-        for (int sindx = 0; sindx < numberOfSubhalos; sindx++) {
-          sStream << "  Subhalo: " << sindx << endl
-                  << "    count = " << fofSubhaloCount[sindx] << endl
-                  << "    mass = "  << subhaloMass[sindx] << endl
-                  << "    center of mass = ["
-                                  << subhaloXCofMass[sindx] << ","
-                                  << subhaloYCofMass[sindx] << ","
-                                  << subhaloZCofMass[sindx] << "]" << endl
-                  << "    avg loc = ["
-                                  << subhaloXPos[sindx] << ","
-                                  << subhaloYPos[sindx] << ","
-                                  << subhaloZPos[sindx] << "]" << endl
-                  << "    avg vel = ["
-                                  << subhaloXVel[sindx] << ","
-                                  << subhaloYVel[sindx] << ","
-                                  << subhaloZVel[sindx] << "]" << endl
-                  << "    velocity dispersion = "
-                                  << subhaloVelDisp[sindx] << endl;
-        }
-        sStream << "------------------------------------------" << endl << endl;
-
-        // Write individual subhalos to file
-        ostringstream name;
-        name << outFile << "_subhalo_" << halo
-             << "_" << particleCount << ".cosmo";
-        string fileName = name.str();
-        subFinder->writeSubhaloCosmoFile(fileName);
-
-        delete [] xLocHalo;
-        delete [] yLocHalo;
-        delete [] zLocHalo;
-        delete [] xVelHalo;
-        delete [] yVelHalo;
-        delete [] zVelHalo;
-        delete [] massHalo;
-        delete [] id;
-        delete [] actualIndx;
-
-        delete subFinder;
+        cout << "Rank: " << this->myProc
+             << " Subhalo find on FOF halo " << tasks[t].halo
+             << " of rank " << tasks[t].owner
+             << " count " << particleCount << endl;
       }
+
+      SubhaloResult result;
+      SubHaloCalculation(particleCount,
+                         &loc[0], &loc[particleCount], &loc[2 * particleCount],
+                         &loc[3 * particleCount], &loc[4 * particleCount],
+                         &loc[5 * particleCount], &loc[6 * particleCount], id,
+                         treeArena, &result);
+
+      if (tasks[t].owner == this->myProc) {
+        results[tasks[t].halo] = result;
+        continue;
+      }
+
+      // Return the subhalos to the owner as
+      // [number of subhalos, counts, first particles, lists, membership]
+      int numberOfSubhalos = result.numberOfSubhalos;
+      int size = 1 + 2 * numberOfSubhalos + 2 * particleCount;
+      int* buffer = new int[size];
+      int indx = 0;
+      buffer[indx++] = numberOfSubhalos;
+      for (int i = 0; i < numberOfSubhalos; i++)
+        buffer[indx++] = result.subhaloCount[i];
+      for (int i = 0; i < numberOfSubhalos; i++)
+        buffer[indx++] = result.subhalos[i];
+      for (int i = 0; i < particleCount; i++)
+        buffer[indx++] = result.particleList[i];
+      for (int i = 0; i < particleCount; i++)
+        buffer[indx++] = result.membership[i];
+
+      MPI_Request request;
+      MPI_Isend(buffer, size, MPI_INT, tasks[t].owner,
+                SUBHALO_RESULT_TAG, comm, &request);
+      requests.push_back(request);
+      sendResult.push_back(buffer);
+    }
+
+    // Receive the subhalos of halos sent away in the same order that
+    // each processor ran them
+    for (int t = 0; t < numberOfTasks; t++) {
+      if (tasks[t].owner != this->myProc || tasks[t].worker == this->myProc)
+        continue;
+
+      MPI_Status mpistatus;
+      int size;
+      MPI_Probe(tasks[t].worker, SUBHALO_RESULT_TAG, comm, &mpistatus);
+      MPI_Get_count(&mpistatus, MPI_INT, &size);
+      int* buffer = new int[size];
+      MPI_Recv(buffer, size, MPI_INT, tasks[t].worker,
+               SUBHALO_RESULT_TAG, comm, &mpistatus);
+
+      long particleCount = tasks[t].count;
+      SubhaloResult& result = results[tasks[t].halo];
+      int indx = 0;
+      result.numberOfSubhalos = buffer[indx++];
+      result.subhaloCount.assign(&buffer[indx],
+                                 &buffer[indx + result.numberOfSubhalos]);
+      indx += result.numberOfSubhalos;
+      result.subhalos.assign(&buffer[indx],
+                             &buffer[indx + result.numberOfSubhalos]);
+      indx += result.numberOfSubhalos;
+      result.particleList.assign(&buffer[indx], &buffer[indx + particleCount]);
+      indx += particleCount;
+      result.membership.assign(&buffer[indx], &buffer[indx + particleCount]);
+      delete [] buffer;
+    }
+
+    if (!requests.empty())
+      MPI_Waitall(requests.size(), &requests[0], MPI_STATUSES_IGNORE);
+    for (size_t i = 0; i < sendLoc.size(); i++) {
+      delete [] sendLoc[i];
+      delete [] sendId[i];
+    }
+    for (size_t i = 0; i < sendResult.size(); i++)
+      delete [] sendResult[i];
+
+    // Subhalo properties in FOF halo order written in one collective file
+    SubhaloCatalog catalog;
+    map<int, SubhaloResult>::iterator iter;
+    for (iter = results.begin(); iter != results.end(); ++iter)
+      SubHaloProperties(iter->first, &iter->second, &catalog);
+    results.clear();
+
+    SubHaloCatalog(&catalog);
+  }
+  Profiler::End(shtimer);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Estimated cost of subhalo finding grows as the square of the halo size
+// because of the pair sum potential used when unbinding, which is
+// replaced by a tree code above MAX_UNBIND_3
+//
+/////////////////////////////////////////////////////////////////////////////
+
+static double subhaloCost(long count)
+{
+  return (double) count * (double) min(count, (long) MAX_UNBIND_3);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Gather the size of every FOF halo which gets subhalo finding and assign
+// each to a processor.  Every processor computes the same plan.  Halos
+// smaller than MIN_SHIP_SUBHALO stay with their owner.  Larger halos are
+// placed largest first on the processor with the least estimated work,
+// staying with the owner on a tie.  Tasks are returned largest first.
+//
+/////////////////////////////////////////////////////////////////////////////
+
+void HaloFinder::PlanSubhaloTasks(vector<SubhaloTask>& tasks)
+{
+  int* fofHaloCount = this->haloFinder.getHaloCount();
+
+  // Halo index and size of local halos for subhalo finding
+  vector<int> local;
+  for (int halo = 0; halo < this->numberOfFOFHalos; halo++) {
+    if (fofHaloCount[halo] > this->haloIn.getMinFOFSubhalo()) {
+      local.push_back(halo);
+      local.push_back(fofHaloCount[halo]);
+    }
+  }
+
+  int localSize = local.size();
+  int* recvCount = new int[this->numProc];
+  int* recvDispl = new int[this->numProc];
+  MPI_Allgather(&localSize, 1, MPI_INT, recvCount, 1, MPI_INT,
+                Partition::getComm());
+
+  int totalSize = 0;
+  for (int proc = 0; proc < this->numProc; proc++) {
+    recvDispl[proc] = totalSize;
+    totalSize += recvCount[proc];
+  }
+  vector<int> all(totalSize + 1);
+  MPI_Allgatherv(localSize > 0 ? &local[0] : 0, localSize, MPI_INT,
+                 &all[0], recvCount, recvDispl, MPI_INT,
+                 Partition::getComm());
+
+  for (int proc = 0; proc < this->numProc; proc++) {
+    for (int i = 0; i < recvCount[proc]; i += 2) {
+      SubhaloTask task;
+      task.owner = proc;
+      task.halo = all[recvDispl[proc] + i];
+      task.count = all[recvDispl[proc] + i + 1];
+      task.worker = proc;
+      task.cost = subhaloCost(task.count);
+      tasks.push_back(task);
     }
   }
-  Timings::stopTimer(shtimer);
+  delete [] recvCount;
+  delete [] recvDispl;
+
+  sort(tasks.begin(), tasks.end(), SubhaloTaskGT());
+
+  // Small halos are not worth sending
+  vector<double> load(this->numProc, 0.0);
+  for (size_t t = 0; t < tasks.size(); t++)
+    if (tasks[t].count < MIN_SHIP_SUBHALO)
+      load[tasks[t].owner] += tasks[t].cost;
+
+  // Largest halos first to the least loaded processor
+  for (size_t t = 0; t < tasks.size(); t++) {
+    if (tasks[t].count < MIN_SHIP_SUBHALO)
+      continue;
+    int best = tasks[t].owner;
+    for (int proc = 0; proc < this->numProc; proc++)
+      if (load[proc] < load[best])
+        best = proc;
+    tasks[t].worker = best;
+    load[best] += tasks[t].cost;
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Run the subhalo finder on one halo's particles and copy out the
+// subhalo structure so it can be kept or sent to the halo's owner
+//
+/////////////////////////////////////////////////////////////////////////////
+
+void HaloFinder::SubHaloCalculation(
+                        long particleCount,
+                        POSVEL_T* xLocHalo,
+                        POSVEL_T* yLocHalo,
+                        POSVEL_T* zLocHalo,
+                        POSVEL_T* xVelHalo,
+                        POSVEL_T* yVelHalo,
+                        POSVEL_T* zVelHalo,
+                        POSVEL_T* massHalo,
+                        ID_T* id,
+                        BigChunkArena* treeArena,
+                        SubhaloResult* result)
+{
+  // Look for subhalos within the FOF halo using extract location arrays
+  SubHaloFinder* subFinder = new SubHaloFinder();
+  subFinder->setParameters(this->particleMass, GRAVITY_C,
+                           this->alphaFactor, this->betaFactor,
+                           this->minCandidateSize,
+                           this->numSPHNeighbors, this->numNeighbors);
+  subFinder->setTreeArena(treeArena);
+  subFinder->setNeighborCacheSize((size_t)
+    (this->haloIn.getSubhaloNeighborCacheMB() * 1024.0 * 1024.0));
+
+  subFinder->setParticles(particleCount, xLocHalo, yLocHalo, zLocHalo,
+                          xVelHalo, yVelHalo, zVelHalo, massHalo, id);
+
+  subFinder->findSubHalos();
+
+  // Retrieve subhalo information suitable for FOFHaloProperties
+  int numberOfSubhalos = subFinder->getNumberOfSubhalos();
+  int* fofSubhalos = subFinder->getSubhalos();
+  int* fofSubhaloCount = subFinder->getSubhaloCount();
+  int* fofSubhaloList = subFinder->getSubhaloList();
+
+  result->numberOfSubhalos = numberOfSubhalos;
+  result->subhaloCount.assign(fofSubhaloCount,
+                              fofSubhaloCount + numberOfSubhalos);
+  result->subhalos.assign(fofSubhalos, fofSubhalos + numberOfSubhalos);
+  result->particleList.assign(fofSubhaloList, fofSubhaloList + particleCount);
+  result->membership.resize(particleCount);
+  subFinder->getSubhaloMembership(&result->membership[0]);
+
+  delete subFinder;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Subhalo properties for a FOF halo owned by this processor whose subhalos
+// were found here or on another processor.  Properties and particles
+// tagged with FOF halo and subhalo are added to the catalog.
+//
+/////////////////////////////////////////////////////////////////////////////
+
+void HaloFinder::SubHaloProperties(
+                        int halo,
+                        SubhaloResult* result,
+                        SubhaloCatalog* catalog)
+{
+  // Get FOF halo information
+  int* fofHaloCount = this->haloFinder.getHaloCount();
+  int* fofHalos = this->haloFinder.getHalos();
+  long particleCount = fofHaloCount[halo];
+  ID_T fofTag = (*this->tag)[fofHalos[halo]];
+
+  // Extract the particles directly onto the end of the catalog
+  size_t first = catalog->id.size();
+  size_t last = first + particleCount;
+  catalog->x.resize(last);
+  catalog->y.resize(last);
+  catalog->z.resize(last);
+  catalog->vx.resize(last);
+  catalog->vy.resize(last);
+  catalog->vz.resize(last);
+  catalog->id.resize(last);
+
+  POSVEL_T* massHalo = new POSVEL_T[particleCount];
+
+  // Map halo index to actual particle index to find locations
+  int* actualIndx = new int[particleCount];
+
+  this->fof.extractInformation(halo, actualIndx,
+                   &catalog->x[first], &catalog->y[first], &catalog->z[first],
+                   &catalog->vx[first], &catalog->vy[first], &catalog->vz[first],
+                   massHalo, &catalog->id[first]);
+  delete [] actualIndx;
+
+  // Subhalo information suitable for FOFHaloProperties
+  int numberOfSubhalos = result->numberOfSubhalos;
+  int* fofSubhalos = numberOfSubhalos > 0 ? &result->subhalos[0] : 0;
+  int* fofSubhaloCount = numberOfSubhalos > 0 ? &result->subhaloCount[0] : 0;
+  int* fofSubhaloList = &result->particleList[0];
+
+  // Construct the FOF properties class
+  FOFHaloProperties subhaloProp;
+  subhaloProp.setHalos(numberOfSubhalos,
+               fofSubhalos, fofSubhaloCount, fofSubhaloList);
+  subhaloProp.setParameters(this->outFile,
+                            this->rL, this->deadSize, this->bb);
+  subhaloProp.setParticles(particleCount,
+                   &catalog->x[first], &catalog->y[first], &catalog->z[first],
+                   &catalog->vx[first], &catalog->vy[first], &catalog->vz[first],
+                   massHalo, &catalog->id[first]);
+
+  // Run some halo properties on subhalos
+  // Find the mass of every subhalo
+  vector<POSVEL_T> subhaloMass;
+  subhaloProp.FOFHaloMass(&subhaloMass);
+
+  // Find the average position of every subhalo
+  vector<POSVEL_T> subhaloXPos;
+  vector<POSVEL_T> subhaloYPos;
+  vector<POSVEL_T> subhaloZPos;
+  subhaloProp.FOFPosition(
+         &subhaloXPos, &subhaloYPos, &subhaloZPos);
+
+  // Find the center of mass of every subhalo
+  vector<POSVEL_T> subhaloXCofMass;
+  vector<POSVEL_T> subhaloYCofMass;
+  vector<POSVEL_T> subhaloZCofMass;
+  subhaloProp.FOFCenterOfMass(
+         &subhaloXCofMass, &subhaloYCofMass, &subhaloZCofMass);
+
+  // Find the average velocity of every subhalo
+  vector<POSVEL_T> subhaloXVel;
+  vector<POSVEL_T> subhaloYVel;
+  vector<POSVEL_T> subhaloZVel;
+  subhaloProp.FOFVelocity(
+         &subhaloXVel, &subhaloYVel, &subhaloZVel);
+
+  // Find the velocity dispersion of every subhalo
+  vector<POSVEL_T> subhaloVelDisp;
+  subhaloProp.FOFVelocityDispersion(
+         &subhaloXVel, &subhaloYVel, &subhaloZVel, &subhaloVelDisp);
+
+  for (int sindx = 0; sindx < numberOfSubhalos; sindx++) {
+    catalog->fofTag.push_back(fofTag);
+    catalog->subhaloTag.push_back(sindx);
+    catalog->count.push_back(fofSubhaloCount[sindx]);
+    catalog->mass.push_back(subhaloMass[sindx]);
+    catalog->xCofMass.push_back(subhaloXCofMass[sindx]);
+    catalog->yCofMass.push_back(subhaloYCofMass[sindx]);
+    catalog->zCofMass.push_back(subhaloZCofMass[sindx]);
+    catalog->xPos.push_back(subhaloXPos[sindx]);
+    catalog->yPos.push_back(subhaloYPos[sindx]);
+    catalog->zPos.push_back(subhaloZPos[sindx]);
+    catalog->xVel.push_back(subhaloXVel[sindx]);
+    catalog->yVel.push_back(subhaloYVel[sindx]);
+    catalog->zVel.push_back(subhaloZVel[sindx]);
+    catalog->velDisp.push_back(subhaloVelDisp[sindx]);
+  }
+
+  // Tag particles with FOF halo and subhalo, fuzz was numbered last
+  catalog->particleFofTag.resize(last, fofTag);
+  catalog->particleSubhaloTag.resize(last);
+  for (long i = 0; i < particleCount; i++) {
+    int sindx = result->membership[i];
+    catalog->particleSubhaloTag[first + i] =
+      (sindx < numberOfSubhalos) ? sindx : -1;
+  }
+
+  delete [] massHalo;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Write the subhalo property table and the subhalo particles of all
+// processors.  Both writes are collective so every processor calls this
+// even if it has no subhalos.
+//
+/////////////////////////////////////////////////////////////////////////////
+
+void HaloFinder::SubHaloCatalog(SubhaloCatalog* catalog)
+{
+  static int ctimer = Profiler::GetPhaseRegion("SubHalo Catalog");
+  ProfilerRegion timed(ctimer);
+
+  gio::GenericIO propGIO(Partition::getComm(),
+                         this->outFile + ".subhaloproperties");
+  propGIO.setNumElems(catalog->fofTag.size());
+  propGIO.addVariable("fof_halo_tag", catalog->fofTag);
+  propGIO.addVariable("subhalo_tag", catalog->subhaloTag);
+  propGIO.addVariable("subhalo_count", catalog->count);
+  propGIO.addVariable("subhalo_mass", catalog->mass);
+  propGIO.addVariable("subhalo_com_x", catalog->xCofMass);
+  propGIO.addVariable("subhalo_com_y", catalog->yCofMass);
+  propGIO.addVariable("subhalo_com_z", catalog->zCofMass);
+  propGIO.addVariable("subhalo_mean_x", catalog->xPos);
+  propGIO.addVariable("subhalo_mean_y", catalog->yPos);
+  propGIO.addVariable("subhalo_mean_z", catalog->zPos);
+  propGIO.addVariable("subhalo_mean_vx", catalog->xVel);
+  propGIO.addVariable("subhalo_mean_vy", catalog->yVel);
+  propGIO.addVariable("subhalo_mean_vz", catalog->zVel);
+  propGIO.addVariable("subhalo_vel_disp", catalog->velDisp);
+  propGIO.write();
+
+  gio::GenericIO partGIO(Partition::getComm(),
+                         this->outFile + ".subhaloparticles");
+  partGIO.setNumElems(catalog->id.size());
+  partGIO.addVariable("x", catalog->x);
+  partGIO.addVariable("y", catalog->y);
+  partGIO.addVariable("z", catalog->z);
+  partGIO.addVariable("vx", catalog->vx);
+  partGIO.addVariable("vy", catalog->vy);
+  partGIO.addVariable("vz", catalog->vz);
+  partGIO.addVariable("id", catalog->id);
+  partGIO.addVariable("fof_halo_tag", catalog->particleFofTag);
+  partGIO.addVariable("subhalo_tag", catalog->particleSubhaloTag);
+  partGIO.write();
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -896,6 +1350,9 @@ void HaloFinder::FOFSubHaloFinding()
 
 void HaloFinder::FOFHaloCatalog()
 {
+  static int ctimer = Profiler::GetPhaseRegion("FOF Catalog");
+  ProfilerRegion timed(ctimer);
+
   int* fofHalos = this->haloFinder.getHalos();
   int* fofHaloCount = this->haloFinder.getHaloCount();
 
@@ -903,41 +1360,51 @@ void HaloFinder::FOFHaloCatalog()
     this->fof.FOFHaloCatalog(this->fofCenter, this->fofMass,
                              this->fofXVel, this->fofYVel, this->fofZVel);
 
-  // Write a summary of FOF properties
+  // Write a summary of FOF properties as one collective table
+  // with a row per FOF halo in halo order on each processor
   if (this->haloIn.getOutputFOFProperties() == 1) {
-    ostringstream sname;
-    if (numProc == 1) {
-      sname << outFile << ".fofproperties";
-    } else {
-      sname << outFile << ".fofproperties." << myProc;
+    int numberHalos = this->numberOfFOFHalos;
+    bool haveCenter = ((int) this->fofCenter->size() == numberHalos);
+
+    vector<ID_T> haloTag(numberHalos);
+    vector<int> haloCount(fofHaloCount, fofHaloCount + numberHalos);
+    vector<POSVEL_T> centerX(numberHalos),
+                     centerY(numberHalos),
+                     centerZ(numberHalos);
+
+    for (int halo = 0; halo < numberHalos; halo++) {
+      haloTag[halo] = (*this->tag)[fofHalos[halo]];
+      if (haveCenter) {
+        int center = (*fofCenter)[halo];
+        centerX[halo] = (*this->xx)[center];
+        centerY[halo] = (*this->yy)[center];
+        centerZ[halo] = (*this->zz)[center];
+      } else {
+        centerX[halo] = (*this->fofXPos)[halo];
+        centerY[halo] = (*this->fofYPos)[halo];
+        centerZ[halo] = (*this->fofZPos)[halo];
+      }
     }
-    ofstream sStream(sname.str().c_str(), ios::out);
 
-    for (int halo = 0; halo < numberOfFOFHalos; halo++) {
-      int center = (*fofCenter)[halo];
-      sStream << "Halo: " << halo << endl
-              << "  FOF count = " << fofHaloCount[halo] << endl
-              << "  FOF tag = " << fofHalos[halo] << endl
-              << "  FOF mass = " << (*this->fofMass)[halo] << endl
-              << "  FOF center = ["
-                                 << (*this->xx)[center] << ","
-                                 << (*this->yy)[center] << ","
-                                 << (*this->zz)[center] << "]" << endl
-              << "  FOF center of mass = ["
-                                 << (*this->fofXCofMass)[halo] << ","
-                                 << (*this->fofYCofMass)[halo] << ","
-                                 << (*this->fofZCofMass)[halo] << "]" << endl
-              << "  FOF avg loc = ["
-                                 << (*this->fofXPos)[halo] << ","
-                                 << (*this->fofYPos)[halo] << ","
-                                 << (*this->fofZPos)[halo] << "]" << endl
-              << "  FOF avg vel = ["
-                                 << (*this->fofXVel)[halo] << ","
-                                 << (*this->fofYVel)[halo] << ","
-                                 << (*this->fofZVel)[halo] << "]" << endl
-              << "  FOF velocity dispersion = "
-                                 << (*this->fofVelDisp)[halo] << endl;
-    }
+    gio::GenericIO GIO(Partition::getComm(), outFile + ".fofproperties");
+    GIO.setNumElems(numberHalos);
+    GIO.addVariable("fof_halo_tag", haloTag);
+    GIO.addVariable("fof_halo_count", haloCount);
+    GIO.addVariable("fof_halo_mass", *this->fofMass);
+    GIO.addVariable("fof_halo_center_x", centerX);
+    GIO.addVariable("fof_halo_center_y", centerY);
+    GIO.addVariable("fof_halo_center_z", centerZ);
+    GIO.addVariable("fof_halo_com_x", *this->fofXCofMass);
+    GIO.addVariable("fof_halo_com_y", *this->fofYCofMass);
+    GIO.addVariable("fof_halo_com_z", *this->fofZCofMass);
+    GIO.addVariable("fof_halo_mean_x", *this->fofXPos);
+    GIO.addVariable("fof_halo_mean_y", *this->fofYPos);
+    GIO.addVariable("fof_halo_mean_z", *this->fofZPos);
+    GIO.addVariable("fof_halo_mean_vx", *this->fofXVel);
+    GIO.addVariable("fof_halo_mean_vy", *this->fofYVel);
+    GIO.addVariable("fof_halo_mean_vz", *this->fofZVel);
+    GIO.addVariable("fof_halo_vel_disp", *this->fofVelDisp);
+    GIO.write();
   }
 }
 
@@ -947,29 +1414,26 @@ void HaloFinder::FOFHaloCatalog()
 // because it must examine all particles, not just those in FOF
 // Requires the FOF halo center
 //
+// Spheres which reach past the dead zone of this processor are completed
+// with particles fetched from the processors owning them in one batched
+// exchange before any halo is built, so the dead zone can stay small.
+//
+// The chaining mesh and particles are only read while building SOD halos
+// so halos are processed concurrently with one SODHalo workspace per
+// thread.  Results go to a table indexed by FOF halo which is written
+// in halo order after the loop.
+//
 ////////////////////////////////////////////////////////////////////////////
 
 void HaloFinder::SODHaloFinding()
 {
-  static Timings::TimerRef sodtimer = Timings::getTimer("SOD Halo Finder");
-  Timings::startTimer(sodtimer);
-
-  int* fofHalos = this->haloFinder.getHalos();
-  int* fofHaloCount = this->haloFinder.getHaloCount();
+  static int sodtimer = Profiler::GetPhaseRegion("SOD Halo Finder");
+  Profiler::Begin(sodtimer);
 
   if (this->haloIn.getOutputSODProperties() == 1) {
     if (this->myProc == 0)
       cout << "Run SOD halo finder" << endl;
 
-    // Open files to hold the SOD output
-    ostringstream sname;
-    if (numProc == 1) {
-      sname << outFile << ".sodproperties";
-    } else {
-      sname << outFile << ".sodproperties." << myProc;
-    }
-    ofstream sStream(sname.str().c_str(), ios::out);
-
     // Construct the chaining mesh of all particles on this processor which
     // is used to determine particles in the SOD
     POSVEL_T chainSize = CHAIN_SIZE;
@@ -986,157 +1450,295 @@ void HaloFinder::SODHaloFinding()
     POSVEL_T cMinFactor = MIN_RADIUS_FACTOR;
     POSVEL_T cMaxFactor = MAX_RADIUS_FACTOR;
 
-    // For every FOF halo construct a SOD halo
-    for (int halo = 0; halo < numberOfFOFHalos; halo++) {
+    // Queue every sphere SODHalo will examine which is not held here
+    SphereExchange sphereExchange;
+    sphereExchange.setParameters(chain, rL, deadSize);
+    sphereExchange.setParticles(this->xx, this->yy, this->zz,
+                                this->vx, this->vy, this->vz,
+                                this->mass, this->tag, this->status);
 
-      // Only build SOD for large enough FOF halos
+    vector<int> sodQuery(this->numberOfFOFHalos, -1);
+    for (int halo = 0; halo < numberOfFOFHalos; halo++) {
       if ((*fofMass)[halo] > minHaloMass) {
-
-        // Construct around the center particle of the FOF halo
         int center = (*fofCenter)[halo];
+        POSVEL_T centerLoc[DIMENSION];
+        centerLoc[0] = (*xx)[center];
+        centerLoc[1] = (*yy)[center];
+        centerLoc[2] = (*zz)[center];
 
-        SODHalo* sod = new SODHalo();
-        sod->setParameters(chain, numberOfBins, rL, np,
-                           this->RHOC, this->SODMASS,
-                           rhoRatio, cMinFactor, cMaxFactor);
-        sod->setParticles(this->xx, this->yy, this->zz,
-                          this->vx, this->vy, this->vz, this->mass, this->tag);
-
-        // SOD halos are calculated from the center particle location of FOF
-        // Send average velocity of FOF halo for calculating radial velocity
-        sod->createSODHalo(
-             fofHaloCount[halo],
-             (*xx)[center],
-             (*yy)[center],
-             (*zz)[center],
-             (*fofXVel)[halo],
-             (*fofYVel)[halo],
-             (*fofZVel)[halo],
-             (*fofMass)[halo]);
-
-        // SOD halo properties
-        long particleCount = sod->SODHaloSize();
-        if (particleCount > 0) {
-
-          POSVEL_T sodRadius = sod->SODRadius();
-          POSVEL_T sodCenterOfMass[DIMENSION];
-          POSVEL_T sodAverageLocation[DIMENSION];
-          POSVEL_T sodMinPotLocation[DIMENSION];
-          POSVEL_T sodAverageVelocity[DIMENSION];
-          POSVEL_T sodVelDisp;
-          POSVEL_T sodMass;
-
-          sod->SODCenterOfMass(sodCenterOfMass);
-          sod->SODAverageLocation(sodAverageLocation);
-          sod->SODAverageVelocity(sodAverageVelocity);
-          sod->SODVelocityDispersion(&sodVelDisp);
-          sod->SODMass(&sodMass);
-
-          // Get information for profiles which is in bins
-          int binCount[numberOfBins];		// Number per bin
-          POSVEL_T binMass[numberOfBins];	// Mass per bin
-          POSVEL_T binRadius[numberOfBins];	// Radius of bin
-          POSVEL_T binRho[numberOfBins];	// total mass / volume at radius
-          POSVEL_T binRhoRatio[numberOfBins];	// rho / rho_c
-          POSVEL_T binRadVelocity[numberOfBins];// avg radial velocity
-
-          sod->SODProfile(binCount, binMass, binRadius,
-                          binRho, binRhoRatio, binRadVelocity);
-
-          // Show how to extract information from SODHalo
-          POSVEL_T* xLocHalo = new POSVEL_T[particleCount];
-          POSVEL_T* yLocHalo = new POSVEL_T[particleCount];
-          POSVEL_T* zLocHalo = new POSVEL_T[particleCount];
-          POSVEL_T* xVelHalo = new POSVEL_T[particleCount];
-          POSVEL_T* yVelHalo = new POSVEL_T[particleCount];
-          POSVEL_T* zVelHalo = new POSVEL_T[particleCount];
-          POSVEL_T* massHalo = new POSVEL_T[particleCount];
-          POSVEL_T* radius = new POSVEL_T[particleCount];
-          ID_T* id = new ID_T[particleCount];
-
-          // Map halo index to actual particle index on this processor
-          // Different still from id tag which is unique across all processors
-          int* actualIndx = new int[particleCount];
-
-          sod->extractInformation(actualIndx,
-                               xLocHalo, yLocHalo, zLocHalo,
-                               xVelHalo, yVelHalo, zVelHalo,
-                               massHalo, radius, id);
-
-          // Most bound particle method of center finding
-          int centerIndex;
-          POTENTIAL_T minPotential;
-          if (this->haloIn.getUseMBPCenterFinder() == 1) {
-            centerIndex = MBPCenterFinding(&minPotential, particleCount,
-                                  xLocHalo, yLocHalo, zLocHalo, massHalo, id);
-            sodMinPotLocation[0] = (*xx)[actualIndx[centerIndex]];
-            sodMinPotLocation[1] = (*yy)[actualIndx[centerIndex]];
-            sodMinPotLocation[2] = (*zz)[actualIndx[centerIndex]];
-          }
-
-          // Most connected particle method of center finding
-          else if (this->haloIn.getUseMCPCenterFinder() == 1) {
-            centerIndex = MCPCenterFinding(particleCount,
-                                  xLocHalo, yLocHalo, zLocHalo, massHalo, id);
-            sodMinPotLocation[0] = (*xx)[actualIndx[centerIndex]];
-            sodMinPotLocation[1] = (*yy)[actualIndx[centerIndex]];
-            sodMinPotLocation[2] = (*zz)[actualIndx[centerIndex]];
-          }
-
-          // Write profile information
-          sStream << "Halo " << (*tag)[fofHalos[halo]] << endl
-                  << "  FOF count = " << fofHaloCount[halo] << endl
-                  << "  FOF center = ["
-                                     << (*xx)[center] << " , "
-                                     << (*yy)[center] << " , "
-                                     << (*zz)[center] << "]" << endl
-                  << "  SOD count = " << particleCount << endl
-                  << "  SOD radius = " << sodRadius << endl
-                  << "  SOD mass = " << sodMass << endl
-                  << "  SOD min pot location = ["
-                                     << sodMinPotLocation[0] << " , "
-                                     << sodMinPotLocation[1] << " , "
-                                     << sodMinPotLocation[2] << "]" << endl
-                  << "  SOD center of mass = ["
-                                     << sodCenterOfMass[0] << " , "
-                                     << sodCenterOfMass[1] << " , "
-                                     << sodCenterOfMass[2] << "]" << endl
-                  << "  SOD avg location = ["
-                                     << sodAverageLocation[0] << " , "
-                                     << sodAverageLocation[1] << " , "
-                                     << sodAverageLocation[2] << "]" << endl
-                  << "  SOD velocity = ["
-                                     << sodAverageVelocity[0] << " , "
-                                     << sodAverageVelocity[1] << " , "
-                                     << sodAverageVelocity[2] << "]" << endl
-                  << "  SOD velocity dispersion = " << sodVelDisp << endl;
-
-          for (int bin = 0; bin < numberOfBins; bin++)
-            sStream << "    Bin " << bin
-                    << " count: " << binCount[bin]
-                    << " mass: " << binMass[bin]
-                    << " radius: " << binRadius[bin]
-                    << " rho: " << binRho[bin]
-                    << " rho ratio: " << binRhoRatio[bin]
-                    << " rad vel: " << binRadVelocity[bin] << endl;
-
-          delete [] xLocHalo;
-          delete [] yLocHalo;
-          delete [] zLocHalo;
-          delete [] xVelHalo;
-          delete [] yVelHalo;
-          delete [] zVelHalo;
-          delete [] massHalo;
-          delete [] radius;
-          delete [] id;
-          delete [] actualIndx;
-          delete sod;
-        }
+        // Same max radius as calculated by SODHalo from the FOF mass
+        POSVEL_T maxRadius = cMaxFactor * (POSVEL_T)pow
+          ((POSVEL_T)((*fofMass)[halo] / this->SODMASS), (POSVEL_T)(1.0/3.0));
+
+        if (sphereExchange.exceedsRegion(centerLoc, maxRadius))
+          sodQuery[halo] = sphereExchange.addQuery(centerLoc, maxRadius);
+      }
+    }
+    sphereExchange.exchangeQueries();
+
+    // Results for every FOF halo, count stays 0 when there is no SOD halo
+    vector<SODProperties> sodTable(this->numberOfFOFHalos);
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+      // Workspace for this thread reused for all of its halos
+      SODHalo sod;
+      sod.setParameters(chain, numberOfBins, rL, np,
+                        this->RHOC, this->SODMASS,
+                        rhoRatio, cMinFactor, cMaxFactor);
+      sod.setParticles(this->xx, this->yy, this->zz,
+                       this->vx, this->vy, this->vz, this->mass, this->tag);
+
+      // Halo sizes are power law distributed so hand out halos dynamically
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+      for (int halo = 0; halo < numberOfFOFHalos; halo++) {
+        sodTable[halo].count = 0;
+
+        // Only build SOD for large enough FOF halos
+        if ((*fofMass)[halo] > minHaloMass)
+          SODHaloCalculation(&sod, halo,
+                             &sphereExchange, sodQuery[halo], &sodTable[halo]);
       }
     }
     delete chain;
+
+    SODHaloCatalog(sodTable);
+  }
+  Profiler::End(sodtimer);
+}
+
+////////////////////////////////////////////////////////////////////////////
+//
+// Write the SOD halos of all processors as two collective tables, one row
+// per SOD halo for properties and one row per halo and bin for profiles.
+// Every processor calls this even if it has no SOD halos.
+//
+////////////////////////////////////////////////////////////////////////////
+
+void HaloFinder::SODHaloCatalog(vector<SODProperties>& sodTable)
+{
+  static int ctimer = Profiler::GetPhaseRegion("SOD Catalog");
+  ProfilerRegion timed(ctimer);
+
+  int* fofHalos = this->haloFinder.getHalos();
+  int* fofHaloCount = this->haloFinder.getHaloCount();
+  int numberOfBins = NUM_SOD_BINS;
+
+  vector<ID_T> haloTag, binHaloTag;
+  vector<int> haloCount, sodCount, bin, binCount;
+  vector<POSVEL_T> centerX, centerY, centerZ;
+  vector<POSVEL_T> radius, mass, velDisp;
+  vector<POSVEL_T> minPotX, minPotY, minPotZ;
+  vector<POSVEL_T> comX, comY, comZ;
+  vector<POSVEL_T> meanX, meanY, meanZ;
+  vector<POSVEL_T> meanVX, meanVY, meanVZ;
+  vector<POSVEL_T> binMass, binRadius, binRho, binRhoRatio, binRadVelocity;
+
+  for (int halo = 0; halo < this->numberOfFOFHalos; halo++) {
+    SODProperties& props = sodTable[halo];
+    if (props.count <= 0)
+      continue;
+
+    int center = props.fofCenter;
+    ID_T fofTag = (*tag)[fofHalos[halo]];
+
+    haloTag.push_back(fofTag);
+    haloCount.push_back(fofHaloCount[halo]);
+    centerX.push_back((*xx)[center]);
+    centerY.push_back((*yy)[center]);
+    centerZ.push_back((*zz)[center]);
+    sodCount.push_back(props.count);
+    radius.push_back(props.radius);
+    mass.push_back(props.mass);
+    minPotX.push_back(props.minPotLocation[0]);
+    minPotY.push_back(props.minPotLocation[1]);
+    minPotZ.push_back(props.minPotLocation[2]);
+    comX.push_back(props.centerOfMass[0]);
+    comY.push_back(props.centerOfMass[1]);
+    comZ.push_back(props.centerOfMass[2]);
+    meanX.push_back(props.avgLocation[0]);
+    meanY.push_back(props.avgLocation[1]);
+    meanZ.push_back(props.avgLocation[2]);
+    meanVX.push_back(props.avgVelocity[0]);
+    meanVY.push_back(props.avgVelocity[1]);
+    meanVZ.push_back(props.avgVelocity[2]);
+    velDisp.push_back(props.velDisp);
+
+    for (int b = 0; b < numberOfBins; b++) {
+      binHaloTag.push_back(fofTag);
+      bin.push_back(b);
+      binCount.push_back(props.binCount[b]);
+      binMass.push_back(props.binMass[b]);
+      binRadius.push_back(props.binRadius[b]);
+      binRho.push_back(props.binRho[b]);
+      binRhoRatio.push_back(props.binRhoRatio[b]);
+      binRadVelocity.push_back(props.binRadVelocity[b]);
+    }
+  }
+
+  gio::GenericIO GIO(Partition::getComm(), outFile + ".sodproperties");
+  GIO.setNumElems(haloTag.size());
+  GIO.addVariable("fof_halo_tag", haloTag);
+  GIO.addVariable("fof_halo_count", haloCount);
+  GIO.addVariable("fof_halo_center_x", centerX);
+  GIO.addVariable("fof_halo_center_y", centerY);
+  GIO.addVariable("fof_halo_center_z", centerZ);
+  GIO.addVariable("sod_halo_count", sodCount);
+  GIO.addVariable("sod_halo_radius", radius);
+  GIO.addVariable("sod_halo_mass", mass);
+  GIO.addVariable("sod_halo_min_pot_x", minPotX);
+  GIO.addVariable("sod_halo_min_pot_y", minPotY);
+  GIO.addVariable("sod_halo_min_pot_z", minPotZ);
+  GIO.addVariable("sod_halo_com_x", comX);
+  GIO.addVariable("sod_halo_com_y", comY);
+  GIO.addVariable("sod_halo_com_z", comZ);
+  GIO.addVariable("sod_halo_mean_x", meanX);
+  GIO.addVariable("sod_halo_mean_y", meanY);
+  GIO.addVariable("sod_halo_mean_z", meanZ);
+  GIO.addVariable("sod_halo_mean_vx", meanVX);
+  GIO.addVariable("sod_halo_mean_vy", meanVY);
+  GIO.addVariable("sod_halo_mean_vz", meanVZ);
+  GIO.addVariable("sod_halo_vel_disp", velDisp);
+  GIO.write();
+
+  gio::GenericIO binGIO(Partition::getComm(), outFile + ".sodpropertybins");
+  binGIO.setNumElems(binHaloTag.size());
+  binGIO.addVariable("fof_halo_tag", binHaloTag);
+  binGIO.addVariable("sod_halo_bin", bin);
+  binGIO.addVariable("sod_halo_bin_count", binCount);
+  binGIO.addVariable("sod_halo_bin_mass", binMass);
+  binGIO.addVariable("sod_halo_bin_radius", binRadius);
+  binGIO.addVariable("sod_halo_bin_rho", binRho);
+  binGIO.addVariable("sod_halo_bin_rho_ratio", binRhoRatio);
+  binGIO.addVariable("sod_halo_bin_rad_vel", binRadVelocity);
+  binGIO.write();
+}
+
+////////////////////////////////////////////////////////////////////////////
+//
+// Build one SOD halo around the center particle of an FOF halo and copy
+// its properties and profile into the results table entry
+// A query index of -1 means the sphere is held on this processor
+//
+////////////////////////////////////////////////////////////////////////////
+
+void HaloFinder::SODHaloCalculation(
+                        SODHalo* sod,
+                        int halo,
+                        SphereExchange* sphereExchange,
+                        int query,
+                        SODProperties* props)
+{
+  int* fofHaloCount = this->haloFinder.getHaloCount();
+
+  // Construct around the center particle of the FOF halo
+  int center = (*fofCenter)[halo];
+  props->fofCenter = center;
+
+  // Particles fetched from other processors complete the sphere
+  if (query >= 0) {
+    sod->setRemoteParticles(sphereExchange->getResultCount(query),
+                            sphereExchange->getXLoc(query),
+                            sphereExchange->getYLoc(query),
+                            sphereExchange->getZLoc(query),
+                            sphereExchange->getXVel(query),
+                            sphereExchange->getYVel(query),
+                            sphereExchange->getZVel(query),
+                            sphereExchange->getMass(query),
+                            sphereExchange->getTag(query));
+  } else {
+    sod->clearRemoteParticles();
+  }
+
+  // SOD halos are calculated from the center particle location of FOF
+  // Send average velocity of FOF halo for calculating radial velocity
+  sod->createSODHalo(
+       fofHaloCount[halo],
+       (*xx)[center],
+       (*yy)[center],
+       (*zz)[center],
+       (*fofXVel)[halo],
+       (*fofYVel)[halo],
+       (*fofZVel)[halo],
+       (*fofMass)[halo]);
+
+  // SOD halo properties
+  long particleCount = sod->SODHaloSize();
+  props->count = particleCount;
+  if (particleCount <= 0)
+    return;
+
+  props->radius = sod->SODRadius();
+  sod->SODCenterOfMass(props->centerOfMass);
+  sod->SODAverageLocation(props->avgLocation);
+  sod->SODAverageVelocity(props->avgVelocity);
+  sod->SODVelocityDispersion(&props->velDisp);
+  sod->SODMass(&props->mass);
+
+  // Get information for profiles which is in bins
+  int numberOfBins = NUM_SOD_BINS;
+  props->binCount.resize(numberOfBins);
+  props->binMass.resize(numberOfBins);
+  props->binRadius.resize(numberOfBins);
+  props->binRho.resize(numberOfBins);
+  props->binRhoRatio.resize(numberOfBins);
+  props->binRadVelocity.resize(numberOfBins);
+
+  sod->SODProfile(&props->binCount[0], &props->binMass[0],
+                  &props->binRadius[0], &props->binRho[0],
+                  &props->binRhoRatio[0], &props->binRadVelocity[0]);
+
+  // Show how to extract information from SODHalo
+  // Scratch is taken from this thread's arena and released on return
+  BigChunkArena* arena = bigchunk_thread_arena();
+  BigChunkPhase phase(arena);
+
+  POSVEL_T* xLocHalo = arena->allocate<POSVEL_T>(particleCount);
+  POSVEL_T* yLocHalo = arena->allocate<POSVEL_T>(particleCount);
+  POSVEL_T* zLocHalo = arena->allocate<POSVEL_T>(particleCount);
+  POSVEL_T* xVelHalo = arena->allocate<POSVEL_T>(particleCount);
+  POSVEL_T* yVelHalo = arena->allocate<POSVEL_T>(particleCount);
+  POSVEL_T* zVelHalo = arena->allocate<POSVEL_T>(particleCount);
+  POSVEL_T* massHalo = arena->allocate<POSVEL_T>(particleCount);
+  POSVEL_T* radius = arena->allocate<POSVEL_T>(particleCount);
+  ID_T* id = arena->allocate<ID_T>(particleCount);
+
+  // Map halo index to actual particle index on this processor
+  // Different still from id tag which is unique across all processors
+  // Remote particles have indices past the particles on this processor
+  int* actualIndx = arena->allocate<int>(particleCount);
+
+  sod->extractInformation(actualIndx,
+                       xLocHalo, yLocHalo, zLocHalo,
+                       xVelHalo, yVelHalo, zVelHalo,
+                       massHalo, radius, id);
+
+  for (int dim = 0; dim < DIMENSION; dim++)
+    props->minPotLocation[dim] = 0.0;
+
+  // Most bound particle method of center finding
+  int centerIndex;
+  POTENTIAL_T minPotential;
+  if (this->haloIn.getUseMBPCenterFinder() == 1) {
+    centerIndex = MBPCenterFinding(&minPotential, particleCount,
+                          xLocHalo, yLocHalo, zLocHalo, massHalo, id);
+    props->minPotLocation[0] = xLocHalo[centerIndex];
+    props->minPotLocation[1] = yLocHalo[centerIndex];
+    props->minPotLocation[2] = zLocHalo[centerIndex];
+  }
+
+  // Most connected particle method of center finding
+  else if (this->haloIn.getUseMCPCenterFinder() == 1) {
+    centerIndex = MCPCenterFinding(particleCount,
+                          xLocHalo, yLocHalo, zLocHalo, massHalo, id);
+    props->minPotLocation[0] = xLocHalo[centerIndex];
+    props->minPotLocation[1] = yLocHalo[centerIndex];
+    props->minPotLocation[2] = zLocHalo[centerIndex];
   }
-  Timings::stopTimer(sodtimer);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -1206,6 +1808,46 @@ void HaloFinder::WriteCosmoFiles(int size)
   }
 }
 
+/////////////////////////////////////////////////////////////////////////////
+//
+// Report the page placement of large allocations summed over processors
+// along with the largest peak on any one processor
+//
+/////////////////////////////////////////////////////////////////////////////
+
+void HaloFinder::PageStatistics()
+{
+  if (this->haloIn.getHugePages() == BIGCHUNK_PAGES_SYSTEM)
+    return;
+
+  struct bigchunk_page_stats stats;
+  bigchunk_get_page_stats(&stats);
+
+  double local[5], total[5];
+  local[0] = (double) stats.allocations;
+  local[1] = (double) stats.explicit_bytes;
+  local[2] = (double) stats.transparent_bytes;
+  local[3] = (double) stats.system_bytes;
+  local[4] = (double) stats.first_touch_bytes;
+  MPI_Reduce(local, total, 5, MPI_DOUBLE, MPI_SUM, MASTER,
+             Partition::getComm());
+
+  double peak = (double) stats.peak_bytes;
+  double maxPeak;
+  MPI_Reduce(&peak, &maxPeak, 1, MPI_DOUBLE, MPI_MAX, MASTER,
+             Partition::getComm());
+
+  if (this->myProc == MASTER) {
+    double MB = 1024.0 * 1024.0;
+    cout << "Page placement: " << total[0] << " allocations" << endl
+         << "  explicit huge pages     " << total[1] / MB << " MB" << endl
+         << "  transparent huge pages  " << total[2] / MB << " MB" << endl
+         << "  system allocator        " << total[3] / MB << " MB" << endl
+         << "  placed by first touch   " << total[4] / MB << " MB" << endl
+         << "  max peak per processor  " << maxPeak / MB << " MB" << endl;
+  }
+}
+
 /////////////////////////////////////////////////////////////////////////////
 //
 // Test driver
@@ -1250,7 +1892,8 @@ int main(int argc, char* argv[])
   cout << "Rank " << Partition::getMyProc() << " FINISHED " << endl;
 
   MPI_Barrier(MPI_COMM_WORLD);
-  Timings::print();
+  Profiler::Print(Partition::getComm());
+  haloFinder.PageStatistics();
 
   // Shut down MPI
   Partition::finalize();
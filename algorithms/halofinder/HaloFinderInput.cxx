@@ -80,6 +80,7 @@ HaloFinderInput::HaloFinderInput()
   this->minFOFSubhalo = 1;
   this->alphaSubhalo = 1.0;
   this->betaSubhalo = 0.0;
+  this->subhaloNeighborCacheMB = 256.0;
 
   this->useMCPCenterFinder = 0;
   this->useMBPCenterFinder = 0;
@@ -95,6 +96,9 @@ HaloFinderInput::HaloFinderInput()
   this->minHaloOutputSize = 0;
   this->outputFrac = 1.0;
   this->outputPosVel = 1;
+
+  this->hugePages = 0;
+  this->firstTouch = 0;
 }
 
 void HaloFinderInput::initialize(const string& inFile)
@@ -172,6 +176,8 @@ void HaloFinderInput::initialize(const string& inFile)
         line >> this->alphaSubhalo;
       else if (keyword == "BETA_SUBHALO")
         line >> this->betaSubhalo;
+      else if (keyword == "SUBHALO_NEIGHBOR_CACHE_MB")
+        line >> this->subhaloNeighborCacheMB;
 
       // Options
       else if (keyword == "USE_MCP_CENTER_FINDER")
@@ -198,6 +204,12 @@ void HaloFinderInput::initialize(const string& inFile)
         line >> this->outputFrac;
       else if (keyword == "OUTPUT_PARTICLE_POS_VEL")
         line >> this->outputPosVel;
+
+      // Memory placement
+      else if (keyword == "HUGE_PAGES")
+        line >> this->hugePages;
+      else if (keyword == "FIRST_TOUCH")
+        line >> this->firstTouch;
     }
   }
   // Only one center finder can be set
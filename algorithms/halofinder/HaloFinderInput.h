@@ -90,6 +90,7 @@ public:
   int    getMinFOFSubhalo()		{ return this->minFOFSubhalo; }
   float  getAlphaSubhalo()		{ return this->alphaSubhalo; }
   float  getBetaSubhalo()		{ return this->betaSubhalo; }
+  float  getSubhaloNeighborCacheMB()	{ return this->subhaloNeighborCacheMB; }
 
   int    getUseMCPCenterFinder()	{ return this->useMCPCenterFinder; }
   int    getUseMBPCenterFinder()	{ return this->useMBPCenterFinder; }
@@ -105,6 +106,9 @@ public:
   float  getOutputFrac()                { return this->outputFrac; }
   int    getOutputPosVel()              { return this->outputPosVel; }
 
+  int    getHugePages()			{ return this->hugePages; }
+  int    getFirstTouch()		{ return this->firstTouch; }
+
 private:
   string headerVersion;
 
@@ -142,6 +146,8 @@ private:
   int    minFOFSubhalo;		// Smallest FOF halo to have subfinding run on
   float  alphaSubhalo;		// Factor for cut/grow criteria
   float  betaSubhalo;		// Factor for Poisson noise significance
+  float  subhaloNeighborCacheMB;// Memory for density neighbors reused
+				// in subgrouping, 0 to search again
 
   // Options
   int    useMCPCenterFinder;	// Run the MCP algorithm for FOF centers
@@ -159,6 +165,11 @@ private:
   float  outputFrac;            // Tthe fraction of all particles in halos meeting
                                 // the halo size cut to output
   int    outputPosVel;          // Output particle position and velocity
+
+  // Memory placement
+  int    hugePages;		// 0 system, 1 transparent, 2 explicit huge
+				// pages for large particle and halo arrays
+  int    firstTouch;		// Place new pages with the threads using them
 };
 
 }
@@ -59,12 +59,28 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "Partition.h"
 #include "ParticleDistribute.h"
+#include "bigchunk.h"
 
 #include <cassert>
 #include <cstring>
 using namespace std;
 
 namespace cosmologytools {
+/////////////////////////////////////////////////////////////////////////
+//
+// Ask for huge pages on the reserved storage of a particle vector
+//
+/////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+static void adviseHugePages(vector<T>* v)
+{
+  // The vector may hold no elements yet, so take the storage from data()
+  // rather than indexing it
+  if (v->capacity() > 0)
+    bigchunk_advise_huge(v->data(), v->capacity() * sizeof(T));
+}
+
 /////////////////////////////////////////////////////////////////////////
 //
 // Particle data space is partitioned for the number of processors
@@ -292,6 +308,16 @@ void ParticleDistribute::readParticlesAllToAll(int reserveQ, bool useAlltoallv)
     this->vz->reserve(reserveSize);
     this->ms->reserve(reserveSize);
     this->tag->reserve(reserveSize);
+
+    // Reserved storage is not yet touched so it can still get huge pages
+    adviseHugePages(this->xx);
+    adviseHugePages(this->yy);
+    adviseHugePages(this->zz);
+    adviseHugePages(this->vx);
+    adviseHugePages(this->vy);
+    adviseHugePages(this->vz);
+    adviseHugePages(this->ms);
+    adviseHugePages(this->tag);
   }
 
   // Running total and index into particle data on this processor
@@ -583,6 +609,16 @@ void ParticleDistribute::readParticlesRoundRobin(int reserveQ)
     this->vz->reserve(reserveSize);
     this->ms->reserve(reserveSize);
     this->tag->reserve(reserveSize);
+
+    // Reserved storage is not yet touched so it can still get huge pages
+    adviseHugePages(this->xx);
+    adviseHugePages(this->yy);
+    adviseHugePages(this->zz);
+    adviseHugePages(this->vx);
+    adviseHugePages(this->vy);
+    adviseHugePages(this->vz);
+    adviseHugePages(this->ms);
+    adviseHugePages(this->tag);
   }
 
   // Running total and index into particle data on this processor
@@ -1628,6 +1664,16 @@ void ParticleDistribute::readParticlesOneToOne(int reserveQ)
     this->vz->reserve(reserveSize);
     this->ms->reserve(reserveSize);
     this->tag->reserve(reserveSize);
+
+    // Reserved storage is not yet touched so it can still get huge pages
+    adviseHugePages(this->xx);
+    adviseHugePages(this->yy);
+    adviseHugePages(this->zz);
+    adviseHugePages(this->vx);
+    adviseHugePages(this->vy);
+    adviseHugePages(this->vz);
+    adviseHugePages(this->ms);
+    adviseHugePages(this->tag);
   }
 
   // Running total and index into particle data on this processor
@@ -51,6 +51,7 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "Partition.h"
 #include "ParticleExchange.h"
+#include "bigchunk.h"
 
 using namespace std;
 
@@ -473,6 +474,14 @@ void ParticleExchange::setParticles(
   this->mask = maskData;
   this->status = type;
   this->status->clear();
+
+  // Status grows with the particles so reserve to match the particle
+  // vectors and ask for huge pages before it is written.  It is empty
+  // here, so the storage comes from data() rather than indexing it
+  this->status->reserve(xLoc->capacity());
+  if (this->status->capacity() > 0)
+    bigchunk_advise_huge(this->status->data(),
+                         this->status->capacity() * sizeof(STATUS_T));
 }
         
 /////////////////////////////////////////////////////////////////////////////
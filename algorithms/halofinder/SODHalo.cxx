@@ -57,8 +57,11 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "Partition.h"
 #include "SODHalo.h"
+#include "Profiler.h"
 
 using namespace std;
+using cosmotk::Profiler;
+using cosmotk::ProfilerRegion;
 
 namespace cosmologytools {
 /////////////////////////////////////////////////////////////////////////
@@ -80,12 +83,15 @@ SODHalo::SODHalo()
   this->binMass = 0;
   this->binRho = 0;
   this->binRhoRatio = 0;
-  this->binInfo = 0;
+  this->binEdge2 = 0;
+  this->binStart = 0;
 
   this->avgRadius = 0;
   this->avgRadVelocity = 0;
   this->particleIndex = 0;
   this->particleRadius = 0;
+
+  clearRemoteParticles();
 }
 
 SODHalo::~SODHalo()
@@ -95,7 +101,8 @@ SODHalo::~SODHalo()
   if (this->binMass) delete [] this->binMass;
   if (this->binRho) delete [] this->binRho;
   if (this->binRhoRatio) delete [] this->binRhoRatio;
-  if (this->binInfo) delete [] this->binInfo;
+  if (this->binEdge2) delete [] this->binEdge2;
+  if (this->binStart) delete [] this->binStart;
 
   if (this->avgRadius) delete [] this->avgRadius;
   if (this->avgRadVelocity) delete [] this->avgRadVelocity;
@@ -137,13 +144,25 @@ void SODHalo::setParameters(
   // minimum radius can be collected into bin 0
   this->numberOfBins = numBins + 1;
 
+  // Release memory from a previous use of this workspace
+  if (this->binCount) delete [] this->binCount;
+  if (this->binRadius) delete [] this->binRadius;
+  if (this->binMass) delete [] this->binMass;
+  if (this->binRho) delete [] this->binRho;
+  if (this->binRhoRatio) delete [] this->binRhoRatio;
+  if (this->binEdge2) delete [] this->binEdge2;
+  if (this->binStart) delete [] this->binStart;
+  if (this->avgRadius) delete [] this->avgRadius;
+  if (this->avgRadVelocity) delete [] this->avgRadVelocity;
+
   // Allocate memory based on bins
   this->binRadius = new POSVEL_T[this->numberOfBins];
   this->binRho = new double[this->numberOfBins];
   this->binRhoRatio = new double[this->numberOfBins];
   this->binCount = new int[this->numberOfBins];
   this->binMass = new double[this->numberOfBins];
-  this->binInfo = new vector<RadiusID>[this->numberOfBins];
+  this->binEdge2 = new POSVEL_T[this->numberOfBins];
+  this->binStart = new int[this->numberOfBins + 1];
 
   this->avgRadius = new double[this->numberOfBins];
   this->avgRadVelocity = new double[this->numberOfBins];
@@ -179,6 +198,51 @@ void SODHalo::setParticles(
   this->tag = &(*id)[0];
 }
 
+/////////////////////////////////////////////////////////////////////////
+//
+// Set the particles beyond the alive and dead region of this processor
+// which were fetched for the next halo.  Locations are already in the
+// frame of the halo center.  They stay in use until cleared or replaced.
+//
+/////////////////////////////////////////////////////////////////////////
+
+void SODHalo::setRemoteParticles(
+                        long count,
+                        POSVEL_T* xLoc,
+                        POSVEL_T* yLoc,
+                        POSVEL_T* zLoc,
+                        POSVEL_T* xVel,
+                        POSVEL_T* yVel,
+                        POSVEL_T* zVel,
+                        POSVEL_T* pmass,
+                        ID_T* id)
+{
+  this->remoteComplete = true;
+  this->remoteCount = count;
+  this->remoteXX = xLoc;
+  this->remoteYY = yLoc;
+  this->remoteZZ = zLoc;
+  this->remoteVX = xVel;
+  this->remoteVY = yVel;
+  this->remoteVZ = zVel;
+  this->remoteMass = pmass;
+  this->remoteTag = id;
+}
+
+void SODHalo::clearRemoteParticles()
+{
+  this->remoteComplete = false;
+  this->remoteCount = 0;
+  this->remoteXX = 0;
+  this->remoteYY = 0;
+  this->remoteZZ = 0;
+  this->remoteVX = 0;
+  this->remoteVY = 0;
+  this->remoteVZ = 0;
+  this->remoteMass = 0;
+  this->remoteTag = 0;
+}
+
 /////////////////////////////////////////////////////////////////////////
 //
 // SOD (Spherically Over Dense) halos centered at FOF center of minimum size
@@ -227,6 +291,15 @@ void SODHalo::createSODHalo(
   this->fofHaloVelocity[2] = avgZVelocity;
 
   this->fofHaloCount = FOFhaloCount;
+
+  // Clear the particles of the previous halo built with this workspace
+  this->numberOfParticles = 0;
+  this->charRadius = 0.0;
+  if (this->particleIndex) delete [] this->particleIndex;
+  if (this->particleRadius) delete [] this->particleRadius;
+  this->particleIndex = 0;
+  this->particleRadius = 0;
+
   this->initRadius = (POSVEL_T)pow
   ((POSVEL_T)(FOFhaloMass / this->SODMASS), (POSVEL_T)(1.0 / 3.0));
 
@@ -284,17 +357,25 @@ void SODHalo::createSODHalo(
 // store the distances for each particle and sort that array of distances
 // Then we should be able to calculate r_200 and r_approximate_200
 //
-// Return radius[numBins], count[numBins], vector<POSVEL_T> distance sorted
+// Particles are binned on squared distance against the squared bin edges
+// so that only particles inside the sphere take a square root.  Binned
+// particles are stored contiguously by bin using a count then fill pass.
+//
+// Return radius[numBins], count[numBins], binParticles grouped by bin
 //
 /////////////////////////////////////////////////////////////////////////
 
 void SODHalo::calculateMassProfile()
 {
+  static int profileRegion = Profiler::GetCountedRegion("SOD Mass Profile");
+  ProfilerRegion timed(profileRegion);
+
   // If the max radius runs into the corner of data for this processor
   // adjust down so as to get a complete sphere
+  // Not needed when remote particles were fetched to complete the sphere
   POSVEL_T limit;
   POSVEL_T requiredMaxRadius = this->maxRadius;
-  for (int dim = 0; dim < DIMENSION; dim++) {
+  for (int dim = 0; dim < DIMENSION && !this->remoteComplete; dim++) {
     limit = this->chain->getMaxMine(dim) - this->fofCenterLocation[dim];
     if (this->maxRadius > limit)
       this->maxRadius = limit;
@@ -317,11 +398,13 @@ void SODHalo::calculateMassProfile()
                                  (this->numberOfBins - 1);
 
   // Bin 0 is for all particles less than the minimum
+  // Bin N holds particles between edge N-1 and edge N
   this->binRadius[0] = this->minRadius;
+  this->binEdge2[0] = this->minRadius * this->minRadius;
   for (int bin = 1; bin < this->numberOfBins; bin++) {
-    this->binRadius[bin] = (POSVEL_T)pow
-      ((POSVEL_T)10.0, (POSVEL_T)((this->deltaRadius * bin) *
-      this->minRadius));
+    this->binRadius[bin] = this->minRadius * (POSVEL_T)pow
+      ((POSVEL_T)10.0, (POSVEL_T)(this->deltaRadius * bin));
+    this->binEdge2[bin] = this->binRadius[bin] * this->binRadius[bin];
   }
 
   for (int bin = 0; bin < this->numberOfBins; bin++) {
@@ -351,13 +434,16 @@ void SODHalo::calculateMassProfile()
     last[dim] = centerIndex[dim] + gridOffset;
     if (first[dim] < 0)
       first[dim] = 0;
-    if (last[dim] > chain->getMeshSize(dim))
-      last[dim] = chain->getMeshSize(dim);
+    if (last[dim] >= chain->getMeshSize(dim))
+      last[dim] = chain->getMeshSize(dim) - 1;
   }
 
   // Iterate over every possible grid and examine particles in the bucket
   // Count the number of particles in each of the logarithmic bins
-  POSVEL_T location[DIMENSION];
+  POSVEL_T maxRadius2 = this->maxRadius * this->maxRadius;
+  this->candidates.clear();
+  this->candidateBin.clear();
+
   for (int i = first[0]; i <= last[0]; i++) {
     for (int j = first[1]; j <= last[1]; j++) {
       for (int k = first[2]; k <= last[2]; k++) {
@@ -367,60 +453,7 @@ void SODHalo::calculateMassProfile()
         // Index of first particle in bucket
         int p = this->buckets[i][j][k];
         while (p != -1) {
-          location[0] = this->xx[p];
-          location[1] = this->yy[p];
-          location[2] = this->zz[p];
-
-          // Calculate distance between this particle and the center
-          POSVEL_T diff[DIMENSION];
-          for (int dim = 0; dim < DIMENSION; dim++)
-            diff[dim] = location[dim] - this->fofCenterLocation[dim];
-
-          POSVEL_T dist = sqrt((diff[0] * diff[0]) +
-                               (diff[1] * diff[1]) +
-                               (diff[2] * diff[2]));
-
-          // If this particle is within the max radius
-          if (dist < this->maxRadius) {
-
-            // Calculate the unit vector for this particle
-            POSVEL_T unit[DIMENSION];
-            for (int dim = 0; dim < DIMENSION; dim++)
-              if (dist > 0.0)
-                unit[dim] = diff[dim] / dist;
-
-            // Calculate the relative velocity vector of particle wrt center
-            POSVEL_T relVel[DIMENSION];
-            relVel[0] = this->vx[p] - this->fofHaloVelocity[0];
-            relVel[1] = this->vy[p] - this->fofHaloVelocity[1];
-            relVel[2] = this->vz[p] - this->fofHaloVelocity[2];
-
-            // Calculate the radial velocity
-            POSVEL_T radVel = 0.0;
-            for (int dim = 0; dim < DIMENSION; dim++)
-              radVel += unit[dim] * relVel[dim];
-
-            // Calculate the bin this particle goes in
-            // Bin 0 contains all particles less than the min radius
-            int bin = 0;
-            if (dist > this->minRadius) {
-              bin = (int) (floor(log10(dist/this->minRadius) /
-                                    this->deltaRadius)) + 1;
-            }
-            if (bin >= this->numberOfBins) {
-              bin = this->numberOfBins - 1;
-            }
-            this->binCount[bin]++;
-            this->binMass[bin] += this->mass[p];
-            this->avgRadius[bin] += dist;
-            this->avgRadVelocity[bin] += radVel;
-
-            // Store the actual radius and index of particle on this processor
-            RadiusID pair;
-            pair.radius = dist;
-            pair.index = p;
-            this->binInfo[bin].push_back(pair);
-          }
+          binParticle(p, maxRadius2);
 
           // Next particle in bucket
           p = this->bucketList[p];
@@ -429,6 +462,10 @@ void SODHalo::calculateMassProfile()
     }
   }
 
+  // Particles fetched from other processors beyond the dead zone
+  for (int r = 0; r < this->remoteCount; r++)
+    binParticle((int) this->particleCount + r, maxRadius2);
+
   // Calculate the average radius per bin
   for (int bin = 0; bin < this->numberOfBins; bin++) {
     if (binCount[bin] > 0) {
@@ -436,6 +473,103 @@ void SODHalo::calculateMassProfile()
       avgRadVelocity[bin] /= binCount[bin];
     }
   }
+
+  // Offset of every bin from the counts, shifted by one so that the fill
+  // below leaves binStart[bin] pointing at the first particle of the bin
+  this->binStart[0] = 0;
+  this->binStart[1] = 0;
+  for (int bin = 1; bin < this->numberOfBins; bin++)
+    this->binStart[bin + 1] = this->binStart[bin] + this->binCount[bin - 1];
+
+  // Fill the particles into their bins keeping mesh order within a bin
+  int numberOfCandidates = (int) this->candidates.size();
+  this->binParticles.resize(numberOfCandidates);
+  for (int i = 0; i < numberOfCandidates; i++) {
+    int bin = this->candidateBin[i];
+    this->binParticles[this->binStart[bin + 1]++] = this->candidates[i];
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////
+//
+// Add a particle to its logarithmic bin if it is within the max radius
+// accumulating count, mass, radius and radial velocity for the bin
+//
+/////////////////////////////////////////////////////////////////////////
+
+void SODHalo::binParticle(int p, POSVEL_T maxRadius2)
+{
+  // Calculate distance between this particle and the center
+  POSVEL_T diff[DIMENSION];
+  diff[0] = xLoc(p) - this->fofCenterLocation[0];
+  diff[1] = yLoc(p) - this->fofCenterLocation[1];
+  diff[2] = zLoc(p) - this->fofCenterLocation[2];
+
+  POSVEL_T dist2 = (diff[0] * diff[0]) +
+                   (diff[1] * diff[1]) +
+                   (diff[2] * diff[2]);
+
+  // If this particle is within the max radius
+  if (dist2 >= maxRadius2)
+    return;
+
+  POSVEL_T dist = sqrt(dist2);
+
+  // Calculate the unit vector for this particle
+  POSVEL_T unit[DIMENSION];
+  for (int dim = 0; dim < DIMENSION; dim++)
+    unit[dim] = (dist > 0.0) ? diff[dim] / dist : 0.0;
+
+  // Calculate the relative velocity vector of particle wrt center
+  POSVEL_T relVel[DIMENSION];
+  relVel[0] = xVel(p) - this->fofHaloVelocity[0];
+  relVel[1] = yVel(p) - this->fofHaloVelocity[1];
+  relVel[2] = zVel(p) - this->fofHaloVelocity[2];
+
+  // Calculate the radial velocity
+  POSVEL_T radVel = 0.0;
+  for (int dim = 0; dim < DIMENSION; dim++)
+    radVel += unit[dim] * relVel[dim];
+
+  // Calculate the bin this particle goes in
+  // Bin 0 contains all particles less than the min radius
+  int bin = findBin(dist2);
+  this->binCount[bin]++;
+  this->binMass[bin] += pMass(p);
+  this->avgRadius[bin] += dist;
+  this->avgRadVelocity[bin] += radVel;
+
+  // Store the actual radius and index of particle on this processor
+  RadiusID pair;
+  pair.radius = dist;
+  pair.index = p;
+  this->candidates.push_back(pair);
+  this->candidateBin.push_back(bin);
+}
+
+/////////////////////////////////////////////////////////////////////////
+//
+// Return the bin for a particle at the given squared distance from the
+// center which is the number of squared outer bin edges below that
+// distance.  Bin 0 holds particles within the min radius and the last bin
+// holds everything beyond the edge before it.  Branch free binary search.
+//
+/////////////////////////////////////////////////////////////////////////
+
+int SODHalo::findBin(POSVEL_T dist2)
+{
+  // A single bin holds every particle
+  int n = this->numberOfBins - 1;
+  if (n == 0)
+    return 0;
+
+  const POSVEL_T* base = this->binEdge2;
+  while (n > 1) {
+    int half = n >> 1;
+    base = (base[half] < dist2) ? base + half : base;
+    n -= half;
+  }
+  return (int) (base - this->binEdge2) + (*base < dist2);
 }
 
 /////////////////////////////////////////////////////////////////////////
@@ -503,9 +637,11 @@ void SODHalo::calculateCharacteristicRadius()
     this->criticalBin = this->numberOfBins - 1;
   }
 
-  // Sort each bin's radius/id pair vector up to the critical bin
-  for (int bin = 0; bin <= criticalBin; bin++)
-    sort(this->binInfo[bin].begin(), this->binInfo[bin].end(), RadiusIDLT());
+  // Only the critical bin needs exact radius order because every particle
+  // in lower bins is inside the characteristic radius
+  vector<RadiusID>::iterator critical =
+    this->binParticles.begin() + this->binStart[this->criticalBin];
+  sort(critical, critical + this->binCount[this->criticalBin], RadiusIDLT());
 
   // Accumulate mass for all bins lower than the critical bin
   double totParticleMass = 0.0;
@@ -516,10 +652,10 @@ void SODHalo::calculateCharacteristicRadius()
   int i = 0;
   bool found = false;
 
-  while (i < (int) this->binInfo[this->criticalBin].size() && found == false) {
-    double r = (double) this->binInfo[this->criticalBin][i].radius;
-    int index = this->binInfo[this->criticalBin][i].index;
-    totParticleMass += (double) this->mass[index];
+  while (i < this->binCount[this->criticalBin] && found == false) {
+    double r = (double) critical[i].radius;
+    int index = critical[i].index;
+    totParticleMass += (double) pMass(index);
     double volume = ((4.0 * M_PI) / 3.0) * r * r * r;
     double ratio = (totParticleMass / volume) / this->RHOC;
 
@@ -557,61 +693,35 @@ void SODHalo::gatherSODParticles()
     this->centerOfMass[dim] = 0.0;
   }
 
-  // Iterate over all bins less than the critical bin collecting particles
+  // Bins are contiguous so all bins less than the critical bin followed by
+  // the critical bin up to the critical index are one range of particles
   this->numberOfParticles = 0;
   this->totalMass = 0.0;
 
-  for (int bin = 0; bin < this->criticalBin; bin++) {
-    for (int i = 0; i < (int) this->binInfo[bin].size(); i++) {
-      int p = this->binInfo[bin][i].index;
-
-      this->particleIndex[this->numberOfParticles] = p;
-      this->particleRadius[this->numberOfParticles] =
-        this->binInfo[bin][i].radius;
-      numberOfParticles++;
-      this->totalMass += (double) this->mass[p];
-
-      // Collect average location of SOD particles
-      this->avgLocation[0] += (double) this->xx[p];
-      this->avgLocation[1] += (double) this->yy[p];
-      this->avgLocation[2] += (double) this->zz[p];
-
-      // Collect center of mass of SOD particles
-      this->centerOfMass[0] += (double) this->xx[p] * (double) this->mass[p];
-      this->centerOfMass[1] += (double) this->yy[p] * (double) this->mass[p];
-      this->centerOfMass[2] += (double) this->zz[p] * (double) this->mass[p];
-
-      // Collect average velocity of SOD particles
-      this->avgVelocity[0] += (double) this->vx[p];
-      this->avgVelocity[1] += (double) this->vy[p];
-      this->avgVelocity[2] += (double) this->vz[p];
-    }
-  }
-
-  // Iterate over the critical bin to the critical index
-  for (int i = 0; i < this->criticalIndex; i++) {
-    int p = this->binInfo[criticalBin][i].index;
+  int lastParticle = this->binStart[this->criticalBin] + this->criticalIndex;
+  for (int i = 0; i < lastParticle; i++) {
+    int p = this->binParticles[i].index;
 
     this->particleIndex[this->numberOfParticles] = p;
     this->particleRadius[this->numberOfParticles] =
-      this->binInfo[criticalBin][i].radius;
+      this->binParticles[i].radius;
     this->numberOfParticles++;
-    this->totalMass += (double) this->mass[p];
+    this->totalMass += (double) pMass(p);
 
     // Collect average location of SOD particles
-    this->avgLocation[0] += (double) this->xx[p];
-    this->avgLocation[1] += (double) this->yy[p];
-    this->avgLocation[2] += (double) this->zz[p];
+    this->avgLocation[0] += (double) xLoc(p);
+    this->avgLocation[1] += (double) yLoc(p);
+    this->avgLocation[2] += (double) zLoc(p);
 
     // Collect center of mass of SOD particles
-    this->centerOfMass[0] += (double) this->xx[p] * (double) this->mass[p];
-    this->centerOfMass[1] += (double) this->yy[p] * (double) this->mass[p];
-    this->centerOfMass[2] += (double) this->zz[p] * (double) this->mass[p];
+    this->centerOfMass[0] += (double) xLoc(p) * (double) pMass(p);
+    this->centerOfMass[1] += (double) yLoc(p) * (double) pMass(p);
+    this->centerOfMass[2] += (double) zLoc(p) * (double) pMass(p);
 
     // Collect average velocity of SOD particles
-    this->avgVelocity[0] += (double) this->vx[p];
-    this->avgVelocity[1] += (double) this->vy[p];
-    this->avgVelocity[2] += (double) this->vz[p];
+    this->avgVelocity[0] += (double) xVel(p);
+    this->avgVelocity[1] += (double) yVel(p);
+    this->avgVelocity[2] += (double) zVel(p);
   }
 
   for (int dim = 0; dim < DIMENSION; dim++) {
@@ -643,14 +753,14 @@ void SODHalo::extractInformation(
     int p = this->particleIndex[i];
     radius[i] = this->particleRadius[i];
 
-    xLocHalo[i] = this->xx[p];
-    yLocHalo[i] = this->yy[p];
-    zLocHalo[i] = this->zz[p];
-    xVelHalo[i] = this->vx[p];
-    yVelHalo[i] = this->vy[p];
-    zVelHalo[i] = this->vz[p];
-    massHalo[i] = this->mass[p];
-    id[i] = this->tag[p];
+    xLocHalo[i] = xLoc(p);
+    yLocHalo[i] = yLoc(p);
+    zLocHalo[i] = zLoc(p);
+    xVelHalo[i] = xVel(p);
+    yVelHalo[i] = yVel(p);
+    zVelHalo[i] = zVel(p);
+    massHalo[i] = pMass(p);
+    id[i] = pTag(p);
     actualIndx[i] = p;
   }
 }
@@ -666,7 +776,7 @@ void SODHalo::calculateVelocityDispersion()
   POSVEL_T particleDot = 0.0;
   for (int i = 0; i < this->numberOfParticles; i++) {
     int p = this->particleIndex[i];
-    particleDot += dotProduct(this->vx[p], this->vy[p], this->vz[p]);
+    particleDot += dotProduct(xVel(p), yVel(p), zVel(p));
   }
 
   // Average of all the dot products
@@ -690,7 +800,7 @@ void SODHalo::calculateMass()
   this->totalMass = 0.0;
   for (int i = 0; i < this->numberOfParticles; i++) {
     int p = this->particleIndex[i];
-    this->totalMass += this->mass[p];
+    this->totalMass += pMass(p);
   }
 }
 
@@ -81,10 +81,39 @@ public:
   }
 };
 
+///////////////////////////////////////////////////////////////////////////
+//
+// Properties of one SOD halo copied out of the SODHalo workspace so that
+// halos can be processed concurrently and written after all are done
+//
+///////////////////////////////////////////////////////////////////////////
+
+struct SODProperties {
+  long     count;                       // Particles in SOD, 0 if no SOD
+  int      fofCenter;                   // Index of FOF center particle
+  POSVEL_T radius;                      // Characteristic radius
+  POSVEL_T mass;                        // Mass within radius
+  POSVEL_T minPotLocation[DIMENSION];   // MBP or MCP of SOD particles
+  POSVEL_T centerOfMass[DIMENSION];
+  POSVEL_T avgLocation[DIMENSION];
+  POSVEL_T avgVelocity[DIMENSION];
+  POSVEL_T velDisp;
+
+  vector<int>      binCount;            // Number per bin
+  vector<POSVEL_T> binMass;             // Mass per bin
+  vector<POSVEL_T> binRadius;           // Radius of bin
+  vector<POSVEL_T> binRho;              // total mass / volume at radius
+  vector<POSVEL_T> binRhoRatio;         // rho / rho_c
+  vector<POSVEL_T> binRadVelocity;      // avg radial velocity
+};
+
 ///////////////////////////////////////////////////////////////////////////
 //
 // SOD Halo creation using either exact density or approximate with bins
 //
+// One SODHalo may be reused for any number of halos and only reads the
+// chaining mesh and particles so one workspace per thread can share them
+//
 ///////////////////////////////////////////////////////////////////////////
 
 
@@ -117,6 +146,20 @@ public:
         vector<POSVEL_T>* pmass,
         vector<ID_T>* id);
 
+  // Set particles fetched from other processors which complete the sphere
+  // of the next halo beyond the dead zone, so max radius is not reduced
+  void setRemoteParticles(
+        long count,
+        POSVEL_T* xLoc,
+        POSVEL_T* yLoc,
+        POSVEL_T* zLoc,
+        POSVEL_T* xVel,
+        POSVEL_T* yVel,
+        POSVEL_T* zVel,
+        POSVEL_T* pmass,
+        ID_T* id);
+  void clearRemoteParticles();
+
   /////////////////////////////////////////////////////////////////////
   //
   // SOD (Spherical over density) halo analysis
@@ -137,6 +180,9 @@ public:
   // Create the SOD mass profile used to calculate characteristic radius
   void calculateMassProfile();
 
+  // Add one particle within the max radius to the mass profile
+  void binParticle(int p, POSVEL_T maxRadius2);
+
   // Calculate the characteristic radius of an SOD halo
   void calculateCharacteristicRadius();
 
@@ -150,6 +196,9 @@ public:
   // Calculate mass
   void calculateMass();
 
+  // Bin of a particle from its squared distance to the center
+  int findBin(POSVEL_T dist2);
+
   // Utilities
   POSVEL_T dotProduct(POSVEL_T x, POSVEL_T y, POSVEL_T z);
   void spline(
@@ -177,6 +226,7 @@ public:
         POSVEL_T* bRadVelocity);
 
   // Extract information for all particles in SOD halo
+  // Indices at or past the processor particle count are remote particles
   void extractInformation(
         int* actualIndx,
         POSVEL_T* xLocHalo,
@@ -190,6 +240,25 @@ public:
         ID_T* tag);
 
 private:
+  // Particle values by index, indices past the particles on this
+  // processor refer to the remote particles of the current halo
+  POSVEL_T xLoc(int p)  { return (p < this->particleCount) ?
+                          this->xx[p] : this->remoteXX[p - particleCount]; }
+  POSVEL_T yLoc(int p)  { return (p < this->particleCount) ?
+                          this->yy[p] : this->remoteYY[p - particleCount]; }
+  POSVEL_T zLoc(int p)  { return (p < this->particleCount) ?
+                          this->zz[p] : this->remoteZZ[p - particleCount]; }
+  POSVEL_T xVel(int p)  { return (p < this->particleCount) ?
+                          this->vx[p] : this->remoteVX[p - particleCount]; }
+  POSVEL_T yVel(int p)  { return (p < this->particleCount) ?
+                          this->vy[p] : this->remoteVY[p - particleCount]; }
+  POSVEL_T zVel(int p)  { return (p < this->particleCount) ?
+                          this->vz[p] : this->remoteVZ[p - particleCount]; }
+  POSVEL_T pMass(int p) { return (p < this->particleCount) ?
+                          this->mass[p] : this->remoteMass[p - particleCount]; }
+  ID_T pTag(int p)      { return (p < this->particleCount) ?
+                          this->tag[p] : this->remoteTag[p - particleCount]; }
+
   int    myProc;                // My processor number
   int    numProc;               // Total number of processors
 
@@ -217,6 +286,17 @@ private:
   POSVEL_T* mass;               // Mass of particles on this processor
   ID_T* tag;                    // Tag of particles on this processor
 
+  bool   remoteComplete;        // Remote particles complete the sphere
+  long   remoteCount;           // Remote particles for the current halo
+  POSVEL_T* remoteXX;           // X location in frame of the halo center
+  POSVEL_T* remoteYY;           // Y location in frame of the halo center
+  POSVEL_T* remoteZZ;           // Z location in frame of the halo center
+  POSVEL_T* remoteVX;           // X velocity of remote particles
+  POSVEL_T* remoteVY;           // Y velocity of remote particles
+  POSVEL_T* remoteVZ;           // Z velocity of remote particles
+  POSVEL_T* remoteMass;         // Mass of remote particles
+  ID_T* remoteTag;              // Tag of remote particles
+
   // Information about this SOD halo
   POSVEL_T initRadius;          // First guess at radius based on FOF size
   POSVEL_T minRadius;           // Smallest radius to bin spheres on
@@ -231,7 +311,12 @@ private:
   double* avgRadius;            // Average radius of particles assigned to bin
   double* avgRadVelocity;       // Average radial velocity of particles in bin
   POSVEL_T* binRadius;          // Max radius of a log bin
-  vector<RadiusID>* binInfo;    // Particles in bin with radius
+  POSVEL_T* binEdge2;           // Squared outer edge of each log bin
+  int*    binStart;             // Offset of first bin particle in binParticles
+
+  vector<RadiusID> binParticles;// Particles with radius grouped by bin
+  vector<RadiusID> candidates;  // Particles within max radius in mesh order
+  vector<int> candidateBin;     // Bin of every candidate particle
 
   int criticalBin;              // Bin holding the critical density ratio
   int criticalIndex;            // Index in critical bin of critical radius
@@ -0,0 +1,561 @@
+/*=========================================================================
+                                                                                
+Copyright (c) 2007, Los Alamos National Security, LLC
+
+All rights reserved.
+
+Copyright 2007. Los Alamos National Security, LLC. 
+This software was produced under U.S. Government contract DE-AC52-06NA25396 
+for Los Alamos National Laboratory (LANL), which is operated by 
+Los Alamos National Security, LLC for the U.S. Department of Energy. 
+The U.S. Government has rights to use, reproduce, and distribute this software. 
+NEITHER THE GOVERNMENT NOR LOS ALAMOS NATIONAL SECURITY, LLC MAKES ANY WARRANTY,
+EXPRESS OR IMPLIED, OR ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  
+If software is modified to produce derivative works, such modified software 
+should be clearly marked, so as not to confuse it with the version available 
+from LANL.
+ 
+Additionally, redistribution and use in source and binary forms, with or 
+without modification, are permitted provided that the following conditions 
+are met:
+-   Redistributions of source code must retain the above copyright notice, 
+    this list of conditions and the following disclaimer. 
+-   Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution. 
+-   Neither the name of Los Alamos National Security, LLC, Los Alamos National
+    Laboratory, LANL, the U.S. Government, nor the names of its contributors
+    may be used to endorse or promote products derived from this software 
+    without specific prior written permission. 
+
+THIS SOFTWARE IS PROVIDED BY LOS ALAMOS NATIONAL SECURITY, LLC AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ARE DISCLAIMED. IN NO EVENT SHALL LOS ALAMOS NATIONAL SECURITY, LLC OR 
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+                                                                                
+=========================================================================*/
+
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include <mpi.h>
+
+#include "Partition.h"
+#include "SphereExchange.h"
+
+using namespace std;
+
+namespace cosmologytools {
+
+// Query is center, radius and the region held by the asking processor
+const int QUERY_SIZE = DIMENSION + 1 + DIMENSION + DIMENSION;
+
+// Floats sent per particle are location, velocity and mass
+const int SPHERE_FLOAT = 2 * DIMENSION + 1;
+
+// Message tags for queries and the three parts of an answer
+const int SPHERE_QUERY_TAG = 110;
+const int SPHERE_INDEX_TAG = 111;
+const int SPHERE_ID_TAG = 112;
+const int SPHERE_FLOAT_TAG = 113;
+
+/////////////////////////////////////////////////////////////////////////
+//
+// SphereExchange gathers spheres which reach past the particles on this
+// processor and fetches the missing particles from the processors which
+// own them as ALIVE
+//
+/////////////////////////////////////////////////////////////////////////
+
+SphereExchange::SphereExchange()
+{
+  // Get the number of processors running this problem and rank
+  this->numProc = Partition::getNumProc();
+  this->myProc = Partition::getMyProc();
+
+  this->resultStart.push_back(0);
+}
+
+SphereExchange::~SphereExchange()
+{
+}
+
+/////////////////////////////////////////////////////////////////////////
+//
+// Set the chaining mesh of all particles on this processor and the sizes
+// needed to know the alive region and wraparound
+//
+/////////////////////////////////////////////////////////////////////////
+
+void SphereExchange::setParameters(
+                        ChainingMesh* chainMesh,
+                        POSVEL_T rL,
+                        POSVEL_T deadSz)
+{
+  this->chain = chainMesh;
+  this->buckets = chainMesh->getBuckets();
+  this->bucketList = chainMesh->getBucketList();
+
+  this->boxSize = rL;
+  this->deadSize = deadSz;
+
+  for (int dim = 0; dim < DIMENSION; dim++) {
+    this->minRange[dim] = chainMesh->getMinMine(dim);
+    this->maxRange[dim] = chainMesh->getMaxMine(dim);
+    this->minAlive[dim] = this->minRange[dim] + this->deadSize;
+    this->maxAlive[dim] = this->maxRange[dim] - this->deadSize;
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////
+//
+// Set the particle vectors holding alive and dead particles
+//
+/////////////////////////////////////////////////////////////////////////
+
+void SphereExchange::setParticles(
+                        vector<POSVEL_T>* xLoc,
+                        vector<POSVEL_T>* yLoc,
+                        vector<POSVEL_T>* zLoc,
+                        vector<POSVEL_T>* xVel,
+                        vector<POSVEL_T>* yVel,
+                        vector<POSVEL_T>* zVel,
+                        vector<POSVEL_T>* pmass,
+                        vector<ID_T>* id,
+                        vector<STATUS_T>* state)
+{
+  this->xx = &(*xLoc)[0];
+  this->yy = &(*yLoc)[0];
+  this->zz = &(*zLoc)[0];
+  this->vx = &(*xVel)[0];
+  this->vy = &(*yVel)[0];
+  this->vz = &(*zVel)[0];
+  this->mass = &(*pmass)[0];
+  this->tag = &(*id)[0];
+  this->status = &(*state)[0];
+}
+
+/////////////////////////////////////////////////////////////////////////
+//
+// A sphere can be completed locally only if it fits inside the alive and
+// dead particles held on this processor
+//
+/////////////////////////////////////////////////////////////////////////
+
+bool SphereExchange::exceedsRegion(POSVEL_T* center, POSVEL_T radius)
+{
+  for (int dim = 0; dim < DIMENSION; dim++) {
+    if (center[dim] - radius < this->minRange[dim] ||
+        center[dim] + radius > this->maxRange[dim])
+      return true;
+  }
+  return false;
+}
+
+/////////////////////////////////////////////////////////////////////////
+//
+// Queue a sphere for the next exchange
+//
+/////////////////////////////////////////////////////////////////////////
+
+int SphereExchange::addQuery(POSVEL_T* center, POSVEL_T radius)
+{
+  for (int dim = 0; dim < DIMENSION; dim++)
+    this->queryCenter.push_back(center[dim]);
+  this->queryRadius.push_back(radius);
+  return (int) this->queryRadius.size() - 1;
+}
+
+/////////////////////////////////////////////////////////////////////////
+//
+// Range of processor positions which wraps all the way around a dimension
+// covers every processor once, otherwise positions are wrapped when used
+//
+/////////////////////////////////////////////////////////////////////////
+
+static void wrapRange(int* firstPos, int* lastPos, int* layoutSize,
+                      int* first, int* last)
+{
+  for (int dim = 0; dim < DIMENSION; dim++) {
+    first[dim] = firstPos[dim];
+    last[dim] = lastPos[dim];
+    if (last[dim] - first[dim] + 1 >= layoutSize[dim]) {
+      first[dim] = 0;
+      last[dim] = layoutSize[dim] - 1;
+    }
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////
+//
+// Every processor sends each query only to the processors whose alive
+// region, widened by the dead zone, overlaps the sphere.  The largest
+// radius on any processor bounds how far a query can reach, so every
+// processor knows the neighborhood of the Cartesian topology which may
+// query it and exchanges (possibly empty) query messages with just those.
+// Answers go back point to point only to processors which asked.
+//
+/////////////////////////////////////////////////////////////////////////
+
+void SphereExchange::exchangeQueries()
+{
+  MPI_Comm comm = Partition::getComm();
+  int numberOfQueries = (int) this->queryRadius.size();
+
+  // Largest sphere on any processor decides the neighborhood to talk to
+  POSVEL_T myMaxRadius = -1.0;
+  for (int q = 0; q < numberOfQueries; q++)
+    if (this->queryRadius[q] > myMaxRadius)
+      myMaxRadius = this->queryRadius[q];
+
+  POSVEL_T maxRadius;
+  MPI_Allreduce(&myMaxRadius, &maxRadius, 1, MPI_POSVEL_T, MPI_MAX, comm);
+
+  this->resultStart.assign(numberOfQueries + 1, 0);
+  if (maxRadius < 0.0)
+    return;
+
+  // Processors within reach of the spheres along each dimension.  A center
+  // lies at most deadSize outside the alive region and a target is widened
+  // by deadSize, so the reach is the radius plus two dead zones.
+  int layoutSize[DIMENSION], layoutPos[DIMENSION];
+  int firstReach[DIMENSION], lastReach[DIMENSION];
+  POSVEL_T boxStep[DIMENSION];
+  Partition::getDecompSize(layoutSize);
+  Partition::getMyPosition(layoutPos);
+
+  for (int dim = 0; dim < DIMENSION; dim++) {
+    boxStep[dim] = this->boxSize / layoutSize[dim];
+    int reach = (int) ceil((maxRadius + 2.0 * this->deadSize) / boxStep[dim]);
+    firstReach[dim] = layoutPos[dim] - reach;
+    lastReach[dim] = layoutPos[dim] + reach;
+  }
+
+  // Neighborhood is symmetric because every processor uses the same reach
+  vector<int> neighborProc;
+  map<int, int> neighborSlot;
+  int first[DIMENSION], last[DIMENSION];
+  wrapRange(firstReach, lastReach, layoutSize, first, last);
+
+  for (int i = first[0]; i <= last[0]; i++) {
+    for (int j = first[1]; j <= last[1]; j++) {
+      for (int k = first[2]; k <= last[2]; k++) {
+        int proc = Partition::getNeighbor(
+                        (i + layoutSize[0]) % layoutSize[0],
+                        (j + layoutSize[1]) % layoutSize[1],
+                        (k + layoutSize[2]) % layoutSize[2]);
+        if (neighborSlot.find(proc) == neighborSlot.end()) {
+          neighborSlot[proc] = (int) neighborProc.size();
+          neighborProc.push_back(proc);
+        }
+      }
+    }
+  }
+  int numberOfNeighbors = (int) neighborProc.size();
+
+  // Pack center, radius and the region held here for every query, once
+  // for each processor whose widened alive region the sphere overlaps
+  vector<vector<POSVEL_T> > sendQueries(numberOfNeighbors);
+  vector<vector<int> > askedQuery(numberOfNeighbors);
+  vector<int> lastAsked(numberOfNeighbors, -1);
+
+  for (int q = 0; q < numberOfQueries; q++) {
+    POSVEL_T query[QUERY_SIZE];
+    int firstCell[DIMENSION], lastCell[DIMENSION];
+    for (int dim = 0; dim < DIMENSION; dim++) {
+      query[dim] = this->queryCenter[q * DIMENSION + dim];
+      query[DIMENSION + 1 + dim] = this->minRange[dim];
+      query[2 * DIMENSION + 1 + dim] = this->maxRange[dim];
+
+      POSVEL_T reach = this->queryRadius[q] + this->deadSize;
+      firstCell[dim] = (int) floor((query[dim] - reach) / boxStep[dim]);
+      lastCell[dim] = (int) floor((query[dim] + reach) / boxStep[dim]);
+      if (firstCell[dim] < firstReach[dim])
+        firstCell[dim] = firstReach[dim];
+      if (lastCell[dim] > lastReach[dim])
+        lastCell[dim] = lastReach[dim];
+    }
+    query[DIMENSION] = this->queryRadius[q];
+    wrapRange(firstCell, lastCell, layoutSize, first, last);
+
+    for (int i = first[0]; i <= last[0]; i++) {
+      for (int j = first[1]; j <= last[1]; j++) {
+        for (int k = first[2]; k <= last[2]; k++) {
+          int proc = Partition::getNeighbor(
+                        (i + layoutSize[0]) % layoutSize[0],
+                        (j + layoutSize[1]) % layoutSize[1],
+                        (k + layoutSize[2]) % layoutSize[2]);
+          int n = neighborSlot[proc];
+          if (lastAsked[n] == q)
+            continue;
+          lastAsked[n] = q;
+          sendQueries[n].insert(sendQueries[n].end(), query, query + QUERY_SIZE);
+          askedQuery[n].push_back(q);
+        }
+      }
+    }
+  }
+
+  // Every neighbor gets a query message even when it is empty
+  vector<MPI_Request> requests;
+  for (int n = 0; n < numberOfNeighbors; n++) {
+    int size = (int) sendQueries[n].size();
+    sendQueries[n].push_back(0.0);
+    MPI_Request request;
+    MPI_Isend(&sendQueries[n][0], size, MPI_POSVEL_T, neighborProc[n],
+              SPHERE_QUERY_TAG, comm, &request);
+    requests.push_back(request);
+  }
+
+  // Answer queries packing particles by asking processor
+  vector<vector<POSVEL_T> > sendFloats(numberOfNeighbors);
+  vector<vector<ID_T> > sendIds(numberOfNeighbors);
+  vector<vector<int> > sendIndex(numberOfNeighbors);
+  MPI_Status mpistatus;
+
+  for (int n = 0; n < numberOfNeighbors; n++) {
+    int size;
+    MPI_Probe(neighborProc[n], SPHERE_QUERY_TAG, comm, &mpistatus);
+    MPI_Get_count(&mpistatus, MPI_POSVEL_T, &size);
+    vector<POSVEL_T> queries(size + 1);
+    MPI_Recv(&queries[0], size, MPI_POSVEL_T, neighborProc[n],
+             SPHERE_QUERY_TAG, comm, &mpistatus);
+
+    // Nothing goes back to a processor which asked nothing
+    if (size == 0)
+      continue;
+
+    for (int q = 0; q < size / QUERY_SIZE; q++)
+      answerQuery(&queries[q * QUERY_SIZE], q,
+                  sendFloats[n], sendIds[n], sendIndex[n]);
+
+    // Extra element keeps the buffers addressable when nothing is found
+    int count = (int) sendIndex[n].size();
+    sendFloats[n].push_back(0.0);
+    sendIds[n].push_back(0);
+    sendIndex[n].push_back(0);
+
+    MPI_Request request;
+    MPI_Isend(&sendIndex[n][0], count, MPI_INT, neighborProc[n],
+              SPHERE_INDEX_TAG, comm, &request);
+    requests.push_back(request);
+    MPI_Isend(&sendIds[n][0], count, MPI_ID_T, neighborProc[n],
+              SPHERE_ID_TAG, comm, &request);
+    requests.push_back(request);
+    MPI_Isend(&sendFloats[n][0], count * SPHERE_FLOAT, MPI_POSVEL_T,
+              neighborProc[n], SPHERE_FLOAT_TAG, comm, &request);
+    requests.push_back(request);
+  }
+
+  // Collect answers from the processors which were asked
+  vector<POSVEL_T> recvFloats;
+  vector<ID_T> recvIds;
+  vector<int> recvIndex;
+
+  for (int n = 0; n < numberOfNeighbors; n++) {
+    if (askedQuery[n].empty())
+      continue;
+
+    int count;
+    MPI_Probe(neighborProc[n], SPHERE_INDEX_TAG, comm, &mpistatus);
+    MPI_Get_count(&mpistatus, MPI_INT, &count);
+
+    int before = (int) recvIndex.size();
+    recvIndex.resize(before + count + 1);
+    recvIds.resize(before + count + 1);
+    recvFloats.resize((before + count) * SPHERE_FLOAT + 1);
+
+    MPI_Recv(&recvIndex[before], count, MPI_INT, neighborProc[n],
+             SPHERE_INDEX_TAG, comm, &mpistatus);
+    MPI_Recv(&recvIds[before], count, MPI_ID_T, neighborProc[n],
+             SPHERE_ID_TAG, comm, &mpistatus);
+    MPI_Recv(&recvFloats[before * SPHERE_FLOAT], count * SPHERE_FLOAT,
+             MPI_POSVEL_T, neighborProc[n], SPHERE_FLOAT_TAG, comm, &mpistatus);
+
+    // Index is the position in the message, map it back to the query
+    for (int i = before; i < before + count; i++)
+      recvIndex[i] = askedQuery[n][recvIndex[i]];
+    recvIndex.pop_back();
+    recvIds.pop_back();
+    recvFloats.pop_back();
+  }
+  int totalToRecv = (int) recvIndex.size();
+
+  MPI_Waitall((int) requests.size(), &requests[0], MPI_STATUSES_IGNORE);
+
+  // Group received particles by query, count then fill
+  this->resultStart.assign(numberOfQueries + 2, 0);
+  for (int i = 0; i < totalToRecv; i++)
+    this->resultStart[recvIndex[i] + 2]++;
+  for (int q = 0; q < numberOfQueries; q++)
+    this->resultStart[q + 2] += this->resultStart[q + 1];
+
+  this->xRemote.resize(totalToRecv);
+  this->yRemote.resize(totalToRecv);
+  this->zRemote.resize(totalToRecv);
+  this->vxRemote.resize(totalToRecv);
+  this->vyRemote.resize(totalToRecv);
+  this->vzRemote.resize(totalToRecv);
+  this->massRemote.resize(totalToRecv);
+  this->tagRemote.resize(totalToRecv);
+
+  for (int i = 0; i < totalToRecv; i++) {
+    long r = this->resultStart[recvIndex[i] + 1]++;
+    POSVEL_T* f = &recvFloats[i * SPHERE_FLOAT];
+    this->xRemote[r] = f[0];
+    this->yRemote[r] = f[1];
+    this->zRemote[r] = f[2];
+    this->vxRemote[r] = f[3];
+    this->vyRemote[r] = f[4];
+    this->vzRemote[r] = f[5];
+    this->massRemote[r] = f[6];
+    this->tagRemote[r] = recvIds[i];
+  }
+  this->resultStart.pop_back();
+
+#ifdef DEBUG
+  cout << "Rank: " << this->myProc << " exchanged queries with "
+       << numberOfNeighbors << " processors and received " << totalToRecv
+       << " sphere particles for " << numberOfQueries << " queries" << endl;
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////
+//
+// Collect ALIVE particles on this processor within the query sphere for
+// every wraparound image of the center.  Locations are shifted back into
+// the frame of the query center and particles the asking processor
+// already holds in its alive and dead region are skipped.
+//
+/////////////////////////////////////////////////////////////////////////
+
+void SphereExchange::answerQuery(
+                        POSVEL_T* query,
+                        int queryIndex,
+                        vector<POSVEL_T>& floats,
+                        vector<ID_T>& ids,
+                        vector<int>& index)
+{
+  POSVEL_T* center = &query[0];
+  POSVEL_T radius = query[DIMENSION];
+  POSVEL_T* askMin = &query[DIMENSION + 1];
+  POSVEL_T* askMax = &query[2 * DIMENSION + 1];
+  POSVEL_T radius2 = radius * radius;
+  POSVEL_T chainSize = this->chain->getChainSize();
+
+  for (int ix = -1; ix <= 1; ix++) {
+    for (int iy = -1; iy <= 1; iy++) {
+      for (int iz = -1; iz <= 1; iz++) {
+        POSVEL_T shift[DIMENSION];
+        shift[0] = ix * this->boxSize;
+        shift[1] = iy * this->boxSize;
+        shift[2] = iz * this->boxSize;
+
+        // Skip images of the sphere which miss the alive region
+        POSVEL_T image[DIMENSION];
+        bool overlap = true;
+        for (int dim = 0; dim < DIMENSION; dim++) {
+          image[dim] = center[dim] + shift[dim];
+          if (image[dim] - radius > this->maxAlive[dim] ||
+              image[dim] + radius < this->minAlive[dim])
+            overlap = false;
+        }
+        if (overlap == false)
+          continue;
+
+        // Range of buckets covering the sphere
+        int first[DIMENSION], last[DIMENSION];
+        for (int dim = 0; dim < DIMENSION; dim++) {
+          first[dim] = (int) ((image[dim] - radius - this->minRange[dim]) /
+                              chainSize);
+          last[dim] = (int) ((image[dim] + radius - this->minRange[dim]) /
+                             chainSize);
+          if (first[dim] < 0)
+            first[dim] = 0;
+          if (last[dim] >= this->chain->getMeshSize(dim))
+            last[dim] = this->chain->getMeshSize(dim) - 1;
+        }
+
+        for (int i = first[0]; i <= last[0]; i++) {
+          for (int j = first[1]; j <= last[1]; j++) {
+            for (int k = first[2]; k <= last[2]; k++) {
+
+              int p = this->buckets[i][j][k];
+              while (p != -1) {
+                if (this->status[p] == ALIVE) {
+                  POSVEL_T loc[DIMENSION];
+                  loc[0] = this->xx[p];
+                  loc[1] = this->yy[p];
+                  loc[2] = this->zz[p];
+
+                  POSVEL_T dist2 = 0.0;
+                  for (int dim = 0; dim < DIMENSION; dim++) {
+                    POSVEL_T diff = loc[dim] - image[dim];
+                    dist2 += diff * diff;
+                  }
+
+                  // Location in the frame of the asking processor
+                  bool held = true;
+                  for (int dim = 0; dim < DIMENSION; dim++) {
+                    loc[dim] -= shift[dim];
+                    if (loc[dim] < askMin[dim] || loc[dim] > askMax[dim])
+                      held = false;
+                  }
+
+                  if (dist2 < radius2 && held == false) {
+                    floats.push_back(loc[0]);
+                    floats.push_back(loc[1]);
+                    floats.push_back(loc[2]);
+                    floats.push_back(this->vx[p]);
+                    floats.push_back(this->vy[p]);
+                    floats.push_back(this->vz[p]);
+                    floats.push_back(this->mass[p]);
+                    ids.push_back(this->tag[p]);
+                    index.push_back(queryIndex);
+                  }
+                }
+                p = this->bucketList[p];
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////
+//
+// Access the particles returned for one query
+//
+/////////////////////////////////////////////////////////////////////////
+
+long SphereExchange::getResultCount(int query)
+{
+  return this->resultStart[query + 1] - this->resultStart[query];
+}
+
+POSVEL_T* SphereExchange::resultData(vector<POSVEL_T>& data, int query)
+{
+  if (getResultCount(query) == 0)
+    return 0;
+  return &data[this->resultStart[query]];
+}
+
+ID_T* SphereExchange::getTag(int query)
+{
+  if (getResultCount(query) == 0)
+    return 0;
+  return &this->tagRemote[this->resultStart[query]];
+}
+
+}
@@ -0,0 +1,173 @@
+/*=========================================================================
+                                                                                
+Copyright (c) 2007, Los Alamos National Security, LLC
+
+All rights reserved.
+
+Copyright 2007. Los Alamos National Security, LLC. 
+This software was produced under U.S. Government contract DE-AC52-06NA25396 
+for Los Alamos National Laboratory (LANL), which is operated by 
+Los Alamos National Security, LLC for the U.S. Department of Energy. 
+The U.S. Government has rights to use, reproduce, and distribute this software. 
+NEITHER THE GOVERNMENT NOR LOS ALAMOS NATIONAL SECURITY, LLC MAKES ANY WARRANTY,
+EXPRESS OR IMPLIED, OR ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  
+If software is modified to produce derivative works, such modified software 
+should be clearly marked, so as not to confuse it with the version available 
+from LANL.
+ 
+Additionally, redistribution and use in source and binary forms, with or 
+without modification, are permitted provided that the following conditions 
+are met:
+-   Redistributions of source code must retain the above copyright notice, 
+    this list of conditions and the following disclaimer. 
+-   Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution. 
+-   Neither the name of Los Alamos National Security, LLC, Los Alamos National
+    Laboratory, LANL, the U.S. Government, nor the names of its contributors
+    may be used to endorse or promote products derived from this software 
+    without specific prior written permission. 
+
+THIS SOFTWARE IS PROVIDED BY LOS ALAMOS NATIONAL SECURITY, LLC AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ARE DISCLAIMED. IN NO EVENT SHALL LOS ALAMOS NATIONAL SECURITY, LLC OR 
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+                                                                                
+=========================================================================*/
+
+// .NAME SphereExchange - fetch particles in spheres reaching past the
+//                        dead zone of this processor from other processors
+//
+// .SECTION Description
+// Analysis such as SOD halos needs every particle within some radius of a
+// center.  When that sphere reaches past the dead (overload) zone of the
+// processor, the particles beyond it live only on other processors.
+// SphereExchange collects such spheres as queries, sends each query only
+// to the processors whose alive region plus dead zone it overlaps, and
+// each of those answers with its ALIVE particles in the sphere which lie
+// outside the region held by the asking processor.  Locations are returned
+// in the frame of the query center so that wraparound is already applied.
+//
+// Queries and answers travel point to point within the neighborhood of the
+// Cartesian topology reached by the largest sphere, so only the few spheres
+// near processor edges cost communication, and the dead zone can be kept
+// small on every processor.
+//
+
+#ifndef SphereExchange_h
+#define SphereExchange_h
+
+#include "Definition.h"
+#include "ChainingMesh.h"
+
+#include <vector>
+
+using std::vector;
+
+namespace cosmologytools {
+
+class SphereExchange {
+public:
+  SphereExchange();
+  ~SphereExchange();
+
+  // Set parameters for the region held on this processor
+  void setParameters(
+        ChainingMesh* chain,    // Buckets of alive and dead particles
+        POSVEL_T rL,            // Box size of the physical problem
+        POSVEL_T deadSize);     // Dead delta border for each processor
+
+  // Set alive and dead particle vectors which were created elsewhere
+  void setParticles(
+        vector<POSVEL_T>* xLoc,
+        vector<POSVEL_T>* yLoc,
+        vector<POSVEL_T>* zLoc,
+        vector<POSVEL_T>* xVel,
+        vector<POSVEL_T>* yVel,
+        vector<POSVEL_T>* zVel,
+        vector<POSVEL_T>* pmass,
+        vector<ID_T>* id,
+        vector<STATUS_T>* state);
+
+  // Sphere reaches outside of the particles held on this processor
+  bool exceedsRegion(POSVEL_T* center, POSVEL_T radius);
+
+  // Queue a sphere and return the index used to retrieve its particles
+  int addQuery(POSVEL_T* center, POSVEL_T radius);
+
+  // Send queued spheres to the processors they overlap and collect answers
+  // Must be called by every processor even with no queries
+  void exchangeQueries();
+
+  // Answer one query from any processor with matching ALIVE particles
+  void answerQuery(
+        POSVEL_T* query,        // Center, radius and asking region
+        int queryIndex,         // Index of query on asking processor
+        vector<POSVEL_T>& floats,
+        vector<ID_T>& ids,
+        vector<int>& index);
+
+  // Particles returned for a query
+  long getResultCount(int query);
+  POSVEL_T* getXLoc(int query)  { return resultData(this->xRemote, query); }
+  POSVEL_T* getYLoc(int query)  { return resultData(this->yRemote, query); }
+  POSVEL_T* getZLoc(int query)  { return resultData(this->zRemote, query); }
+  POSVEL_T* getXVel(int query)  { return resultData(this->vxRemote, query); }
+  POSVEL_T* getYVel(int query)  { return resultData(this->vyRemote, query); }
+  POSVEL_T* getZVel(int query)  { return resultData(this->vzRemote, query); }
+  POSVEL_T* getMass(int query)  { return resultData(this->massRemote, query); }
+  ID_T* getTag(int query);
+
+  int getNumberOfQueries()      { return (int) this->queryRadius.size(); }
+
+private:
+  POSVEL_T* resultData(vector<POSVEL_T>& data, int query);
+
+  int    myProc;                // My processor number
+  int    numProc;               // Total number of processors
+
+  POSVEL_T boxSize;             // Physical box size (rL)
+  POSVEL_T deadSize;            // Border size for dead particles
+
+  ChainingMesh* chain;          // Buckets of particles on processor
+  int*** buckets;               // First particle index into bucketList
+  int* bucketList;              // Indices of next particle in bucket
+
+  POSVEL_T minRange[DIMENSION]; // Region held including dead particles
+  POSVEL_T maxRange[DIMENSION];
+  POSVEL_T minAlive[DIMENSION]; // Region of alive particles
+  POSVEL_T maxAlive[DIMENSION];
+
+  POSVEL_T* xx;                 // X location for particles on this processor
+  POSVEL_T* yy;                 // Y location for particles on this processor
+  POSVEL_T* zz;                 // Z location for particles on this processor
+  POSVEL_T* vx;                 // X velocity for particles on this processor
+  POSVEL_T* vy;                 // Y velocity for particles on this processor
+  POSVEL_T* vz;                 // Z velocity for particles on this processor
+  POSVEL_T* mass;               // Mass of particles on this processor
+  ID_T* tag;                    // Tag of particles on this processor
+  STATUS_T* status;             // ALIVE or neighbor holding the particle
+
+  vector<POSVEL_T> queryCenter; // Queued sphere centers, DIMENSION per query
+  vector<POSVEL_T> queryRadius; // Queued sphere radii
+
+  vector<long> resultStart;     // First particle of a query in the results
+  vector<POSVEL_T> xRemote;     // Particles received grouped by query
+  vector<POSVEL_T> yRemote;
+  vector<POSVEL_T> zRemote;
+  vector<POSVEL_T> vxRemote;
+  vector<POSVEL_T> vyRemote;
+  vector<POSVEL_T> vzRemote;
+  vector<POSVEL_T> massRemote;
+  vector<ID_T> tagRemote;
+};
+
+}
+#endif
@@ -54,7 +54,6 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "FOFHaloProperties.h"
 #include "HaloCenterFinder.h"
 
-#include "Timings.h"
 
 
 using namespace std;
@@ -76,6 +75,8 @@ SubHaloFinder::SubHaloFinder()
 
   this->candidateCount = 0;
   this->bhTree = 0;
+  this->treeArena = 0;
+  this->neighborCacheBytes = 0;
 
   this->particleList = 0;
   this->candidateIndx = 0;
@@ -212,11 +213,18 @@ void SubHaloFinder::findSubHalos()
     if (maxLoc[2] < this->zz[i]) maxLoc[2] = this->zz[i];
   }
 
-  // BHTree is constructed from halo particles
+  // BHTree is constructed from halo particles in the caller's arena
+  // which is released by the caller's phase when the halo is done
   this->bhTree = new BHTree(minLoc, maxLoc, 
                             this->particleCount,
                             this->xx, this->yy, this->zz, this->mass,
-                            this->particleMass);
+                            this->particleMass, this->treeArena);
+
+  // Subgroups need a prefix of the density neighbors so keep them if
+  // the cache fits in the memory allowed
+  if (this->numberOfCloseNeighbors <= this->numberOfSPHNeighbors)
+    this->bhTree->setNeighborCache(this->numberOfCloseNeighbors,
+                                   this->neighborCacheBytes);
 
   // Calculate smoothing length for density calculation
   this->bhTree->calculateInitialSmoothingLength(this->numberOfSPHNeighbors);
@@ -224,11 +232,11 @@ void SubHaloFinder::findSubHalos()
   // Refine smoothing length and calculate local density of particles
   this->bhTree->calculateDensity(this->numberOfSPHNeighbors);
 
-  vector<SPHParticle*>& sphParticle = this->bhTree->getSPHParticle();
+  POSVEL_T* density = this->bhTree->getDensity();
 
   for (int p = 0; p < this->particleCount; p++) {
     ValueInfo info;
-    info.value = sphParticle[p]->density;
+    info.value = density[p];
     info.particleId = p;
     this->data.push_back(info);
   }
@@ -416,7 +424,8 @@ void SubHaloFinder::findSubHalos()
 
 void SubHaloFinder::calculateSubGroups()
 {
-  vector<SPHParticle*>& sphParticle = this->bhTree->getSPHParticle();
+  POSVEL_T* density = this->bhTree->getDensity();
+  POSVEL_T* smoothingLength = this->bhTree->getSmoothingLength();
 
   // Create arrays to hold the subhalo candidate particle information
   this->candidateIndx = new int[this->particleCount];
@@ -429,6 +438,10 @@ void SubHaloFinder::calculateSubGroups()
   // Put the most dense particle into the first subhalo candidate
   makeNewCandidate(0);
 
+  // Closest neighbors of each particle in turn
+  vector<ValueInfo> neighborList;
+  vector<ID_T> stack;
+
   // Iterate over the particles by decreasing density
   for (ID_T p = 1; p < this->particleCount; p++) {
 
@@ -441,22 +454,34 @@ void SubHaloFinder::calculateSubGroups()
     pos[0] = this->xx[particleIndx];
     pos[1] = this->yy[particleIndx];
     pos[2] = this->zz[particleIndx];
-    h = sphParticle[particleIndx]->smoothingLength;
-    rho = sphParticle[particleIndx]->density;
+    h = smoothingLength[particleIndx];
+    rho = density[particleIndx];
 
-    vector<ValueInfo> neighborList;
     set<int> possibleGroup;
     set<int>::iterator siter;
 
-    this->bhTree->getClosestNeighbors(this->numberOfCloseNeighbors, 
-                                      particleIndx, pos, h, 
-                                      this->particleCount, neighborList);
+    // Closest neighbors were kept by the density pass if they fit
+    if (this->bhTree->hasNeighborCache()) {
+      int count = this->bhTree->getCachedNeighborCount(particleIndx);
+      int* index = this->bhTree->getCachedNeighbors(particleIndx);
+      POSVEL_T* dist = this->bhTree->getCachedNeighborDistances(particleIndx);
+      neighborList.resize(count);
+      for (int n = 0; n < count; n++) {
+        neighborList[n].particleId = index[n];
+        neighborList[n].value = dist[n];
+      }
+    } else {
+      this->bhTree->getClosestNeighbors(this->numberOfCloseNeighbors, 
+                                        particleIndx, pos, h, 
+                                        this->particleCount, neighborList,
+                                        stack);
+    }
 
     // Find the neighbors which have already been placed in candidates
     vector<ValueInfo> closeList;
-    for (int n = 0; n < this->numberOfCloseNeighbors; n++) {
+    for (int n = 0; n < (int) neighborList.size(); n++) {
       int neighbor = neighborList[n].particleId;
-      if (rho < sphParticle[neighbor]->density) {
+      if (rho < density[neighbor]) {
         ValueInfo info;
         info.particleId = neighbor;
         info.value = neighborList[n].value;
@@ -689,7 +714,7 @@ void SubHaloFinder::mergeCandidate(int p,
                                    int cand1, int cand2,
                                    int top1, int top2)
 {
-  vector<SPHParticle*>& sphParticle = this->bhTree->getSPHParticle();
+  POSVEL_T* density = this->bhTree->getDensity();
   ID_T particleIndx = this->data[p].particleId;
 
   // Is the smaller halo significant, if not absorb its particles into larger
@@ -698,11 +723,11 @@ void SubHaloFinder::mergeCandidate(int p,
   POSVEL_T avgDensity = 0;
   int curPart = this->candidates[cand2]->first;
   while (curPart != -1) {
-    avgDensity += sphParticle[curPart]->density;
+    avgDensity += density[curPart];
     curPart = this->particleList[curPart];
   }
   avgDensity /= count;
-  POSVEL_T saddleDensity = sphParticle[particleIndx]->density;
+  POSVEL_T saddleDensity = density[particleIndx];
 
   // Use the Poisson Noise beta parameter to decide if smaller is significant
   int significant = 0;
@@ -1076,16 +1101,20 @@ void SubHaloFinder::unbindParticles(int cIndx)
 
   int massivePartner = this->candidates[cIndx]->partner;
 
-  POTENTIAL_T* lpot = new POTENTIAL_T[numberOfParticles];
-  int* valid = new int[numberOfParticles];
-  int* id = new int[numberOfParticles];
-  POSVEL_T* xLoc = new POSVEL_T[numberOfParticles];
-  POSVEL_T* yLoc = new POSVEL_T[numberOfParticles];
-  POSVEL_T* zLoc = new POSVEL_T[numberOfParticles];
-  POSVEL_T* xVel = new POSVEL_T[numberOfParticles];
-  POSVEL_T* yVel = new POSVEL_T[numberOfParticles];
-  POSVEL_T* zVel = new POSVEL_T[numberOfParticles];
-  POSVEL_T* MASS = new POSVEL_T[numberOfParticles];
+  // Scratch arrays live in this thread's arena until the candidate is done
+  BigChunkArena* arena = bigchunk_thread_arena();
+  BigChunkPhase phase(arena);
+
+  POTENTIAL_T* lpot = arena->allocate<POTENTIAL_T>(numberOfParticles);
+  int* valid = arena->allocate<int>(numberOfParticles);
+  int* id = arena->allocate<int>(numberOfParticles);
+  POSVEL_T* xLoc = arena->allocate<POSVEL_T>(numberOfParticles);
+  POSVEL_T* yLoc = arena->allocate<POSVEL_T>(numberOfParticles);
+  POSVEL_T* zLoc = arena->allocate<POSVEL_T>(numberOfParticles);
+  POSVEL_T* xVel = arena->allocate<POSVEL_T>(numberOfParticles);
+  POSVEL_T* yVel = arena->allocate<POSVEL_T>(numberOfParticles);
+  POSVEL_T* zVel = arena->allocate<POSVEL_T>(numberOfParticles);
+  POSVEL_T* MASS = arena->allocate<POSVEL_T>(numberOfParticles);
 
   // Store the location and velocity information in arrays
   int p = this->candidates[cIndx]->first;
@@ -1104,10 +1133,13 @@ void SubHaloFinder::unbindParticles(int cIndx)
     indx++;
   }
 
-  int bindDone = 0;
-  if (numberLeft > MAX_UNBIND_3)
-    bindDone = 1;
+  // Potential from all pairs is computed once and afterwards only the
+  // contributions of removed particles are taken away.  Candidates too
+  // large for the pair sum use a tree code potential each pass until
+  // enough particles are removed to switch to the pair sum.
+  int exactPotential = 0;
 
+  int bindDone = 0;
   while (numberLeft >= this->minCandidateSize && bindDone == 0) {
 
     vector<ValueInfo>* totalEnergy = new vector<ValueInfo>[numberLeft];
@@ -1128,28 +1160,36 @@ void SubHaloFinder::unbindParticles(int cIndx)
     zAvg /= numberLeft;
 
     // Calculate the potential of each particle within the body of particles
-    for (int i = 0; i < numberOfParticles; i++)
-      lpot[i] = 0.0;
+    if (numberLeft > MAX_UNBIND_3) {
+      treePotential(numberOfParticles, valid, xLoc, yLoc, zLoc,
+                    lpot, arena);
+    }
 
-    // First particle in halo to calculate minimum potential on
-    for (int i = 0; i < numberOfParticles; i++) {
+    else if (exactPotential == 0) {
+      for (int i = 0; i < numberOfParticles; i++)
+        lpot[i] = 0.0;
+
+      // First particle in halo to calculate minimum potential on
+      for (int i = 0; i < numberOfParticles; i++) {
 
-      // Next particle in halo in minimum potential loop
-      for (int j = i+1; j < numberOfParticles; j++) {
+        // Next particle in halo in minimum potential loop
+        for (int j = i+1; j < numberOfParticles; j++) {
 
-        if (valid[i] == 1 && valid[j] == 1) {
-          POSVEL_T xdist = (POSVEL_T) fabs(xLoc[i] - xLoc[j]);
-          POSVEL_T ydist = (POSVEL_T) fabs(yLoc[i] - yLoc[j]);
-          POSVEL_T zdist = (POSVEL_T) fabs(zLoc[i] - zLoc[j]);
+          if (valid[i] == 1 && valid[j] == 1) {
+            POSVEL_T xdist = (POSVEL_T) fabs(xLoc[i] - xLoc[j]);
+            POSVEL_T ydist = (POSVEL_T) fabs(yLoc[i] - yLoc[j]);
+            POSVEL_T zdist = (POSVEL_T) fabs(zLoc[i] - zLoc[j]);
   
-          POSVEL_T r = sqrt((xdist*xdist) + (ydist*ydist) + (zdist*zdist));
+            POSVEL_T r = sqrt((xdist*xdist) + (ydist*ydist) + (zdist*zdist));
   
-          if (r != 0.0) {
-            lpot[i] = (POTENTIAL_T)(lpot[i] - (1.0 / r));
-            lpot[j] = (POTENTIAL_T)(lpot[j] - (1.0 / r));
+            if (r != 0.0) {
+              lpot[i] = (POTENTIAL_T)(lpot[i] - (1.0 / r));
+              lpot[j] = (POTENTIAL_T)(lpot[j] - (1.0 / r));
+            }
           }
         }
       }
+      exactPotential = 1;
     }
 
     // Calculate total_energy = kinetic_energy + potential+energy
@@ -1183,7 +1223,7 @@ void SubHaloFinder::unbindParticles(int cIndx)
       int maxToDelete = 1;
       if (numberLeft > MAX_UNBIND_1 && numberLeft < MAX_UNBIND_2)
         maxToDelete = (positiveTECount / FACTOR_UNBIND_1) + 1;
-      else if (numberLeft >= MAX_UNBIND_2 && numberLeft < MAX_UNBIND_3)
+      else if (numberLeft >= MAX_UNBIND_2)
         maxToDelete = (positiveTECount / FACTOR_UNBIND_2) + 1;
 #ifdef DEBUG
       cout << "Unbind at most " << maxToDelete 
@@ -1198,6 +1238,28 @@ void SubHaloFinder::unbindParticles(int cIndx)
       }
       numberLeft -= maxToDelete;
 
+      // Take the removed particles out of the pair sum potential, unless
+      // so many went that summing the remaining pairs again is cheaper
+      if (exactPotential == 1 && 2 * maxToDelete > numberLeft)
+        exactPotential = 0;
+      if (exactPotential == 1) {
+        for (int k = 0; k < maxToDelete; k++) {
+          int j = (*totalEnergy)[k].particleId;
+          for (int i = 0; i < numberOfParticles; i++) {
+            if (valid[i] == 1) {
+              POSVEL_T xdist = (POSVEL_T) fabs(xLoc[i] - xLoc[j]);
+              POSVEL_T ydist = (POSVEL_T) fabs(yLoc[i] - yLoc[j]);
+              POSVEL_T zdist = (POSVEL_T) fabs(zLoc[i] - zLoc[j]);
+
+              POSVEL_T r = sqrt((xdist*xdist) + (ydist*ydist) + (zdist*zdist));
+
+              if (r != 0.0)
+                lpot[i] = (POTENTIAL_T)(lpot[i] + (1.0 / r));
+            }
+          }
+        }
+      }
+
       // If we are almost done and the halo is large enough just quit
       if (numberLeft > MAX_UNBIND_2 && maxToDelete <= MAX_UNBIND_DELETE)
         bindDone = 1;
@@ -1230,10 +1292,18 @@ void SubHaloFinder::unbindParticles(int cIndx)
     cout << "UNBIND " << numberOfBoundParticles 
          << " particles to massive partner " << massivePartner << endl;
 #endif
+    // Particles were gathered in list order so relink the bound ones in
+    // that order rather than searching the list for each unbound one
+    int lastBound = -1;
+    this->candidates[cIndx]->first = -1;
     for (int i = 0; i < numberOfParticles; i++) {
-      if (valid[i] == 0) {
-        removeParticleFromCandidate(id[i], cIndx);
-
+      if (valid[i] == 1) {
+        if (lastBound == -1)
+          this->candidates[cIndx]->first = id[i];
+        else
+          this->particleList[lastBound] = id[i];
+        lastBound = id[i];
+      } else {
         if (massivePartner != -1) {
           addParticleToCandidate(id[i], massivePartner);
         } else {
@@ -1241,17 +1311,10 @@ void SubHaloFinder::unbindParticles(int cIndx)
         }
       }
     }
+    if (lastBound != -1)
+      this->particleList[lastBound] = -1;
+    this->candidates[cIndx]->count = numberOfBoundParticles;
   }
-  delete [] valid;
-  delete [] id;
-  delete [] xLoc;
-  delete [] yLoc;
-  delete [] zLoc;
-  delete [] xVel;
-  delete [] yVel;
-  delete [] zVel;
-  delete [] MASS;
-  delete [] lpot;
 
 #ifdef DEBUG
     cout << "UNBIND CANDIDATE " << setw(7) << cIndx 
@@ -1263,6 +1326,63 @@ void SubHaloFinder::unbindParticles(int cIndx)
 #endif
 }
 
+/////////////////////////////////////////////////////////////////////////////
+//
+// Potential of the valid particles of a candidate from a BHTree built on
+// just those particles.  Used on candidates too large for the pair sum.
+// The tree is released from the arena after every pass so repeated passes
+// reuse the same memory.
+//
+/////////////////////////////////////////////////////////////////////////////
+
+void SubHaloFinder::treePotential(
+			int numberOfParticles,
+			int* valid,
+			POSVEL_T* xLoc,
+			POSVEL_T* yLoc,
+			POSVEL_T* zLoc,
+			POTENTIAL_T* lpot,
+			BigChunkArena* arena)
+{
+  BigChunkPhase phase(arena);
+
+  // Gather the valid particles so the tree holds nothing else
+  int* index = arena->allocate<int>(numberOfParticles);
+  int count = 0;
+  for (int i = 0; i < numberOfParticles; i++)
+    if (valid[i] == 1)
+      index[count++] = i;
+
+  POSVEL_T* x = arena->allocate<POSVEL_T>(count);
+  POSVEL_T* y = arena->allocate<POSVEL_T>(count);
+  POSVEL_T* z = arena->allocate<POSVEL_T>(count);
+  POTENTIAL_T* pot = arena->allocate<POTENTIAL_T>(count);
+
+  POSVEL_T minLoc[DIMENSION];
+  POSVEL_T maxLoc[DIMENSION];
+  minLoc[0] = maxLoc[0] = xLoc[index[0]];
+  minLoc[1] = maxLoc[1] = yLoc[index[0]];
+  minLoc[2] = maxLoc[2] = zLoc[index[0]];
+
+  for (int n = 0; n < count; n++) {
+    x[n] = xLoc[index[n]];
+    y[n] = yLoc[index[n]];
+    z[n] = zLoc[index[n]];
+    if (minLoc[0] > x[n]) minLoc[0] = x[n];
+    if (maxLoc[0] < x[n]) maxLoc[0] = x[n];
+    if (minLoc[1] > y[n]) minLoc[1] = y[n];
+    if (maxLoc[1] < y[n]) maxLoc[1] = y[n];
+    if (minLoc[2] > z[n]) minLoc[2] = z[n];
+    if (maxLoc[2] < z[n]) maxLoc[2] = z[n];
+  }
+
+  BHTree tree(minLoc, maxLoc, count, x, y, z, 0, this->particleMass, arena);
+  tree.calculatePotential(UNBIND_TREE_THETA, pot);
+
+  for (int n = 0; n < count; n++)
+    lpot[index[n]] = pot[n];
+}
+
 /////////////////////////////////////////////////////////////////////////////
 //
 // Write a .cosmo file for ParaView with location, velocity and subhalo
@@ -1271,6 +1391,67 @@ void SubHaloFinder::unbindParticles(int cIndx)
 /////////////////////////////////////////////////////////////////////////////
 
 void SubHaloFinder::writeSubhaloCosmoFile(const string& outFile)
+{
+  int* membership = new int[this->particleCount];
+  getSubhaloMembership(membership);
+
+  writeSubhaloCosmoFile(outFile, this->particleCount,
+                        this->xx, this->yy, this->zz,
+                        this->vx, this->vy, this->vz,
+                        membership, this->tag);
+  delete [] membership;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Write the .cosmo file from arrays so that a processor which did not
+// run the subhalo finder can write the result it was sent
+//
+/////////////////////////////////////////////////////////////////////////////
+
+void SubHaloFinder::writeSubhaloCosmoFile(
+			const string& outFile,
+			ID_T count,
+			POSVEL_T* xLoc,
+			POSVEL_T* yLoc,
+			POSVEL_T* zLoc,
+			POSVEL_T* xVel,
+			POSVEL_T* yVel,
+			POSVEL_T* zVel,
+			int* membership,
+			ID_T* id)
+{
+  // Write the particles with mapped candidate numbers
+  ofstream cStream(outFile.c_str(), ios::out|ios::binary);
+
+  float fBlock[COSMO_FLOAT];
+  int iBlock[COSMO_INT];
+
+  for (ID_T p = 0; p < count; p++) {
+    fBlock[0] = xLoc[p];
+    fBlock[1] = xVel[p];
+    fBlock[2] = yLoc[p];
+    fBlock[3] = yVel[p];
+    fBlock[4] = zLoc[p];
+    fBlock[5] = zVel[p];
+    fBlock[6] = (float) membership[p];
+    cStream.write(reinterpret_cast<char*>(fBlock),
+                  COSMO_FLOAT * sizeof(POSVEL_T));
+    iBlock[0] = id[p];
+    cStream.write(reinterpret_cast<char*>(iBlock),
+                  COSMO_INT * sizeof(ID_T));
+  }
+  cStream.close();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Subhalo index of every particle with subhalos renumbered by decreasing
+// size and the fuzz numbered after the last subhalo
+//
+/////////////////////////////////////////////////////////////////////////////
+
+void SubHaloFinder::getSubhaloMembership(int* membership)
 {
   // Collect the candidates with particles for sorting and remapping
   // Fuzz is the last candidate
@@ -1314,27 +1495,8 @@ void SubHaloFinder::writeSubhaloCosmoFile(const string& outFile)
        << " with count " << this->candidates[fuzz]->count << endl;
 #endif
 
-  // Write the particles with mapped candidate numbers
-  ofstream cStream(outFile.c_str(), ios::out|ios::binary);
-
-  float fBlock[COSMO_FLOAT];
-  int iBlock[COSMO_INT];
-
-  for (int p = 0; p < this->particleCount; p++) {
-    fBlock[0] = this->xx[p];
-    fBlock[1] = this->vx[p];
-    fBlock[2] = this->yy[p];
-    fBlock[3] = this->vy[p];
-    fBlock[4] = this->zz[p];
-    fBlock[5] = this->vz[p];
-    fBlock[6] = (float) mapCandidate[this->candidateIndx[p]];
-    cStream.write(reinterpret_cast<char*>(fBlock),
-                  COSMO_FLOAT * sizeof(POSVEL_T));
-    iBlock[0] = this->tag[p];
-    cStream.write(reinterpret_cast<char*>(iBlock),
-                  COSMO_INT * sizeof(ID_T));
-  }
-  cStream.close();
+  for (int p = 0; p < this->particleCount; p++)
+    membership[p] = mapCandidate[this->candidateIndx[p]];
   delete [] mapCandidate;
 }
 
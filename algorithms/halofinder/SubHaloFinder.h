@@ -136,6 +136,14 @@ public:
         POSVEL_T* pmass,
         ID_T* id);
 
+  // Storage for the BHTree, so that a caller processing many halos
+  // reuses the same memory by scoping each halo with a BigChunkPhase
+  void setTreeArena(BigChunkArena* arena)	{ this->treeArena = arena; }
+
+  // Memory allowed for keeping density neighbors for the subgroup pass
+  // instead of searching the tree again, 0 to always search
+  void setNeighborCacheSize(size_t bytes) { this->neighborCacheBytes = bytes; }
+
   // Create the subhalos found within each FOF halo
   void findSubHalos();
 
@@ -159,9 +167,31 @@ public:
   void unbind();
   void unbindCandidate(int cIndx);
   void unbindParticles(int cIndx);
+  void treePotential(
+	int numberOfParticles,
+	int* valid,
+	POSVEL_T* xLoc,
+	POSVEL_T* yLoc,
+	POSVEL_T* zLoc,
+	POTENTIAL_T* lpot,
+	BigChunkArena* arena);
 
   // Utilities
   void writeSubhaloCosmoFile(const string& outFile);
+  static void writeSubhaloCosmoFile(
+	const string& outFile,
+	ID_T count,
+	POSVEL_T* xLoc,
+	POSVEL_T* yLoc,
+	POSVEL_T* zLoc,
+	POSVEL_T* xVel,
+	POSVEL_T* yVel,
+	POSVEL_T* zVel,
+	int* membership,
+	ID_T* id);
+
+  // Subhalo of every particle numbered by decreasing size, fuzz is last
+  void getSubhaloMembership(int* membership);
   int  collectTotal(int cIndx);
   int  collectAllTotals(int cIndx);
   void printCandidate(int cIndx, int indent);
@@ -211,6 +241,8 @@ private:
 
   // Barnes Hut Tree
   BHTree* bhTree;		// Particles organized by location
+  BigChunkArena* treeArena;	// Storage for the tree, or 0 for its own
+  size_t neighborCacheBytes;	// Limit on the neighbor cache
 
   int numberOfSubhalos;		// Candidates with valid subhalos
   int* subhaloCount;		// Counts in subhalos found
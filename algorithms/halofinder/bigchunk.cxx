@@ -35,15 +35,30 @@
 
 #include "bigchunk.h"
 #include <stdio.h>
+#include <string.h>
+#include <map>
+
+#include <sys/mman.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 static void *_bigchunk_ptr = (void *) 0;
 static size_t _bigchunk_last_alloc = (size_t) -1;
 static size_t _bigchunk_sz = 0;
 static size_t _bigchunk_used = 0;
 static size_t _bigchunk_total = 0;
+static size_t _bigchunk_high_water = 0;
+static size_t _bigchunk_fallback = 0;
 static const size_t min_alloc = 32; /* for alignment; must be 2^n */
 
-void *bigchunk_malloc(size_t sz)
+/*
+ * The big chunk is shared by all threads, so every entry point which
+ * changes its state holds the same lock.
+ */
+
+static void *_bigchunk_malloc(size_t sz)
 {
 	if (sz < min_alloc)
 		sz = min_alloc;
@@ -59,6 +74,8 @@ void *bigchunk_malloc(size_t sz)
 		_bigchunk_last_alloc = _bigchunk_used;
 		_bigchunk_used += sz;
 		_bigchunk_total += sz;
+		if (_bigchunk_used > _bigchunk_high_water)
+			_bigchunk_high_water = _bigchunk_used;
 		return r;
 	} else if (_bigchunk_used == 0 && _bigchunk_sz > 0) {
 		/* this is smaller than the big chunk, but nothing
@@ -66,13 +83,18 @@ void *bigchunk_malloc(size_t sz)
 		   the big chunk bigger.
 		*/
 
-		void *new_chuck = realloc(_bigchunk_ptr, sz);
+		/* nothing needs to be copied so free before allocating */
+		bigchunk_page_free(_bigchunk_ptr);
+		void *new_chuck = bigchunk_page_malloc(sz);
+		_bigchunk_ptr = new_chuck;
+		_bigchunk_sz = 0;
 		if (new_chuck) {
-			_bigchunk_ptr = new_chuck;
 			_bigchunk_last_alloc = 0;
 			_bigchunk_sz = sz;
 			_bigchunk_used = sz;
 			_bigchunk_total += sz;
+			if (_bigchunk_used > _bigchunk_high_water)
+				_bigchunk_high_water = _bigchunk_used;
 			return _bigchunk_ptr;
 		}
         }
@@ -82,11 +104,24 @@ void *bigchunk_malloc(size_t sz)
 				sz, _bigchunk_sz - _bigchunk_used, _bigchunk_sz);
 
 	void *ptr = malloc(sz);
-	if (ptr) _bigchunk_total += sz;
+	if (ptr) {
+		_bigchunk_total += sz;
+		_bigchunk_fallback += sz;
+	}
 	return ptr;
 }
 
-void bigchunk_free(void *ptr)
+void *bigchunk_malloc(size_t sz)
+{
+	void *ptr;
+#ifdef _OPENMP
+#pragma omp critical (bigchunk)
+#endif
+	ptr = _bigchunk_malloc(sz);
+	return ptr;
+}
+
+static void _bigchunk_free(void *ptr)
 {
 	// Cast to char* so that we can do pointer arithmetic
 	char *myPtr 		= reinterpret_cast<char*>(ptr);
@@ -102,16 +137,29 @@ void bigchunk_free(void *ptr)
 	}
 }
 
+void bigchunk_free(void *ptr)
+{
+#ifdef _OPENMP
+#pragma omp critical (bigchunk)
+#endif
+	_bigchunk_free(ptr);
+}
+
 void bigchunk_reset()
 {
-	_bigchunk_used = 0;
-	_bigchunk_total = 0;
-	_bigchunk_last_alloc = (size_t) -1;
+#ifdef _OPENMP
+#pragma omp critical (bigchunk)
+#endif
+	{
+		_bigchunk_used = 0;
+		_bigchunk_total = 0;
+		_bigchunk_last_alloc = (size_t) -1;
+	}
 }
 
 void bigchunk_init(size_t sz)
 {
-	_bigchunk_ptr = malloc(sz);
+	_bigchunk_ptr = bigchunk_page_malloc(sz);
 	if (_bigchunk_ptr) {
 		_bigchunk_sz = sz;
 		_bigchunk_used = 0;
@@ -121,12 +169,16 @@ void bigchunk_init(size_t sz)
 
 void bigchunk_cleanup()
 {
-	free(_bigchunk_ptr);
+	bigchunk_page_free(_bigchunk_ptr);
 	_bigchunk_ptr = 0;
 	_bigchunk_sz = 0;
 	_bigchunk_used = 0;
 	_bigchunk_total = 0;
+	_bigchunk_high_water = 0;
+	_bigchunk_fallback = 0;
 	_bigchunk_last_alloc = (size_t) -1;
+
+	cosmologytools::bigchunk_thread_arena_cleanup();
 }
 
 size_t bigchunk_get_size()
@@ -145,3 +197,394 @@ size_t bigchunk_get_used()
 	return _bigchunk_used;
 }
 
+size_t bigchunk_get_high_water()
+{
+	return _bigchunk_high_water;
+}
+
+size_t bigchunk_get_fallback()
+{
+	return _bigchunk_fallback;
+}
+
+/*
+ * Page placement layer.  Every allocation is remembered with its size, for
+ * the tracked bytes, and whether it was mapped so it can be unmapped.
+ */
+
+static const size_t BIGCHUNK_HUGE_PAGE = 2 * 1024 * 1024;
+static const size_t BIGCHUNK_PAGE = 4096;
+
+static int _bigchunk_page_policy = BIGCHUNK_PAGES_SYSTEM;
+static int _bigchunk_first_touch = 0;
+struct _bigchunk_block {
+	size_t size;
+	int mapped;
+};
+
+static std::map<void *, struct _bigchunk_block> _bigchunk_blocks;
+static struct bigchunk_page_stats _bigchunk_page_stats;
+static size_t _bigchunk_tracked = 0;
+static size_t _bigchunk_tracked_peak = 0;
+
+/* Callers hold the bigchunk_page lock */
+static void _bigchunk_track(size_t added, size_t removed)
+{
+	_bigchunk_tracked += added;
+	_bigchunk_tracked -= removed;
+	if (_bigchunk_tracked > _bigchunk_tracked_peak)
+		_bigchunk_tracked_peak = _bigchunk_tracked;
+}
+
+void bigchunk_set_page_policy(int policy, int first_touch)
+{
+	_bigchunk_page_policy = policy;
+	_bigchunk_first_touch = first_touch;
+}
+
+static void _bigchunk_first_touch_pages(char *ptr, size_t sz)
+{
+	long pages = (long) ((sz + BIGCHUNK_PAGE - 1) / BIGCHUNK_PAGE);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+	for (long i = 0; i < pages; i++) {
+		size_t offset = (size_t) i * BIGCHUNK_PAGE;
+		size_t len = (sz - offset < BIGCHUNK_PAGE) ? sz - offset : BIGCHUNK_PAGE;
+		memset(ptr + offset, 0, len);
+	}
+}
+
+static void *_bigchunk_map(size_t sz, size_t *mapped, int *hugetlb)
+{
+	void *ptr = MAP_FAILED;
+	*hugetlb = 0;
+
+#ifdef MAP_HUGETLB
+	if (_bigchunk_page_policy == BIGCHUNK_PAGES_EXPLICIT) {
+		size_t len = (sz + BIGCHUNK_HUGE_PAGE - 1) & ~(BIGCHUNK_HUGE_PAGE - 1);
+		ptr = mmap(0, len, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (ptr != MAP_FAILED) {
+			*mapped = len;
+			*hugetlb = 1;
+			return ptr;
+		}
+	}
+#endif
+
+	size_t len = (sz + BIGCHUNK_PAGE - 1) & ~(BIGCHUNK_PAGE - 1);
+	ptr = mmap(0, len, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ptr == MAP_FAILED)
+		return 0;
+
+#ifdef MADV_HUGEPAGE
+	madvise(ptr, len, MADV_HUGEPAGE);
+#endif
+	*mapped = len;
+	return ptr;
+}
+
+void *bigchunk_page_malloc(size_t sz)
+{
+	void *ptr = 0;
+	size_t mapped = 0;
+	int hugetlb = 0;
+
+	if (_bigchunk_page_policy != BIGCHUNK_PAGES_SYSTEM &&
+	    sz >= BIGCHUNK_HUGE_PAGE)
+		ptr = _bigchunk_map(sz, &mapped, &hugetlb);
+
+	if (ptr != 0 && _bigchunk_first_touch)
+		_bigchunk_first_touch_pages((char *) ptr, mapped);
+
+	if (ptr == 0) {
+		ptr = malloc(sz);
+		if (ptr == 0)
+			return 0;
+	}
+
+#ifdef _OPENMP
+#pragma omp critical (bigchunk_page)
+#endif
+	{
+		struct bigchunk_page_stats *st = &_bigchunk_page_stats;
+		struct _bigchunk_block block;
+		block.size = (mapped > 0) ? mapped : sz;
+		block.mapped = (mapped > 0);
+		_bigchunk_blocks[ptr] = block;
+		_bigchunk_track(block.size, 0);
+
+		st->allocations++;
+		if (mapped > 0) {
+			st->bytes += mapped;
+			if (hugetlb)
+				st->explicit_bytes += mapped;
+			else
+				st->transparent_bytes += mapped;
+			if (_bigchunk_first_touch)
+				st->first_touch_bytes += mapped;
+		} else {
+			st->system_bytes += sz;
+		}
+		if (st->bytes > st->peak_bytes)
+			st->peak_bytes = st->bytes;
+	}
+	return ptr;
+}
+
+void bigchunk_page_free(void *ptr)
+{
+	if (ptr == 0)
+		return;
+
+	size_t mapped = 0;
+#ifdef _OPENMP
+#pragma omp critical (bigchunk_page)
+#endif
+	{
+		std::map<void *, struct _bigchunk_block>::iterator it =
+			_bigchunk_blocks.find(ptr);
+		if (it != _bigchunk_blocks.end()) {
+			if (it->second.mapped) {
+				mapped = it->second.size;
+				_bigchunk_page_stats.bytes -= mapped;
+			}
+			_bigchunk_track(0, it->second.size);
+			_bigchunk_blocks.erase(it);
+		}
+		_bigchunk_page_stats.frees++;
+	}
+
+	if (mapped > 0)
+		munmap(ptr, mapped);
+	else
+		free(ptr);
+}
+
+void bigchunk_advise_huge(void *ptr, size_t sz)
+{
+#ifdef MADV_HUGEPAGE
+	if (_bigchunk_page_policy == BIGCHUNK_PAGES_SYSTEM ||
+	    ptr == 0 || sz < BIGCHUNK_HUGE_PAGE)
+		return;
+
+	/* only whole huge pages inside the range can be advised */
+	size_t start = ((size_t) ptr + BIGCHUNK_HUGE_PAGE - 1) &
+		       ~(BIGCHUNK_HUGE_PAGE - 1);
+	size_t end = ((size_t) ptr + sz) & ~(BIGCHUNK_HUGE_PAGE - 1);
+	if (end > start)
+		madvise((void *) start, end - start, MADV_HUGEPAGE);
+#endif
+}
+
+void bigchunk_get_page_stats(struct bigchunk_page_stats *stats)
+{
+#ifdef _OPENMP
+#pragma omp critical (bigchunk_page)
+#endif
+	*stats = _bigchunk_page_stats;
+}
+
+size_t bigchunk_get_tracked()
+{
+	size_t tracked;
+#ifdef _OPENMP
+#pragma omp critical (bigchunk_page)
+#endif
+	tracked = _bigchunk_tracked;
+	return tracked;
+}
+
+size_t bigchunk_get_tracked_peak()
+{
+	size_t peak;
+#ifdef _OPENMP
+#pragma omp critical (bigchunk_page)
+#endif
+	peak = _bigchunk_tracked_peak;
+	return peak;
+}
+
+void bigchunk_reset_tracked_peak()
+{
+#ifdef _OPENMP
+#pragma omp critical (bigchunk_page)
+#endif
+	_bigchunk_tracked_peak = _bigchunk_tracked;
+}
+
+/*
+ * Arena overflow blocks come from malloc, so they are counted here rather
+ * than through bigchunk_page_malloc.
+ */
+
+static void _bigchunk_track_overflow(size_t added, size_t removed)
+{
+	if (added == removed)
+		return;
+#ifdef _OPENMP
+#pragma omp critical (bigchunk_page)
+#endif
+	_bigchunk_track(added, removed);
+}
+
+namespace cosmologytools {
+
+/* Arena allocations are rounded to a cache line so arrays do not share one */
+static const size_t ARENA_ALIGN = 64;
+
+BigChunkArena::BigChunkArena(size_t sz)
+{
+	this->block = 0;
+	this->size = 0;
+	this->used = 0;
+	this->overflowUsed = 0;
+	this->highWater = 0;
+	this->fallbackCount = 0;
+	this->warnOnFallback = false;
+
+	if (sz > 0) {
+		this->block = (char *) bigchunk_page_malloc(sz);
+		if (this->block)
+			this->size = sz;
+	}
+}
+
+BigChunkArena::~BigChunkArena()
+{
+	for (size_t i = 0; i < this->overflow.size(); i++)
+		free(this->overflow[i]);
+	_bigchunk_track_overflow(0, this->overflowUsed);
+	bigchunk_page_free(this->block);
+}
+
+/*
+ * Bump allocate from the primary block, or fall back to the system's
+ * allocator for an overflow block which lives until release or reset.
+ */
+
+void *BigChunkArena::allocate(size_t bytes)
+{
+	size_t sz = (bytes + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+	if (sz == 0)
+		sz = ARENA_ALIGN;
+
+	void *ptr;
+	if (this->size - this->used >= sz) {
+		ptr = this->block + this->used;
+		this->used += sz;
+	} else {
+		if (this->warnOnFallback)
+			fprintf(stderr, "WARNING: bigchunk arena: allocation of %zu bytes has been requested, only %zu of %zu remain!\n",
+					sz, this->size - this->used, this->size);
+
+		char *extra = (char *) malloc(sz);
+		if (extra == 0)
+			throw std::bad_alloc();
+		this->overflow.push_back(extra);
+		this->overflowUsed += sz;
+		this->fallbackCount++;
+		_bigchunk_track_overflow(sz, 0);
+		ptr = extra;
+	}
+
+	size_t total = this->used + this->overflowUsed;
+	if (this->highWater < total)
+		this->highWater = total;
+	return ptr;
+}
+
+/*
+ * Release everything allocated since the mark.  Overflow blocks are
+ * handed out after the primary block fills, so those past the mark are
+ * simply freed.
+ */
+
+BigChunkMark BigChunkArena::mark() const
+{
+	BigChunkMark m;
+	m.used = this->used;
+	m.overflowCount = this->overflow.size();
+	m.overflowUsed = this->overflowUsed;
+	return m;
+}
+
+void BigChunkArena::release(const BigChunkMark &m)
+{
+	if (m.used == 0 && m.overflowCount == 0) {
+		reset();
+		return;
+	}
+
+	for (size_t i = m.overflowCount; i < this->overflow.size(); i++)
+		free(this->overflow[i]);
+	this->overflow.resize(m.overflowCount);
+	_bigchunk_track_overflow(0, this->overflowUsed - m.overflowUsed);
+	this->overflowUsed = m.overflowUsed;
+	this->used = m.used;
+}
+
+/*
+ * Release all allocations and size the primary block to the high water
+ * mark so the next phase fits without falling back.
+ */
+
+void BigChunkArena::reset()
+{
+	for (size_t i = 0; i < this->overflow.size(); i++)
+		free(this->overflow[i]);
+	this->overflow.clear();
+	_bigchunk_track_overflow(0, this->overflowUsed);
+	this->overflowUsed = 0;
+
+	if (this->highWater > this->size) {
+		bigchunk_page_free(this->block);
+		this->block = (char *) bigchunk_page_malloc(this->highWater);
+		this->size = (this->block != 0) ? this->highWater : 0;
+	}
+	this->used = 0;
+}
+
+/*
+ * One arena per thread, created by the thread on first use so no lock is
+ * needed.  Threads are numbered within the current team so arenas must
+ * not be taken from inside a nested parallel region.
+ */
+
+static const int BIGCHUNK_MAX_THREADS = 1024;
+static BigChunkArena *_bigchunk_arenas[BIGCHUNK_MAX_THREADS];
+
+BigChunkArena *bigchunk_thread_arena()
+{
+	int thread = 0;
+#ifdef _OPENMP
+	thread = omp_get_thread_num();
+#endif
+	if (thread >= BIGCHUNK_MAX_THREADS)
+		throw std::bad_alloc();
+
+	if (_bigchunk_arenas[thread] == 0)
+		_bigchunk_arenas[thread] = new BigChunkArena();
+	return _bigchunk_arenas[thread];
+}
+
+size_t bigchunk_thread_arena_high_water()
+{
+	size_t highWater = 0;
+	for (int i = 0; i < BIGCHUNK_MAX_THREADS; i++)
+		if (_bigchunk_arenas[i] != 0)
+			highWater += _bigchunk_arenas[i]->getHighWater();
+	return highWater;
+}
+
+void bigchunk_thread_arena_cleanup()
+{
+	for (int i = 0; i < BIGCHUNK_MAX_THREADS; i++) {
+		delete _bigchunk_arenas[i];
+		_bigchunk_arenas[i] = 0;
+	}
+}
+
+}
@@ -41,6 +41,7 @@
 
 #ifdef __cplusplus
 #include <new>
+#include <vector>
 extern "C" {
 #endif
 
@@ -94,6 +95,86 @@ size_t bigchunk_get_total();
 
 size_t bigchunk_get_used();
 
+/*
+ * Get the largest amount of the big chunk used at one time.
+ */
+
+size_t bigchunk_get_high_water();
+
+/*
+ * Get the total of all requests which did not fit in the big chunk and
+ * fell back to the system's allocator.
+ */
+
+size_t bigchunk_get_fallback();
+
+/*
+ * Page placement for large allocations (the big chunk, arena blocks and
+ * large particle and halo arrays).
+ *   BIGCHUNK_PAGES_SYSTEM       use the system's allocator
+ *   BIGCHUNK_PAGES_TRANSPARENT  map pages and ask for transparent huge pages
+ *   BIGCHUNK_PAGES_EXPLICIT     map from the reserved huge page pool,
+ *                               falling back to transparent huge pages
+ * With first touch, newly mapped pages are zeroed by all threads in
+ * static order so that each page lands on the NUMA node of the thread
+ * which will use it in a statically scheduled loop.
+ */
+
+#define BIGCHUNK_PAGES_SYSTEM		0
+#define BIGCHUNK_PAGES_TRANSPARENT	1
+#define BIGCHUNK_PAGES_EXPLICIT		2
+
+void bigchunk_set_page_policy(int policy, int first_touch);
+
+/*
+ * Allocate with the page policy.  Requests smaller than a huge page always
+ * use the system's allocator.  Memory must be freed with bigchunk_page_free.
+ */
+
+void *bigchunk_page_malloc(size_t sz);
+
+void bigchunk_page_free(void *ptr);
+
+/*
+ * Ask for transparent huge pages on memory allocated elsewhere, such as the
+ * storage of a large std::vector, before it is first written.
+ */
+
+void bigchunk_advise_huge(void *ptr, size_t sz);
+
+/*
+ * Statistics of allocations made through bigchunk_page_malloc.
+ */
+
+struct bigchunk_page_stats {
+  size_t allocations;		/* calls to bigchunk_page_malloc */
+  size_t frees;			/* calls to bigchunk_page_free */
+  size_t bytes;			/* bytes currently allocated */
+  size_t peak_bytes;		/* largest bytes allocated at once */
+  size_t explicit_bytes;	/* total from the huge page pool */
+  size_t transparent_bytes;	/* total mapped with transparent huge pages */
+  size_t system_bytes;		/* total from the system's allocator */
+  size_t first_touch_bytes;	/* total placed by first touch */
+};
+
+void bigchunk_get_page_stats(struct bigchunk_page_stats *stats);
+
+/*
+ * Bytes currently held through bigchunk_page_malloc, whatever the page
+ * policy, and by the overflow blocks of the arenas.  Requests which fell
+ * back from the big chunk to malloc are not included.
+ */
+
+size_t bigchunk_get_tracked();
+
+/*
+ * Largest tracked bytes held at once since the peak was last reset.
+ * Resetting lets a caller measure the peak of a single phase.
+ */
+
+size_t bigchunk_get_tracked_peak();
+void bigchunk_reset_tracked_peak();
+
 #ifdef __cplusplus
 }
 
@@ -151,6 +232,165 @@ public:
   }
 };
 
+/*
+ * Position in an arena to release back to.
+ */
+
+struct BigChunkMark {
+  size_t used;
+  size_t overflowCount;
+  size_t overflowUsed;
+};
+
+/*
+ * Bump allocator for temporaries of one phase of work, such as the tree and
+ * scratch arrays for one FOF halo.  Allocations are never freed
+ * individually; release() returns to a mark and reset() frees everything.
+ * Requests which do not fit fall back to the system's allocator, and the
+ * next reset() replaces the primary block with one as large as the high
+ * water mark so that the next phase fits.  An arena belongs to one thread.
+ */
+
+class BigChunkArena {
+public:
+  BigChunkArena(size_t sz = 0);
+  ~BigChunkArena();
+
+  void *allocate(size_t bytes);
+
+  template <typename T>
+  T *allocate(size_t n)		{ return (T *) allocate(n * sizeof(T)); }
+
+  BigChunkMark mark() const;
+  void release(const BigChunkMark &m);
+  void reset();
+
+  // Print a warning for every allocation that falls back
+  void setWarnOnFallback(bool warn)	{ this->warnOnFallback = warn; }
+
+  size_t getSize() const		{ return this->size; }
+  size_t getUsed() const		{ return this->used + this->overflowUsed; }
+  size_t getHighWater() const		{ return this->highWater; }
+  size_t getFallbackCount() const	{ return this->fallbackCount; }
+
+private:
+  BigChunkArena(const BigChunkArena &);
+  BigChunkArena &operator=(const BigChunkArena &);
+
+  char *block;			// Primary block
+  size_t size;			// Size of primary block
+  size_t used;			// Bytes used in primary block
+
+  std::vector<char *> overflow;	// Blocks from the system's allocator
+  size_t overflowUsed;		// Bytes handed out from overflow blocks
+  size_t highWater;		// Largest total used between resets
+  size_t fallbackCount;		// Number of overflow blocks ever allocated
+  bool warnOnFallback;
+};
+
+/*
+ * Scope of one phase: everything allocated from the arena while the scope
+ * is alive is released when it ends.  A scope which starts on an empty
+ * arena resets it so that the primary block grows to the high water mark.
+ */
+
+class BigChunkPhase {
+public:
+  BigChunkPhase(BigChunkArena *a) : arena(a), start(a->mark()) {}
+  ~BigChunkPhase()		{ this->arena->release(this->start); }
+
+  BigChunkArena *getArena()	{ return this->arena; }
+
+private:
+  BigChunkPhase(const BigChunkPhase &);
+  BigChunkPhase &operator=(const BigChunkPhase &);
+
+  BigChunkArena *arena;
+  BigChunkMark start;
+};
+
+/*
+ * Arena of the calling thread, created on first use.
+ */
+
+BigChunkArena *bigchunk_thread_arena();
+
+/*
+ * Sum of the high water marks of all thread arenas.
+ */
+
+size_t bigchunk_thread_arena_high_water();
+
+/*
+ * Free all thread arenas (nothing may be allocated from them).
+ */
+
+void bigchunk_thread_arena_cleanup();
+
+/*
+ * Standard allocator drawing from an arena, for std::vector scratch which
+ * lives within one phase.  Deallocation is a no-op.
+ */
+
+template <typename T>
+class bigchunk_arena_allocator
+{
+public:
+  typedef T value_type;
+  typedef T *pointer;
+  typedef T &reference;
+  typedef const T *const_pointer;
+  typedef const T &const_reference;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+
+  template <typename U>
+  struct rebind {
+  	typedef bigchunk_arena_allocator<U> other;
+  };
+
+public:
+  bigchunk_arena_allocator(BigChunkArena *a) throw() : arena(a) {};
+  bigchunk_arena_allocator(const bigchunk_arena_allocator &x) throw()
+    : arena(x.arena) {};
+
+  template <typename U>
+  bigchunk_arena_allocator(const bigchunk_arena_allocator<U> &x) throw()
+    : arena(x.arena) {};
+
+public:
+  ~bigchunk_arena_allocator() throw () {};
+
+public:
+  pointer address(reference x) const { return &x; }
+  const_pointer address (const_reference x) const { return &x; }
+
+  size_type max_size() const throw() { return size_t(-1) / sizeof(T); }
+
+  void construct(pointer p, const_reference val) { ::new ((void*)p) T(val); }
+  void destroy(pointer p) { ((T*)p)->~T(); }
+
+public:
+  pointer allocate(size_type n,
+                   const void * /*hint*/ = 0)
+  {
+    return this->arena->template allocate<T>(n);
+  }
+
+  void deallocate(pointer, size_type) {}
+
+  bool operator==(const bigchunk_arena_allocator &x) const
+  {
+    return this->arena == x.arena;
+  }
+  bool operator!=(const bigchunk_arena_allocator &x) const
+  {
+    return this->arena != x.arena;
+  }
+
+  BigChunkArena *arena;
+};
+
 }
 #endif // __cplusplus
 #endif // BIGCHUNK_H
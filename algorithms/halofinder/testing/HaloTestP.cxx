@@ -58,7 +58,7 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "HaloFinderInput.h"
 #include "Partition.h"
-#include "Timings.h"
+#include "Profiler.h"
 
 #include "ParticleDistribute.h"
 #include "ParticleExchange.h"
@@ -78,6 +78,7 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rru_mpi.h>
 
 using namespace std;
+using cosmotk::Profiler;
 
 /////////////////////////////////////////////////////////////////////////////
 //
@@ -420,8 +421,8 @@ HaloTestP::~HaloTestP()
 
 void HaloTestP::DistributeParticles()
 {
-  static Timings::TimerRef dtimer = Timings::getTimer("Distribute Particles");
-  Timings::startTimer(dtimer);
+  static int dtimer = Profiler::GetRegion("Distribute Particles");
+  Profiler::Begin(dtimer);
 
   // The current PatricleDistribute cannot be reused at this time because
   // it stores information about the number of particles and the names of
@@ -473,7 +474,7 @@ void HaloTestP::DistributeParticles()
       (*this->mass)[i] = this->particleMass;
   }
 
-  Timings::stopTimer(dtimer);
+  Profiler::End(dtimer);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -484,8 +485,8 @@ void HaloTestP::DistributeParticles()
 
 void HaloTestP::FOFHaloFinder()
 {
-  static Timings::TimerRef h1timer = Timings::getTimer("FOF Halo Finder");
-  Timings::startTimer(h1timer);
+  static int h1timer = Profiler::GetRegion("FOF Halo Finder");
+  Profiler::Begin(h1timer);
 
   // Just for testing memory leak by reusing this code PKF
   vector<STATUS_T>* tempStatus = new vector<STATUS_T>(this->numberOfParticles);
@@ -518,7 +519,7 @@ void HaloTestP::FOFHaloFinder()
   tempStatus->clear();
   delete tempStatus;
 
-  Timings::stopTimer(h1timer);
+  Profiler::End(h1timer);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -529,8 +530,8 @@ void HaloTestP::FOFHaloFinder()
 
 void HaloTestP::BasicFOFHaloProperties()
 {
-  static Timings::TimerRef ftimer = Timings::getTimer("FOF Properties");
-  Timings::startTimer(ftimer);
+  static int ftimer = Profiler::GetRegion("FOF Properties");
+  Profiler::Begin(ftimer);
 
   this->fofMass->clear();
   this->fofXPos->clear();
@@ -577,7 +578,7 @@ void HaloTestP::BasicFOFHaloProperties()
   this->fof.FOFVelocityDispersion(this->fofXVel, 
                                 this->fofYVel, this->fofZVel, this->fofVelDisp);
 
-  Timings::stopTimer(ftimer);
+  Profiler::End(ftimer);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -674,8 +675,8 @@ int HaloTestP::MBPCenterFinding(
 
 {
   // Find the index of the particle at the FOF center
-  static Timings::TimerRef cftimer = Timings::getTimer("MBP Center Finder");
-  Timings::startTimer(cftimer);
+  static int cftimer = Profiler::GetRegion("MBP Center Finder");
+  Profiler::Begin(cftimer);
   int centerIndex;
 
   // Create the center finder
@@ -692,7 +693,7 @@ int HaloTestP::MBPCenterFinding(
     centerIndex = centerFinder.mostBoundParticleAStar(minPotential);
   }
 
-  Timings::stopTimer(cftimer);
+  Profiler::End(cftimer);
   return centerIndex;
 }
 
@@ -713,8 +714,8 @@ int HaloTestP::MCPCenterFinding(
 
 {
   // Find the index of the particle at the FOF center
-  static Timings::TimerRef cftimer = Timings::getTimer("MCP Center Finder");
-  Timings::startTimer(cftimer);
+  static int cftimer = Profiler::GetRegion("MCP Center Finder");
+  Profiler::Begin(cftimer);
   int centerIndex = 0;
 
   // Create the center finder
@@ -731,7 +732,7 @@ int HaloTestP::MCPCenterFinding(
   else {
     centerIndex = centerFinder.mostConnectedParticleChainMesh();
   }
-  Timings::stopTimer(cftimer);
+  Profiler::End(cftimer);
   return centerIndex;
 }
 
@@ -747,8 +748,8 @@ int HaloTestP::MCPCenterFinding(
 
 void HaloTestP::FOFSubHaloFinding()
 {
-  static Timings::TimerRef shtimer = Timings::getTimer("SubHalo Finder");
-  Timings::startTimer(shtimer);
+  static int shtimer = Profiler::GetRegion("SubHalo Finder");
+  Profiler::Begin(shtimer);
 
   // Get FOF halo information
   int* fofHaloCount = this->haloFinder.getHaloCount();
@@ -912,7 +913,7 @@ void HaloTestP::FOFSubHaloFinding()
       }
     }
   }
-  Timings::stopTimer(shtimer);
+  Profiler::End(shtimer);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -978,8 +979,8 @@ void HaloTestP::FOFHaloCatalog()
 
 void HaloTestP::SODHaloFinding()
 {
-  static Timings::TimerRef sodtimer = Timings::getTimer("SOD Halo Finder");
-  Timings::startTimer(sodtimer);
+  static int sodtimer = Profiler::GetRegion("SOD Halo Finder");
+  Profiler::Begin(sodtimer);
 
   int* fofHalos = this->haloFinder.getHalos();
   int* fofHaloCount = this->haloFinder.getHaloCount();
@@ -1162,7 +1163,7 @@ void HaloTestP::SODHaloFinding()
     }
     delete chain;
   }
-  Timings::stopTimer(sodtimer);
+  Profiler::End(sodtimer);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -1278,7 +1279,7 @@ int main(int argc, char* argv[])
   cout << "Rank " << Partition::getMyProc() << " FINISHED " << endl;
 
   MPI_Barrier(MPI_COMM_WORLD);
-  Timings::print();
+  Profiler::Print(MPI_COMM_WORLD);
 
   // Shut down MPI
   Partition::finalize();
@@ -48,7 +48,7 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //
 
 #include "HaloFinderInput.h"
-#include "Timings.h"
+#include "Profiler.h"
 
 #include "CosmoHaloFinder.h"
 
@@ -66,6 +66,7 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rru_mpi.h>
 
 using namespace std;
+using cosmotk::Profiler;
 
 /////////////////////////////////////////////////////////////////////////////
 //
@@ -400,8 +401,8 @@ int pkfRecordSize = sizeof(POSVEL_T) * (COSMO_FLOAT+2) +
 
 void SubHaloTest::FOFSubHalo()
 {
-  static Timings::TimerRef h1timer = Timings::getTimer("FOF Halo Finder");
-  Timings::startTimer(h1timer);
+  static int h1timer = Profiler::GetRegion("FOF Halo Finder");
+  Profiler::Begin(h1timer);
 
   // Serial halo finder
   this->haloFinder.np = this->np;
@@ -492,7 +493,7 @@ cout << "Particle " << p << " haloSize " << this->haloSize[p] << endl;
     }
   }
 
-  Timings::stopTimer(h1timer);
+  Profiler::End(h1timer);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -507,8 +508,8 @@ cout << "Particle " << p << " haloSize " << this->haloSize[p] << endl;
 
 void SubHaloTest::FindSubHalos()
 {
-  static Timings::TimerRef shtimer = Timings::getTimer("Find SubHalos");
-  Timings::startTimer(shtimer);
+  static int shtimer = Profiler::GetRegion("Find SubHalos");
+  Profiler::Begin(shtimer);
 
   // Look for subhalos within the FOF halo using extract location arrays
   SubHaloFinder subFinder;
@@ -524,7 +525,7 @@ void SubHaloTest::FindSubHalos()
                         &this->mass[0], &this->smoothingLength[0], &this->density[0], &this->tag[0]);
   subFinder.findSubHalos();
 
-  Timings::stopTimer(shtimer);
+  Profiler::End(shtimer);
 }
 
 /////////////////////////////////////////////////////////////////////////////
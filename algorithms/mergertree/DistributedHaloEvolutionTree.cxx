@@ -8,11 +8,14 @@
 #include "MergerTreeFileFormat.h"
 
 // STL includes
+#include <algorithm>
 #include <cassert>
 #include <cstddef>
 #include <cstdio>
+#include <fstream>
 #include <sstream>
 #include <iomanip>
+#include <iostream>
 #include <set>
 #include <limits>
 
@@ -56,6 +59,8 @@ DistributedHaloEvolutionTree::DistributedHaloEvolutionTree()
   this->NumberOfSplits   = 0;
   this->NumberOfZombies  = 0;
   this->MergerTreeFileFormat = cosmotk::MergerTreeFileFormat::GENERIC_IO_POSIX;
+  this->NumberOfSegments     = 0;
+  this->LastFlushedTimeStep  = -1;
 }
 
 //------------------------------------------------------------------------------
@@ -71,7 +76,7 @@ void DistributedHaloEvolutionTree::InsertNode(
   assert("pre: corrupted merger-tree" && this->EnsureArraysAreConsistent());
 
   // STEP 0: Get hash code for node
-  std::string hashCode = Halo::GetHashCodeForHalo(halo.Tag,halo.TimeStep);
+  HaloKey hashCode = Halo::GetHashCodeForHalo(halo.Tag,halo.TimeStep);
   assert("pre: Encountered duplicate tree node!" && !this->HasNode(hashCode));
 
   // STEP 1: Insert node to list and create node-to-index mapping
@@ -129,9 +134,11 @@ void DistributedHaloEvolutionTree::LinkHalos(
 
   // STEP 0: If the progenitor is local, i.e., exists in this rank, update
   // its descendant list.
-  if(this->HasNode(progenitor->GetHashCode()))
+  HaloKeyMap< int >::iterator iter =
+      this->Node2Idx.find(progenitor->GetHashCode());
+  if(iter != this->Node2Idx.end())
     {
-    int idx = this->Node2Idx[ progenitor->GetHashCode() ];
+    int idx = iter->second;
     halo_link_t link;
     link.ID   = descendant->GlobalID;
     link.Mass = descendant->HaloMass;
@@ -140,9 +147,10 @@ void DistributedHaloEvolutionTree::LinkHalos(
 
   // STEP 1: If the descendant is local, i.e., exists in this rank, update
   // its progenitor list.
-  if(this->HasNode(descendant->GetHashCode()))
+  iter = this->Node2Idx.find(descendant->GetHashCode());
+  if(iter != this->Node2Idx.end())
     {
-    int idx = this->Node2Idx[ descendant->GetHashCode() ];
+    int idx = iter->second;
     this->Progenitors[ idx ].push_back( progenitor->GlobalID );
     }
 
@@ -185,7 +193,7 @@ int DistributedHaloEvolutionTree::GetNumberOfZombieNodes(
 }
 
 //------------------------------------------------------------------------------
-bool DistributedHaloEvolutionTree::HasNode(std::string hashCode)
+bool DistributedHaloEvolutionTree::HasNode(const HaloKey &hashCode)
 {
   if( this->Node2Idx.find(hashCode) == this->Node2Idx.end() )
     {
@@ -245,12 +253,7 @@ int DistributedHaloEvolutionTree::GetTotalNumberOfBytes()
     }
 
   // Sum memory for Node2Idx map
-  std::map< std::string, int >::iterator iter = this->Node2Idx.begin();
-  for(; iter != this->Node2Idx.end(); ++iter )
-    {
-    localNumBytes += iter->first.size()*sizeof(char);
-    localNumBytes += sizeof(int);
-    } // END for for all items in the map
+  localNumBytes += this->Node2Idx.GetNumberOfBytes();
 
   // various statistics
   localNumBytes += 4*sizeof(int)+
@@ -267,28 +270,178 @@ int DistributedHaloEvolutionTree::GetTotalNumberOfBytes()
 
 //------------------------------------------------------------------------------
 void DistributedHaloEvolutionTree::WriteTree(std::string fileName)
+{
+  // STEP 0: When streaming, the nodes in memory make up the last segment
+  if( this->IsStreaming() )
+    {
+    int tstep = -1;
+    for(int i=0; i < this->GetNumberOfNodes(); ++i)
+      {
+      tstep = std::max(tstep,this->Nodes[ i ].TimeStep);
+      }
+    int lastTimeStep = -1;
+    MPI_Allreduce(
+        &tstep,&lastTimeStep,1,MPI_INT,MPI_MAX,this->Communicator);
+    if( lastTimeStep >= 0 )
+      {
+      this->FlushTimeStep( lastTimeStep );
+      }
+    return;
+    }
+
+  // STEP 1: Get the descendant of each node
+  int N = this->GetNumberOfNodes();
+  std::vector< ID_T > descendant(N,-1);
+  for(int i=0; i < N; ++i)
+    {
+    descendant[ i ] = this->GetDescendant( i );
+    }
+
+  // STEP 2: Write the nodes
+  DistributedHaloEvolutionTree::WriteNodes(
+      this->Communicator,this->MergerTreeFileFormat,fileName,
+      (N > 0)? &this->Nodes[0] : NULL,
+      (N > 0)? &descendant[0] : NULL,
+      (N > 0)? &this->EventBitMask[0] : NULL,
+      N);
+}
+
+//------------------------------------------------------------------------------
+void DistributedHaloEvolutionTree::FlushTimeStep(const int tstep)
+{
+  assert("pre: tree is not streamed!" && this->IsStreaming() );
+  assert("pre: corrupted merger-tree" && this->EnsureArraysAreConsistent());
+
+  int rank = 0;
+  MPI_Comm_rank(this->Communicator,&rank);
+
+  // STEP 0: Every rank flushes the same time-step, so all ranks reject it
+  if( (this->NumberOfSegments > 0) && (tstep <= this->LastFlushedTimeStep) )
+    {
+    if( rank == 0 )
+      {
+      std::cerr << "ERROR: time-step " << tstep << " is not after the last ";
+      std::cerr << "flushed time-step " << this->LastFlushedTimeStep;
+      std::cerr << " of segment index " << this->SegmentFilePrefix;
+      std::cerr << std::endl;
+      }
+    MPI_Abort(this->Communicator,-1);
+    }
+
+  // STEP 1: Gather the nodes to flush
+  std::vector< HaloInfo > nodes;
+  std::vector< ID_T > descendant;
+  std::vector< unsigned char > eventMask;
+  std::vector< int > kept;
+  for(int i=0; i < this->GetNumberOfNodes(); ++i)
+    {
+    if( this->Nodes[ i ].TimeStep > tstep )
+      {
+      kept.push_back( i );
+      continue;
+      }
+
+    nodes.push_back( this->Nodes[ i ] );
+    descendant.push_back( this->GetDescendant( i ) );
+    eventMask.push_back( this->EventBitMask[ i ] );
+    } // END for all nodes
+
+  // STEP 2: Write the segment
+  std::string segment =
+      DistributedHaloEvolutionTree::GetSegmentFileName(
+          this->SegmentFilePrefix,tstep);
+  int N = static_cast<int>(nodes.size());
+  DistributedHaloEvolutionTree::WriteNodes(
+      this->Communicator,this->MergerTreeFileFormat,segment,
+      (N > 0)? &nodes[0] : NULL,
+      (N > 0)? &descendant[0] : NULL,
+      (N > 0)? &eventMask[0] : NULL,
+      N);
+
+  // STEP 3: List the segment in the index, replacing the index of any
+  // earlier run with the first segment
+  if( rank == 0 )
+    {
+    std::ofstream ofs;
+    ofs.open(
+      DistributedHaloEvolutionTree::GetSegmentIndexFileName(
+          this->SegmentFilePrefix).c_str(),
+      (this->NumberOfSegments == 0)?
+          std::ios::out | std::ios::trunc : std::ios::out | std::ios::app);
+    ofs << segment << std::endl;
+    ofs.close();
+    }
+  ++this->NumberOfSegments;
+  this->LastFlushedTimeStep = tstep;
+
+  // STEP 4: Compact the nodes kept in memory
+  for(unsigned int k=0; k < kept.size(); ++k)
+    {
+    int i = kept[ k ];
+    if( i == static_cast<int>(k) )
+      {
+      continue;
+      }
+    this->Nodes[ k ] = this->Nodes[ i ];
+    this->Progenitors[ k ].swap( this->Progenitors[ i ] );
+    this->Descendants[ k ].swap( this->Descendants[ i ] );
+    this->EventBitMask[ k ] = this->EventBitMask[ i ];
+    } // END for all kept nodes
+  this->Nodes.resize( kept.size() );
+  this->Progenitors.resize( kept.size() );
+  this->Descendants.resize( kept.size() );
+  this->EventBitMask.resize( kept.size() );
+
+  // STEP 5: Re-index the nodes kept in memory
+  this->Node2Idx.clear();
+  for(int i=0; i < this->GetNumberOfNodes(); ++i)
+    {
+    this->Node2Idx[ Halo::GetHashCodeForHalo(
+        this->Nodes[ i ].Tag,this->Nodes[ i ].TimeStep) ] = i;
+    }
+
+  assert("post: corrupted merger-tree" && this->EnsureArraysAreConsistent());
+}
+
+//------------------------------------------------------------------------------
+std::string DistributedHaloEvolutionTree::GetSegmentFileName(
+      const std::string &prefix, const int tstep)
+{
+  std::ostringstream oss;
+  oss << prefix << "." << tstep;
+  return( oss.str() );
+}
+
+//------------------------------------------------------------------------------
+std::string DistributedHaloEvolutionTree::GetSegmentIndexFileName(
+      const std::string &prefix)
+{
+  return( prefix + ".segments" );
+}
+
+//------------------------------------------------------------------------------
+void DistributedHaloEvolutionTree::WriteNodes(
+      MPI_Comm comm, const int fileFormat, const std::string &fileName,
+      const HaloInfo *nodes, const ID_T *descendants,
+      const unsigned char *eventMasks, const int N)
 {
   // STEP 0: Allocate writer
   GenericIO *writer = NULL;
-  switch(this->MergerTreeFileFormat)
+  switch(fileFormat)
     {
     case MergerTreeFileFormat::GENERIC_IO_MPI:
-      writer = new GenericIO(
-          this->Communicator,fileName,GenericIO::FileIOMPI);
+      writer = new GenericIO(comm,fileName,GenericIO::FileIOMPI);
       break;
     case MergerTreeFileFormat::GENERIC_IO_POSIX:
-      writer = new GenericIO(
-          this->Communicator,fileName,GenericIO::FileIOPOSIX);
+      writer = new GenericIO(comm,fileName,GenericIO::FileIOPOSIX);
       break;
     default:
       std::cerr << "WARNING: invalid file format! ";
       std::cerr << "Defaulting to GENERIC_IO_POSIX\n";
-      writer = new GenericIO(
-          this->Communicator,fileName,GenericIO::FileIOPOSIX);
+      writer = new GenericIO(comm,fileName,GenericIO::FileIOPOSIX);
     } // END switch
 
   // STEP 1: Allocate temporary arrays for writting
-  int N = this->GetNumberOfNodes();
   std::vector< ID_T > treeNodeIds(N+(CRCSize/sizeof(ID_T)),-1);
   std::vector< ID_T > haloTags(N+(CRCSize/sizeof(ID_T)),-1);
   std::vector< REAL > haloMass(N+(CRCSize/sizeof(REAL)),0.0);
@@ -310,22 +463,22 @@ void DistributedHaloEvolutionTree::WriteTree(std::string fileName)
   // STEP 2: Fill arrays
   for(int i=0; i < N; ++i)
     {
-    treeNodeIds[ i ] = this->Nodes[ i ].GlobalID;
-    haloTags[ i ]    = this->Nodes[ i ].Tag;
-    haloMass[ i ]    = this->Nodes[ i ].HaloMass;
-    tsteps[ i ]      = this->Nodes[ i ].TimeStep;
-    redshift[ i ]    = this->Nodes[ i ].Redshift;
-    center_x[ i ]    = this->Nodes[ i ].Center[ 0 ];
-    center_y[ i ]    = this->Nodes[ i ].Center[ 1 ];
-    center_z[ i ]    = this->Nodes[ i ].Center[ 2 ];
-    mcx[ i ]         = this->Nodes[ i ].MeanCenter[ 0 ];
-    mcy[ i ]         = this->Nodes[ i ].MeanCenter[ 1 ];
-    mcz[ i ]         = this->Nodes[ i ].MeanCenter[ 2 ];
-    vx[ i ]          = this->Nodes[ i ].AverageVelocity[ 0 ];
-    vy[ i ]          = this->Nodes[ i ].AverageVelocity[ 1 ];
-    vz[ i ]          = this->Nodes[ i ].AverageVelocity[ 2 ];
-    descendant[ i ]  = this->GetDescendant( i );
-    eventMask[ i ]   = this->EventBitMask[ i ];
+    treeNodeIds[ i ] = nodes[ i ].GlobalID;
+    haloTags[ i ]    = nodes[ i ].Tag;
+    haloMass[ i ]    = nodes[ i ].HaloMass;
+    tsteps[ i ]      = nodes[ i ].TimeStep;
+    redshift[ i ]    = nodes[ i ].Redshift;
+    center_x[ i ]    = nodes[ i ].Center[ 0 ];
+    center_y[ i ]    = nodes[ i ].Center[ 1 ];
+    center_z[ i ]    = nodes[ i ].Center[ 2 ];
+    mcx[ i ]         = nodes[ i ].MeanCenter[ 0 ];
+    mcy[ i ]         = nodes[ i ].MeanCenter[ 1 ];
+    mcz[ i ]         = nodes[ i ].MeanCenter[ 2 ];
+    vx[ i ]          = nodes[ i ].AverageVelocity[ 0 ];
+    vy[ i ]          = nodes[ i ].AverageVelocity[ 1 ];
+    vz[ i ]          = nodes[ i ].AverageVelocity[ 2 ];
+    descendant[ i ]  = descendants[ i ];
+    eventMask[ i ]   = eventMasks[ i ];
     } // END for all nodes
 
   // STEP 3: Register variables & data arrays to the writer
@@ -6,11 +6,18 @@
  * directed graph. Each node in the tree corresponds to a halo and the edges
  * between nodes indicate parent/child relationship. The data-structure is
  * designed s.t. it can be constructed incrementally.
+ *
+ * When a segment file prefix is set, the tree is streamed to disk: the nodes
+ * of a time-step are written to a segment file of their own, and dropped from
+ * memory, as soon as their descendants are known, s.t., only the nodes of the
+ * last two time-steps are kept in memory. The mergertreestitch program joins
+ * the segments into a single file in the format written by WriteTree.
  */
 #ifndef DISTRIBUTEDHALOEVOLUTIONTREE_H_
 #define DISTRIBUTEDHALOEVOLUTIONTREE_H_
 
 #include "CosmoToolsMacros.h"
+#include "HaloKeyMap.h"
 #include "MergerTreeEvent.h"
 #include "MergerTreeFileFormat.h"
 
@@ -18,6 +25,7 @@
 #include <vector> // For STL vector
 #include <map>    // For STL map
 #include <set>    // For STL set
+#include <string> // For STL string
 
 // MPI
 #include <mpi.h>
@@ -49,6 +57,20 @@ public:
    */
   GetNSetMacro(MergerTreeFileFormat,int);
 
+  /**
+   * @brief Get/Set the prefix of the segment files. An empty prefix, the
+   * default, keeps the entire tree in memory. Setting the prefix starts a
+   * new segment index, which replaces any index of an earlier run with the
+   * same prefix at the first flush.
+   */
+  GetMacro(SegmentFilePrefix,std::string);
+  void SetSegmentFilePrefix(const std::string &prefix)
+    {
+    this->SegmentFilePrefix   = prefix;
+    this->NumberOfSegments    = 0;
+    this->LastFlushedTimeStep = -1;
+    }
+
   // Get macros for some of the statistics
   GetMacro(NumberOfMergers,int);
   GetMacro(NumberOfRebirths,int);
@@ -105,7 +127,7 @@ public:
    * @param hashCode the hash code corresponding to the halo in query.
    * @return true iff the halo exists in the tree, else false.
    */
-  bool HasNode( std::string hashCode );
+  bool HasNode( const HaloKey &hashCode );
 
   /**
    * @brief Clears out all the data in this tree
@@ -134,9 +156,67 @@ public:
 
   /**
    * @brief Writes the Tree in GenericIO.
+   * @param fileName the name of the file to write.
+   * @note When the tree is streamed, the nodes still in memory are instead
+   * written to a last segment, and fileName is not written.
+   * @note This method is collective, hence, it must be called by all ranks.
    */
   void WriteTree( std::string fileName );
 
+  /**
+   * @brief Checks if the tree is streamed to segment files.
+   * @return true iff a segment file prefix is set, else, false.
+   */
+  bool IsStreaming() const
+    { return( !this->SegmentFilePrefix.empty() ); }
+
+  /**
+   * @brief Writes the nodes at the given time-step and at all earlier
+   * time-steps to the segment file of the time-step and removes them from
+   * the tree. Rank 0 appends the name of the segment to the segment index,
+   * which it truncates at the first flush after the prefix is set.
+   * @param tstep the last time-step whose nodes have all their descendants.
+   * @pre this->IsStreaming()
+   * @pre tstep is greater than the time-step of any earlier flush, else, the
+   * run is aborted, since the segment would be listed twice.
+   * @note This method is collective, hence, it must be called by all ranks.
+   */
+  void FlushTimeStep(const int tstep);
+
+  /**
+   * @brief Returns the name of the segment file of the given time-step.
+   * @param prefix the segment file prefix.
+   * @param tstep the time-step of the segment.
+   * @return fileName the segment file name, i.e., <prefix>.<tstep>
+   */
+  static std::string GetSegmentFileName(
+        const std::string &prefix, const int tstep);
+
+  /**
+   * @brief Returns the name of the segment index, the file that lists the
+   * segments written so far, one per line, in the order they were written.
+   * @param prefix the segment file prefix.
+   * @return fileName the segment index name, i.e., <prefix>.segments
+   */
+  static std::string GetSegmentIndexFileName(const std::string &prefix);
+
+  /**
+   * @brief Writes the given tree nodes to a GenericIO file in the format of
+   * WriteTree.
+   * @param comm the communicator of the ranks writing the file.
+   * @param fileFormat the file format, see MergerTreeFileFormat.
+   * @param fileName the name of the file to write.
+   * @param nodes the nodes written by this rank.
+   * @param descendants the descendant ID of each node, -1 if none.
+   * @param eventMasks the event bitmask of each node.
+   * @param N the number of nodes written by this rank.
+   * @note This method is collective, hence, it must be called by all ranks.
+   */
+  static void WriteNodes(
+        MPI_Comm comm, const int fileFormat, const std::string &fileName,
+        const HaloInfo *nodes, const ID_T *descendants,
+        const unsigned char *eventMasks, const int N);
+
 protected:
 
   // User-supplied MPI communicator
@@ -157,7 +237,7 @@ protected:
   // Mapping of halo hashcode to the index of the halo in the Nodes vector.
   // Note, Halo hash codes are generated using Halo::GetHashCodeForHalo method.
   // This data-structure is used to determine if a node is in the tree.
-  std::map< std::string, int > Node2Idx;
+  HaloKeyMap< int > Node2Idx;
 
   // VARIOUS STATISTICS
   // Number of Nodes at each time-step
@@ -175,6 +255,10 @@ protected:
 
   int MergerTreeFileFormat;
 
+  std::string SegmentFilePrefix;
+  int NumberOfSegments;     // segments listed in the index so far
+  int LastFlushedTimeStep;  // the time-step of the last segment
+
   /**
    * @brief Issues a split warning message to stderr.
    * @param i the local node index, i.e., index to the Nodes array.
@@ -9,7 +9,9 @@
 #include "Partition.h"
 #include "TemporalHaloInformation.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <vector>
 
 namespace cosmologytools {
@@ -99,6 +101,7 @@ void ForwardHaloTracker::Initialize()
 
   // Set parameters for the halo evolution tree
   this->HaloEvolutionTree->SetCommunicator(this->Communicator);
+  this->HaloEvolutionTree->SetMergerTreeFileFormat(this->MergerTreeFileFormat);
 
   // Set parameters for the merger-tree
   this->HaloMergerTree->SetCommunicator(this->Communicator);
@@ -296,15 +299,25 @@ void ForwardHaloTracker::GetHaloInformation(
 
       ID_T* haloParticles = new ID_T[fofHaloCount[halo]];
       fof->extractHaloParticleIds(halo,haloParticles);
-      for( int hpidx=0; hpidx < fofHaloCount[halo]; ++hpidx)
-        {
-        myHalo.ParticleIds.insert( haloParticles[hpidx] );
-        } // END for all halo particles
+      myHalo.SetHaloParticles(haloParticles,fofHaloCount[halo]);
       delete [] haloParticles;
 
       fof->FOFHaloPosition(halo,myHalo.Center);
       fof->FOFHaloVelocity(halo,myHalo.AverageVelocity);
 
+      // The radius is the distance of the farthest particle from the center
+      POSVEL_T r2 = 0.;
+      int p = fofHalos[halo];
+      for(int i=0; i < fofHaloCount[halo]; ++i)
+        {
+        POSVEL_T dx = this->Px[p]-myHalo.Center[0];
+        POSVEL_T dy = this->Py[p]-myHalo.Center[1];
+        POSVEL_T dz = this->Pz[p]-myHalo.Center[2];
+        r2 = std::max(r2,dx*dx+dy*dy+dz*dz);
+        p  = fofHaloList[p];
+        } // END for all halo particles
+      myHalo.Radius = std::sqrt(r2);
+
       haloData->Halos.push_back(myHalo);
       } // END if halo is big enough
     } // END for all halos
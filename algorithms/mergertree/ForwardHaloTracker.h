@@ -72,6 +72,7 @@ public:
   GetNSetMacro(MergerTreeFileFormat,int);
 
   GetMacro(HaloEvolutionTree,cosmotk::DistributedHaloEvolutionTree*);
+  GetMacro(HaloMergerTree,cosmotk::ParallelHaloMergerTree*);
 
   /**
    * @brief This method finds the halos at the given, registered particle
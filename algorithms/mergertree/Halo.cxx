@@ -9,12 +9,120 @@
 #include <cmath>
 #include <cstddef>
 #include <cstdio>
-#include <sstream>
+#include <functional>
+#include <stdint.h>
 #include <vector>
 
 namespace cosmotk
 {
 
+namespace
+{
+
+//-----------------------------------------------------------------------------
+// Walks the sorted particle IDs of a halo in order, decoding them on the fly
+// iff the halo is compressed.
+class ParticleIdCursor
+{
+public:
+  ParticleIdCursor(const std::vector<ID_T> &ids,
+                   const std::vector<unsigned char> &bytes, int N)
+    {
+    this->Ids       = ids.empty()? NULL : &ids[0];
+    this->Bytes     = bytes.empty()? NULL : &bytes[0];
+    this->Remaining = N;
+    this->Current   = 0;
+    this->Next();
+    }
+
+  bool IsValid() const { return( this->Remaining >= 0 ); }
+  ID_T Get() const { return( this->Current ); }
+
+  void Next()
+    {
+    if( --this->Remaining < 0 )
+      {
+      return;
+      }
+
+    if( this->Bytes == NULL )
+      {
+      this->Current = *this->Ids++;
+      return;
+      }
+
+    uint64_t delta = 0;
+    int shift      = 0;
+    unsigned char byte;
+    do
+      {
+      byte   = *this->Bytes++;
+      delta |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      shift += 7;
+      } while( byte & 0x80 );
+
+    // NOTE: the arithmetic is unsigned so the first, possibly negative, ID
+    // round-trips as a gap from zero.
+    this->Current = static_cast<ID_T>(
+        static_cast<uint64_t>(this->Current) + delta);
+    }
+
+private:
+  const ID_T *Ids;
+  const unsigned char *Bytes;
+  int Remaining;
+  ID_T Current;
+};
+
+//-----------------------------------------------------------------------------
+// Counts the IDs common to two sorted ID arrays. When one is much smaller,
+// each of its IDs is searched for in the rest of the other instead of
+// walking both.
+int CountCommonIds(const ID_T *a, int na, const ID_T *b, int nb)
+{
+  if( na > nb )
+    {
+    std::swap(a,b);
+    std::swap(na,nb);
+    }
+
+  int common = 0;
+  const ID_T *aEnd = a+na;
+  const ID_T *bEnd = b+nb;
+  if( 16*na < nb )
+    {
+    for( ; a != aEnd; ++a )
+      {
+      b = std::lower_bound(b,bEnd,*a);
+      if( b == bEnd )
+        {
+        break;
+        }
+      common += (*b == *a);
+      } // END for all IDs of the smaller array
+    return( common );
+    }
+
+  while( (a != aEnd) && (b != bEnd) )
+    {
+    if( *a < *b )
+      {
+      ++a;
+      }
+    else if( *b < *a )
+      {
+      ++b;
+      }
+    else
+      {
+      ++common; ++a; ++b;
+      }
+    } // END while
+  return( common );
+}
+
+} // END anonymous namespace
+
 int Halo::GetHaloMetadataBytesize()
 {
   return(
@@ -47,14 +155,16 @@ void Halo::CreateDIYHaloInfoType(DIY_Datatype *dtype)
 }
 
 //-----------------------------------------------------------------------------
-void Halo::CreateDIYHaloParticleType(DIY_Datatype *dtype)
+void Halo::CreateDIYHaloParticleBlockType(DIY_Datatype *dtype)
 {
-  struct map_block_t halo_part_map[3] = {
-   {DIY_ID_T, OFST, 1, offsetof(struct HaloParticle, Tag)},
-   {DIY_INT,  OFST, 1, offsetof(struct HaloParticle, TimeStep)},
-   {DIY_ID_T, OFST, 1, offsetof(struct HaloParticle, HaloParticleID)},
+  struct map_block_t halo_block_map[4] = {
+   {DIY_ID_T, OFST, 1, offsetof(struct HaloParticleBlock, Tag)},
+   {DIY_INT,  OFST, 1, offsetof(struct HaloParticleBlock, TimeStep)},
+   {DIY_INT,  OFST, 1, offsetof(struct HaloParticleBlock, NumberOfIds)},
+   {DIY_ID_T, OFST, HALO_PARTICLE_BLOCK_SIZE,
+       offsetof(struct HaloParticleBlock, ParticleIds)},
   };
-  DIY_Create_struct_datatype(0, 3, halo_part_map, dtype);
+  DIY_Create_struct_datatype(0, 4, halo_block_map, dtype);
 }
 
 //-----------------------------------------------------------------------------
@@ -70,6 +180,7 @@ Halo::Halo()
   this->GlobalID = -1;
   this->HaloMass = 0.;
   this->OwnerBlockId = DIY_Gid(0,0);
+  this->NumberOfCompressedIds = 0;
 
   this->Center[0] =
   this->Center[1] =
@@ -82,6 +193,8 @@ Halo::Halo()
   this->AverageVelocity[0] =
   this->AverageVelocity[1] =
   this->AverageVelocity[2] = 0.;
+
+  this->Radius = -1.;
 }
 
 //-----------------------------------------------------------------------------
@@ -134,6 +247,7 @@ Halo::Halo(
 Halo::~Halo()
 {
   this->ParticleIds.clear();
+  this->CompressedIds.clear();
 }
 
 //-----------------------------------------------------------------------------
@@ -153,31 +267,111 @@ void Halo::InitHalo(
     this->Center[i]          = cntr[i];
     this->AverageVelocity[i] = vel[i];
     }
+  this->Radius = -1.;
+
+  this->NumberOfCompressedIds = 0;
+  this->SetHaloParticles(particleIds,N);
+}
 
-  if(particleIds==NULL)
+//-----------------------------------------------------------------------------
+void Halo::SetHaloParticles(ID_T *particleIds, int N)
+{
+  this->ParticleIds.clear();
+  this->CompressedIds.clear();
+  this->NumberOfCompressedIds = 0;
+  if( particleIds == NULL )
     {
     return;
     }
 
-  for( int i=0; i < N; ++i )
+  this->ParticleIds.assign(particleIds,particleIds+N);
+  this->SortParticleIds();
+}
+
+//-----------------------------------------------------------------------------
+void Halo::SortParticleIds()
+{
+  assert("pre: halo is compressed!" && !this->IsCompressed() );
+
+  // Halo finders typically hand over IDs that are already sorted
+  std::vector< ID_T >::iterator iter =
+      std::adjacent_find(
+          this->ParticleIds.begin(),this->ParticleIds.end(),
+          std::greater_equal<ID_T>());
+  if( iter == this->ParticleIds.end() )
     {
-    this->ParticleIds.insert( particleIds[i] );
+    return;
     }
+
+  std::sort(this->ParticleIds.begin(),this->ParticleIds.end());
+  this->ParticleIds.erase(
+      std::unique(this->ParticleIds.begin(),this->ParticleIds.end()),
+      this->ParticleIds.end());
 }
 
 //-----------------------------------------------------------------------------
-void Halo::SetHaloParticles(ID_T *particleIds, int N)
+void Halo::CompressParticleIds()
 {
-  this->ParticleIds.clear();
-  if( particleIds == NULL )
+  if( this->IsCompressed() || this->ParticleIds.empty() )
+    {
+    return;
+    }
+
+  this->CompressedIds.reserve( 2*this->ParticleIds.size() );
+  uint64_t prev = 0;
+  for( unsigned int i=0; i < this->ParticleIds.size(); ++i )
+    {
+    uint64_t id    = static_cast<uint64_t>(this->ParticleIds[i]);
+    uint64_t delta = id-prev;
+    prev           = id;
+    while( delta >= 0x80 )
+      {
+      this->CompressedIds.push_back(
+          static_cast<unsigned char>((delta & 0x7f) | 0x80) );
+      delta >>= 7;
+      }
+    this->CompressedIds.push_back( static_cast<unsigned char>(delta) );
+    } // END for all particle IDs
+
+  this->NumberOfCompressedIds = static_cast<int>(this->ParticleIds.size());
+
+  // NOTE: swap with empty vectors, clear() keeps the capacity
+  std::vector< ID_T >().swap(this->ParticleIds);
+  std::vector< unsigned char >(this->CompressedIds).swap(this->CompressedIds);
+}
+
+//-----------------------------------------------------------------------------
+void Halo::DecompressParticleIds()
+{
+  if( !this->IsCompressed() )
     {
     return;
     }
 
-  for(int i=0; i < N; ++i)
+  std::vector< ID_T > ids;
+  this->GetParticleIds( ids );
+  this->ParticleIds.swap( ids );
+  std::vector< unsigned char >().swap(this->CompressedIds);
+  this->NumberOfCompressedIds = 0;
+}
+
+//-----------------------------------------------------------------------------
+const std::vector<ID_T>& Halo::GetParticleIds(
+      std::vector<ID_T> &buffer) const
+{
+  if( !this->IsCompressed() )
+    {
+    return( this->ParticleIds );
+    }
+
+  buffer.resize( this->NumberOfCompressedIds );
+  ParticleIdCursor cursor(
+      this->ParticleIds,this->CompressedIds,this->NumberOfCompressedIds);
+  for( int i=0; cursor.IsValid(); cursor.Next(), ++i )
     {
-    this->ParticleIds.insert(particleIds[i]);
-    } // END for
+    buffer[ i ] = cursor.Get();
+    }
+  return( buffer );
 }
 
 //-----------------------------------------------------------------------------
@@ -186,15 +380,36 @@ int Halo::Intersect(Halo *h)
   assert("pre: halo to intersect with should not be NULL" && (h != NULL) );
 
   int overlap = 0;
-
-  std::vector<ID_T> overlapParticles;
-  std::set_intersection(
-      this->ParticleIds.begin(),this->ParticleIds.end(),
-      h->ParticleIds.begin(),h->ParticleIds.end(),
-      std::inserter(overlapParticles, overlapParticles.end()));
-
-  overlap = overlapParticles.size();
-  overlapParticles.clear();
+  if( !this->IsCompressed() && !h->IsCompressed() )
+    {
+    overlap = CountCommonIds(
+        this->ParticleIds.empty()? NULL : &this->ParticleIds[0],
+        static_cast<int>(this->ParticleIds.size()),
+        h->ParticleIds.empty()? NULL : &h->ParticleIds[0],
+        static_cast<int>(h->ParticleIds.size()) );
+    }
+  else
+    {
+    ParticleIdCursor a(
+        this->ParticleIds,this->CompressedIds,this->GetNumberOfParticles());
+    ParticleIdCursor b(
+        h->ParticleIds,h->CompressedIds,h->GetNumberOfParticles());
+    while( a.IsValid() && b.IsValid() )
+      {
+      if( a.Get() < b.Get() )
+        {
+        a.Next();
+        }
+      else if( b.Get() < a.Get() )
+        {
+        b.Next();
+        }
+      else
+        {
+        ++overlap; a.Next(); b.Next();
+        }
+      } // END while
+    }
 
   int percentOverlap = static_cast<int>(
       round( 100*( static_cast<double>(overlap)/
@@ -203,20 +418,6 @@ int Halo::Intersect(Halo *h)
   return( percentOverlap );
 }
 
-//-----------------------------------------------------------------------------
-std::string Halo::GetHashCode()
-{
-  return( Halo::GetHashCodeForHalo(this->Tag,this->TimeStep));
-}
-
-//-----------------------------------------------------------------------------
-std::string Halo::GetHashCodeForHalo(ID_T tag, int timestep)
-{
-  std::ostringstream oss;
-  oss << timestep << "." << tag;
-  return( oss.str() );
-}
-
 //-----------------------------------------------------------------------------
 void Halo::Print(std::ostream &os)
 {
@@ -233,10 +434,11 @@ void Halo::Print(std::ostream &os)
   os << std::endl;
 
   os << "HALO Particles: " << std::endl << "\t";
-  std::set< ID_T >::iterator iter = this->ParticleIds.begin();
-  for( ; iter != this->ParticleIds.end(); ++iter )
+  std::vector< ID_T > buffer;
+  const std::vector< ID_T > &ids = this->GetParticleIds( buffer );
+  for( unsigned int i=0; i < ids.size(); ++i )
     {
-    os << *iter << " ";
+    os << ids[ i ] << " ";
     } // END for all halo particles
   os << std::endl;
 }
@@ -262,17 +464,25 @@ void Halo::GetHaloInfo(HaloInfo *halo)
 }
 
 //-----------------------------------------------------------------------------
-void Halo::GetHaloParticlesVector(
-          std::vector<HaloParticle> &haloParticles)
+void Halo::GetHaloParticleBlocks(std::vector<HaloParticleBlock> &blocks)
 {
-  haloParticles.resize(this->ParticleIds.size());
-  std::set< ID_T >::iterator iter = this->ParticleIds.begin();
-  for(int idx=0; iter != this->ParticleIds.end(); ++iter, ++idx)
+  std::vector< ID_T > buffer;
+  const std::vector< ID_T > &ids = this->GetParticleIds( buffer );
+
+  int nids = static_cast<int>(ids.size());
+  blocks.resize(
+     (nids+HALO_PARTICLE_BLOCK_SIZE-1)/HALO_PARTICLE_BLOCK_SIZE );
+  for( unsigned int blk=0; blk < blocks.size(); ++blk )
     {
-    haloParticles[ idx ].Tag            = this->Tag;
-    haloParticles[ idx ].TimeStep       = this->TimeStep;
-    haloParticles[ idx ].HaloParticleID = *iter;
-    } // END for all particles
+    int offset = blk*HALO_PARTICLE_BLOCK_SIZE;
+    blocks[ blk ].Tag         = this->Tag;
+    blocks[ blk ].TimeStep    = this->TimeStep;
+    blocks[ blk ].NumberOfIds =
+        std::min(HALO_PARTICLE_BLOCK_SIZE,nids-offset);
+    std::copy(
+        ids.begin()+offset, ids.begin()+offset+blocks[blk].NumberOfIds,
+        blocks[ blk ].ParticleIds);
+    } // END for all blocks
 }
 
 } /* namespace cosmotk */
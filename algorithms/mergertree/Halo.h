@@ -8,9 +8,9 @@
 #define HALO_H_
 
 #include "CosmoToolsMacros.h"
+#include "HaloKeyMap.h" // For HaloKey
 
 #include <iostream> // For ostream
-#include <set>      // For STL set
 #include <vector>   // For STL vector
 
 #include "diy.h" // For DIY_Datatype
@@ -35,14 +35,20 @@ struct HaloInfo {
 };
 
 /**
- * @struct HaloParticle
- * @brief Used to encapsulate a *single* halo particle ID for communication
- * over DIY.
+ * @brief The number of particle IDs carried by a HaloParticleBlock.
  */
-struct HaloParticle {
+#define HALO_PARTICLE_BLOCK_SIZE 128
+
+/**
+ * @struct HaloParticleBlock
+ * @brief Used to encapsulate a contiguous run of the sorted particle IDs of
+ * a halo for communication over DIY.
+ */
+struct HaloParticleBlock {
   ID_T Tag;
   int TimeStep;
-  ID_T HaloParticleID;
+  int NumberOfIds;
+  ID_T ParticleIds[HALO_PARTICLE_BLOCK_SIZE];
 };
 
 namespace cosmotk
@@ -97,12 +103,48 @@ public:
    */
   void SetHaloParticles(ID_T *particleIds, int N);
 
+  /**
+   * @brief Sorts the particle IDs and removes duplicates. Must be called
+   * after appending particle IDs to ParticleIds directly.
+   */
+  void SortParticleIds();
+
+  /**
+   * @brief Replaces the particle IDs with the gaps between consecutive IDs,
+   * each stored as a variable-length integer, and releases the ID array.
+   * Halos kept across time-steps typically need 1-2 bytes per particle.
+   * @post this->IsCompressed() && this->ParticleIds.empty()
+   */
+  void CompressParticleIds();
+
+  /**
+   * @brief Restores the particle ID array of a compressed halo.
+   * @post !this->IsCompressed()
+   */
+  void DecompressParticleIds();
+
+  /**
+   * @brief Checks if the particle IDs of this halo are compressed.
+   * @return status true if compressed, else false.
+   */
+  bool IsCompressed() const
+    { return( !this->CompressedIds.empty() ); }
+
+  /**
+   * @brief Returns the sorted particle IDs of this halo, decoding them into
+   * the given buffer iff the halo is compressed.
+   * @param buffer storage for the decoded IDs of a compressed halo.
+   * @return ids reference to either ParticleIds or buffer.
+   */
+  const std::vector<ID_T>& GetParticleIds(std::vector<ID_T> &buffer) const;
+
   /**
    * @brief Intersects this halo instance with another halo
    * @param h the halo to intersect with
    * @return N the percentage of particles of the given halo, h, that intersect
    * with this halo instance.
    * @note iff N==0 this halo does not intersect with another halo.
+   * @note Either halo may be compressed.
    */
   int Intersect(Halo *h);
 
@@ -110,8 +152,11 @@ public:
    * @brief Returns the the number of particles in the halo
    * @return N the number of particles
    */
-  int GetNumberOfParticles()
-    {return static_cast<int>(this->ParticleIds.size());}
+  int GetNumberOfParticles() const
+    {
+    return( this->IsCompressed() ? this->NumberOfCompressedIds :
+                static_cast<int>(this->ParticleIds.size()) );
+    }
 
   /**
    * @brief Computes a hashcode for a halo with the given tag(ID) and timestep.
@@ -119,13 +164,20 @@ public:
    * @param timestep the timestep of the halo
    * @return h a hashcode for a halo with the given tag and timestep
    */
-  static std::string GetHashCodeForHalo(ID_T tag, int timestep);
+  static HaloKey GetHashCodeForHalo(ID_T tag, int timestep)
+    {
+    HaloKey key;
+    key.Tag      = tag;
+    key.TimeStep = timestep;
+    return( key );
+    }
 
   /**
    * @brief Gets the hash code of this halo instance.
    * @return h a hashcode for this halo instance.
    */
-  std::string GetHashCode();
+  HaloKey GetHashCode() const
+    { return( Halo::GetHashCodeForHalo(this->Tag,this->TimeStep) ); }
 
   /**
    * @brief Prints a halo to the given C++ output stream
@@ -143,19 +195,13 @@ public:
   void GetHaloInfo(HaloInfo *halo);
 
   /**
-   * @brief Populates a user-supplied vector with HaloParticle instances
-   * corresponding to the particles of this halos.
-   * @param haloParticles vector of particles to populate.
-   * @post haloParticles.size() == this->GetNumberOfParticles()
-   * @post haloParticles[ i ].Tag == this->Tag \f$ \forall i \f$
-   * @post haloParticles[ i ].TimeStep == this->TimeStep \f$ \forall i \f$
-   * @post haloParticles[ i ].HaloParticleID == *(this->ParticleIds.begin()+i)
-   * \f$ \forall i \f$ i.e., each HaloParticle in the output vector corresponds
-   * to a particle in the ParticleIds list associated with this instance.
-   * @see HaloParticle
+   * @brief Populates a user-supplied vector with the HaloParticleBlock
+   * instances that carry the sorted particle IDs of this halo, in order.
+   * @param blocks vector of blocks to populate.
+   * @post the concatenated IDs of the blocks equal the IDs of this halo.
+   * @see HaloParticleBlock
    */
-  void GetHaloParticlesVector(
-          std::vector<HaloParticle> &haloParticles);
+  void GetHaloParticleBlocks(std::vector<HaloParticleBlock> &blocks);
 
   /**
    * @brief Returns the bytesize of the metadata for a halo instance.
@@ -170,10 +216,10 @@ public:
   static void CreateDIYHaloInfoType(DIY_Datatype *dtype);
 
   /**
-   * @brief Registers a DIY data-type to represent halo particles.
+   * @brief Registers a DIY data-type to represent a HaloParticleBlock.
    * @param dtype pointer to the DIY data type
    */
-  static void CreateDIYHaloParticleType(DIY_Datatype *dtype);
+  static void CreateDIYHaloParticleBlockType(DIY_Datatype *dtype);
 
 
   int Count;                    // A count used for book-keeping the number of
@@ -197,10 +243,15 @@ public:
   POSVEL_T Center[3];            // The halo-center
   POSVEL_T MeanCenter[3];        // Alternate halo-center definition
   POSVEL_T AverageVelocity[3];   // The average velocity of the halo
-  std::set< ID_T > ParticleIds;  // The global particle IDs of the halo
-
+  POSVEL_T Radius;               // Max distance of a particle from the
+                                // halo-center, or negative if not known.
+  std::vector< ID_T > ParticleIds; // The global particle IDs of the halo,
+                                  // sorted and unique. Empty iff the halo
+                                  // is compressed.
 
 private:
+  std::vector< unsigned char > CompressedIds; // Delta/varint encoded IDs
+  int NumberOfCompressedIds;                   // Number of encoded IDs
 
   /**
    * @brief Custom constructor
@@ -0,0 +1,189 @@
+/**
+ * @brief HaloKey identifies a halo by its (tag,timestep) pair and HaloKeyMap
+ * is an open-addressing hash map keyed by it, used for the halo lookups of
+ * the merger-tree.
+ *
+ * Entries are stored contiguously in the order they were inserted, which is
+ * also the order they are iterated in, so results do not depend on the hash
+ * function. Entries cannot be erased individually.
+ */
+#ifndef HALOKEYMAP_H_
+#define HALOKEYMAP_H_
+
+#include "CosmoToolsDefinitions.h" // For ID_T
+
+#include <cstddef>  // For size_t
+#include <stdint.h> // For uint64_t
+#include <utility>  // For STL pair
+#include <vector>   // For STL vector
+
+namespace cosmotk
+{
+
+/**
+ * @struct HaloKey
+ * @brief The (tag,timestep) pair that uniquely identifies a halo.
+ */
+struct HaloKey {
+  ID_T Tag;
+  int TimeStep;
+
+  bool operator==(const HaloKey &rhs) const
+    { return( (this->Tag==rhs.Tag) && (this->TimeStep==rhs.TimeStep) ); }
+  bool operator!=(const HaloKey &rhs) const
+    { return( !(*this==rhs) ); }
+
+  /**
+   * @brief Returns a hash of the key with all bits well mixed, s.t., its low
+   * bits can be used directly as a table index.
+   */
+  uint64_t Hash() const
+    {
+    uint64_t h = static_cast<uint64_t>(this->Tag) ^
+        (static_cast<uint64_t>(static_cast<uint32_t>(this->TimeStep)) << 40);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return( h );
+    }
+};
+
+template<class T>
+class HaloKeyMap
+{
+public:
+  typedef std::pair<HaloKey,T> value_type;
+  typedef typename std::vector<value_type>::iterator iterator;
+  typedef typename std::vector<value_type>::const_iterator const_iterator;
+
+  iterator begin() { return( this->Entries.begin() ); }
+  iterator end()   { return( this->Entries.end() ); }
+  const_iterator begin() const { return( this->Entries.begin() ); }
+  const_iterator end() const   { return( this->Entries.end() ); }
+
+  size_t size() const { return( this->Entries.size() ); }
+  bool empty() const  { return( this->Entries.empty() ); }
+
+  /**
+   * @brief Removes all entries.
+   */
+  void clear()
+    {
+    this->Entries.clear();
+    this->Slots.clear();
+    }
+
+  /**
+   * @brief Sizes the table to hold n entries without rehashing.
+   * @param n the number of entries.
+   */
+  void reserve(size_t n)
+    {
+    this->Entries.reserve(n);
+    if( 2*n > this->Slots.size() )
+      {
+      this->Rehash(2*n);
+      }
+    }
+
+  /**
+   * @brief Finds the entry with the given key.
+   * @param key the key in query.
+   * @return iter iterator to the entry, or end() if there is none.
+   */
+  iterator find(const HaloKey &key)
+    {
+    int idx = this->FindIndex(key);
+    return( (idx < 0)? this->end() : this->Entries.begin()+idx );
+    }
+  const_iterator find(const HaloKey &key) const
+    {
+    int idx = this->FindIndex(key);
+    return( (idx < 0)? this->end() : this->Entries.begin()+idx );
+    }
+
+  /**
+   * @brief Returns the value of the given key, inserting a default value iff
+   * the key is not in the map.
+   * @param key the key in query.
+   * @return value reference to the value of the key.
+   */
+  T& operator[](const HaloKey &key)
+    {
+    if( 2*(this->Entries.size()+1) > this->Slots.size() )
+      {
+      this->Rehash( 2*(this->Entries.size()+1) );
+      }
+
+    size_t slot = this->FindSlot(key);
+    if( this->Slots[slot] < 0 )
+      {
+      this->Slots[slot] = static_cast<int>(this->Entries.size());
+      this->Entries.push_back( value_type(key,T()) );
+      }
+    return( this->Entries[ this->Slots[slot] ].second );
+    }
+
+  /**
+   * @brief Returns the number of bytes held by the map, excluding any memory
+   * held by the values themselves.
+   */
+  size_t GetNumberOfBytes() const
+    {
+    return( this->Entries.capacity()*sizeof(value_type) +
+            this->Slots.capacity()*sizeof(int) );
+    }
+
+private:
+  std::vector< value_type > Entries; // entries in insertion order
+  std::vector< int > Slots;          // index into Entries, or -1 if empty
+
+  /**
+   * @brief Returns the slot that holds the key, or the empty slot where it
+   * would be inserted, probing linearly from its hash.
+   * @pre the table has at least one empty slot.
+   */
+  size_t FindSlot(const HaloKey &key) const
+    {
+    size_t mask = this->Slots.size()-1;
+    size_t slot = static_cast<size_t>(key.Hash()) & mask;
+    while( (this->Slots[slot] >= 0) &&
+           (this->Entries[this->Slots[slot]].first != key) )
+      {
+      slot = (slot+1) & mask;
+      }
+    return( slot );
+    }
+
+  /**
+   * @brief Returns the index of the entry with the key, or -1.
+   */
+  int FindIndex(const HaloKey &key) const
+    {
+    return( this->Slots.empty()? -1 : this->Slots[this->FindSlot(key)] );
+    }
+
+  /**
+   * @brief Grows the table to the next power of two of at least n slots and
+   * re-inserts all entries.
+   */
+  void Rehash(size_t n)
+    {
+    size_t nslots = 16;
+    while( nslots < n )
+      {
+      nslots <<= 1;
+      }
+
+    this->Slots.assign(nslots,-1);
+    for( unsigned int idx=0; idx < this->Entries.size(); ++idx )
+      {
+      this->Slots[ this->FindSlot(this->Entries[idx].first) ] = idx;
+      }
+    }
+};
+
+} /* namespace cosmotk */
+#endif /* HALOKEYMAP_H_ */
@@ -4,9 +4,15 @@
 #include "HaloType.h"
 
 // C/C++ includes
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <fstream>
+#include <iostream>
 
 namespace cosmotk
 {
@@ -27,11 +33,29 @@ HaloMergerTreeKernel::HaloMergerTreeKernel()
 //------------------------------------------------------------------------------
 HaloMergerTreeKernel::~HaloMergerTreeKernel()
 {
-  this->HaloSimilarityMatrix.clear();
+  this->RowOffsets.clear();
+  this->OverlapColumns.clear();
+  this->OverlapPercent.clear();
+  this->ParticleRows.clear();
   this->MatrixColumnSum.clear();
   this->MatrixRowSum.clear();
 }
 
+//------------------------------------------------------------------------------
+void HaloMergerTreeKernel::SetMergerTreeThreshold(const int threshold)
+{
+  assert("pre: merger-tree threshold must be at least 1" && (threshold > 0));
+
+  if( threshold <= 0 )
+    {
+    std::cerr << "ERROR: merger-tree threshold " << threshold;
+    std::cerr << " must be at least 1! Keeping ";
+    std::cerr << this->MergerTreeThreshold << std::endl;
+    return;
+    }
+
+  this->MergerTreeThreshold = threshold;
+}
 
 //------------------------------------------------------------------------------
 void HaloMergerTreeKernel::UpdateMergerTree(
@@ -78,22 +102,24 @@ void HaloMergerTreeKernel::ComputeMergerTree( )
   this->SplitHalos.clear();
   this->MergeHalos.clear();
   this->ProcessedColumns.clear();
+  this->BirthColumns.clear();
   this->NumberOfBirths = 0;
   this->NumberOfRebirths = 0;
 
   int nrows = this->Sizes[0];
   int ncol  = this->Sizes[1];
-  this->HaloSimilarityMatrix.resize( nrows*ncol,0 );
-  this->MatrixRowSum.resize(nrows,0);
-  this->MatrixColumnSum.resize(ncol,0);
 
   // STEP 1: Initialize row-sum and column-sum
-  std::fill(
-      this->HaloSimilarityMatrix.begin(),this->HaloSimilarityMatrix.end(),0);
-  std::fill(this->MatrixRowSum.begin(),this->MatrixRowSum.end(),0);
-  std::fill(this->MatrixColumnSum.begin(),this->MatrixColumnSum.end(),0);
-
-  // STEP 2: Compute similarity matrix
+  this->MatrixRowSum.assign(nrows,0);
+  this->MatrixColumnSum.assign(ncol,0);
+  this->RowOffsets.assign(nrows+1,0);
+  this->OverlapColumns.clear();
+  this->OverlapPercent.clear();
+
+  // STEP 2: Map the particles of each halo at the previous timestep to the
+  // row of the halo.
+  this->ParticleRows.clear();
+  std::vector< ID_T > particleIds; // decoded IDs of a compressed halo
   for( int row=0; row < nrows; ++row )
     {
     // STEP 2.0: Propagate zombies across timesteps without further checking
@@ -107,25 +133,164 @@ void HaloMergerTreeKernel::ComputeMergerTree( )
       continue;
       }
 
-    // STEP 2.1: Loop through all columns in this row
-    for( int col=0; col < ncol; ++col )
+    const std::vector< ID_T > &ids =
+        this->Halos1[row].GetParticleIds( particleIds );
+    for( unsigned int i=0; i < ids.size(); ++i )
+      {
+      this->ParticleRows.push_back( std::make_pair(ids[i],row) );
+      } // END for all particles of the halo
+    } // END for all rows
+  std::sort(this->ParticleRows.begin(),this->ParticleRows.end());
+
+  // STEP 3: Stream the particles of each halo at the current timestep
+  // through the map, counting the particles it shares with each halo at the
+  // previous timestep. The particle IDs of a halo are sorted, so the search
+  // for each one starts where the search for the previous one ended. Columns
+  // are independent, so they are handed out to threads, each of which keeps
+  // the overlaps of its columns in column order.
+  int nthreads = 1;
+#ifdef _OPENMP
+  nthreads = omp_get_max_threads();
+#endif
+  std::vector< std::vector<int> > entryRows(nthreads);
+  std::vector< std::vector<int> > entryPercent(nthreads);
+  std::vector< int > columnThread(ncol,0); // thread that computed the column
+  std::vector< int > columnStart(ncol,0);  // first overlap of the column
+  std::vector< int > columnCount(ncol,0);  // number of overlaps of the column
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+  {
+  int thread = 0;
+#ifdef _OPENMP
+  thread = omp_get_thread_num();
+#endif
+  std::vector< int > &rows    = entryRows[ thread ];
+  std::vector< int > &percent = entryPercent[ thread ];
+  std::vector< int > sharedParticles(nrows,0);
+  std::vector< int > sharedRows;
+  std::vector< ID_T > colParticleIds; // decoded IDs of a compressed halo
+
+  // Halo sizes are power law distributed so hand out columns dynamically
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic,16)
+#endif
+  for( int col=0; col < ncol; ++col )
+    {
+    columnThread[ col ] = thread;
+    columnStart[ col ]  = static_cast<int>(rows.size());
+
+    sharedRows.clear();
+    std::vector< std::pair<ID_T,int> >::iterator pos =
+        this->ParticleRows.begin();
+    const std::vector< ID_T > &ids =
+        this->Halos2[col].GetParticleIds( colParticleIds );
+    for( unsigned int i=0; i < ids.size(); ++i )
       {
-      int overlap = -1;
-      if(!HaloType::IsType(this->Halos1[row].HaloTypeMask,HaloType::GHOST) ||
-         !HaloType::IsType(this->Halos2[col].HaloTypeMask,HaloType::GHOST))
+      // NOTE: rows are non-negative, so this finds the first pair of the ID
+      pos = std::lower_bound(
+          pos,this->ParticleRows.end(),std::make_pair(ids[i],-1));
+      for( ; (pos != this->ParticleRows.end()) && (pos->first == ids[i]); ++pos)
         {
-        overlap = this->Halos1[row].Intersect(&this->Halos2[col]);
+        if( sharedParticles[pos->second]++ == 0 )
+          {
+          sharedRows.push_back(pos->second);
+          }
+        } // END for all halos the particle belongs to
+      } // END for all particles of the halo
+
+    // STEP 3.1: Compute the percent overlap with every halo that shares
+    // particles with this halo. Overlaps between two ghost halos are not
+    // computed.
+    for( unsigned int i=0; i < sharedRows.size(); ++i )
+      {
+      int row    = sharedRows[i];
+      int shared = sharedParticles[row];
+      sharedParticles[row] = 0;
+
+      if(HaloType::IsType(this->Halos1[row].HaloTypeMask,HaloType::GHOST) &&
+         HaloType::IsType(this->Halos2[col].HaloTypeMask,HaloType::GHOST))
+        {
+        continue;
         }
 
-      this->HaloSimilarityMatrix[row*ncol+col] = overlap;
+      int overlap = static_cast<int>(
+          round( 100*( static_cast<double>(shared)/
+              static_cast<double>(this->Halos1[row].GetNumberOfParticles()))));
+      rows.push_back(row);
+      percent.push_back(overlap);
+
+      // NOTE: only this thread writes the sum of this column
       if( this->MajorityRuleCheck(overlap) )
         {
         this->MatrixColumnSum[ col ]++;
-        this->MatrixRowSum[ row ]++;
         } // END if
+      } // END for all overlapping rows
 
-      } // END for all columns
-    } // END for all rows
+    columnCount[ col ] = static_cast<int>(rows.size())-columnStart[ col ];
+    } // END for all columns
+  } // END parallel region
+
+  // STEP 4: Arrange the overlaps by row, visiting the columns in order
+  // regardless of which thread computed them, so the columns of each row
+  // remain sorted and the result does not depend on the number of threads.
+  // The row sums are accumulated here, since rows are shared among columns.
+  int nentries = 0;
+  for( int col=0; col < ncol; ++col )
+    {
+    if( columnCount[col] == 0 )
+      {
+      continue;
+      }
+
+    const int *rows    = &entryRows[ columnThread[col] ][ columnStart[col] ];
+    const int *percent = &entryPercent[ columnThread[col] ][ columnStart[col] ];
+    for( int i=0; i < columnCount[col]; ++i )
+      {
+      this->RowOffsets[ rows[i]+1 ]++;
+      if( this->MajorityRuleCheck(percent[i]) )
+        {
+        this->MatrixRowSum[ rows[i] ]++;
+        }
+      } // END for all overlaps of the column
+    nentries += columnCount[col];
+    } // END for all columns
+  for( int row=0; row < nrows; ++row )
+    {
+    this->RowOffsets[ row+1 ] += this->RowOffsets[ row ];
+    }
+
+  this->OverlapColumns.resize(nentries);
+  this->OverlapPercent.resize(nentries);
+  std::vector< int > next(this->RowOffsets.begin(),this->RowOffsets.end()-1);
+  for( int col=0; col < ncol; ++col )
+    {
+    if( columnCount[col] == 0 )
+      {
+      continue;
+      }
+
+    const int *rows    = &entryRows[ columnThread[col] ][ columnStart[col] ];
+    const int *percent = &entryPercent[ columnThread[col] ][ columnStart[col] ];
+    for( int i=0; i < columnCount[col]; ++i )
+      {
+      int idx = next[ rows[i] ]++;
+      this->OverlapColumns[ idx ] = col;
+      this->OverlapPercent[ idx ] = percent[ i ];
+      } // END for all overlaps of the column
+    } // END for all columns
+
+  // STEP 5: Halos at the current timestep that match no halo from the
+  // previous timestep are born at the current timestep.
+  for( int col=0; col < ncol; ++col )
+    {
+    if( !this->IsHaloGhost(&this->Halos2[col]) &&
+        (this->MatrixColumnSum[col]==0) )
+      {
+      this->BirthColumns.push_back(col);
+      }
+    } // END for all columns
 
 //  this->PrintMatrix();
 }
@@ -220,105 +385,140 @@ void HaloMergerTreeKernel::DetectEvent(
   assert("pre: rowEvent is undefined!" &&
          (rowEvent != MergerTreeEvent::UNDEFINED) );
 
-  int ncol     = this->Sizes[1];
-  int colEvent = MergerTreeEvent::UNDEFINED;
-  for(int col=0; col < ncol; ++col)
+  // Only the columns of halos born at this timestep, or of halos that share
+  // particles with the halo of this row, can have an event. Visit them in
+  // column order, as a scan of the full row would.
+  std::vector< int >::iterator birth = this->BirthColumns.begin();
+  int entry = this->RowOffsets[ row ];
+  int end   = this->RowOffsets[ row+1 ];
+  while( (birth != this->BirthColumns.end()) || (entry < end) )
     {
-    colEvent = MergerTreeEvent::UNDEFINED;
-
-    // STEP 0: Short-circuit if we have finished processing this column
-    if( this->ProcessedColumns.find(col) != this->ProcessedColumns.end() )
+    int col     = -1;
+    int overlap = 0;
+    if( (entry == end) ||
+        ((birth != this->BirthColumns.end()) &&
+         (*birth <= this->OverlapColumns[entry])) )
       {
-      continue;
+      col = *birth;
+      ++birth;
       }
-
-    // STEP 1: Get the current halo and percent overlap computed in
-    // ComputeMergerTree
-    Halo* currHalo = &this->Halos2[col];
-    assert("pre: current halo is NULL!" && (currHalo != NULL) );
-    assert("pre: halo at current timestep cannot be a zombie" &&
-           !HaloType::IsType(currHalo->HaloTypeMask,HaloType::ZOMBIE) );
-    int overlap = this->HaloSimilarityMatrix[row*ncol+col];
-
-    // STEP 2: Check if this is a new halo
-    if( !this->IsHaloGhost(currHalo) && (this->MatrixColumnSum[col]==0) )
+    else
       {
-      // This is a birth of a new halo that is not related to any halos from
-      // the previous time-step
-      ++this->NumberOfBirths;
-      unsigned char bitmask;
-      MergerTreeEvent::Reset(bitmask);
-      MergerTreeEvent::SetEvent(bitmask,MergerTreeEvent::BIRTH);
-      this->InsertHalo(currHalo,bitmask,mergerTree);
-      ProcessedColumns.insert(col);
+      col = this->OverlapColumns[entry];
       }
 
-    // STEP 3: Check if the majority rule passes. If it passes, detect the
-    // event type and insert the node to the tree, linking it to the halo
-    // from the previous time-step.
-    else if(this->MajorityRuleCheck(overlap))
+    if( (entry < end) && (this->OverlapColumns[entry] == col) )
       {
-      unsigned char bitmask;
-      MergerTreeEvent::Reset(bitmask);
+      overlap = this->OverlapPercent[entry];
+      ++entry;
+      }
 
-      switch(this->MatrixColumnSum[col])
-        {
-        case 1:
-          {
-          MergerTreeEvent::SetEvent(bitmask,MergerTreeEvent::CONTINUATION);
+    this->DetectColumnEvent(row,col,overlap,rowEvent,prevHalo,mergerTree);
+    } // END for all columns
 
-          if( HaloType::IsType(prevHalo->HaloTypeMask,HaloType::ZOMBIE) )
-            {
-            MergerTreeEvent::SetEvent(bitmask,MergerTreeEvent::REBIRTH);
-            if(!this->IsHaloGhost(currHalo))
-              {
-              ++this->NumberOfRebirths;
-              }
-            }
+  // All births are processed by the first row that gets here
+  this->BirthColumns.clear();
+}
 
-          if( rowEvent == MergerTreeEvent::SPLIT )
-            {
-            MergerTreeEvent::SetEvent(bitmask,MergerTreeEvent::SPLIT);
-            }
+//------------------------------------------------------------------------------
+void HaloMergerTreeKernel::DetectColumnEvent(
+        const int row, const int col, const int overlap, const int rowEvent,
+        Halo* prevHalo, DistributedHaloEvolutionTree *mergerTree)
+{
+  assert("pre: row index is out-of-bounds!" &&
+         (row >= 0) && (row < this->Sizes[0]) );
+  assert("pre: column index is out-of-bounds!" &&
+         (col >= 0) && (col < this->Sizes[1]) );
+
+  // STEP 0: Short-circuit if we have finished processing this column
+  if( this->ProcessedColumns.find(col) != this->ProcessedColumns.end() )
+    {
+    return;
+    }
+
+  // STEP 1: Get the current halo
+  Halo* currHalo = &this->Halos2[col];
+  assert("pre: current halo is NULL!" && (currHalo != NULL) );
+  assert("pre: halo at current timestep cannot be a zombie" &&
+         !HaloType::IsType(currHalo->HaloTypeMask,HaloType::ZOMBIE) );
+
+  // STEP 2: Check if this is a new halo
+  if( !this->IsHaloGhost(currHalo) && (this->MatrixColumnSum[col]==0) )
+    {
+    // This is a birth of a new halo that is not related to any halos from
+    // the previous time-step
+    ++this->NumberOfBirths;
+    unsigned char bitmask;
+    MergerTreeEvent::Reset(bitmask);
+    MergerTreeEvent::SetEvent(bitmask,MergerTreeEvent::BIRTH);
+    this->InsertHalo(currHalo,bitmask,mergerTree);
+    ProcessedColumns.insert(col);
+    }
+
+  // STEP 3: Check if the majority rule passes. If it passes, detect the
+  // event type and insert the node to the tree, linking it to the halo
+  // from the previous time-step.
+  else if(this->MajorityRuleCheck(overlap))
+    {
+    unsigned char bitmask;
+    MergerTreeEvent::Reset(bitmask);
+
+    switch(this->MatrixColumnSum[col])
+      {
+      case 1:
+        {
+        MergerTreeEvent::SetEvent(bitmask,MergerTreeEvent::CONTINUATION);
 
-          if( !this->IsHaloGhost(currHalo) )
+        if( HaloType::IsType(prevHalo->HaloTypeMask,HaloType::ZOMBIE) )
+          {
+          MergerTreeEvent::SetEvent(bitmask,MergerTreeEvent::REBIRTH);
+          if(!this->IsHaloGhost(currHalo))
             {
-            this->InsertHalo(currHalo,bitmask,mergerTree);
+            ++this->NumberOfRebirths;
             }
+          }
 
-          mergerTree->LinkHalos(prevHalo,currHalo);
-          this->ProcessedColumns.insert( col );
+        if( rowEvent == MergerTreeEvent::SPLIT )
+          {
+          MergerTreeEvent::SetEvent(bitmask,MergerTreeEvent::SPLIT);
           }
-          break;
-        default:
-          assert("pre: merger must be with 2 or more halos" &&
-                  (this->MatrixColumnSum[col] >= 2) );
 
-          this->MergeHalos.insert(col);
+        if( !this->IsHaloGhost(currHalo) )
+          {
+          this->InsertHalo(currHalo,bitmask,mergerTree);
+          }
 
-          MergerTreeEvent::SetEvent(bitmask,MergerTreeEvent::MERGE);
+        mergerTree->LinkHalos(prevHalo,currHalo);
+        this->ProcessedColumns.insert( col );
+        }
+        break;
+      default:
+        assert("pre: merger must be with 2 or more halos" &&
+                (this->MatrixColumnSum[col] >= 2) );
 
-          if( HaloType::IsType(prevHalo->HaloTypeMask,HaloType::ZOMBIE) )
-            {
-            MergerTreeEvent::SetEvent(bitmask,MergerTreeEvent::REBIRTH);
-            }
+        this->MergeHalos.insert(col);
 
-          if( rowEvent == MergerTreeEvent::SPLIT )
-            {
-            MergerTreeEvent::SetEvent(bitmask,MergerTreeEvent::SPLIT);
-            }
+        MergerTreeEvent::SetEvent(bitmask,MergerTreeEvent::MERGE);
 
-          if( !this->IsHaloGhost(currHalo) &&
-              !mergerTree->HasNode(currHalo->GetHashCode()))
-            {
-            this->InsertHalo(currHalo,bitmask,mergerTree);
-            }
+        if( HaloType::IsType(prevHalo->HaloTypeMask,HaloType::ZOMBIE) )
+          {
+          MergerTreeEvent::SetEvent(bitmask,MergerTreeEvent::REBIRTH);
+          }
 
-          mergerTree->LinkHalos(prevHalo,currHalo);
-        } // END switch
-      } // END if majority rule passes
-    } // END for all columns
+        if( rowEvent == MergerTreeEvent::SPLIT )
+          {
+          MergerTreeEvent::SetEvent(bitmask,MergerTreeEvent::SPLIT);
+          }
+
+        if( !this->IsHaloGhost(currHalo) &&
+            !mergerTree->HasNode(currHalo->GetHashCode()))
+          {
+          this->InsertHalo(currHalo,bitmask,mergerTree);
+          }
 
+        mergerTree->LinkHalos(prevHalo,currHalo);
+      } // END switch
+    } // END if majority rule passes
 }
 
 //------------------------------------------------------------------------------
@@ -331,13 +531,14 @@ void HaloMergerTreeKernel::PrintMatrix(int rank)
   std::ofstream ofs;
   ofs.open( oss.str().c_str() );
 
+  // Each row lists the non-zero entries as column:overlap
   int nrows = this->Sizes[0];
   int ncol  = this->Sizes[1];
   for(int row=0; row < nrows; ++row )
     {
-    for(int col=0; col < ncol; ++col )
+    for(int i=this->RowOffsets[row]; i < this->RowOffsets[row+1]; ++i )
       {
-      ofs << this->HaloSimilarityMatrix[row*ncol+col] << " ";
+      ofs << this->OverlapColumns[i] << ":" << this->OverlapPercent[i] << " ";
       }
 
     ofs << "|| " << this->MatrixRowSum[ row ];
@@ -14,6 +14,7 @@
 
 // C/C++ includes
 #include <cassert> // For assert()
+#include <utility> // For STL pair
 #include <vector>  // For STL vector
 #include <set>     // For STL set
 
@@ -33,9 +34,15 @@ public:
   GetNSetMacro(Verbose,bool);
 
   /**
-   * @brief Get/Set macro for the merger-tree. Default is 10.
+   * @brief Get/Set the merger-tree threshold, i.e., the minimum percent of
+   * a previous halo's particles that must be found in a next halo for the
+   * two halos to be linked. Default is 50.
+   * @note The threshold must be at least 1. Only halo pairs that share
+   * particles are examined, so a threshold <= 0 can no longer link pairs
+   * with no overlap and is rejected.
    */
-  GetNSetMacro(MergerTreeThreshold,int);
+  GetMacro(MergerTreeThreshold,int);
+  void SetMergerTreeThreshold(const int threshold);
 
   /**
    * @brief Get/Set macro for the zombie cut-off. Default is 5.
@@ -129,6 +136,12 @@ protected:
   // needs to be checked.
   std::set< int > ProcessedColumns;
 
+  // Sorted list of columns in the similarity matrix that correspond to halos
+  // born at the current timestep, i.e., halos that do not match any halo from
+  // the previous timestep. These are all processed by the first call to
+  // DetectEvent.
+  std::vector< int > BirthColumns;
+
   // The MatrixColumnSum stores the sum of each column in the similarity
   // matrix. Based on this sum, we can infer, if a new halo is "born" or
   // if we have a merge event.
@@ -140,8 +153,17 @@ protected:
 
   // The similarity matrix stores the percent similarity of halo at a previous
   // timestep, i.e., Halos1, and a halo at the current timestep, i.e., the
-  // array Halos2.
-  std::vector< int > HaloSimilarityMatrix; // Flat 2-D matrix
+  // array Halos2. Since most pairs of halos share no particles, the matrix is
+  // stored in compressed row form: the columns and overlaps of row i are at
+  // [RowOffsets[i], RowOffsets[i+1]) of OverlapColumns and OverlapPercent,
+  // sorted by column. Pairs of halos that share no particles are not stored.
+  std::vector< int > RowOffsets;
+  std::vector< int > OverlapColumns;
+  std::vector< int > OverlapPercent;
+
+  // The particle IDs of all the halos at the previous timestep, sorted, each
+  // paired with the row of the halo it belongs to.
+  std::vector< std::pair<ID_T,int> > ParticleRows;
 
   bool Verbose;     // Parameter that indicate whether to print out debug
                      // output and other information.
@@ -258,6 +280,10 @@ protected:
    * will compute the corresponding merger-tree matrix. The merger-tree is
    * defined in an MxN matrix, H, wherein H(i,j) > MergerThreeThreshold
    * indicates that halo_i \in t_1 is a parent of halo_j \in t_2.
+   * @note Only the non-zero entries of H are computed, by mapping the
+   * particles of the halos at t1 to their halo and looking up the particles
+   * of each halo at t2 in that map, so the cost grows with the number of
+   * particles rather than with M*N.
    */
   void ComputeMergerTree();
 
@@ -281,6 +307,21 @@ protected:
       const int row, const int rowEvent,
       Halo *prevHalo, DistributedHaloEvolutionTree *t);
 
+  /**
+   * @brief Detects the event between the halo of a previous timestep and a
+   * halo at the current timestep and updates the merger-tree accordingly.
+   * @param row the row-index of the halo from the previous timestep.
+   * @param col the column-index of the halo at the current timestep.
+   * @param overlap the percent overlap of the two halos.
+   * @param rowEvent the event detected for the halo of the previous timestep.
+   * @param prevHalo the halo from the previous timestep.
+   * @param t the merger-tree being updated.
+   * @see DetectEvent
+   */
+  void DetectColumnEvent(
+      const int row, const int col, const int overlap, const int rowEvent,
+      Halo *prevHalo, DistributedHaloEvolutionTree *t);
+
   /**
    * @brief Prints the current instance of the similarity matrix.
    * @param rank optional parameter used to
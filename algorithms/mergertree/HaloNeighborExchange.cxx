@@ -14,8 +14,14 @@ namespace cosmotk
 
 HaloNeighborExchange::HaloNeighborExchange()
 {
-  this->Communicator = MPI_COMM_NULL;
+  this->Communicator   = MPI_COMM_NULL;
+  this->HasBlockBounds = false;
+  this->Margin         = 0.;
 
+  for( int i=0; i < 3; ++i )
+    {
+    this->BlockMin[i] = this->BlockMax[i] = 0.;
+    }
 }
 
 //------------------------------------------------------------------------------
@@ -24,6 +30,18 @@ HaloNeighborExchange::~HaloNeighborExchange()
   this->EnqueuedHalos.clear();
 }
 
+//------------------------------------------------------------------------------
+void HaloNeighborExchange::SetBlockBounds(
+      const POSVEL_T min[3], const POSVEL_T max[3])
+{
+  for( int i=0; i < 3; ++i )
+    {
+    this->BlockMin[i] = min[i];
+    this->BlockMax[i] = max[i];
+    }
+  this->HasBlockBounds = true;
+}
+
 //------------------------------------------------------------------------------
 void HaloNeighborExchange::EnqueueHalo(Halo* h)
 {
@@ -54,6 +72,7 @@ void HaloNeighborExchange::ExchangeHalos(
   // 'neighborHalos' data-structure. Second, the particle IDs of each halo
   // are exchanged.
   HaloHashMap neighborHalos;
+  this->ComputeNeighborDirections(localHalos,N);
   this->ExchangeHaloInformation(localHalos,N,neighborHalos);
   this->ExchangeHaloParticles(localHalos,N,neighborHalos);
 
@@ -87,6 +106,89 @@ void HaloNeighborExchange::ExchangeHalos(
   neighborHalos.clear();
 }
 
+//------------------------------------------------------------------------------
+void HaloNeighborExchange::ComputeNeighborDirections(
+      Halo *localHalos, const int N)
+{
+  static const unsigned char lowDirs[3]  = { DIY_X0, DIY_Y0, DIY_Z0 };
+  static const unsigned char highDirs[3] = { DIY_X1, DIY_Y1, DIY_Z1 };
+
+  this->Directions.resize( 26*N );
+  this->NumberOfDirections.resize( N );
+
+  for( int hidx=0; hidx < N; ++hidx )
+    {
+    Halo &h = localHalos[ hidx ];
+    if( !this->HasBlockBounds || (h.Radius < 0.) )
+      {
+      this->NumberOfDirections[ hidx ] = -1;
+      continue;
+      }
+
+    // STEP 0: Find the faces of the block the halo comes within the margin of
+    POSVEL_T extent = h.Radius + this->Margin;
+    bool low[3], high[3];
+    for( int i=0; i < 3; ++i )
+      {
+      low[i]  = (h.Center[i]-extent < this->BlockMin[i]);
+      high[i] = (h.Center[i]+extent > this->BlockMax[i]);
+      }
+
+    // STEP 1: The halo is sent across every face, edge and corner whose
+    // faces it all comes near
+    unsigned char *dirs = &this->Directions[ 26*hidx ];
+    int ndirs = 0;
+    int offset[3];
+    for( offset[0]=-1; offset[0] <= 1; ++offset[0] )
+      {
+      for( offset[1]=-1; offset[1] <= 1; ++offset[1] )
+        {
+        for( offset[2]=-1; offset[2] <= 1; ++offset[2] )
+          {
+          unsigned char dir = 0;
+          bool touches      = true;
+          for( int i=0; touches && (i < 3); ++i )
+            {
+            if( offset[i] < 0 )
+              {
+              touches = low[i];
+              dir    |= lowDirs[i];
+              }
+            else if( offset[i] > 0 )
+              {
+              touches = high[i];
+              dir    |= highDirs[i];
+              }
+            } // END for all dimensions
+
+          if( touches && (dir != 0) )
+            {
+            dirs[ ndirs++ ] = dir;
+            }
+          } // END for all z offsets
+        } // END for all y offsets
+      } // END for all x offsets
+
+    this->NumberOfDirections[ hidx ] = ndirs;
+    } // END for all local halos
+}
+
+//------------------------------------------------------------------------------
+void HaloNeighborExchange::EnqueueHaloItem(
+      const int hidx, void *item, size_t size)
+{
+  int ndirs = this->NumberOfDirections[ hidx ];
+  if( ndirs < 0 )
+    {
+    DIY_Enqueue_item_all(0, 0, item, NULL, size, NULL);
+    }
+  else if( ndirs > 0 )
+    {
+    DIY_Enqueue_item_dirs(
+        0, 0, item, NULL, size, &this->Directions[ 26*hidx ], ndirs, NULL);
+    }
+}
+
 //------------------------------------------------------------------------------
 void HaloNeighborExchange::ExchangeHaloInformation(
       Halo *localHalos, const int N, HaloHashMap& neighborHalos )
@@ -97,9 +199,12 @@ void HaloNeighborExchange::ExchangeHaloInformation(
   HaloInfo hinfo;
   for( int hidx=0; hidx < N; ++hidx )
     {
+    if( this->NumberOfDirections[ hidx ] == 0 )
+      {
+      continue;
+      }
     localHalos[ hidx ].GetHaloInfo( &hinfo );
-    DIY_Enqueue_item_all(
-       0, 0, (void*)&hinfo, NULL, sizeof(HaloInfo), NULL);
+    this->EnqueueHaloItem(hidx, (void*)&hinfo, sizeof(HaloInfo));
     } // END for all local halos
 
   // STEP 1: Allocate receive buffer and exchange data with neighbors
@@ -136,45 +241,59 @@ void HaloNeighborExchange::ExchangeHaloInformation(
 void HaloNeighborExchange::ExchangeHaloParticles(
       Halo *localHalos, const int N, HaloHashMap& neighborHalos )
 {
-  // STEP 0: Enqueue HaloParticle objects to send to neighbors
-  std::vector< HaloParticle > hparticles;
+  // STEP 0: Enqueue the sorted particle IDs of each halo, in blocks of
+  // contiguous IDs, to send to neighbors
+  std::vector< HaloParticleBlock > hblocks;
   for(int hidx=0; hidx < N; ++hidx)
     {
-    localHalos[ hidx ].GetHaloParticlesVector( hparticles );
-    for(int pidx=0; pidx < hparticles.size(); ++pidx )
+    if( this->NumberOfDirections[ hidx ] == 0 )
+      {
+      continue;
+      }
+    localHalos[ hidx ].GetHaloParticleBlocks( hblocks );
+    for(unsigned int blk=0; blk < hblocks.size(); ++blk )
       {
-      DIY_Enqueue_item_all(
-         0, 0, (void*)&hparticles[pidx], NULL, sizeof(HaloParticle),
-         NULL);
-      } // END for all halo particles
+      this->EnqueueHaloItem(
+         hidx, (void*)&hblocks[blk], sizeof(HaloParticleBlock));
+      } // END for all blocks of the halo
     } // END for all halos
 
   // STEP 1: Allocate receive buffer and exchange data with neighbors
-  int nblocks              = 1;
-  void ***rcvHaloParticles = new void**[nblocks];
-  int *numParticlesRcvd    = new int[ nblocks];
+  int nblocks           = 1;
+  void ***rcvHaloBlocks = new void**[nblocks];
+  int *numBlocksRcvd    = new int[ nblocks];
   DIY_Exchange_neighbors(
-    0,rcvHaloParticles,numParticlesRcvd,1.0,&Halo::CreateDIYHaloParticleType);
+    0,rcvHaloBlocks,numBlocksRcvd,1.0,&Halo::CreateDIYHaloParticleBlockType);
 
-  // STEP 2:Unpack halo particles
-  HaloParticle *haloParticle = NULL;
+  // STEP 2: Unpack halo particle blocks
+  HaloParticleBlock *haloBlock = NULL;
   for(int i=0; i < nblocks; ++i)
     {
-    for(int j=0; j < numParticlesRcvd[i]; ++j)
+    for(int j=0; j < numBlocksRcvd[i]; ++j)
       {
-      haloParticle = (struct HaloParticle*)rcvHaloParticles[i][j];
-      std::string hashCode =
-          Halo::GetHashCodeForHalo(haloParticle->Tag,haloParticle->TimeStep);
-      assert( neighborHalos.find(hashCode) != neighborHalos.end() );
-      neighborHalos[hashCode].ParticleIds.insert(
-          haloParticle->HaloParticleID);
-      } // END for all particles of this block
+      haloBlock = (struct HaloParticleBlock*)rcvHaloBlocks[i][j];
+      HaloHashMap::iterator halo = neighborHalos.find(
+          Halo::GetHashCodeForHalo(haloBlock->Tag,haloBlock->TimeStep));
+      assert( halo != neighborHalos.end() );
+      std::vector< ID_T > &ids = halo->second.ParticleIds;
+      ids.insert(
+          ids.end(),haloBlock->ParticleIds,
+          haloBlock->ParticleIds+haloBlock->NumberOfIds);
+      } // END for all particle blocks of this block
     } // END for all blocks
 
-  // STEP 3: Clean up
+  // STEP 3: Blocks arrive in the order they were sent, in which case this
+  // only checks that the IDs of each halo are sorted
+  HaloHashMap::iterator iter = neighborHalos.begin();
+  for( ; iter != neighborHalos.end(); ++iter )
+    {
+    iter->second.SortParticleIds();
+    }
+
+  // STEP 4: Clean up
   DIY_Flush_neighbors(
-    0, rcvHaloParticles, numParticlesRcvd, &Halo::CreateDIYHaloParticleType);
-  delete [] numParticlesRcvd;
+    0, rcvHaloBlocks, numBlocksRcvd, &Halo::CreateDIYHaloParticleBlockType);
+  delete [] numBlocksRcvd;
 }
 
 } /* namespace cosmotk */
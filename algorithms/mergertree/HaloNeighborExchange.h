@@ -2,6 +2,12 @@
  * @brief HaloNeighborExchange implements functionality for exchanging a set
  * of halos with neighboring processes over the DIY communication
  * infrastructure.
+ *
+ * By default every halo is sent to all neighbors. When the bounds of the
+ * local block are set, a halo is only sent to the neighbors across the faces,
+ * edges and corners of the block that its extent, i.e., its center plus its
+ * radius, comes within the margin of. Halos that do not come near any face are
+ * not sent at all and halos with no known radius are sent to all neighbors.
  * @note To use this class, DIY must be initialized and decomposed accordingly.
  */
 #ifndef HALONEIGHBOREXCHANGE_H_
@@ -14,11 +20,10 @@
 #include <mpi.h>  // For MPI_Comm
 
 // C/C++ includes
-#include <map>    // For STL map
 #include <vector> // For STL vector
 
 // Data-structure to store halos based on hash-code
-typedef std::map<std::string,cosmotk::Halo> HaloHashMap;
+typedef cosmotk::HaloKeyMap<cosmotk::Halo> HaloHashMap;
 
 namespace cosmotk
 {
@@ -31,6 +36,27 @@ public:
 
   GetNSetMacro(Communicator,MPI_Comm);
 
+  /**
+   * @brief Get/Set the distance from the block faces within which a halo is
+   * sent to the neighbors across them, which should cover how far halo
+   * particles move between the time-steps that are compared. Zero by default.
+   */
+  GetNSetMacro(Margin,POSVEL_T);
+
+  /**
+   * @brief Sets the bounds of the local block, s.t., halos are only sent to
+   * the neighbors they come within the margin of.
+   * @param min the minimum corner of the block.
+   * @param max the maximum corner of the block.
+   */
+  void SetBlockBounds(const POSVEL_T min[3], const POSVEL_T max[3]);
+
+  /**
+   * @brief Unsets the bounds of the local block, s.t., all halos are sent to
+   * all neighbors.
+   */
+  void ClearBlockBounds() { this->HasBlockBounds = false; };
+
   /**
    * @brief Enqueues a halo to send to neighboring processes
    * @param halo pointer to the halo to send
@@ -69,8 +95,36 @@ public:
 protected:
   MPI_Comm Communicator;
 
+  bool HasBlockBounds;
+  POSVEL_T BlockMin[3];
+  POSVEL_T BlockMax[3];
+  POSVEL_T Margin;
+
   std::vector< Halo  > EnqueuedHalos;
 
+  // The DIY neighbor directions each local halo is sent to, 26 per halo,
+  // and the number of directions of each halo, or -1 for all neighbors.
+  std::vector< unsigned char > Directions;
+  std::vector< int > NumberOfDirections;
+
+  /**
+   * @brief Computes the neighbor directions each of the given halos is sent
+   * to in this->Directions and this->NumberOfDirections.
+   * @param localHalos array consisting of the halos in this process.
+   * @param N the number of local halos in this process.
+   */
+  void ComputeNeighborDirections(Halo *localHalos, const int N);
+
+  /**
+   * @brief Enqueues an item of the halo with the given index to the
+   * neighbors the halo is sent to.
+   * @param hidx the index of the halo.
+   * @param item pointer to the item to send.
+   * @param size the size of the item in bytes.
+   * @pre ComputeNeighborDirections has been called for the local halos.
+   */
+  void EnqueueHaloItem(const int hidx, void *item, size_t size);
+
   /**
    * @brief Exchanges the HaloInformation object of each halo.
    * @param localHalos array consisting of the halos in this process.
@@ -5,7 +5,7 @@
 #include "HaloNeighborExchange.h"
 #include "HaloType.h"
 #include "MPIUtilities.h"
-#include "TaskTimer.h"
+#include "Profiler.h"
 
 // DIY communication sub-strate
 #include "diy.h"
@@ -19,6 +19,7 @@ namespace cosmotk
 ParallelHaloMergerTree::ParallelHaloMergerTree()
 {
   this->Communicator     = MPI_COMM_NULL;
+  this->CompressHalos    = false;
   this->CurrentIdx       = this->PreviousIdx = -1;
   this->NumberOfNodes    = 0;
   this->NeighborExchange = new HaloNeighborExchange();
@@ -46,7 +47,7 @@ void ParallelHaloMergerTree::UpdateMergerTree(
   assert("pre: HaloNeighborExchange object is NULL!" &&
           (this->NeighborExchange != NULL) );
 
-  TaskTimer exchangeTimer, mtreeTimer, buildTreeTimer,handleDeathTimer;
+  ProfilerRegion updateTimer(Profiler::GetPhaseRegion("UpdateMergerTree"));
 
   int nrank		  = 0;
   int averageSize = 0;
@@ -72,7 +73,7 @@ void ParallelHaloMergerTree::UpdateMergerTree(
 	MPIUtilities::Printf(this->Communicator,"EXCHANGE HALOS...\n");
     }
 
-  exchangeTimer.StartTimer();
+  ProfilerRegion exchangeTimer("ExchangeHalos");
   if( this->TemporalHalos.size() == 0 )
     {
     // This is the first time that we run the algorithm, so we must communicate
@@ -102,12 +103,12 @@ void ParallelHaloMergerTree::UpdateMergerTree(
     this->NeighborExchange->ExchangeHalos(
         haloSet2,N,this->TemporalHalos[this->CurrentIdx]);
     }
-  exchangeTimer.StopTimer();
+  exchangeTimer.Stop();
   if( this->Verbose )
     {
 	MPIUtilities::Printf(
 		   this->Communicator,"EXCHANGE HALOS [DONE] (%f)\n",
-	   	   exchangeTimer.GetEllapsedTime());
+	   	   exchangeTimer.GetElapsedTime());
     }
 
   // STEP 1: Register halos
@@ -116,7 +117,7 @@ void ParallelHaloMergerTree::UpdateMergerTree(
 	MPIUtilities::Printf(this->Communicator,"COMPUTE SIMILARITY MATRIX...\n");
     }
 
-  mtreeTimer.StartTimer();
+  ProfilerRegion mtreeTimer("SimilarityMatrix");
   this->RegisterHalos(
       t1,&this->TemporalHalos[this->PreviousIdx][0],
           this->TemporalHalos[this->PreviousIdx].size(),
@@ -126,12 +127,12 @@ void ParallelHaloMergerTree::UpdateMergerTree(
 
   // STEP 2: Compute merger-tree
   this->ComputeMergerTree();
-  mtreeTimer.StopTimer();
+  mtreeTimer.Stop();
   if( this->Verbose )
     {
 	MPIUtilities::Printf(
 			this->Communicator,"SIMILARITY MATRIX [DONE] (%f)\n",
-			mtreeTimer.GetEllapsedTime() );
+			mtreeTimer.GetElapsedTime() );
     }
 
   //this->PrintMatrix( this->GetRank() );
@@ -142,14 +143,14 @@ void ParallelHaloMergerTree::UpdateMergerTree(
 	MPIUtilities::Printf(this->Communicator,"BUILD MERGER TREE...\n");
     }
 
-  buildTreeTimer.StartTimer();
+  ProfilerRegion buildTreeTimer("BuildMergerTree");
   this->UpdateHaloEvolutionTree( t );
-  buildTreeTimer.StopTimer();
+  buildTreeTimer.Stop();
   if( this->Verbose )
     {
 	MPIUtilities::Printf(
 			this->Communicator,"BUILD MERGER TREE [DONE] (%f)\n",
-			buildTreeTimer.GetEllapsedTime());
+			buildTreeTimer.GetElapsedTime());
     }
 
   // STEP 4: Print diagnostics for this interval
@@ -184,18 +185,37 @@ void ParallelHaloMergerTree::UpdateMergerTree(
 	MPIUtilities::Printf(this->Communicator,"HANDLE DEATH EVENTS...\n");
     }
 
-  handleDeathTimer.StartTimer();
+  ProfilerRegion handleDeathTimer("HandleDeathEvents");
   this->HandleDeathEvents( t );
-  handleDeathTimer.StopTimer();
+  handleDeathTimer.Stop();
 
   if( this->Verbose )
     {
 	MPIUtilities::Printf(
 			this->Communicator,"HANDLE DEATH EVENTS [DONE] (%f)",
-			handleDeathTimer.GetEllapsedTime());
+			handleDeathTimer.GetElapsedTime());
     }
 
-  // STEP 6: Barrier synchronization
+  // STEP 6: The nodes at t1 now have all their descendants, so a streamed
+  // tree writes them out
+  if( t->IsStreaming() )
+    {
+    ProfilerRegion flushTimer("FlushMergerTree");
+    t->FlushTimeStep( t1 );
+    }
+
+  // STEP 7: Compress the halos at the current time-step, which are kept
+  // until the next time-step
+  if( this->CompressHalos )
+    {
+    std::vector< Halo > &halos = this->TemporalHalos[ this->CurrentIdx ];
+    for( unsigned int hidx=0; hidx < halos.size(); ++hidx )
+      {
+      halos[ hidx ].CompressParticleIds();
+      }
+    }
+
+  // STEP 8: Barrier synchronization
   this->Barrier();
 }
 
@@ -455,7 +475,7 @@ int ParallelHaloMergerTree::GetTotalNumberOfHaloParticles()
      {
      for(unsigned int hidx=0; hidx < this->TemporalHalos[t].size(); ++hidx)
        {
-       nHaloParticles += this->TemporalHalos[t][hidx].ParticleIds.size();
+       nHaloParticles += this->TemporalHalos[t][hidx].GetNumberOfParticles();
        } // END for all previous halos
      } // END for all timesteps
    } // END if
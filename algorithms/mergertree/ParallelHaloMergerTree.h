@@ -10,12 +10,12 @@
 
 #include "CosmoToolsMacros.h"
 #include "DistributedHaloEvolutionTree.h"
+#include "HaloKeyMap.h"
 
 // MPI
 #include <mpi.h>
 
 // STL data-structures
-#include <map>
 #include <vector>
 
 namespace cosmotk
@@ -26,7 +26,7 @@ class Halo;
 class HaloNeighborExchange;
 
 // Data-structure to store halos based on hash-code
-typedef std::map<std::string,Halo> HaloHashMap;
+typedef HaloKeyMap<Halo> HaloHashMap;
 
 class ParallelHaloMergerTree: public HaloMergerTreeKernel
 {
@@ -39,6 +39,21 @@ public:
    */
   GetNSetMacro(Communicator,MPI_Comm);
 
+  /**
+   * @brief Get/Set whether to compress the particle IDs of the halos kept
+   * in memory until the next time-step, which trades the time to decode them
+   * at the next call to UpdateMergerTree for a several times smaller memory
+   * footprint in between. Off by default.
+   */
+  GetNSetMacro(CompressHalos,bool);
+
+  /**
+   * @brief Returns the object used to exchange halos with neighboring
+   * processes, e.g., to set the block bounds that limit which halos are
+   * exchanged.
+   */
+  GetMacro(NeighborExchange,HaloNeighborExchange*);
+
   /**
    * @brief Returns rank of this process.
    * @return r the rank of this process.
@@ -127,6 +142,7 @@ public:
 
 protected:
    MPI_Comm Communicator;
+   bool CompressHalos;
 
    // Keeps an incremental count of the number of nodes, i.e., halos per
    // time-step including zombies. Used for calculation of Global IDs.
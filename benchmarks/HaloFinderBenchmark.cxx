@@ -0,0 +1,686 @@
+/*=========================================================================
+                                                                                
+Copyright (c) 2007, Los Alamos National Security, LLC
+
+All rights reserved.
+
+Copyright 2007. Los Alamos National Security, LLC. 
+This software was produced under U.S. Government contract DE-AC52-06NA25396 
+for Los Alamos National Laboratory (LANL), which is operated by 
+Los Alamos National Security, LLC for the U.S. Department of Energy. 
+The U.S. Government has rights to use, reproduce, and distribute this software. 
+NEITHER THE GOVERNMENT NOR LOS ALAMOS NATIONAL SECURITY, LLC MAKES ANY WARRANTY,
+EXPRESS OR IMPLIED, OR ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  
+If software is modified to produce derivative works, such modified software 
+should be clearly marked, so as not to confuse it with the version available 
+from LANL.
+ 
+Additionally, redistribution and use in source and binary forms, with or 
+without modification, are permitted provided that the following conditions 
+are met:
+-   Redistributions of source code must retain the above copyright notice, 
+    this list of conditions and the following disclaimer. 
+-   Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution. 
+-   Neither the name of Los Alamos National Security, LLC, Los Alamos National
+    Laboratory, LANL, the U.S. Government, nor the names of its contributors
+    may be used to endorse or promote products derived from this software 
+    without specific prior written permission. 
+
+THIS SOFTWARE IS PROVIDED BY LOS ALAMOS NATIONAL SECURITY, LLC AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ARE DISCLAIMED. IN NO EVENT SHALL LOS ALAMOS NATIONAL SECURITY, LLC OR 
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+                                                                                
+=========================================================================*/
+
+// .NAME HaloFinderBenchmark - throughput of the halo finder kernels on
+//                             synthetic particles
+//
+// .SECTION Description
+// Generates particles with SyntheticParticles on every processor and
+// times each kernel on them, reporting particles processed per second:
+//
+//   fof        CosmoHaloFinder::Finding on all particles
+//   chainmesh  ChainingMesh construction on all particles
+//   mbp        HaloCenterFinder most bound particle of every halo
+//   mcp        HaloCenterFinder most connected particle of every halo
+//   sod        SODHalo mass profile around halos large enough for SOD
+//   bhtree     BHTree SPH density of halos large enough for subhalos
+//   fofprops   FOFHaloProperties mass, position, velocity and dispersion
+//
+// Each kernel is run a number of times and the best time of the slowest
+// processor is kept.  Kernels over halos are reported as n/a and left out
+// of the results when no halo is generated, as with -g uniform, or when no
+// halo is large enough for them.  Results can be written as a baseline and a later
+// run compared against it, failing when a kernel is slower than the
+// baseline by more than the tolerance.
+//
+// Usage: HaloFinderBenchmark [-n particles] [-g uniform|nfw|powerlaw]
+//                            [-k kernel,...] [-r repeats] [-s seed]
+//                            [-f haloFraction] [-t tolerance]
+//                            [-b baseline] [-w baseline]
+//
+
+#include "Partition.h"
+#include "SyntheticParticles.h"
+#include "CosmoHaloFinder.h"
+#include "ChainingMesh.h"
+#include "HaloCenterFinder.h"
+#include "SODHalo.h"
+#include "BHTree.h"
+#include "FOFHaloProperties.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <math.h>
+
+#include <mpi.h>
+
+using namespace std;
+using namespace cosmologytools;
+
+// Overload zone around the region of each processor
+const POSVEL_T BENCHMARK_DEAD_SIZE = 4.0;
+
+// Linking length in units of the interparticle spacing
+const POSVEL_T BENCHMARK_BB = 0.2;
+
+/////////////////////////////////////////////////////////////////////////
+//
+// Result of one kernel over all processors
+//
+/////////////////////////////////////////////////////////////////////////
+
+struct BenchmarkResult {
+  string kernel;
+  double particles;             // Particles processed by all processors
+  double seconds;               // Best time of the slowest processor
+  double rate;                  // Particles per second
+};
+
+class HaloFinderBenchmark;
+typedef long (HaloFinderBenchmark::*BenchmarkKernel)();
+
+class HaloFinderBenchmark {
+public:
+  HaloFinderBenchmark(int argc, char* argv[]);
+  ~HaloFinderBenchmark();
+
+  bool isValid()                { return this->valid; }
+
+  // Generate the particles of this processor and the halo lists
+  void GenerateParticles();
+
+  // Time every requested kernel
+  void RunKernels();
+
+  // Write results as a baseline or compare with one, on rank 0
+  void WriteBaseline();
+  bool CompareBaseline();
+
+private:
+  // Kernels return the number of particles they processed
+  long FOFKernel();
+  long ChainingMeshKernel();
+  long MBPKernel();
+  long MCPKernel();
+  long SODKernel();
+  long BHTreeKernel();
+  long FOFPropertiesKernel();
+
+  void TimeKernel(const string& name, BenchmarkKernel kernel);
+  void PrintNotApplicable(const string& name, const string& reason);
+  void Usage();
+
+  int myProc;
+  int numProc;
+  bool valid;
+
+  // Options
+  long totalParticles;
+  int type;
+  vector<string> kernels;
+  int repeats;
+  unsigned int seed;
+  double haloFraction;
+  double tolerance;
+  string baselineIn;
+  string baselineOut;
+
+  // Problem shared by the kernels
+  SyntheticParticles particles;
+  POSVEL_T np;                  // Particles along a side of the box
+  POSVEL_T rL;                  // Box size with a spacing of one
+  long totalHalos;              // Generated halos on all processors
+  vector<int> haloStart;        // Generated halos in FOFHaloProperties form
+  vector<int> haloCount;
+  vector<int> haloList;
+  ChainingMesh* chain;          // Buckets of all particles for SOD halos
+
+  vector<BenchmarkResult> results;
+};
+
+/////////////////////////////////////////////////////////////////////////
+//
+// Parse the command line, all processors see the same options
+//
+/////////////////////////////////////////////////////////////////////////
+
+HaloFinderBenchmark::HaloFinderBenchmark(int argc, char* argv[])
+{
+  this->myProc = Partition::getMyProc();
+  this->numProc = Partition::getNumProc();
+  this->valid = true;
+  this->chain = 0;
+  this->totalHalos = 0;
+
+  this->totalParticles = 1000000;
+  this->type = POWER_LAW_HALOS;
+  this->repeats = 3;
+  this->seed = 1;
+  this->haloFraction = 0.5;
+  this->tolerance = 0.1;
+
+  string kernelList = "fof,chainmesh,mbp,mcp,sod,bhtree,fofprops";
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (i + 1 >= argc || arg.size() != 2 || arg[0] != '-') {
+      this->valid = false;
+      break;
+    }
+    string value = argv[++i];
+    switch (arg[1]) {
+      case 'n': this->totalParticles = atol(value.c_str()); break;
+      case 'g': this->type = SyntheticParticles::getType(value); break;
+      case 'k': kernelList = value; break;
+      case 'r': this->repeats = atoi(value.c_str()); break;
+      case 's': this->seed = (unsigned int) atol(value.c_str()); break;
+      case 'f': this->haloFraction = atof(value.c_str()); break;
+      case 't': this->tolerance = atof(value.c_str()); break;
+      case 'b': this->baselineIn = value; break;
+      case 'w': this->baselineOut = value; break;
+      default: this->valid = false; break;
+    }
+  }
+
+  istringstream names(kernelList);
+  string name;
+  while (getline(names, name, ','))
+    if (!name.empty())
+      this->kernels.push_back(name);
+
+  if (this->totalParticles < this->numProc || this->type < 0 ||
+      this->repeats < 1 || this->kernels.empty())
+    this->valid = false;
+
+  if (!this->valid && this->myProc == MASTER)
+    Usage();
+}
+
+HaloFinderBenchmark::~HaloFinderBenchmark()
+{
+  delete this->chain;
+}
+
+void HaloFinderBenchmark::Usage()
+{
+  cout << "Usage: HaloFinderBenchmark [-n particles] [-g uniform|nfw|powerlaw]"
+       << endl
+       << "         [-k fof,chainmesh,mbp,mcp,sod,bhtree,fofprops]"
+       << " [-r repeats]" << endl
+       << "         [-s seed] [-f haloFraction] [-t tolerance]"
+       << " [-b baseline] [-w baseline]" << endl;
+}
+
+/////////////////////////////////////////////////////////////////////////
+//
+// The box holds the requested particles at a spacing of one and each
+// processor fills its region of the decomposition with its share
+//
+/////////////////////////////////////////////////////////////////////////
+
+void HaloFinderBenchmark::GenerateParticles()
+{
+  this->np = (POSVEL_T) floor(pow((double) this->totalParticles, 1.0 / 3.0)
+                              + 0.5);
+  this->rL = this->np;
+
+  int layoutSize[DIMENSION], layoutPos[DIMENSION];
+  Partition::getDecompSize(layoutSize);
+  Partition::getMyPosition(layoutPos);
+
+  POSVEL_T minLoc[DIMENSION], maxLoc[DIMENSION];
+  for (int dim = 0; dim < DIMENSION; dim++) {
+    POSVEL_T step = this->rL / layoutSize[dim];
+    minLoc[dim] = layoutPos[dim] * step;
+    maxLoc[dim] = minLoc[dim] + step;
+  }
+
+  this->particles.setRegion(minLoc, maxLoc);
+  this->particles.setSeed(this->seed + this->myProc);
+  this->particles.setHaloFraction(this->haloFraction);
+  this->particles.generate(this->type, this->totalParticles / this->numProc);
+
+  // Generated halos are contiguous so each chain runs through its range
+  int numberOfHalos = this->particles.getNumberOfHalos();
+  this->haloStart.resize(numberOfHalos);
+  this->haloCount.resize(numberOfHalos);
+  this->haloList.assign(this->particles.getParticleCount(), -1);
+  for (int halo = 0; halo < numberOfHalos; halo++) {
+    int start = (int) this->particles.getHaloStart(halo);
+    int count = (int) this->particles.getHaloCount(halo);
+    this->haloStart[halo] = start;
+    this->haloCount[halo] = count;
+    for (int i = start; i < start + count - 1; i++)
+      this->haloList[i] = i + 1;
+  }
+
+  // The halo finder builds the chaining mesh before SOD halos so it is
+  // timed separately as chainmesh rather than as part of sod
+  this->chain = new ChainingMesh(this->rL, BENCHMARK_DEAD_SIZE, CHAIN_SIZE,
+                                 this->particles.getXLoc(),
+                                 this->particles.getYLoc(),
+                                 this->particles.getZLoc());
+
+  long localHalos = numberOfHalos;
+  MPI_Allreduce(&localHalos, &this->totalHalos, 1, MPI_LONG, MPI_SUM,
+                Partition::getComm());
+  if (this->myProc == MASTER)
+    cout << "Generated " << this->totalParticles << " "
+         << SyntheticParticles::getTypeName(this->type)
+         << " particles in " << this->totalHalos << " halos on "
+         << this->numProc << " processors" << endl;
+}
+
+/////////////////////////////////////////////////////////////////////////
+//
+// Run one kernel the requested number of times keeping the best time of
+// the slowest processor
+//
+/////////////////////////////////////////////////////////////////////////
+
+void HaloFinderBenchmark::TimeKernel(const string& name, BenchmarkKernel kernel)
+{
+  double best = -1.0;
+  long count = 0;
+
+  for (int r = 0; r < this->repeats; r++) {
+    MPI_Barrier(Partition::getComm());
+    double start = MPI_Wtime();
+    count = (this->*kernel)();
+    double elapsed = MPI_Wtime() - start;
+
+    double slowest = 0.0;
+    MPI_Allreduce(&elapsed, &slowest, 1, MPI_DOUBLE, MPI_MAX,
+                  Partition::getComm());
+    if (best < 0.0 || slowest < best)
+      best = slowest;
+  }
+
+  double localCount = (double) count;
+  double totalCount = 0.0;
+  MPI_Allreduce(&localCount, &totalCount, 1, MPI_DOUBLE, MPI_SUM,
+                Partition::getComm());
+
+  BenchmarkResult result;
+  result.kernel = name;
+  result.particles = totalCount;
+  result.seconds = best;
+  result.rate = (best > 0.0) ? totalCount / best : 0.0;
+  this->results.push_back(result);
+}
+
+void HaloFinderBenchmark::RunKernels()
+{
+  if (this->myProc == MASTER)
+    cout << left << setw(12) << "Kernel"
+         << right << setw(14) << "Particles"
+         << setw(12) << "Seconds"
+         << setw(16) << "Particles/s" << endl;
+
+  for (size_t k = 0; k < this->kernels.size(); k++) {
+    const string& name = this->kernels[k];
+    BenchmarkKernel kernel = 0;
+    if (name == "fof")               kernel = &HaloFinderBenchmark::FOFKernel;
+    else if (name == "chainmesh")    kernel = &HaloFinderBenchmark::ChainingMeshKernel;
+    else if (name == "mbp")          kernel = &HaloFinderBenchmark::MBPKernel;
+    else if (name == "mcp")          kernel = &HaloFinderBenchmark::MCPKernel;
+    else if (name == "sod")          kernel = &HaloFinderBenchmark::SODKernel;
+    else if (name == "bhtree")       kernel = &HaloFinderBenchmark::BHTreeKernel;
+    else if (name == "fofprops")     kernel = &HaloFinderBenchmark::FOFPropertiesKernel;
+
+    if (kernel == 0) {
+      if (this->myProc == MASTER)
+        cout << "Unknown kernel " << name << endl;
+      continue;
+    }
+
+    // Kernels over halos have nothing to measure without any halos
+    bool overHalos = (name != "fof" && name != "chainmesh");
+    if (overHalos && this->totalHalos == 0) {
+      PrintNotApplicable(name, "no halos generated");
+      continue;
+    }
+
+    TimeKernel(name, kernel);
+
+    const BenchmarkResult& result = this->results.back();
+    if (result.particles <= 0.0) {
+      this->results.pop_back();
+      PrintNotApplicable(name, "no halos large enough");
+      continue;
+    }
+
+    if (this->myProc == MASTER)
+      cout << left << setw(12) << result.kernel
+           << right << setw(14) << (long) result.particles
+           << fixed << setprecision(4) << setw(12) << result.seconds
+           << scientific << setprecision(4) << setw(16) << result.rate
+           << endl;
+    cout.unsetf(ios::floatfield);
+  }
+}
+
+void HaloFinderBenchmark::PrintNotApplicable(
+                        const string& name,
+                        const string& reason)
+{
+  if (this->myProc == MASTER)
+    cout << left << setw(12) << name
+         << right << setw(14) << "n/a" << "  (" << reason << ")" << endl;
+}
+
+/////////////////////////////////////////////////////////////////////////
+//
+// Kernels
+//
+/////////////////////////////////////////////////////////////////////////
+
+long HaloFinderBenchmark::FOFKernel()
+{
+  long count = this->particles.getParticleCount();
+  vector<int> haloTag(count), haloFirst(count), haloNext(count);
+
+  CosmoHaloFinder haloFinder;
+  haloFinder.np = (int) this->np;
+  haloFinder.rL = this->rL;
+  haloFinder.bb = BENCHMARK_BB;
+  haloFinder.pmin = 1;
+  haloFinder.periodic = false;
+  haloFinder.setParticleLocations(&(*this->particles.getXLoc())[0],
+                                  &(*this->particles.getYLoc())[0],
+                                  &(*this->particles.getZLoc())[0]);
+  haloFinder.setHaloLocations(&haloTag[0], &haloFirst[0], &haloNext[0]);
+  haloFinder.setNumberOfParticles((int) count);
+  haloFinder.setMyProc(this->myProc);
+  if (count > 0)
+    haloFinder.Finding();
+  return count;
+}
+
+long HaloFinderBenchmark::ChainingMeshKernel()
+{
+  ChainingMesh chain(this->rL, BENCHMARK_DEAD_SIZE, CHAIN_SIZE,
+                     this->particles.getXLoc(),
+                     this->particles.getYLoc(),
+                     this->particles.getZLoc());
+  return this->particles.getParticleCount();
+}
+
+long HaloFinderBenchmark::MBPKernel()
+{
+  long processed = 0;
+  for (int halo = 0; halo < this->particles.getNumberOfHalos(); halo++) {
+    long start = this->particles.getHaloStart(halo);
+    long count = this->particles.getHaloCount(halo);
+
+    HaloCenterFinder centerFinder;
+    centerFinder.setParticles(count,
+                              &(*this->particles.getXLoc())[start],
+                              &(*this->particles.getYLoc())[start],
+                              &(*this->particles.getZLoc())[start],
+                              &(*this->particles.getMass())[start],
+                              &(*this->particles.getTag())[start]);
+    centerFinder.setParameters(BENCHMARK_BB, 1.0);
+
+    // Same choice of method as the halo finder
+    POTENTIAL_T minPotential;
+    if (count < MBP_THRESHOLD)
+      centerFinder.mostBoundParticleN2(&minPotential);
+    else
+      centerFinder.mostBoundParticleAStar(&minPotential);
+    processed += count;
+  }
+  return processed;
+}
+
+long HaloFinderBenchmark::MCPKernel()
+{
+  long processed = 0;
+  for (int halo = 0; halo < this->particles.getNumberOfHalos(); halo++) {
+    long start = this->particles.getHaloStart(halo);
+    long count = this->particles.getHaloCount(halo);
+
+    HaloCenterFinder centerFinder;
+    centerFinder.setParticles(count,
+                              &(*this->particles.getXLoc())[start],
+                              &(*this->particles.getYLoc())[start],
+                              &(*this->particles.getZLoc())[start],
+                              &(*this->particles.getMass())[start],
+                              &(*this->particles.getTag())[start]);
+    centerFinder.setParameters(BENCHMARK_BB, 1.0);
+
+    // Same choice of method as the halo finder
+    if (count < MCP_THRESHOLD)
+      centerFinder.mostConnectedParticleN2();
+    else
+      centerFinder.mostConnectedParticleChainMesh();
+    processed += count;
+  }
+  return processed;
+}
+
+long HaloFinderBenchmark::SODKernel()
+{
+  SODHalo sod;
+  sod.setParameters(this->chain, NUM_SOD_BINS, this->rL, this->np,
+                    RHO_C, SOD_MASS, RHO_RATIO,
+                    MIN_RADIUS_FACTOR, MAX_RADIUS_FACTOR);
+  sod.setParticles(this->particles.getXLoc(), this->particles.getYLoc(),
+                   this->particles.getZLoc(), this->particles.getXVel(),
+                   this->particles.getYVel(), this->particles.getZVel(),
+                   this->particles.getMass(), this->particles.getTag());
+
+  long processed = 0;
+  POSVEL_T particleMass = this->particles.getParticleMass();
+  for (int halo = 0; halo < this->particles.getNumberOfHalos(); halo++) {
+    long count = this->particles.getHaloCount(halo);
+    POSVEL_T haloMass = count * particleMass;
+    if (count < MIN_SOD_SIZE || haloMass <= MIN_SOD_MASS)
+      continue;
+
+    POSVEL_T* center = this->particles.getHaloCenter(halo);
+    POSVEL_T* velocity = this->particles.getHaloVelocity(halo);
+    sod.createSODHalo((int) count, center[0], center[1], center[2],
+                      velocity[0], velocity[1], velocity[2], haloMass);
+    processed += count;
+  }
+  return processed;
+}
+
+long HaloFinderBenchmark::BHTreeKernel()
+{
+  long processed = 0;
+  for (int halo = 0; halo < this->particles.getNumberOfHalos(); halo++) {
+    long start = this->particles.getHaloStart(halo);
+    long count = this->particles.getHaloCount(halo);
+    if (count < MIN_FOF_SUBHALO)
+      continue;
+
+    POSVEL_T* x = &(*this->particles.getXLoc())[start];
+    POSVEL_T* y = &(*this->particles.getYLoc())[start];
+    POSVEL_T* z = &(*this->particles.getZLoc())[start];
+    POSVEL_T minLoc[DIMENSION] = { x[0], y[0], z[0] };
+    POSVEL_T maxLoc[DIMENSION] = { x[0], y[0], z[0] };
+    for (long i = 1; i < count; i++) {
+      minLoc[0] = min(minLoc[0], x[i]); maxLoc[0] = max(maxLoc[0], x[i]);
+      minLoc[1] = min(minLoc[1], y[i]); maxLoc[1] = max(maxLoc[1], y[i]);
+      minLoc[2] = min(minLoc[2], z[i]); maxLoc[2] = max(maxLoc[2], z[i]);
+    }
+
+    BHTree tree(minLoc, maxLoc, count, x, y, z,
+                &(*this->particles.getMass())[start],
+                this->particles.getParticleMass());
+    tree.calculateInitialSmoothingLength(NUM_SPH_DENSITY);
+    tree.calculateDensity(NUM_SPH_DENSITY);
+    processed += count;
+  }
+  return processed;
+}
+
+long HaloFinderBenchmark::FOFPropertiesKernel()
+{
+  int numberOfHalos = this->particles.getNumberOfHalos();
+  if (numberOfHalos == 0)
+    return 0;
+
+  FOFHaloProperties fof;
+  fof.setHalos(numberOfHalos, &this->haloStart[0], &this->haloCount[0],
+               &this->haloList[0]);
+  fof.setParameters("", this->rL, BENCHMARK_DEAD_SIZE, BENCHMARK_BB);
+  fof.setParticles(this->particles.getXLoc(), this->particles.getYLoc(),
+                   this->particles.getZLoc(), this->particles.getXVel(),
+                   this->particles.getYVel(), this->particles.getZVel(),
+                   this->particles.getMass(), this->particles.getPotential(),
+                   this->particles.getTag(), this->particles.getMask(),
+                   this->particles.getStatus());
+
+  // Same properties as the halo finder computes for every FOF halo
+  vector<POSVEL_T> mass, xPos, yPos, zPos, xCom, yCom, zCom;
+  vector<POSVEL_T> xVel, yVel, zVel, velDisp;
+  fof.FOFHaloMass(&mass);
+  fof.FOFPosition(&xPos, &yPos, &zPos);
+  fof.FOFCenterOfMass(&xCom, &yCom, &zCom);
+  fof.FOFVelocity(&xVel, &yVel, &zVel);
+  fof.FOFVelocityDispersion(&xVel, &yVel, &zVel, &velDisp);
+
+  long processed = 0;
+  for (int halo = 0; halo < numberOfHalos; halo++)
+    processed += this->haloCount[halo];
+  return processed;
+}
+
+/////////////////////////////////////////////////////////////////////////
+//
+// Baselines hold one line per kernel of the distribution, particles and
+// particles per second, so only runs of the same problem are compared
+//
+/////////////////////////////////////////////////////////////////////////
+
+void HaloFinderBenchmark::WriteBaseline()
+{
+  if (this->baselineOut.empty() || this->myProc != MASTER)
+    return;
+
+  ofstream out(this->baselineOut.c_str());
+  if (out.fail()) {
+    cout << "Baseline " << this->baselineOut << " cannot be written" << endl;
+    return;
+  }
+  out << "# kernel distribution particles processors particles/s" << endl;
+  for (size_t r = 0; r < this->results.size(); r++)
+    out << this->results[r].kernel << " "
+        << SyntheticParticles::getTypeName(this->type) << " "
+        << this->totalParticles << " " << this->numProc << " "
+        << setprecision(8) << this->results[r].rate << endl;
+  cout << "Wrote baseline " << this->baselineOut << endl;
+}
+
+bool HaloFinderBenchmark::CompareBaseline()
+{
+  int passed = 1;
+  if (!this->baselineIn.empty() && this->myProc == MASTER) {
+    ifstream in(this->baselineIn.c_str());
+    if (in.fail()) {
+      cout << "Baseline " << this->baselineIn << " not found, run with -w "
+           << this->baselineIn << " to record one" << endl;
+    } else {
+      cout << endl << left << setw(12) << "Kernel"
+           << right << setw(16) << "Baseline/s"
+           << setw(16) << "Particles/s"
+           << setw(10) << "Ratio" << endl;
+
+      string line;
+      while (getline(in, line)) {
+        if (line.empty() || line[0] == '#')
+          continue;
+        istringstream fields(line);
+        string kernel, distribution;
+        long count;
+        int procs;
+        double rate;
+        if (!(fields >> kernel >> distribution >> count >> procs >> rate))
+          continue;
+        if (distribution != SyntheticParticles::getTypeName(this->type) ||
+            count != this->totalParticles || procs != this->numProc)
+          continue;
+
+        for (size_t r = 0; r < this->results.size(); r++) {
+          if (this->results[r].kernel != kernel || rate <= 0.0)
+            continue;
+          double ratio = this->results[r].rate / rate;
+          bool slower = ratio < 1.0 - this->tolerance;
+          cout << left << setw(12) << kernel
+               << right << scientific << setprecision(4)
+               << setw(16) << rate << setw(16) << this->results[r].rate
+               << fixed << setprecision(3) << setw(10) << ratio
+               << (slower ? "  SLOWER" : "") << endl;
+          cout.unsetf(ios::floatfield);
+          if (slower)
+            passed = 0;
+        }
+      }
+    }
+  }
+
+  MPI_Bcast(&passed, 1, MPI_INT, MASTER, Partition::getComm());
+  return passed != 0;
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char* argv[])
+{
+  MPI_Init(&argc, &argv);
+  Partition::initialize();
+
+  int status = 1;
+  {
+    HaloFinderBenchmark benchmark(argc, argv);
+    if (benchmark.isValid()) {
+      benchmark.GenerateParticles();
+      benchmark.RunKernels();
+      benchmark.WriteBaseline();
+      status = benchmark.CompareBaseline() ? 0 : 1;
+    }
+  }
+
+  Partition::finalize();
+  MPI_Finalize();
+  return status;
+}
@@ -0,0 +1,619 @@
+/*=========================================================================
+                                                                                
+Copyright (c) 2007, Los Alamos National Security, LLC
+
+All rights reserved.
+
+Copyright 2007. Los Alamos National Security, LLC. 
+This software was produced under U.S. Government contract DE-AC52-06NA25396 
+for Los Alamos National Laboratory (LANL), which is operated by 
+Los Alamos National Security, LLC for the U.S. Department of Energy. 
+The U.S. Government has rights to use, reproduce, and distribute this software. 
+NEITHER THE GOVERNMENT NOR LOS ALAMOS NATIONAL SECURITY, LLC MAKES ANY WARRANTY,
+EXPRESS OR IMPLIED, OR ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  
+If software is modified to produce derivative works, such modified software 
+should be clearly marked, so as not to confuse it with the version available 
+from LANL.
+ 
+Additionally, redistribution and use in source and binary forms, with or 
+without modification, are permitted provided that the following conditions 
+are met:
+-   Redistributions of source code must retain the above copyright notice, 
+    this list of conditions and the following disclaimer. 
+-   Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution. 
+-   Neither the name of Los Alamos National Security, LLC, Los Alamos National
+    Laboratory, LANL, the U.S. Government, nor the names of its contributors
+    may be used to endorse or promote products derived from this software 
+    without specific prior written permission. 
+
+THIS SOFTWARE IS PROVIDED BY LOS ALAMOS NATIONAL SECURITY, LLC AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ARE DISCLAIMED. IN NO EVENT SHALL LOS ALAMOS NATIONAL SECURITY, LLC OR 
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+                                                                                
+=========================================================================*/
+
+// .NAME InSituScalingHarness - cost of the in-situ analysis tools driven
+//                              through the simulation interface
+//
+// .SECTION Description
+// Stands in for the simulation: generates particles with SyntheticParticles
+// on every processor and, for a number of time-steps, drifts them,
+// exchanges the overload zone as the simulation would and hands them to
+// the tools in the configuration file through cosmotools_set_particles and
+// cosmotools_coprocess.  The time of each tool is read back from the
+// regions InSituAnalysisManager times it in.
+//
+// Strong scaling keeps the total particles fixed as processors are added,
+// weak scaling the particles per processor.  Every time-step appends the
+// max and mean over processors of each tool to <prefix>.steps and every
+// run appends the mean per time-step to <prefix>.runs.  Running with -S
+// reads <prefix>.runs from runs at several processor counts and prints
+// the speedup and efficiency of each tool.
+//
+// Usage: InSituScalingHarness -c config [-m strong|weak] [-n particles]
+//                             [-g uniform|nfw|powerlaw] [-t timesteps]
+//                             [-d dt] [-s seed] [-f haloFraction]
+//                             [-o prefix]
+//        InSituScalingHarness -S prefix
+//
+
+#include "Partition.h"
+#include "ParticleExchange.h"
+#include "SyntheticParticles.h"
+#include "CosmologyTools.h"
+#include "Profiler.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <map>
+#include <cstdlib>
+#include <math.h>
+
+#include <mpi.h>
+
+using namespace std;
+using namespace cosmologytools;
+using cosmotk::Profiler;
+
+// Overload zone around the region of each processor
+const POSVEL_T HARNESS_DEAD_SIZE = 4.0;
+
+// Redshift of the first time-step, the last is at redshift zero
+const double HARNESS_START_REDSHIFT = 10.0;
+
+// Region InSituAnalysisManager times every tool in
+const char* HARNESS_INSITU_REGION = "TotalInSituExecution";
+
+// Name recorded for the whole of cosmotools_coprocess
+const char* HARNESS_COPROCESS = "coprocess";
+
+/////////////////////////////////////////////////////////////////////////
+//
+// Time per time-step of one tool over the run
+//
+/////////////////////////////////////////////////////////////////////////
+
+struct ToolCost {
+  double seconds;               // Summed max over processors
+  int steps;                    // Time-steps the tool ran
+};
+
+class InSituScalingHarness {
+public:
+  InSituScalingHarness(int argc, char* argv[]);
+  ~InSituScalingHarness();
+
+  bool isValid()                { return this->valid; }
+  bool isReport()               { return this->report; }
+
+  // Generate the particles and set up the simulation interface
+  void Initialize();
+
+  // Advance and analyze every time-step
+  void Run();
+
+  // Append the mean cost of every tool to <prefix>.runs, on rank 0
+  void WriteRun();
+
+  // Scaling tables of the runs in <prefix>.runs, on rank 0
+  void Report();
+
+private:
+  void RunTimeStep(int step);
+
+  // Copy the alive particles and add the overload zone from neighbors
+  void OverloadParticles();
+
+  void Usage();
+
+  int myProc;
+  int numProc;
+  MPI_Comm comm;
+  bool valid;
+  bool report;
+
+  // Options
+  string configFile;
+  bool weak;
+  long particleCount;           // Total for strong, per processor for weak
+  int type;
+  int timeSteps;
+  POSVEL_T dt;
+  unsigned int seed;
+  double haloFraction;
+  string prefix;
+
+  // Simulation state
+  SyntheticParticles particles;
+  long totalParticles;
+  POSVEL_T rL;                  // Box size with a spacing of one
+  long np;                      // Particles along a side of the box
+  ID_T firstTag;                // Tag of the first particle on this processor
+
+  // Alive and overloaded particles handed to the tools
+  vector<POSVEL_T> xx, yy, zz, vx, vy, vz, mass;
+  vector<POTENTIAL_T> potential;
+  vector<ID_T> tag;
+  vector<MASK_T> mask;
+  vector<STATUS_T> status;
+
+  map<string, ToolCost> costs;
+};
+
+/////////////////////////////////////////////////////////////////////////
+//
+// Parse the command line, all processors see the same options
+//
+/////////////////////////////////////////////////////////////////////////
+
+InSituScalingHarness::InSituScalingHarness(int argc, char* argv[])
+{
+  this->myProc = Partition::getMyProc();
+  this->numProc = Partition::getNumProc();
+  this->comm = Partition::getComm();
+  this->valid = true;
+  this->report = false;
+
+  this->weak = false;
+  this->particleCount = 1000000;
+  this->type = POWER_LAW_HALOS;
+  this->timeSteps = 10;
+  this->dt = 0.001f;
+  this->seed = 1;
+  this->haloFraction = 0.5;
+  this->prefix = "InSituScaling";
+
+  this->totalParticles = 0;
+  this->rL = 0.0;
+  this->np = 0;
+  this->firstTag = 0;
+
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (i + 1 >= argc || arg.size() != 2 || arg[0] != '-') {
+      this->valid = false;
+      break;
+    }
+    string value = argv[++i];
+    switch (arg[1]) {
+      case 'c': this->configFile = value; break;
+      case 'm':
+        this->weak = (value == "weak");
+        if (value != "weak" && value != "strong")
+          this->valid = false;
+        break;
+      case 'n': this->particleCount = atol(value.c_str()); break;
+      case 'g': this->type = SyntheticParticles::getType(value); break;
+      case 't': this->timeSteps = atoi(value.c_str()); break;
+      case 'd': this->dt = (POSVEL_T) atof(value.c_str()); break;
+      case 's': this->seed = (unsigned int) atol(value.c_str()); break;
+      case 'f': this->haloFraction = atof(value.c_str()); break;
+      case 'o': this->prefix = value; break;
+      case 'S': this->prefix = value; this->report = true; break;
+      default: this->valid = false; break;
+    }
+  }
+
+  if (!this->report &&
+      (this->configFile.empty() || this->particleCount < 1 ||
+       (!this->weak && this->particleCount < this->numProc) ||
+       this->type < 0 || this->timeSteps < 1))
+    this->valid = false;
+
+  if (!this->valid && this->myProc == MASTER)
+    Usage();
+}
+
+InSituScalingHarness::~InSituScalingHarness()
+{
+}
+
+void InSituScalingHarness::Usage()
+{
+  cout << "Usage: InSituScalingHarness -c config [-m strong|weak]"
+       << " [-n particles]" << endl
+       << "         [-g uniform|nfw|powerlaw] [-t timesteps] [-d dt]"
+       << " [-s seed]" << endl
+       << "         [-f haloFraction] [-o prefix]" << endl
+       << "       InSituScalingHarness -S prefix" << endl;
+}
+
+/////////////////////////////////////////////////////////////////////////
+//
+// The box holds the particles at a spacing of one, each processor fills
+// its region of the decomposition, and particle tags are unique over all
+// processors as the tools expect from a simulation
+//
+/////////////////////////////////////////////////////////////////////////
+
+void InSituScalingHarness::Initialize()
+{
+  this->totalParticles = this->weak ?
+                         this->particleCount * this->numProc :
+                         this->particleCount;
+  this->np = (long) floor(pow((double) this->totalParticles, 1.0 / 3.0)
+                          + 0.5);
+  this->rL = (POSVEL_T) this->np;
+
+  int layoutSize[DIMENSION], layoutPos[DIMENSION];
+  Partition::getDecompSize(layoutSize);
+  Partition::getMyPosition(layoutPos);
+
+  POSVEL_T minLoc[DIMENSION], maxLoc[DIMENSION];
+  for (int dim = 0; dim < DIMENSION; dim++) {
+    POSVEL_T step = this->rL / layoutSize[dim];
+    minLoc[dim] = layoutPos[dim] * step;
+    maxLoc[dim] = minLoc[dim] + step;
+  }
+
+  long count = this->totalParticles / this->numProc;
+  this->particles.setRegion(minLoc, maxLoc);
+  this->particles.setSeed(this->seed + this->myProc);
+  this->particles.setHaloFraction(this->haloFraction);
+  this->particles.generate(this->type, count);
+
+  long first = 0;
+  MPI_Exscan(&count, &first, 1, MPI_LONG, MPI_SUM, this->comm);
+  this->firstTag = (this->myProc == MASTER) ? 0 : (ID_T) first;
+
+  // The manager is handed the communicator the decomposition is on so the
+  // halo finder sees the same processor layout
+  vector<char> config(this->configFile.begin(), this->configFile.end());
+  config.push_back('\0');
+  REAL boxLength = (REAL) this->rL;
+  INTEGER ghostOverlap = (INTEGER) HARNESS_DEAD_SIZE;
+  INTEGER ndim = (INTEGER) this->np;
+  INTEGER periodic = 1;
+
+  cosmotools_initialize(&this->comm);
+  cosmotools_set_analysis_config(&config[0]);
+  cosmotools_set_domain_parameters(&boxLength, &ghostOverlap, &ndim,
+                                   &periodic);
+
+  if (this->myProc == MASTER)
+    cout << (this->weak ? "Weak" : "Strong") << " scaling, "
+         << this->totalParticles << " "
+         << SyntheticParticles::getTypeName(this->type)
+         << " particles on " << this->numProc << " processors for "
+         << this->timeSteps << " time-steps" << endl;
+}
+
+/////////////////////////////////////////////////////////////////////////
+//
+// The simulation holds its alive particles and a copy of its neighbors'
+// particles in the overload zone, so the tools get both
+//
+/////////////////////////////////////////////////////////////////////////
+
+void InSituScalingHarness::OverloadParticles()
+{
+  this->xx = *this->particles.getXLoc();
+  this->yy = *this->particles.getYLoc();
+  this->zz = *this->particles.getZLoc();
+  this->vx = *this->particles.getXVel();
+  this->vy = *this->particles.getYVel();
+  this->vz = *this->particles.getZVel();
+  this->mass = *this->particles.getMass();
+  this->potential = *this->particles.getPotential();
+  this->mask = *this->particles.getMask();
+  this->status = *this->particles.getStatus();
+
+  this->tag.resize(this->xx.size());
+  for (size_t i = 0; i < this->tag.size(); i++)
+    this->tag[i] = this->firstTag + (*this->particles.getTag())[i];
+
+  ParticleExchange exchange;
+  exchange.setParameters(this->rL, HARNESS_DEAD_SIZE);
+  exchange.initialize();
+  exchange.setParticles(&this->xx, &this->yy, &this->zz,
+                        &this->vx, &this->vy, &this->vz, &this->mass,
+                        &this->potential, &this->tag,
+                        &this->mask, &this->status);
+  exchange.exchangeParticles();
+}
+
+/////////////////////////////////////////////////////////////////////////
+//
+// Run every time-step, redshift falling linearly in the expansion factor
+// from the start to zero at the last
+//
+/////////////////////////////////////////////////////////////////////////
+
+void InSituScalingHarness::Run()
+{
+  if (this->myProc == MASTER)
+    cout << endl << right << setw(6) << "Step"
+         << setw(9) << "Redshift" << "  "
+         << left << setw(28) << "Tool"
+         << right << setw(12) << "Max" << setw(12) << "Mean" << endl;
+
+  for (int step = 0; step < this->timeSteps; step++) {
+    if (step > 0)
+      this->particles.advance(this->dt);
+    RunTimeStep(step);
+  }
+}
+
+void InSituScalingHarness::RunTimeStep(int step)
+{
+  double aStart = 1.0 / (1.0 + HARNESS_START_REDSHIFT);
+  double a = aStart;
+  if (this->timeSteps > 1)
+    a += (1.0 - aStart) * step / (this->timeSteps - 1);
+
+  INTEGER tstep = (INTEGER) step;
+  REAL redshift = (REAL) (1.0 / a - 1.0);
+  INTEGER execute = 0;
+  cosmotools_timestep(&tstep, &redshift, &execute);
+  if (!execute)
+    return;
+
+  OverloadParticles();
+  ID_T count = (ID_T) this->xx.size();
+
+  map<string, double> before, after;
+  Profiler::GetChildTimes(HARNESS_INSITU_REGION, before);
+
+  MPI_Barrier(this->comm);
+  double start = MPI_Wtime();
+  cosmotools_set_particles(&tstep, &redshift,
+                           &this->xx[0], &this->yy[0], &this->zz[0],
+                           &this->vx[0], &this->vy[0], &this->vz[0],
+                           &this->mass[0], &this->potential[0],
+                           &this->tag[0], &this->mask[0], &this->status[0],
+                           &count);
+  cosmotools_coprocess();
+  double elapsed = MPI_Wtime() - start;
+
+  Profiler::GetChildTimes(HARNESS_INSITU_REGION, after);
+
+  // Every processor reports the tools in the order rank 0 saw them
+  ostringstream names;
+  for (map<string, double>::iterator iter = after.begin();
+       iter != after.end(); ++iter)
+    names << iter->first << "\n";
+  string list = names.str();
+  int length = (int) list.size();
+  MPI_Bcast(&length, 1, MPI_INT, MASTER, this->comm);
+  list.resize(length);
+  vector<char> buffer(list.begin(), list.end());
+  buffer.push_back('\0');
+  MPI_Bcast(&buffer[0], length, MPI_CHAR, MASTER, this->comm);
+
+  vector<string> tools;
+  istringstream lines(&buffer[0]);
+  string line;
+  while (getline(lines, line))
+    tools.push_back(line);
+  tools.push_back(HARNESS_COPROCESS);
+
+  vector<double> local(tools.size(), 0.0);
+  for (size_t t = 0; t + 1 < tools.size(); t++)
+    local[t] = after[tools[t]] - before[tools[t]];
+  local[tools.size() - 1] = elapsed;
+
+  vector<double> maxTime(tools.size(), 0.0), sumTime(tools.size(), 0.0);
+  MPI_Reduce(&local[0], &maxTime[0], (int) tools.size(), MPI_DOUBLE, MPI_MAX,
+             MASTER, this->comm);
+  MPI_Reduce(&local[0], &sumTime[0], (int) tools.size(), MPI_DOUBLE, MPI_SUM,
+             MASTER, this->comm);
+
+  if (this->myProc != MASTER)
+    return;
+
+  string stepsFile = this->prefix + ".steps";
+  ifstream existing(stepsFile.c_str());
+  bool header = !existing.good() || existing.peek() == EOF;
+  existing.close();
+  ofstream out(stepsFile.c_str(), ios::app);
+  if (header)
+    out << "# mode processors particles timestep redshift tool max mean"
+        << endl;
+
+  for (size_t t = 0; t < tools.size(); t++) {
+
+    // Tools which did not run this time-step have no time
+    if (maxTime[t] <= 0.0)
+      continue;
+    double meanTime = sumTime[t] / this->numProc;
+
+    ToolCost& cost = this->costs[tools[t]];
+    cost.seconds += maxTime[t];
+    cost.steps++;
+
+    out << (this->weak ? "weak" : "strong") << " " << this->numProc << " "
+        << this->particleCount << " " << step << " " << redshift << " "
+        << tools[t] << " " << setprecision(8) << maxTime[t] << " "
+        << meanTime << endl;
+    cout << right << setw(6) << step
+         << fixed << setprecision(3) << setw(9) << redshift << "  "
+         << left << setw(28) << tools[t]
+         << right << setprecision(4) << setw(12) << maxTime[t]
+         << setw(12) << meanTime << endl;
+    cout.unsetf(ios::floatfield);
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////
+//
+// Runs hold one line per tool of the mode, problem size, processors and
+// mean seconds per time-step, the max over processors of each time-step
+//
+/////////////////////////////////////////////////////////////////////////
+
+void InSituScalingHarness::WriteRun()
+{
+  if (this->myProc != MASTER)
+    return;
+
+  string runsFile = this->prefix + ".runs";
+  ifstream existing(runsFile.c_str());
+  bool header = !existing.good() || existing.peek() == EOF;
+  existing.close();
+
+  ofstream out(runsFile.c_str(), ios::app);
+  if (out.fail()) {
+    cout << "Runs " << runsFile << " cannot be written" << endl;
+    return;
+  }
+  if (header)
+    out << "# mode particles processors timesteps tool seconds" << endl;
+
+  cout << endl << left << setw(28) << "Tool"
+       << right << setw(8) << "Steps" << setw(14) << "Seconds/step" << endl;
+  for (map<string, ToolCost>::iterator iter = this->costs.begin();
+       iter != this->costs.end(); ++iter) {
+    double seconds = iter->second.seconds / iter->second.steps;
+    out << (this->weak ? "weak" : "strong") << " " << this->particleCount
+        << " " << this->numProc << " " << iter->second.steps << " "
+        << iter->first << " " << setprecision(8) << seconds << endl;
+    cout << left << setw(28) << iter->first
+         << right << setw(8) << iter->second.steps
+         << fixed << setprecision(4) << setw(14) << seconds << endl;
+    cout.unsetf(ios::floatfield);
+  }
+  cout << "Appended run to " << runsFile << endl;
+}
+
+/////////////////////////////////////////////////////////////////////////
+//
+// Each tool of each mode and problem size is compared with its run on the
+// fewest processors.  Strong scaling should divide the time by the
+// processors added, weak scaling should keep it constant.  A later run of
+// the same configuration replaces an earlier one.
+//
+/////////////////////////////////////////////////////////////////////////
+
+void InSituScalingHarness::Report()
+{
+  if (this->myProc != MASTER)
+    return;
+
+  string runsFile = this->prefix + ".runs";
+  ifstream in(runsFile.c_str());
+  if (in.fail()) {
+    cout << "Runs " << runsFile << " not found" << endl;
+    return;
+  }
+
+  // Seconds by processors for every mode, problem size and tool
+  map<string, map<int, double> > runs;
+  string line;
+  while (getline(in, line)) {
+    if (line.empty() || line[0] == '#')
+      continue;
+    istringstream fields(line);
+    string mode, tool;
+    long count;
+    int procs, steps;
+    double seconds;
+    if (!(fields >> mode >> count >> procs >> steps >> tool >> seconds))
+      continue;
+    ostringstream key;
+    key << mode << " " << count << " " << tool;
+    runs[key.str()][procs] = seconds;
+  }
+
+  string table;
+  for (map<string, map<int, double> >::iterator iter = runs.begin();
+       iter != runs.end(); ++iter) {
+    istringstream key(iter->first);
+    string mode, tool;
+    long count;
+    key >> mode >> count >> tool;
+    bool weakRun = (mode == "weak");
+
+    ostringstream title;
+    title << mode << " " << count;
+    if (title.str() != table) {
+      table = title.str();
+      cout << endl << (weakRun ? "Weak" : "Strong") << " scaling, " << count
+           << (weakRun ? " particles per processor" : " particles") << endl
+           << left << setw(28) << "Tool"
+           << right << setw(12) << "Processors"
+           << setw(14) << "Seconds/step"
+           << setw(10) << "Speedup"
+           << setw(12) << "Efficiency" << endl;
+    }
+
+    map<int, double>& times = iter->second;
+    int baseProcs = times.begin()->first;
+    double baseTime = times.begin()->second;
+    for (map<int, double>::iterator run = times.begin();
+         run != times.end(); ++run) {
+      double ratio = (run->second > 0.0) ? baseTime / run->second : 0.0;
+      double procs = (double) run->first / baseProcs;
+
+      // Weak scaling speedup is the work done per second
+      double speedup = weakRun ? ratio * procs : ratio;
+      double efficiency = weakRun ? ratio : ratio / procs;
+      cout << left << setw(28) << tool
+           << right << setw(12) << run->first
+           << fixed << setprecision(4) << setw(14) << run->second
+           << setprecision(2) << setw(10) << speedup
+           << setw(12) << efficiency << endl;
+      cout.unsetf(ios::floatfield);
+    }
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char* argv[])
+{
+  MPI_Init(&argc, &argv);
+  Partition::initialize();
+
+  int status = 1;
+  {
+    InSituScalingHarness harness(argc, argv);
+    if (harness.isValid() && harness.isReport()) {
+      harness.Report();
+      status = 0;
+    } else if (harness.isValid()) {
+      harness.Initialize();
+      harness.Run();
+      cosmotools_finalize();
+      harness.WriteRun();
+      status = 0;
+    }
+  }
+
+  Partition::finalize();
+  MPI_Finalize();
+  return status;
+}
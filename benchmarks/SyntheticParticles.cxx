@@ -0,0 +1,361 @@
+/*=========================================================================
+                                                                                
+Copyright (c) 2007, Los Alamos National Security, LLC
+
+All rights reserved.
+
+Copyright 2007. Los Alamos National Security, LLC. 
+This software was produced under U.S. Government contract DE-AC52-06NA25396 
+for Los Alamos National Laboratory (LANL), which is operated by 
+Los Alamos National Security, LLC for the U.S. Department of Energy. 
+The U.S. Government has rights to use, reproduce, and distribute this software. 
+NEITHER THE GOVERNMENT NOR LOS ALAMOS NATIONAL SECURITY, LLC MAKES ANY WARRANTY,
+EXPRESS OR IMPLIED, OR ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  
+If software is modified to produce derivative works, such modified software 
+should be clearly marked, so as not to confuse it with the version available 
+from LANL.
+ 
+Additionally, redistribution and use in source and binary forms, with or 
+without modification, are permitted provided that the following conditions 
+are met:
+-   Redistributions of source code must retain the above copyright notice, 
+    this list of conditions and the following disclaimer. 
+-   Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution. 
+-   Neither the name of Los Alamos National Security, LLC, Los Alamos National
+    Laboratory, LANL, the U.S. Government, nor the names of its contributors
+    may be used to endorse or promote products derived from this software 
+    without specific prior written permission. 
+
+THIS SOFTWARE IS PROVIDED BY LOS ALAMOS NATIONAL SECURITY, LLC AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ARE DISCLAIMED. IN NO EVENT SHALL LOS ALAMOS NATIONAL SECURITY, LLC OR 
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+                                                                                
+=========================================================================*/
+
+#include "SyntheticParticles.h"
+
+#include <algorithm>
+#include <math.h>
+
+using namespace std;
+
+namespace cosmologytools {
+
+// Concentration of every generated halo
+const double NFW_CONCENTRATION  = 5.0;
+
+// Slope of the halo size distribution dN/dn ~ n^-slope
+const double HALO_SIZE_SLOPE    = 1.9;
+
+// Velocity dispersion of background particles and of halo bulk motion
+const double BACKGROUND_SIGMA_V = 100.0;
+
+/////////////////////////////////////////////////////////////////////////
+//
+// SyntheticParticles generates clustered particles in a region
+//
+/////////////////////////////////////////////////////////////////////////
+
+SyntheticParticles::SyntheticParticles()
+{
+  for (int dim = 0; dim < DIMENSION; dim++) {
+    this->minLoc[dim] = 0.0;
+    this->maxLoc[dim] = 1.0;
+  }
+  this->seed = 1;
+  this->state = 1;
+  this->haloFraction = 0.5;
+  this->minHaloSize = 40;
+  this->maxHaloSize = 20000;
+
+  // Spacing of one Mpc/h at the critical density
+  this->particleMass = (POSVEL_T) RHO_C;
+}
+
+SyntheticParticles::~SyntheticParticles()
+{
+}
+
+void SyntheticParticles::setRegion(POSVEL_T* minLoc, POSVEL_T* maxLoc)
+{
+  for (int dim = 0; dim < DIMENSION; dim++) {
+    this->minLoc[dim] = minLoc[dim];
+    this->maxLoc[dim] = maxLoc[dim];
+  }
+}
+
+void SyntheticParticles::setHaloSize(long minSize, long maxSize)
+{
+  this->minHaloSize = max(minSize, 1L);
+  this->maxHaloSize = max(maxSize, this->minHaloSize);
+}
+
+/////////////////////////////////////////////////////////////////////////
+//
+// Names of the distributions for command lines and reports
+//
+/////////////////////////////////////////////////////////////////////////
+
+static const char* SyntheticTypeNames[NUM_SYNTHETIC_TYPES] = {
+  "uniform", "nfw", "powerlaw"
+};
+
+int SyntheticParticles::getType(const string& name)
+{
+  for (int type = 0; type < NUM_SYNTHETIC_TYPES; type++)
+    if (name == SyntheticTypeNames[type])
+      return type;
+  return -1;
+}
+
+const char* SyntheticParticles::getTypeName(int type)
+{
+  if (type < 0 || type >= NUM_SYNTHETIC_TYPES)
+    return "unknown";
+  return SyntheticTypeNames[type];
+}
+
+/////////////////////////////////////////////////////////////////////////
+//
+// Random deviates from a 64 bit linear congruential sequence which is
+// the same on every platform, using the upper bits which are the best
+//
+/////////////////////////////////////////////////////////////////////////
+
+double SyntheticParticles::uniform()
+{
+  this->state = this->state * 6364136223846793005ULL + 1442695040888963407ULL;
+  return (double) (this->state >> 11) * (1.0 / 9007199254740992.0);
+}
+
+double SyntheticParticles::normal()
+{
+  // Box-Muller, the second deviate is dropped to keep the sequence simple
+  double u1 = 1.0 - uniform();
+  double u2 = uniform();
+  return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+/////////////////////////////////////////////////////////////////////////
+//
+// Generate count particles.  Halos are added until the halo fraction of
+// the particles is used, the rest are the uniform background.
+//
+/////////////////////////////////////////////////////////////////////////
+
+void SyntheticParticles::generate(int type, long count)
+{
+  clear();
+  this->state = this->seed;
+
+  this->xx.reserve(count);
+  this->yy.reserve(count);
+  this->zz.reserve(count);
+  this->vx.reserve(count);
+  this->vy.reserve(count);
+  this->vz.reserve(count);
+
+  long inHalos = 0;
+  if (type != UNIFORM_PARTICLES)
+    inHalos = (long) (this->haloFraction * count);
+
+  long remaining = inHalos;
+  while (remaining >= this->minHaloSize) {
+    long size = this->maxHaloSize;
+
+    // Inverse of the cumulative distribution, too large sizes are redrawn
+    if (type == POWER_LAW_HALOS) {
+      do {
+        size = (long) (this->minHaloSize *
+                       pow(1.0 - uniform(), -1.0 / (HALO_SIZE_SLOPE - 1.0)));
+      } while (size > this->maxHaloSize);
+    }
+
+    size = min(size, remaining);
+    addHalo(size);
+    remaining -= size;
+  }
+  addBackground(count - (long) this->xx.size());
+
+  // Every particle is alive with its index as the tag
+  this->mass.assign(count, this->particleMass);
+  this->potential.assign(count, 0.0);
+  this->mask.assign(count, 0);
+  this->status.assign(count, ALIVE);
+  this->tag.resize(count);
+  for (long i = 0; i < count; i++)
+    this->tag[i] = i;
+}
+
+/////////////////////////////////////////////////////////////////////////
+//
+// Add a halo with an NFW profile truncated at r200.  With a spacing of
+// one the radius holding count particles at 200 times the mean density is
+//
+//   r200 = (3 count / (800 PI))^(1/3)
+//
+// and radii are drawn by inverting the enclosed mass of the profile
+//
+//   M(x) ~ ln(1 + x) - x / (1 + x),   x = r / rs,   rs = r200 / c
+//
+// Velocities are isotropic with the circular velocity at r200.
+//
+/////////////////////////////////////////////////////////////////////////
+
+void SyntheticParticles::addHalo(long count)
+{
+  double r200 = pow(3.0 * count / (800.0 * M_PI), 1.0 / 3.0);
+  double rs = r200 / NFW_CONCENTRATION;
+  double massC = log(1.0 + NFW_CONCENTRATION) -
+                 NFW_CONCENTRATION / (1.0 + NFW_CONCENTRATION);
+  double sigmaV = sqrt(GRAVITY_C * count * this->particleMass / r200 / 3.0);
+
+  // Center so the whole halo lies in the region where it fits
+  double center[DIMENSION], bulk[DIMENSION];
+  for (int dim = 0; dim < DIMENSION; dim++) {
+    double lo = this->minLoc[dim] + r200;
+    double hi = this->maxLoc[dim] - r200;
+    if (hi < lo)
+      lo = hi = 0.5 * (this->minLoc[dim] + this->maxLoc[dim]);
+    center[dim] = lo + (hi - lo) * uniform();
+    bulk[dim] = BACKGROUND_SIGMA_V * normal();
+  }
+
+  this->haloStart.push_back((long) this->xx.size());
+  this->haloCount.push_back(count);
+  for (int dim = 0; dim < DIMENSION; dim++) {
+    this->haloCenter.push_back((POSVEL_T) center[dim]);
+    this->haloVelocity.push_back((POSVEL_T) bulk[dim]);
+  }
+
+  for (long p = 0; p < count; p++) {
+
+    // Bisect for the radius enclosing a uniform fraction of the mass
+    double target = uniform() * massC;
+    double lo = 0.0;
+    double hi = NFW_CONCENTRATION;
+    for (int iter = 0; iter < 40; iter++) {
+      double x = 0.5 * (lo + hi);
+      if (log(1.0 + x) - x / (1.0 + x) < target)
+        lo = x;
+      else
+        hi = x;
+    }
+    double radius = 0.5 * (lo + hi) * rs;
+
+    // Direction uniform on the sphere
+    double cosTheta = 2.0 * uniform() - 1.0;
+    double sinTheta = sqrt(1.0 - cosTheta * cosTheta);
+    double phi = 2.0 * M_PI * uniform();
+
+    double pos[DIMENSION];
+    pos[0] = center[0] + radius * sinTheta * cos(phi);
+    pos[1] = center[1] + radius * sinTheta * sin(phi);
+    pos[2] = center[2] + radius * cosTheta;
+    for (int dim = 0; dim < DIMENSION; dim++)
+      pos[dim] = min(max(pos[dim], (double) this->minLoc[dim]),
+                     (double) this->maxLoc[dim]);
+
+    this->xx.push_back((POSVEL_T) pos[0]);
+    this->yy.push_back((POSVEL_T) pos[1]);
+    this->zz.push_back((POSVEL_T) pos[2]);
+    this->vx.push_back((POSVEL_T) (bulk[0] + sigmaV * normal()));
+    this->vy.push_back((POSVEL_T) (bulk[1] + sigmaV * normal()));
+    this->vz.push_back((POSVEL_T) (bulk[2] + sigmaV * normal()));
+  }
+}
+
+void SyntheticParticles::addBackground(long count)
+{
+  for (long p = 0; p < count; p++) {
+    this->xx.push_back((POSVEL_T) (this->minLoc[0] +
+                       (this->maxLoc[0] - this->minLoc[0]) * uniform()));
+    this->yy.push_back((POSVEL_T) (this->minLoc[1] +
+                       (this->maxLoc[1] - this->minLoc[1]) * uniform()));
+    this->zz.push_back((POSVEL_T) (this->minLoc[2] +
+                       (this->maxLoc[2] - this->minLoc[2]) * uniform()));
+    this->vx.push_back((POSVEL_T) (BACKGROUND_SIGMA_V * normal()));
+    this->vy.push_back((POSVEL_T) (BACKGROUND_SIGMA_V * normal()));
+    this->vz.push_back((POSVEL_T) (BACKGROUND_SIGMA_V * normal()));
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////
+//
+// Drift the particles for one time-step.  Halo particles move with the
+// bulk velocity of their halo rather than their own, which would spread
+// the halo out, so halos stay bound and move through the background.
+//
+/////////////////////////////////////////////////////////////////////////
+
+void SyntheticParticles::advance(POSVEL_T dt)
+{
+  long count = (long) this->xx.size();
+  long background = 0;
+
+  for (int halo = 0; halo < getNumberOfHalos(); halo++) {
+    long start = this->haloStart[halo];
+    long end = start + this->haloCount[halo];
+    POSVEL_T* center = &this->haloCenter[3 * halo];
+    POSVEL_T* bulk = &this->haloVelocity[3 * halo];
+
+    for (long i = start; i < end; i++) {
+      this->xx[i] = wrap(this->xx[i] + bulk[0] * dt, 0);
+      this->yy[i] = wrap(this->yy[i] + bulk[1] * dt, 1);
+      this->zz[i] = wrap(this->zz[i] + bulk[2] * dt, 2);
+    }
+    for (int dim = 0; dim < DIMENSION; dim++)
+      center[dim] = wrap(center[dim] + bulk[dim] * dt, dim);
+    background = end;
+  }
+
+  for (long i = background; i < count; i++) {
+    this->xx[i] = wrap(this->xx[i] + this->vx[i] * dt, 0);
+    this->yy[i] = wrap(this->yy[i] + this->vy[i] * dt, 1);
+    this->zz[i] = wrap(this->zz[i] + this->vz[i] * dt, 2);
+  }
+}
+
+POSVEL_T SyntheticParticles::wrap(POSVEL_T loc, int dim)
+{
+  POSVEL_T size = this->maxLoc[dim] - this->minLoc[dim];
+  POSVEL_T offset = (POSVEL_T) fmod(loc - this->minLoc[dim], size);
+  if (offset < 0.0)
+    offset += size;
+
+  // Rounding can land a location exactly on the upper bound
+  if (offset >= size)
+    offset = 0.0;
+  return this->minLoc[dim] + offset;
+}
+
+void SyntheticParticles::clear()
+{
+  this->xx.clear();
+  this->yy.clear();
+  this->zz.clear();
+  this->vx.clear();
+  this->vy.clear();
+  this->vz.clear();
+  this->mass.clear();
+  this->potential.clear();
+  this->tag.clear();
+  this->mask.clear();
+  this->status.clear();
+  this->haloStart.clear();
+  this->haloCount.clear();
+  this->haloCenter.clear();
+  this->haloVelocity.clear();
+}
+
+}
@@ -0,0 +1,178 @@
+/*=========================================================================
+                                                                                
+Copyright (c) 2007, Los Alamos National Security, LLC
+
+All rights reserved.
+
+Copyright 2007. Los Alamos National Security, LLC. 
+This software was produced under U.S. Government contract DE-AC52-06NA25396 
+for Los Alamos National Laboratory (LANL), which is operated by 
+Los Alamos National Security, LLC for the U.S. Department of Energy. 
+The U.S. Government has rights to use, reproduce, and distribute this software. 
+NEITHER THE GOVERNMENT NOR LOS ALAMOS NATIONAL SECURITY, LLC MAKES ANY WARRANTY,
+EXPRESS OR IMPLIED, OR ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  
+If software is modified to produce derivative works, such modified software 
+should be clearly marked, so as not to confuse it with the version available 
+from LANL.
+ 
+Additionally, redistribution and use in source and binary forms, with or 
+without modification, are permitted provided that the following conditions 
+are met:
+-   Redistributions of source code must retain the above copyright notice, 
+    this list of conditions and the following disclaimer. 
+-   Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution. 
+-   Neither the name of Los Alamos National Security, LLC, Los Alamos National
+    Laboratory, LANL, the U.S. Government, nor the names of its contributors
+    may be used to endorse or promote products derived from this software 
+    without specific prior written permission. 
+
+THIS SOFTWARE IS PROVIDED BY LOS ALAMOS NATIONAL SECURITY, LLC AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ARE DISCLAIMED. IN NO EVENT SHALL LOS ALAMOS NATIONAL SECURITY, LLC OR 
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+                                                                                
+=========================================================================*/
+
+// .NAME SyntheticParticles - clustered particle distributions for driving
+//                            the halo finder without input files
+//
+// .SECTION Description
+// SyntheticParticles fills a region of the simulation box with particles
+// at a mean interparticle spacing of one Mpc/h, so a linking length of 0.2
+// finds the generated halos and the particle mass is the critical density
+// of one cell.  Three distributions are available:
+//
+//   UNIFORM_PARTICLES  particles placed at random, no halos
+//   NFW_CLUSTERS       equal halos with NFW density profiles
+//   POWER_LAW_HALOS    halo sizes drawn from dN/dn ~ n^-1.9 as in a
+//                      real mass function, each with an NFW profile
+//
+// Halos are sized to an overdensity of 200 and the particles not in halos
+// form a uniform background.  Halo particles are stored halo by halo
+// ahead of the background so each halo is a contiguous range of the
+// arrays.  The same seed always generates the same particles.  Advancing
+// drifts them, keeping each halo intact, to give a sequence of time-steps.
+//
+
+#ifndef SyntheticParticles_h
+#define SyntheticParticles_h
+
+#include "Definition.h"
+
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+namespace cosmologytools {
+
+enum SyntheticType {
+  UNIFORM_PARTICLES,
+  NFW_CLUSTERS,
+  POWER_LAW_HALOS,
+  NUM_SYNTHETIC_TYPES
+};
+
+class SyntheticParticles {
+public:
+  SyntheticParticles();
+  ~SyntheticParticles();
+
+  // Region of the box to fill
+  void setRegion(POSVEL_T* minLoc, POSVEL_T* maxLoc);
+
+  // Seed of the random sequence
+  void setSeed(unsigned int seed)       { this->seed = seed; }
+
+  // Fraction of the particles placed in halos
+  void setHaloFraction(double f)        { this->haloFraction = f; }
+
+  // Smallest and largest halo, NFW_CLUSTERS makes all of the largest
+  void setHaloSize(long minSize, long maxSize);
+
+  // Replace the particles with count particles of the given distribution
+  void generate(int type, long count);
+
+  // Drift the particles for dt, halos as a whole with their bulk velocity,
+  // wrapping them around the region so the particle count is unchanged
+  void advance(POSVEL_T dt);
+
+  // Distribution by name, uniform, nfw or powerlaw, -1 if unknown
+  static int getType(const string& name);
+  static const char* getTypeName(int type);
+
+  long getParticleCount()               { return (long) this->xx.size(); }
+  POSVEL_T getParticleMass()            { return this->particleMass; }
+
+  vector<POSVEL_T>* getXLoc()           { return &this->xx; }
+  vector<POSVEL_T>* getYLoc()           { return &this->yy; }
+  vector<POSVEL_T>* getZLoc()           { return &this->zz; }
+  vector<POSVEL_T>* getXVel()           { return &this->vx; }
+  vector<POSVEL_T>* getYVel()           { return &this->vy; }
+  vector<POSVEL_T>* getZVel()           { return &this->vz; }
+  vector<POSVEL_T>* getMass()           { return &this->mass; }
+  vector<POTENTIAL_T>* getPotential()   { return &this->potential; }
+  vector<ID_T>* getTag()                { return &this->tag; }
+  vector<MASK_T>* getMask()             { return &this->mask; }
+  vector<STATUS_T>* getStatus()         { return &this->status; }
+
+  // Generated halos, particles start..start+count-1 of the arrays
+  int getNumberOfHalos()                { return (int) this->haloStart.size(); }
+  long getHaloStart(int halo)           { return this->haloStart[halo]; }
+  long getHaloCount(int halo)           { return this->haloCount[halo]; }
+  POSVEL_T* getHaloCenter(int halo)     { return &this->haloCenter[3 * halo]; }
+  POSVEL_T* getHaloVelocity(int halo)   { return &this->haloVelocity[3 * halo]; }
+
+private:
+  // Uniform deviate in [0,1) and normal deviate
+  double uniform();
+  double normal();
+
+  // Add one halo of count particles with an NFW profile
+  void addHalo(long count);
+
+  // Add count particles placed at random in the region
+  void addBackground(long count);
+
+  // Wrap a location around the region along one dimension
+  POSVEL_T wrap(POSVEL_T loc, int dim);
+
+  void clear();
+
+  POSVEL_T minLoc[DIMENSION];           // Region to fill
+  POSVEL_T maxLoc[DIMENSION];
+
+  unsigned int seed;                    // Seed of the sequence
+  unsigned long long state;             // Current state of the sequence
+
+  double haloFraction;                  // Fraction of particles in halos
+  long minHaloSize;                     // Smallest halo
+  long maxHaloSize;                     // Largest halo
+  POSVEL_T particleMass;                // Mass of every particle
+
+  vector<POSVEL_T> xx, yy, zz;          // Generated particles
+  vector<POSVEL_T> vx, vy, vz;
+  vector<POSVEL_T> mass;
+  vector<POTENTIAL_T> potential;
+  vector<ID_T> tag;
+  vector<MASK_T> mask;
+  vector<STATUS_T> status;
+
+  vector<long> haloStart;               // First particle of each halo
+  vector<long> haloCount;               // Particles in each halo
+  vector<POSVEL_T> haloCenter;          // Center of each halo
+  vector<POSVEL_T> haloVelocity;        // Bulk velocity of each halo
+};
+
+}
+#endif
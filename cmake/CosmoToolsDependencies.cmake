@@ -8,6 +8,14 @@ add_definitions(-DOMPI_SKIP_MPICXX -DMPICH_SKIP_MPICXX)
 find_package(GenericIO REQUIRED)
 include_directories(${GENERIC_IO_INCLUDE_DIR})
 
+## Enable OpenMP threading of the per-halo analysis
+option(ENABLE_OPENMP "Enable OpenMP" OFF)
+if(${ENABLE_OPENMP})
+  find_package(OpenMP REQUIRED)
+  set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} ${OpenMP_C_FLAGS}")
+  set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} ${OpenMP_CXX_FLAGS}")
+endif()
+
 ## Enable DIY
 option(ENABLE_DIY "Enable DIY" OFF)
 if(${ENABLE_DIY})
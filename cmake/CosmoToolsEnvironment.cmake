@@ -56,6 +56,12 @@ if(${ENABLE_FRAMEWORK_STATISTICS})
  add_definitions(-DENABLESTATS)
 endif()
 
+## Sample hardware counters on profiled kernels, Linux perf_event only
+option(ENABLE_PERF_COUNTERS "Enable Hardware Performance Counters" OFF)
+if(${ENABLE_PERF_COUNTERS})
+ add_definitions(-DENABLEPERFCOUNTERS)
+endif()
+
 ## Build single library
 option(BUILD_SINGLE_LIBRARY "Build a single library" ON)
 option(BUILD_SIMULATION_INTERFACE "Build simulation interface" OFF)
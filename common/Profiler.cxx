@@ -0,0 +1,1138 @@
+/**
+ * @brief Implementation of Profiler
+ */
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef __linux__
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef ENABLEPERFCOUNTERS
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace cosmotk {
+
+namespace {
+
+// Must be at least the number of OpenMP threads
+const int PROFILER_MAX_THREADS = 1024;
+
+// Memory sampled on serial phases, the largest of each over calls
+const int NUM_MEMORY = 5;
+const char *MemoryNames[NUM_MEMORY] = {
+  "rss_entry", "rss_exit",
+  "tracked_entry", "tracked_exit", "tracked_peak" };
+
+#ifdef ENABLEPERFCOUNTERS
+// Hardware counters sampled on regions with counters enabled
+const int NUM_COUNTERS = 5;
+const char *CounterNames[NUM_COUNTERS] = {
+  "cycles", "instructions", "llc_misses", "dtlb_misses", "branch_misses" };
+const uint32_t CounterTypes[NUM_COUNTERS] = {
+  PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+  PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE };
+const uint64_t CounterConfigs[NUM_COUNTERS] = {
+  PERF_COUNT_HW_CPU_CYCLES,
+  PERF_COUNT_HW_INSTRUCTIONS,
+  PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+  PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+  PERF_COUNT_HW_BRANCH_MISSES };
+#endif
+
+// A region at one place in the hierarchy
+struct RegionNode
+{
+  int Parent;   // node of the enclosing region, -1 at the top
+  int Region;   // region handle
+};
+
+// Everything a thread touches while timing, so only node creation locks
+struct ThreadProfile
+{
+  std::vector<int> Stack;        // running nodes, innermost last
+  std::vector<int> Regions;      // region handle of each running node
+  std::vector<double> Start;     // start time of each running node
+  std::vector<double> Total;     // accumulated time per node
+  std::vector<double> Step;      // time per node since the last time-step
+  std::vector<long> TotalCalls;
+  std::vector<long> StepCalls;
+  std::vector<char> Phase;       // per node, whether it samples memory
+  std::map< std::pair<int,int>, int > Nodes;   // (parent,region) to node
+
+#ifdef ENABLEPERFCOUNTERS
+  ThreadProfile() : CountersOpen(false), Leader(-1) {}
+
+  bool CountersOpen;             // tried to open the counters of this thread
+  int Leader;                    // perf group leader, -1 if unavailable
+  int Slot[NUM_COUNTERS];        // position of each counter in a group read
+  std::vector<char> Counted;     // per node, whether to sample counters
+  std::vector<uint64_t> CounterStart;  // NUM_COUNTERS per running node
+  std::vector<double> TotalCounters;   // NUM_COUNTERS per node
+  std::vector<double> StepCounters;
+#endif
+};
+
+// Reduced statistics of one region over all processes
+struct RegionStatistics
+{
+  std::string Path;
+  int Depth;
+  double Calls;
+  double Threads;
+  double Min;
+  double Max;
+  double Mean;
+  double Imbalance;
+  double MemoryRanks;                  // processes with memory samples
+  double MemoryMax[NUM_MEMORY];
+  double MemoryMean[NUM_MEMORY];
+#ifdef ENABLEPERFCOUNTERS
+  double Counters[NUM_COUNTERS];       // summed over processes
+  std::vector<double> RankCounters;    // NUM_COUNTERS per process
+#endif
+};
+
+std::vector<std::string> RegionNames;
+std::map<std::string,int> RegionIndex;
+std::vector<RegionNode> Nodes;
+std::map< std::pair<int,int>, int > NodeIndex;
+ThreadProfile Threads[PROFILER_MAX_THREADS];
+std::vector<char> PhaseRegions;
+#ifdef ENABLEPERFCOUNTERS
+std::vector<char> CountedRegions;
+bool CounterWarning = false;
+#endif
+
+// Innermost node running outside of any parallel region. Threads which
+// begin a region with nothing of their own running are placed under it.
+int SerialTop = -1;
+
+// Memory on entry of each running serial phase, with the tracked peak
+// seen by its parent before it began
+struct MemoryEntry
+{
+  double Rss;
+  double Tracked;
+  double TrackedPeak;
+};
+
+// Only serial phases sample memory, so none of this needs a lock
+std::vector<MemoryEntry> MemoryStack;
+std::vector<double> TotalMemory;   // NUM_MEMORY per node
+std::vector<double> StepMemory;
+double TrackedCarry = 0.0;         // peak of the running phase before its
+                                   // innermost child phase reset it
+size_t (*TrackedCurrent)()   = NULL;
+size_t (*TrackedPeak)()      = NULL;
+void (*TrackedResetPeak)()   = NULL;
+
+//------------------------------------------------------------------------------
+inline int ThreadId()
+{
+#ifdef _OPENMP
+  return omp_get_thread_num();
+#else
+  return 0;
+#endif
+}
+
+//------------------------------------------------------------------------------
+inline bool InParallel()
+{
+#ifdef _OPENMP
+  return omp_in_parallel() != 0;
+#else
+  return false;
+#endif
+}
+
+//------------------------------------------------------------------------------
+int FindNode(ThreadProfile &tp, int parent, int region)
+{
+  std::pair<int,int> key(parent,region);
+  std::map< std::pair<int,int>, int >::iterator iter = tp.Nodes.find(key);
+  if( iter != tp.Nodes.end() )
+    {
+    return iter->second;
+    }
+
+  int node = -1;
+  bool phase   = false;
+  bool counted = false;
+#ifdef _OPENMP
+#pragma omp critical (profiler)
+#endif
+  {
+  phase = region < static_cast<int>(PhaseRegions.size()) &&
+          PhaseRegions[region];
+#ifdef ENABLEPERFCOUNTERS
+  counted = region < static_cast<int>(CountedRegions.size()) &&
+            CountedRegions[region];
+#endif
+  std::map< std::pair<int,int>, int >::iterator found = NodeIndex.find(key);
+  if( found == NodeIndex.end() )
+    {
+    RegionNode n;
+    n.Parent = parent;
+    n.Region = region;
+    node = static_cast<int>(Nodes.size());
+    Nodes.push_back(n);
+    NodeIndex[key] = node;
+    }
+  else
+    {
+    node = found->second;
+    }
+  }
+
+  tp.Nodes[key] = node;
+  if( node >= static_cast<int>(tp.Total.size()) )
+    {
+    tp.Total.resize(node+1,0.0);
+    tp.Step.resize(node+1,0.0);
+    tp.TotalCalls.resize(node+1,0);
+    tp.StepCalls.resize(node+1,0);
+    tp.Phase.resize(node+1,0);
+#ifdef ENABLEPERFCOUNTERS
+    tp.Counted.resize(node+1,0);
+    tp.TotalCounters.resize(NUM_COUNTERS*(node+1),0.0);
+    tp.StepCounters.resize(NUM_COUNTERS*(node+1),0.0);
+#endif
+    }
+  tp.Phase[node] = phase;
+#ifdef ENABLEPERFCOUNTERS
+  tp.Counted[node] = counted;
+#else
+  (void)counted;
+#endif
+  return node;
+}
+
+#ifdef ENABLEPERFCOUNTERS
+//------------------------------------------------------------------------------
+// Opens the counters of the calling thread as one group, so they are read
+// with a single system call. Counters the processor can not provide are
+// left out, without the cycle counter the thread has no counters.
+void OpenCounters(ThreadProfile &tp)
+{
+  tp.CountersOpen = true;
+  int numOpen = 0;
+  for(int k=0; k < NUM_COUNTERS; ++k)
+    {
+    struct perf_event_attr attr;
+    memset(&attr,0,sizeof(attr));
+    attr.type           = CounterTypes[k];
+    attr.size           = sizeof(attr);
+    attr.config         = CounterConfigs[k];
+    attr.disabled       = (tp.Leader < 0) ? 1 : 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    attr.read_format    = PERF_FORMAT_GROUP;
+
+    int fd = static_cast<int>(
+        syscall(__NR_perf_event_open,&attr,0,-1,tp.Leader,0) );
+    tp.Slot[k] = -1;
+    if( fd < 0 )
+      {
+      if( k == 0 )
+        {
+#ifdef _OPENMP
+#pragma omp critical (profiler)
+#endif
+        {
+        if( !CounterWarning )
+          {
+          std::cerr << "Profiler: hardware counters unavailable ("
+                    << strerror(errno) << ")" << std::endl;
+          CounterWarning = true;
+          }
+        }
+        return;
+        }
+      continue;
+      }
+
+    if( tp.Leader < 0 )
+      {
+      tp.Leader = fd;
+      }
+    tp.Slot[k] = numOpen++;
+    }
+
+  ioctl(tp.Leader,PERF_EVENT_IOC_RESET,PERF_IOC_FLAG_GROUP);
+  ioctl(tp.Leader,PERF_EVENT_IOC_ENABLE,PERF_IOC_FLAG_GROUP);
+}
+
+//------------------------------------------------------------------------------
+void ReadCounters(ThreadProfile &tp, uint64_t values[NUM_COUNTERS])
+{
+  if( !tp.CountersOpen )
+    {
+    OpenCounters(tp);
+    }
+
+  uint64_t buffer[1+NUM_COUNTERS];
+  if( tp.Leader < 0 ||
+      read(tp.Leader,buffer,sizeof(buffer)) < (ssize_t) sizeof(uint64_t) )
+    {
+    std::fill(values,values+NUM_COUNTERS,0);
+    return;
+    }
+
+  for(int k=0; k < NUM_COUNTERS; ++k)
+    {
+    values[k] = (tp.Slot[k] >= 0 && tp.Slot[k] < (int) buffer[0]) ?
+                buffer[1+tp.Slot[k]] : 0;
+    }
+}
+#endif
+
+//------------------------------------------------------------------------------
+// Reads a small file of /proc, returning the number of bytes read
+int ReadProcFile(const char *name, char *buffer, int size)
+{
+  int length = 0;
+#ifdef __linux__
+  int fd = open(name,O_RDONLY);
+  if( fd >= 0 )
+    {
+    ssize_t n = read(fd,buffer,size-1);
+    length = (n > 0) ? static_cast<int>(n) : 0;
+    close(fd);
+    }
+#else
+  (void)name;
+#endif
+  buffer[length] = '\0';
+  return length;
+}
+
+//------------------------------------------------------------------------------
+double GetResidentBytes()
+{
+#ifdef __linux__
+  char buffer[128];
+  unsigned long size = 0, resident = 0;
+  if( ReadProcFile("/proc/self/statm",buffer,sizeof(buffer)) > 0 &&
+      sscanf(buffer,"%lu %lu",&size,&resident) == 2 )
+    {
+    return static_cast<double>(resident) * sysconf(_SC_PAGESIZE);
+    }
+#endif
+  return 0.0;
+}
+
+//------------------------------------------------------------------------------
+// Samples memory on entry of a serial phase, then resets the tracked peak
+// so the one at its exit is its own. The parent's peak is carried in the
+// entry and restored at exit, which keeps nested phases correct. The
+// resident set size has no peak, since resetting it would also reset the
+// one seen by the batch system and tools such as time.
+void BeginMemory()
+{
+  MemoryEntry e;
+  e.Rss         = GetResidentBytes();
+  e.Tracked     = 0.0;
+  e.TrackedPeak = TrackedCarry;
+  if( TrackedCurrent != NULL )
+    {
+    e.Tracked     = static_cast<double>(TrackedCurrent());
+    e.TrackedPeak = std::max(TrackedCarry,
+                             static_cast<double>(TrackedPeak()));
+    TrackedResetPeak();
+    }
+  TrackedCarry = 0.0;
+  MemoryStack.push_back(e);
+}
+
+//------------------------------------------------------------------------------
+void EndMemory(int node)
+{
+  assert("pre: no memory sample for the region" && !MemoryStack.empty());
+  MemoryEntry e = MemoryStack.back();
+  MemoryStack.pop_back();
+
+  double sample[NUM_MEMORY];
+  sample[0] = e.Rss;
+  sample[1] = GetResidentBytes();
+  sample[2] = e.Tracked;
+  sample[3] = 0.0;
+  sample[4] = TrackedCarry;
+  if( TrackedCurrent != NULL )
+    {
+    sample[3] = static_cast<double>(TrackedCurrent());
+    sample[4] = std::max(TrackedCarry,static_cast<double>(TrackedPeak()));
+    }
+  sample[4] = std::max(sample[4],std::max(sample[2],sample[3]));
+
+  if( NUM_MEMORY*(node+1) > static_cast<int>(TotalMemory.size()) )
+    {
+    TotalMemory.resize(NUM_MEMORY*(node+1),0.0);
+    StepMemory.resize(NUM_MEMORY*(node+1),0.0);
+    }
+  for(int k=0; k < NUM_MEMORY; ++k)
+    {
+    double &total = TotalMemory[NUM_MEMORY*node+k];
+    double &step  = StepMemory[NUM_MEMORY*node+k];
+    total = std::max(total,sample[k]);
+    step  = std::max(step,sample[k]);
+    }
+
+  TrackedCarry = std::max(e.TrackedPeak,sample[4]);
+}
+
+//------------------------------------------------------------------------------
+std::string GetNodePath(int node)
+{
+  std::string path = RegionNames[ Nodes[node].Region ];
+  for(int p=Nodes[node].Parent; p >= 0; p=Nodes[p].Parent)
+    {
+    path = RegionNames[ Nodes[p].Region ] + "/" + path;
+    }
+  return path;
+}
+
+//------------------------------------------------------------------------------
+// Orders paths depth first, so a region is followed by its children
+std::string GetSortKey(std::string path)
+{
+  for(size_t i=0; i < path.size(); ++i)
+    {
+    if( path[i] == '/' )
+      {
+      path[i] = '\001';
+      }
+    }
+  return path;
+}
+
+//------------------------------------------------------------------------------
+void SplitLines(const std::string &s, std::vector<std::string> &lines)
+{
+  std::istringstream iss(s);
+  std::string line;
+  while( std::getline(iss,line) )
+    {
+    lines.push_back(line);
+    }
+}
+
+//------------------------------------------------------------------------------
+// Reduces the time of every region that ran on any process. The results
+// are only significant on rank 0.
+void ReduceRegions(
+    MPI_Comm comm, bool step, std::vector<RegionStatistics> &stats)
+{
+  int rank, numRanks;
+  MPI_Comm_rank(comm,&rank);
+  MPI_Comm_size(comm,&numRanks);
+
+  // STEP 0: Collect the local time of each region over threads. The time
+  // of a region on this process is the time of its slowest thread.
+  std::map<std::string,int> localIndex;
+  std::vector<double> localTime, localCalls, localThreads;
+  std::ostringstream localPaths;
+  std::vector<double> localMemory;
+#ifdef ENABLEPERFCOUNTERS
+  std::vector<double> localCounters;
+#endif
+  for(int node=0; node < static_cast<int>(Nodes.size()); ++node)
+    {
+    double time = 0.0, calls = 0.0, threads = 0.0;
+#ifdef ENABLEPERFCOUNTERS
+    double counters[NUM_COUNTERS] = { 0.0 };
+#endif
+    for(int t=0; t < PROFILER_MAX_THREADS; ++t)
+      {
+      ThreadProfile &tp = Threads[t];
+      if( node >= static_cast<int>(tp.Total.size()) )
+        {
+        continue;
+        }
+      long n = step ? tp.StepCalls[node] : tp.TotalCalls[node];
+      if( n > 0 )
+        {
+        double tt = step ? tp.Step[node] : tp.Total[node];
+        time = (tt > time) ? tt : time;
+        calls += n;
+        threads += 1.0;
+#ifdef ENABLEPERFCOUNTERS
+        const std::vector<double> &c = step ? tp.StepCounters :
+                                              tp.TotalCounters;
+        for(int k=0; k < NUM_COUNTERS; ++k)
+          {
+          counters[k] += c[NUM_COUNTERS*node+k];
+          }
+#endif
+        }
+      }
+
+    if( calls > 0.0 )
+      {
+      std::string path = GetNodePath(node);
+      localIndex[path] = static_cast<int>(localTime.size());
+      localTime.push_back(time);
+      localCalls.push_back(calls);
+      localThreads.push_back(threads);
+      localPaths << path << "\n";
+
+      const std::vector<double> &m = step ? StepMemory : TotalMemory;
+      for(int k=0; k < NUM_MEMORY; ++k)
+        {
+        int index = NUM_MEMORY*node+k;
+        localMemory.push_back(
+            (index < static_cast<int>(m.size())) ? m[index] : 0.0 );
+        }
+#ifdef ENABLEPERFCOUNTERS
+      localCounters.insert(localCounters.end(),counters,counters+NUM_COUNTERS);
+#endif
+      }
+    }
+
+  // STEP 1: Rank 0 forms the union of the regions seen on any process
+  std::string mine = localPaths.str();
+  int length = static_cast<int>(mine.size());
+  std::vector<int> lengths(numRanks,0), offsets(numRanks,0);
+  MPI_Gather(&length,1,MPI_INT,&lengths[0],1,MPI_INT,0,comm);
+
+  int totalLength = 0;
+  for(int r=0; r < numRanks; ++r)
+    {
+    offsets[r]   = totalLength;
+    totalLength += lengths[r];
+    }
+  std::vector<char> allPaths(totalLength+1,'\0');
+  MPI_Gatherv(const_cast<char*>(mine.c_str()),length,MPI_CHAR,
+      &allPaths[0],&lengths[0],&offsets[0],MPI_CHAR,0,comm);
+
+  std::string regions;
+  if( rank == 0 )
+    {
+    std::vector<std::string> lines;
+    SplitLines(std::string(&allPaths[0],totalLength),lines);
+
+    std::map<std::string,std::string> sorted;
+    for(size_t i=0; i < lines.size(); ++i)
+      {
+      sorted[ GetSortKey(lines[i]) ] = lines[i];
+      }
+
+    std::map<std::string,std::string>::iterator iter = sorted.begin();
+    for(; iter != sorted.end(); ++iter)
+      {
+      regions += iter->second + "\n";
+      }
+    }
+
+  int regionsLength = static_cast<int>(regions.size());
+  MPI_Bcast(&regionsLength,1,MPI_INT,0,comm);
+  std::vector<char> regionsBuffer(regionsLength+1,'\0');
+  if( rank == 0 )
+    {
+    regions.copy(&regionsBuffer[0],regionsLength);
+    }
+  MPI_Bcast(&regionsBuffer[0],regionsLength,MPI_CHAR,0,comm);
+
+  std::vector<std::string> paths;
+  SplitLines(std::string(&regionsBuffer[0],regionsLength),paths);
+  int numRegions = static_cast<int>(paths.size());
+  if( numRegions == 0 )
+    {
+    stats.resize(0);
+    return;
+    }
+
+  // STEP 2: Reduce in the common order, regions which did not run on a
+  // process count as zero time there
+  std::vector<double> time(numRegions,0.0);
+  std::vector<double> counts(2*numRegions,0.0);
+  for(int i=0; i < numRegions; ++i)
+    {
+    std::map<std::string,int>::iterator iter = localIndex.find(paths[i]);
+    if( iter != localIndex.end() )
+      {
+      time[i]              = localTime[iter->second];
+      counts[i]            = localCalls[iter->second];
+      counts[numRegions+i] = localThreads[iter->second];
+      }
+    }
+
+  std::vector<double> minTime(numRegions), maxTime(numRegions);
+  std::vector<double> sumTime(numRegions), sumCounts(2*numRegions);
+  MPI_Reduce(&time[0],&minTime[0],numRegions,MPI_DOUBLE,MPI_MIN,0,comm);
+  MPI_Reduce(&time[0],&maxTime[0],numRegions,MPI_DOUBLE,MPI_MAX,0,comm);
+  MPI_Reduce(&time[0],&sumTime[0],numRegions,MPI_DOUBLE,MPI_SUM,0,comm);
+  MPI_Reduce(&counts[0],&sumCounts[0],2*numRegions,MPI_DOUBLE,MPI_SUM,0,comm);
+
+  // Memory is reduced with a count of the processes which sampled it, so
+  // the mean is over those rather than over all processes
+  const int MEMORY_VALUES = NUM_MEMORY+1;
+  std::vector<double> memory(MEMORY_VALUES*numRegions,0.0);
+  for(int i=0; i < numRegions; ++i)
+    {
+    std::map<std::string,int>::iterator iter = localIndex.find(paths[i]);
+    if( iter != localIndex.end() )
+      {
+      const double *m = &localMemory[NUM_MEMORY*iter->second];
+      std::copy(m,m+NUM_MEMORY,&memory[MEMORY_VALUES*i]);
+      memory[MEMORY_VALUES*i+NUM_MEMORY] =
+          (m[1] > 0.0 || m[4] > 0.0) ? 1.0 : 0.0;
+      }
+    }
+  std::vector<double> maxMemory(memory.size()), sumMemory(memory.size());
+  MPI_Reduce(&memory[0],&maxMemory[0],static_cast<int>(memory.size()),
+      MPI_DOUBLE,MPI_MAX,0,comm);
+  MPI_Reduce(&memory[0],&sumMemory[0],static_cast<int>(memory.size()),
+      MPI_DOUBLE,MPI_SUM,0,comm);
+
+#ifdef ENABLEPERFCOUNTERS
+  // Counters are kept per process as well as summed
+  int numValues = NUM_COUNTERS*numRegions;
+  std::vector<double> counters(numValues,0.0);
+  for(int i=0; i < numRegions; ++i)
+    {
+    std::map<std::string,int>::iterator iter = localIndex.find(paths[i]);
+    if( iter != localIndex.end() )
+      {
+      std::copy(&localCounters[NUM_COUNTERS*iter->second],
+                &localCounters[NUM_COUNTERS*iter->second]+NUM_COUNTERS,
+                &counters[NUM_COUNTERS*i]);
+      }
+    }
+  std::vector<double> allCounters( (rank == 0) ? numRanks*numValues : 1 );
+  MPI_Gather(&counters[0],numValues,MPI_DOUBLE,
+      &allCounters[0],numValues,MPI_DOUBLE,0,comm);
+#endif
+
+  // STEP 3: Form the statistics on rank 0
+  stats.resize(numRegions);
+  for(int i=0; i < numRegions; ++i)
+    {
+    RegionStatistics &s = stats[i];
+    s.Path      = paths[i];
+    s.Depth     = 0;
+    for(size_t c=0; c < s.Path.size(); ++c)
+      {
+      s.Depth += (s.Path[c] == '/') ? 1 : 0;
+      }
+    s.Calls     = sumCounts[i];
+    s.Threads   = sumCounts[numRegions+i] / numRanks;
+    s.Min       = minTime[i];
+    s.Max       = maxTime[i];
+    s.Mean      = sumTime[i] / numRanks;
+    s.Imbalance = (s.Mean > 0.0) ? s.Max / s.Mean : 1.0;
+
+    s.MemoryRanks = sumMemory[MEMORY_VALUES*i+NUM_MEMORY];
+    for(int k=0; k < NUM_MEMORY; ++k)
+      {
+      s.MemoryMax[k]  = maxMemory[MEMORY_VALUES*i+k];
+      s.MemoryMean[k] = (s.MemoryRanks > 0.0) ?
+          sumMemory[MEMORY_VALUES*i+k] / s.MemoryRanks : 0.0;
+      }
+#ifdef ENABLEPERFCOUNTERS
+    s.RankCounters.resize(NUM_COUNTERS*numRanks);
+    std::fill(s.Counters,s.Counters+NUM_COUNTERS,0.0);
+    for(int r=0; r < numRanks; ++r)
+      {
+      for(int k=0; k < NUM_COUNTERS; ++k)
+        {
+        double value = allCounters[r*numValues+NUM_COUNTERS*i+k];
+        s.RankCounters[NUM_COUNTERS*r+k] = value;
+        s.Counters[k] += value;
+        }
+      }
+#endif
+    }
+}
+
+//------------------------------------------------------------------------------
+std::string QuotedString(const std::string &s)
+{
+  std::string quoted = "\"";
+  for(size_t i=0; i < s.size(); ++i)
+    {
+    if( s[i] == '"' || s[i] == '\\' )
+      {
+      quoted += '\\';
+      }
+    quoted += s[i];
+    }
+  return quoted + "\"";
+}
+
+} // END anonymous namespace
+
+//------------------------------------------------------------------------------
+int Profiler::GetRegion(const std::string &name)
+{
+  assert("pre: region names may not contain a '/'" &&
+         (name.find('/') == std::string::npos) );
+
+  int region = -1;
+#ifdef _OPENMP
+#pragma omp critical (profiler)
+#endif
+  {
+  std::map<std::string,int>::iterator iter = RegionIndex.find(name);
+  if( iter == RegionIndex.end() )
+    {
+    region = static_cast<int>(RegionNames.size());
+    RegionNames.push_back(name);
+    RegionIndex[name] = region;
+    }
+  else
+    {
+    region = iter->second;
+    }
+  }
+  return region;
+}
+
+//------------------------------------------------------------------------------
+void Profiler::MarkPhase(int region)
+{
+#ifdef _OPENMP
+#pragma omp critical (profiler)
+#endif
+  {
+  if( region >= static_cast<int>(PhaseRegions.size()) )
+    {
+    PhaseRegions.resize(region+1,0);
+    }
+  PhaseRegions[region] = 1;
+  }
+}
+
+//------------------------------------------------------------------------------
+void Profiler::SetMemoryTracker(
+    size_t (*current)(), size_t (*peak)(), void (*resetPeak)())
+{
+  assert("pre: SetMemoryTracker called in a parallel region" && !InParallel());
+  assert("pre: tracker functions must all be given or none" &&
+         ((current == NULL) == (peak == NULL)) &&
+         ((current == NULL) == (resetPeak == NULL)) );
+  TrackedCurrent   = current;
+  TrackedPeak      = peak;
+  TrackedResetPeak = resetPeak;
+}
+
+#ifdef ENABLEPERFCOUNTERS
+//------------------------------------------------------------------------------
+void Profiler::EnableCounters(int region)
+{
+#ifdef _OPENMP
+#pragma omp critical (profiler)
+#endif
+  {
+  if( region >= static_cast<int>(CountedRegions.size()) )
+    {
+    CountedRegions.resize(region+1,0);
+    }
+  CountedRegions[region] = 1;
+  }
+}
+#endif
+
+//------------------------------------------------------------------------------
+void Profiler::Begin(int region)
+{
+  int thread = ThreadId();
+  assert("pre: too many threads for the profiler" &&
+         (thread < PROFILER_MAX_THREADS) );
+
+  ThreadProfile &tp = Threads[thread];
+  int parent = tp.Stack.empty() ? SerialTop : tp.Stack.back();
+  int node   = FindNode(tp,parent,region);
+
+  tp.Stack.push_back(node);
+  tp.Regions.push_back(region);
+  if( !InParallel() )
+    {
+    SerialTop = node;
+    if( tp.Phase[node] )
+      {
+      BeginMemory();
+      }
+    }
+#ifdef ENABLEPERFCOUNTERS
+  uint64_t values[NUM_COUNTERS] = { 0 };
+  if( tp.Counted[node] )
+    {
+    ReadCounters(tp,values);
+    }
+  tp.CounterStart.insert(tp.CounterStart.end(),values,values+NUM_COUNTERS);
+#endif
+  tp.Start.push_back(MPI_Wtime());
+}
+
+//------------------------------------------------------------------------------
+double Profiler::End(int region)
+{
+  double endTime = MPI_Wtime();
+
+  ThreadProfile &tp = Threads[ThreadId()];
+  assert("pre: no region is running on this thread" && !tp.Stack.empty());
+  assert("pre: regions must end in the reverse order they began" &&
+         (tp.Regions.back() == region) );
+
+  int node       = tp.Stack.back();
+  double elapsed = endTime - tp.Start.back();
+  tp.Total[node] += elapsed;
+  tp.Step[node]  += elapsed;
+  tp.TotalCalls[node]++;
+  tp.StepCalls[node]++;
+
+#ifdef ENABLEPERFCOUNTERS
+  if( tp.Counted[node] )
+    {
+    uint64_t values[NUM_COUNTERS];
+    ReadCounters(tp,values);
+    uint64_t *start = &tp.CounterStart[tp.CounterStart.size()-NUM_COUNTERS];
+    for(int k=0; k < NUM_COUNTERS; ++k)
+      {
+      double delta = static_cast<double>(values[k] - start[k]);
+      tp.TotalCounters[NUM_COUNTERS*node+k] += delta;
+      tp.StepCounters[NUM_COUNTERS*node+k]  += delta;
+      }
+    }
+  tp.CounterStart.resize(tp.CounterStart.size()-NUM_COUNTERS);
+#endif
+
+  tp.Stack.pop_back();
+  tp.Regions.pop_back();
+  tp.Start.pop_back();
+  if( !InParallel() )
+    {
+    if( tp.Phase[node] )
+      {
+      EndMemory(node);
+      }
+    SerialTop = tp.Stack.empty() ? -1 : tp.Stack.back();
+    }
+  return elapsed;
+}
+
+//------------------------------------------------------------------------------
+void Profiler::GetChildTimes(
+    const std::string &path, std::map<std::string,double> &times)
+{
+  assert("pre: called inside a parallel region" && !InParallel());
+
+  times.clear();
+  for(int node=0; node < static_cast<int>(Nodes.size()); ++node)
+    {
+    int parent = Nodes[node].Parent;
+    if( (parent < 0) || (GetNodePath(parent) != path) )
+      {
+      continue;
+      }
+
+    double time = 0.0;
+    for(int t=0; t < PROFILER_MAX_THREADS; ++t)
+      {
+      ThreadProfile &tp = Threads[t];
+      if( (node < static_cast<int>(tp.Total.size())) &&
+          (tp.Total[node] > time) )
+        {
+        time = tp.Total[node];
+        }
+      }
+    times[ RegionNames[ Nodes[node].Region ] ] = time;
+    }
+}
+
+//------------------------------------------------------------------------------
+void Profiler::Print(MPI_Comm comm)
+{
+  std::vector<RegionStatistics> stats;
+  ReduceRegions(comm,false,stats);
+
+  int rank, numRanks;
+  MPI_Comm_rank(comm,&rank);
+  MPI_Comm_size(comm,&numRanks);
+  if( rank != 0 || stats.empty() )
+    {
+    return;
+    }
+
+  std::cout << "-----------------------------------------------------------------";
+  std::cout << "---------------" << std::endl;
+  std::cout << "     Timing results for " << numRanks << " processes:"
+            << std::endl;
+  std::cout << "-----------------------------------------------------------------";
+  std::cout << "---------------" << std::endl;
+  std::cout << std::left << std::setw(32) << "Region"
+            << std::right << std::setw(10) << "Calls"
+            << std::setw(10) << "Min"
+            << std::setw(10) << "Max"
+            << std::setw(10) << "Mean"
+            << std::setw(8) << "Max/Mn" << std::endl;
+
+  for(size_t i=0; i < stats.size(); ++i)
+    {
+    RegionStatistics &s = stats[i];
+    std::string name = std::string(2*s.Depth,' ') +
+                       s.Path.substr(s.Path.rfind('/')+1);
+    std::cout << std::left << std::setw(32) << name
+              << std::right << std::setw(10) << static_cast<long>(s.Calls)
+              << std::fixed << std::setprecision(3)
+              << std::setw(10) << s.Min
+              << std::setw(10) << s.Max
+              << std::setw(10) << s.Mean
+              << std::setprecision(2)
+              << std::setw(8) << s.Imbalance << std::endl;
+    std::cout.unsetf(std::ios::fixed);
+    }
+  std::cout << std::setprecision(6) << std::endl;
+
+  // Peaks in MB, max and mean over the processes which sampled them
+  const double MB = 1024.0 * 1024.0;
+  bool memoryHeader = false;
+  for(size_t i=0; i < stats.size(); ++i)
+    {
+    RegionStatistics &s = stats[i];
+    if( s.MemoryRanks <= 0.0 )
+      {
+      continue;
+      }
+    if( !memoryHeader )
+      {
+      std::cout << std::left << std::setw(32) << "Region"
+                << std::right << std::setw(12) << "Entry Max"
+                << std::setw(12) << "Exit Max"
+                << std::setw(12) << "Exit Mean"
+                << std::setw(12) << "Track Max"
+                << std::setw(12) << "Track Mean" << std::endl;
+      memoryHeader = true;
+      }
+    std::string name = std::string(2*s.Depth,' ') +
+                       s.Path.substr(s.Path.rfind('/')+1);
+    std::cout << std::left << std::setw(32) << name
+              << std::right << std::fixed << std::setprecision(1)
+              << std::setw(12) << s.MemoryMax[0] / MB
+              << std::setw(12) << s.MemoryMax[1] / MB
+              << std::setw(12) << s.MemoryMean[1] / MB
+              << std::setw(12) << s.MemoryMax[4] / MB
+              << std::setw(12) << s.MemoryMean[4] / MB << std::endl;
+    std::cout.unsetf(std::ios::fixed);
+    }
+  if( memoryHeader )
+    {
+    std::cout << std::setprecision(6) << std::endl;
+    }
+
+#ifdef ENABLEPERFCOUNTERS
+  // Rates per thousand instructions summed over processes
+  bool header = false;
+  for(size_t i=0; i < stats.size(); ++i)
+    {
+    RegionStatistics &s = stats[i];
+    if( s.Counters[0] <= 0.0 )
+      {
+      continue;
+      }
+    if( !header )
+      {
+      std::cout << std::left << std::setw(32) << "Region"
+                << std::right << std::setw(10) << "Gcycles"
+                << std::setw(8) << "IPC"
+                << std::setw(10) << "LLC/kI"
+                << std::setw(10) << "dTLB/kI"
+                << std::setw(10) << "Br/kI" << std::endl;
+      header = true;
+      }
+    double kilo = (s.Counters[1] > 0.0) ? s.Counters[1] / 1000.0 : 1.0;
+    std::cout << std::left << std::setw(32) << s.Path
+              << std::right << std::fixed << std::setprecision(3)
+              << std::setw(10) << s.Counters[0] * 1.0e-9
+              << std::setprecision(2)
+              << std::setw(8) << s.Counters[1] / s.Counters[0]
+              << std::setw(10) << s.Counters[2] / kilo
+              << std::setw(10) << s.Counters[3] / kilo
+              << std::setw(10) << s.Counters[4] / kilo << std::endl;
+    std::cout.unsetf(std::ios::fixed);
+    }
+  if( header )
+    {
+    std::cout << std::setprecision(6) << std::endl;
+    }
+#endif
+}
+
+//------------------------------------------------------------------------------
+void Profiler::WriteTimeStep(
+    MPI_Comm comm, int tstep, const std::string &basename)
+{
+  assert("pre: WriteTimeStep called in a parallel region" && !InParallel());
+
+  std::vector<RegionStatistics> stats;
+  ReduceRegions(comm,true,stats);
+
+  int rank;
+  MPI_Comm_rank(comm,&rank);
+  if( rank == 0 )
+    {
+    std::string csvName = basename + ".csv";
+    std::ofstream csv(csvName.c_str(),std::ios::out | std::ios::app);
+    if( csv.tellp() == 0 )
+      {
+      csv << "tstep,region,depth,calls,threads,min,max,mean,imbalance";
+      for(int k=0; k < NUM_MEMORY; ++k)
+        {
+        csv << "," << MemoryNames[k] << "_max," << MemoryNames[k] << "_mean";
+        }
+#ifdef ENABLEPERFCOUNTERS
+      for(int k=0; k < NUM_COUNTERS; ++k)
+        {
+        csv << "," << CounterNames[k];
+        }
+#endif
+      csv << "\n";
+      }
+    for(size_t i=0; i < stats.size(); ++i)
+      {
+      RegionStatistics &s = stats[i];
+      csv << tstep << "," << QuotedString(s.Path) << "," << s.Depth << ","
+          << static_cast<long>(s.Calls) << "," << s.Threads << ","
+          << s.Min << "," << s.Max << "," << s.Mean << ","
+          << s.Imbalance;
+      for(int k=0; k < NUM_MEMORY; ++k)
+        {
+        csv << "," << static_cast<long>(s.MemoryMax[k])
+            << "," << static_cast<long>(s.MemoryMean[k]);
+        }
+#ifdef ENABLEPERFCOUNTERS
+      for(int k=0; k < NUM_COUNTERS; ++k)
+        {
+        csv << "," << s.Counters[k];
+        }
+#endif
+      csv << "\n";
+      }
+    csv.close();
+
+    std::string jsonName = basename + ".json";
+    std::ofstream json(jsonName.c_str(),std::ios::out | std::ios::app);
+    json << "{\"tstep\":" << tstep << ",\"regions\":[";
+    for(size_t i=0; i < stats.size(); ++i)
+      {
+      RegionStatistics &s = stats[i];
+      json << ((i > 0) ? "," : "")
+           << "{\"region\":" << QuotedString(s.Path)
+           << ",\"depth\":" << s.Depth
+           << ",\"calls\":" << static_cast<long>(s.Calls)
+           << ",\"threads\":" << s.Threads
+           << ",\"min\":" << s.Min
+           << ",\"max\":" << s.Max
+           << ",\"mean\":" << s.Mean
+           << ",\"imbalance\":" << s.Imbalance;
+      for(int k=0; k < NUM_MEMORY; ++k)
+        {
+        json << ",\"" << MemoryNames[k] << "_max\":"
+             << static_cast<long>(s.MemoryMax[k])
+             << ",\"" << MemoryNames[k] << "_mean\":"
+             << static_cast<long>(s.MemoryMean[k]);
+        }
+#ifdef ENABLEPERFCOUNTERS
+      for(int k=0; k < NUM_COUNTERS; ++k)
+        {
+        json << ",\"" << CounterNames[k] << "\":" << s.Counters[k];
+        }
+#endif
+      json << "}";
+      }
+    json << "]}\n";
+    json.close();
+
+#ifdef ENABLEPERFCOUNTERS
+    std::string rankName = basename + ".counters.csv";
+    std::ofstream ranks(rankName.c_str(),std::ios::out | std::ios::app);
+    if( ranks.tellp() == 0 )
+      {
+      ranks << "tstep,rank,region";
+      for(int k=0; k < NUM_COUNTERS; ++k)
+        {
+        ranks << "," << CounterNames[k];
+        }
+      ranks << "\n";
+      }
+    for(size_t i=0; i < stats.size(); ++i)
+      {
+      RegionStatistics &s = stats[i];
+      if( s.Counters[0] <= 0.0 )
+        {
+        continue;
+        }
+      int numRanks = static_cast<int>(s.RankCounters.size()) / NUM_COUNTERS;
+      for(int r=0; r < numRanks; ++r)
+        {
+        ranks << tstep << "," << r << "," << QuotedString(s.Path);
+        for(int k=0; k < NUM_COUNTERS; ++k)
+          {
+          ranks << "," << s.RankCounters[NUM_COUNTERS*r+k];
+          }
+        ranks << "\n";
+        }
+      }
+    ranks.close();
+#endif
+    }
+
+  // Start the next time-step, the totals carry on
+  std::fill(StepMemory.begin(),StepMemory.end(),0.0);
+  for(int t=0; t < PROFILER_MAX_THREADS; ++t)
+    {
+    std::fill(Threads[t].Step.begin(),Threads[t].Step.end(),0.0);
+    std::fill(Threads[t].StepCalls.begin(),Threads[t].StepCalls.end(),0);
+#ifdef ENABLEPERFCOUNTERS
+    std::fill(Threads[t].StepCounters.begin(),Threads[t].StepCounters.end(),
+              0.0);
+#endif
+    }
+}
+
+//------------------------------------------------------------------------------
+void Profiler::Reset()
+{
+  std::fill(TotalMemory.begin(),TotalMemory.end(),0.0);
+  std::fill(StepMemory.begin(),StepMemory.end(),0.0);
+  for(int t=0; t < PROFILER_MAX_THREADS; ++t)
+    {
+    ThreadProfile &tp = Threads[t];
+    std::fill(tp.Total.begin(),tp.Total.end(),0.0);
+    std::fill(tp.Step.begin(),tp.Step.end(),0.0);
+    std::fill(tp.TotalCalls.begin(),tp.TotalCalls.end(),0);
+    std::fill(tp.StepCalls.begin(),tp.StepCalls.end(),0);
+#ifdef ENABLEPERFCOUNTERS
+    std::fill(tp.TotalCounters.begin(),tp.TotalCounters.end(),0.0);
+    std::fill(tp.StepCounters.begin(),tp.StepCounters.end(),0.0);
+#endif
+    }
+}
+
+} /* namespace cosmotk */
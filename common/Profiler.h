@@ -0,0 +1,234 @@
+/**
+ * @brief A hierarchical profiler of named regions shared by the halo finder,
+ * the merger tree and the in-situ framework.
+ *
+ * Regions nest: a region begun while another is running on the same thread
+ * is recorded as its child, so the same name under different parents is
+ * timed separately. Each thread accumulates into its own table, and a thread
+ * that begins a region inside an OpenMP parallel region with nothing of its
+ * own running is attributed to the innermost region that was running when
+ * the parallel region was entered.
+ *
+ * Regions marked as phases, when begun outside of any parallel region, also
+ * record the resident set size on entry and exit and, when a tracker is set,
+ * the bytes held by the tracked allocator on entry and exit along with their
+ * peak while the phase ran. Other regions only read the clock, so they are
+ * cheap enough to time once per halo.
+ *
+ * General usage
+ *  1) look up a region once, typically into a static
+ *     static int region = Profiler::GetRegion("MBP Center Finder");
+ *     or, for a phase run a few times per time-step
+ *     static int region = Profiler::GetPhaseRegion("FOF Halo Finder");
+ *  2) time it, either explicitly
+ *     Profiler::Begin(region); ... Profiler::End(region);
+ *     or for the lifetime of a scope
+ *     ProfilerRegion scope(region);
+ *  3) optionally sample hardware counters on it, when built with
+ *     ENABLEPERFCOUNTERS, before it first begins
+ *     Profiler::EnableCounters(region);
+ *  4) report it, each a collective call over the given communicator
+ *     Profiler::Print(comm);
+ *     Profiler::WriteTimeStep(comm, tstep, "InSituTimes");
+ */
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include "CosmoToolsMacros.h"
+
+#include <mpi.h>
+
+#include <cstddef>
+#include <map>
+#include <string>
+
+namespace cosmotk {
+
+class Profiler
+{
+public:
+  /**
+   * @brief Returns the handle of the region with the given name, creating
+   * it on first use.
+   * @param name the region name, which must not contain a '/'
+   * @return region the handle to pass to Begin and End
+   */
+  static int GetRegion(const std::string &name);
+
+  /**
+   * @brief Samples cycles, instructions, last level cache misses, data TLB
+   * misses and branch misses of the calling thread on every instance of the
+   * region, using Linux perf_event_open. Must be called before the region
+   * first begins. Without ENABLEPERFCOUNTERS this does nothing.
+   * @param region the region handle
+   */
+#ifdef ENABLEPERFCOUNTERS
+  static void EnableCounters(int region);
+#else
+  static void EnableCounters(int) {}
+#endif
+
+  /**
+   * @brief Marks the region as a phase, whose memory is sampled on entry and
+   * exit. Sampling reads /proc, so only mark regions begun a few times per
+   * time-step. Must be called before the region first begins.
+   * @param region the region handle
+   */
+  static void MarkPhase(int region);
+
+  /**
+   * @brief Returns the handle of a phase, creating it on first use.
+   * @param name the region name, which must not contain a '/'
+   * @return region the handle to pass to Begin and End
+   */
+  static int GetPhaseRegion(const std::string &name)
+    {
+    int region = Profiler::GetRegion(name);
+    Profiler::MarkPhase(region);
+    return region;
+    }
+
+  /**
+   * @brief Returns the handle of a hot kernel with counters enabled, for the
+   * kernels whose behavior the wall time alone does not explain.
+   * @param name the region name, which must not contain a '/'
+   * @return region the handle to pass to Begin and End
+   */
+  static int GetCountedRegion(const std::string &name)
+    {
+    int region = Profiler::GetRegion(name);
+    Profiler::EnableCounters(region);
+    return region;
+    }
+
+  /**
+   * @brief Sets the functions giving the bytes held by an allocator which
+   * tracks its own use, such as bigchunk, recorded next to the resident set
+   * size of every serial phase.
+   * @param current returns the bytes held now
+   * @param peak returns the most bytes held since the peak was last reset
+   * @param resetPeak resets the peak to the bytes held now
+   */
+  static void SetMemoryTracker(
+      size_t (*current)(), size_t (*peak)(), void (*resetPeak)());
+
+  /**
+   * @brief Begins timing the region on the calling thread.
+   * @param region the region handle
+   */
+  static void Begin(int region);
+  static void Begin(const std::string &name)
+    { Profiler::Begin(Profiler::GetRegion(name)); }
+
+  /**
+   * @brief Ends the innermost region running on the calling thread.
+   * @param region the region handle, which must match the matching Begin
+   * @return elapsed the wall time of this instance of the region
+   */
+  static double End(int region);
+  static double End(const std::string &name)
+    { return Profiler::End(Profiler::GetRegion(name)); }
+
+  /**
+   * @brief Returns the accumulated time on this process of every region run
+   * directly inside the given one, for programs reporting on the regions of
+   * the library they drive. The time of a region is that of its slowest
+   * thread.
+   * @param path the names of the region and its parents, outermost first,
+   * joined by '/'
+   * @param times the time of each child region by name (out)
+   * @note Must be called outside of any OpenMP parallel region.
+   */
+  static void GetChildTimes(
+      const std::string &path, std::map<std::string,double> &times);
+
+  /**
+   * @brief Prints the accumulated time of every region as a nested table.
+   * For each region the time on a process is that of its slowest thread, and
+   * the table gives the minimum, maximum and mean over processes and the
+   * imbalance, max/mean. Phases get a second table of their resident set
+   * size and tracked peak, max and mean over processes, and regions with
+   * hardware counters a third of the counter rates summed over processes.
+   * @param comm the communicator of the processes to reduce over
+   * @note This is a collective call, all processes must call this method.
+   */
+  static void Print(MPI_Comm comm);
+
+  /**
+   * @brief Appends the time of every region since the last call to
+   * <basename>.csv and as one JSON object per line to <basename>.json, then
+   * clears the per time-step times. The totals used by Print are kept.
+   * Memory samples of phases are written as the max and mean over processes
+   * of the largest value of each on a process. With hardware counters the
+   * records carry the counters summed over processes, and
+   * <basename>.counters.csv gets one record per process.
+   * @param comm the communicator of the processes to reduce over
+   * @param tstep the time-step to label the records with
+   * @param basename the base name of the files written by rank 0
+   * @note This is a collective call, all processes must call this method
+   * outside of any OpenMP parallel region.
+   */
+  static void WriteTimeStep(
+      MPI_Comm comm, int tstep, const std::string &basename);
+
+  /**
+   * @brief Clears all accumulated times. Region handles remain valid.
+   */
+  static void Reset();
+};
+
+/**
+ * @brief Times a region for the lifetime of the object, or until Stop.
+ */
+class ProfilerRegion
+{
+public:
+  ProfilerRegion(int region)
+    {
+    this->Region  = region;
+    this->Elapsed = 0.0;
+    this->Running = true;
+    Profiler::Begin(this->Region);
+    }
+
+  ProfilerRegion(const std::string &name)
+    {
+    this->Region  = Profiler::GetRegion(name);
+    this->Elapsed = 0.0;
+    this->Running = true;
+    Profiler::Begin(this->Region);
+    }
+
+  ~ProfilerRegion()
+    { this->Stop(); }
+
+  /**
+   * @brief Ends the region before the end of the scope.
+   * @return elapsed the wall time of the region
+   */
+  double Stop()
+    {
+    if( this->Running )
+      {
+      this->Elapsed = Profiler::End(this->Region);
+      this->Running = false;
+      }
+    return( this->Elapsed );
+    }
+
+  /**
+   * @return elapsed the wall time of the region once stopped.
+   */
+  double GetElapsedTime() const
+    { return( this->Elapsed ); }
+
+private:
+  int Region;
+  double Elapsed;
+  bool Running;
+
+  DISABLE_COPY_AND_ASSIGNMENT(ProfilerRegion);
+};
+
+} /* namespace cosmotk */
+#endif /* PROFILER_H_ */
@@ -4,4 +4,4 @@ COMMON_INCLUDES := ${COMMON_HOME}
 
 ## List of sources to be compiled under this directory
 COMMON_SOURCES += ${COMMON_HOME}/MPIUtilities.cxx
-COMMON_SOURCES += ${COMMON_HOME}/TaskTimer.cxx
\ No newline at end of file
+COMMON_SOURCES += ${COMMON_HOME}/Profiler.cxx
\ No newline at end of file
@@ -0,0 +1,121 @@
+/**
+ * @brief Tests that only regions marked as phases sample memory, so that
+ * regions timed once per halo cost no more than reading the clock.
+ */
+#include <cstdarg>
+#include <cstring>
+#include <iostream>
+#include <mpi.h>
+
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "Profiler.h"
+
+namespace {
+
+int ProcReads    = 0;   // files of /proc opened
+int TrackerCalls = 0;   // calls to the memory tracker
+
+size_t TrackedCurrent()   { ++TrackerCalls; return 0; }
+size_t TrackedPeak()      { ++TrackerCalls; return 0; }
+void   TrackedResetPeak() { ++TrackerCalls; }
+
+void ResetCounts()
+{
+  ProcReads    = 0;
+  TrackerCalls = 0;
+}
+
+bool Check(bool condition, const char *message)
+{
+  if( !condition )
+    {
+    std::cerr << "FAILED: " << message
+              << " (proc reads=" << ProcReads
+              << ", tracker calls=" << TrackerCalls << ")\n";
+    }
+  return condition;
+}
+
+} // END anonymous namespace
+
+/**
+ * @brief Counts every file of /proc the profiler opens. Defined here, it
+ * takes the place of the C library open for the whole program.
+ */
+extern "C" int open(const char *path, int flags, ...)
+{
+  mode_t mode = 0;
+  if( flags & O_CREAT )
+    {
+    va_list args;
+    va_start(args,flags);
+    mode = static_cast<mode_t>(va_arg(args,int));
+    va_end(args);
+    }
+  if( strncmp(path,"/proc/",6) == 0 )
+    {
+    ++ProcReads;
+    }
+  return static_cast<int>(syscall(SYS_openat,AT_FDCWD,path,flags,mode));
+}
+
+/**
+ * @brief Program main
+ * @param argc the argument counter
+ * @param argv the argument vector
+ * @return rc test return code rc=0 if success, else rc!=0.
+ */
+int main(int argc, char **argv)
+{
+  bool ok = true;
+
+  MPI_Init(&argc,&argv);
+
+  using cosmotk::Profiler;
+  Profiler::SetMemoryTracker(TrackedCurrent,TrackedPeak,TrackedResetPeak);
+  int phase  = Profiler::GetPhaseRegion("TestPhase");
+  int region = Profiler::GetRegion("TestRegion");
+
+  // A phase samples memory on entry
+  ResetCounts();
+  Profiler::Begin(phase);
+#ifdef __linux__
+  ok &= Check(ProcReads > 0,"phase did not read the resident set size");
+#endif
+  ok &= Check(TrackerCalls > 0,"phase did not sample the memory tracker");
+
+  // A region nested in the phase only reads the clock
+  ResetCounts();
+  for(int i=0; i < 1000; ++i)
+    {
+    Profiler::Begin(region);
+    Profiler::End(region);
+    }
+  ok &= Check(ProcReads == 0,"nested region read /proc");
+  ok &= Check(TrackerCalls == 0,"nested region sampled the memory tracker");
+
+  // The phase samples memory again on exit
+  ResetCounts();
+  Profiler::End(phase);
+#ifdef __linux__
+  ok &= Check(ProcReads > 0,"phase did not read the resident set size");
+#endif
+
+  // Neither does a region outside of any phase
+  ResetCounts();
+  Profiler::Begin(region);
+  Profiler::End(region);
+  ok &= Check(ProcReads == 0,"top level region read /proc");
+  ok &= Check(TrackerCalls == 0,"top level region sampled the memory tracker");
+
+  MPI_Finalize();
+
+  if( ok )
+    {
+    std::cout << "TestProfilerPhases passed\n";
+    }
+  return( ok ? 0 : -1 );
+}
@@ -3,6 +3,7 @@
 #include "InSituAlgorithm.h"
 #include "InSituAlgorithmInstantiator.h"
 #include "InSituAnalysisConfig.h"
+#include "Profiler.h"
 #include "SimulationParticles.h"
 
 #ifdef USEDIY
@@ -129,7 +130,7 @@ InSituAnalysisManager::~InSituAnalysisManager()
   this->ClearInSituAlgorithms();
 
 #ifdef ENABLESTATS
-  this->FinalizeTimers();
+  Profiler::Print(this->Communicator);
 #endif
 }
 
@@ -347,12 +348,12 @@ bool InSituAnalysisManager::IsExecutionTimeStep(
   bool status = false;
 
   // STEP 0: Parse the configuration file
-  this->StartTimer(tstep,"ReadConfiguration");
+  Profiler::Begin("ReadConfiguration");
   this->ParseConfigurationFile();
 
   // STEP 1: Create a vector of analysis tools
   this->CreateInSituAlgorithms();
-  this->EndTimer(tstep,"ReadConfiguration");
+  Profiler::End("ReadConfiguration");
   this->Barrier();
 
   // STEP 2: Loop through all analsysis tools and see if anything needs to
@@ -489,191 +490,6 @@ void InSituAnalysisManager::CreateInSituAlgorithms()
     } // END for all tools in the configuration file
 }
 
-//------------------------------------------------------------------------------
-void InSituAnalysisManager::StartTimer(
-      INTEGER tstep, std::string eventName)
-{
-
-#ifdef ENABLESTATS
-  // STEP 0: Get the start time
-  double startTime = MPI_Wtime();
-
-  // STEP 1: Update event counter
-  if( this->EventCounter.find(eventName) == this->EventCounter.end() )
-    {
-    this->EventCounter[ eventName ] = 1;
-    this->GlobalTimers[ eventName ] = 0.0;
-    }
-  else
-    {
-    this->EventCounter[ eventName ]++;
-    }
-
-  // STEP 2: Store start time for this event at the given timestep
-  std::ostringstream oss;
-  oss << eventName << "-" << tstep;
-  assert("pre: Event should not already exist!" &&
-    (this->Timers.find(oss.str()) == this->Timers.end()) );
-
-  this->Timers[oss.str()]=startTime;
-#endif
-
-}
-
-//------------------------------------------------------------------------------
-void InSituAnalysisManager::EndTimer(INTEGER tstep, std::string eventName)
-{
-
-#ifdef ENABLESTATS
-  // STEP 0: Get the end time
-  double endTime = MPI_Wtime();
-
-  // STEP 1: Get the previously stored start time
-  std::ostringstream oss;
-  oss << eventName << "-" << tstep;
-  assert("pre: Event does not exist!" &&
-    (this->Timers.find(oss.str()) != this->Timers.end())  );
-  REAL startTime = this->Timers[oss.str()];
-
-  // STEP 2: Compute & store elapsed time
-  REAL elapsed = endTime-startTime;
-  this->Timers[oss.str()] = elapsed;
-
-  // STEP 3: Update global timer across all timers
-  assert("pre: Event does not exist in global timers" &&
-          (this->GlobalTimers.find(eventName) != this->GlobalTimers.end()));
-  this->GlobalTimers[eventName] += elapsed;
-#endif
-
-}
-
-//------------------------------------------------------------------------------
-void InSituAnalysisManager::GatherVector(
-      std::vector<double> &snd, std::vector<double> &rcv)
-{
-  // STEP 0: Get the number of items each process will send
-  int N = static_cast<int>( snd.size() );
-
-  // STEP 1: Ensure each process sends the same number of items
-  int NTOTAL = 0;
-  MPI_Allreduce(&N,&NTOTAL,1,MPI_INT,MPI_SUM,this->Communicator);
-  assert("pre: Each proc must send the same number of data" &&
-          NTOTAL==this->NumRanks*N);
-
-  // STEP 2: Allocate rcv buffer at the root process
-  if( this->Rank==0 )
-    {
-    rcv.resize(NTOTAL,0.0);
-    }
-
-  // STEP 3: Do gather
-  MPI_Gather(&snd[0],N,MPI_DOUBLE,
-      &rcv[0],N,MPI_DOUBLE,0,this->Communicator);
-}
-
-//------------------------------------------------------------------------------
-void InSituAnalysisManager::FinalizeTimers()
-{
-  // STEP 0: Print out the frequency of each event
-  std::map<std::string,INTEGER>::iterator eventCounterIter=
-      this->EventCounter.begin();
-  for(; eventCounterIter != this->EventCounter.end(); ++eventCounterIter )
-    {
-    std::string eventName = eventCounterIter->first;
-    INTEGER frequency = eventCounterIter->second;
-    PRINTLN( << "EVENT: " << eventName << " RUN " << frequency << " TIMES" );
-    } // END for all events
-
-  // STEP 2: Pack the discrete timers for this process
-  std::vector< double > processTimers;
-  processTimers.resize( this->Timers.size() );
-  std::map<std::string,double>::iterator timersIter = this->Timers.begin();
-  for(int idx=0; timersIter != this->Timers.end(); ++timersIter, ++idx )
-    {
-    processTimers[idx] = timersIter->second;
-    } // END for all timers in this process
-
-  // STEP 3: Pack the global timers for this process
-  std::vector< double > processGlobalTimers;
-  processGlobalTimers.resize( this->GlobalTimers.size() );
-  std::map<std::string,double>::iterator globalTimersIter=
-      this->GlobalTimers.begin();
-  int idx=0;
-  for(;globalTimersIter != this->GlobalTimers.end(); ++globalTimersIter,++idx)
-    {
-    processGlobalTimers[idx] = globalTimersIter->second;
-    } // END for all global timers in this process
-
-
-  // STEP 4: Gather vectors
-  std::vector<double> DiscreteTimes;
-  std::vector<double> TotalTimes;
-  this->GatherVector(processTimers,DiscreteTimes);
-  this->GatherVector(processGlobalTimers,TotalTimes);
-
-  // STEP 4: Process 0 dumps the time statistics
-  if( this->Rank == 0 )
-    {
-    std::map<std::string,double>::iterator iter;
-    int NEVENTS = 0;
-
-    // Write Total times per process
-    std::ofstream ttimesFile;
-    ttimesFile.open("TotalTimes.dat");
-    assert("pre: Cannot write TotalTimes file!" && (ttimesFile.is_open()));
-
-    ttimesFile << "ProcessID;";
-    iter = this->GlobalTimers.begin();
-    for(;iter != this->GlobalTimers.end(); ++iter)
-      {
-      ttimesFile << iter->first << ";";
-      } // END for
-    ttimesFile << std::endl;
-
-    NEVENTS = this->GlobalTimers.size(); // number of events per proc.
-    for(int rnk=0; rnk < this->NumRanks; ++rnk )
-      {
-      ttimesFile << rnk << ";";
-      for(int event=0; event < NEVENTS; ++event )
-        {
-        ttimesFile << TotalTimes[rnk*NEVENTS+event] << ";";
-        } // END for all events
-      ttimesFile << std::endl;
-      } // END for all ranks
-
-    ttimesFile.close();
-
-    // Write breakdown per time-step file
-    std::ofstream dtimesFile;
-    dtimesFile.open("DiscreteTimes.dat");
-    assert("pre: Cannot write DiscreteTimes file!" && (dtimesFile.is_open()));
-
-    dtimesFile << "ProcessID;";
-    iter = this->Timers.begin();
-    for(;iter != this->Timers.end(); ++iter)
-      {
-      dtimesFile << iter->first << ";";
-      } // END for
-    dtimesFile << std::endl;
-
-    NEVENTS = this->Timers.size(); // number of events per proc.
-    for(int rnk=0; rnk < this->NumRanks; ++rnk )
-      {
-      dtimesFile << rnk << ";";
-      for( int event=0; event < NEVENTS; ++event )
-        {
-        dtimesFile << DiscreteTimes[rnk*NEVENTS+event] << ";";
-        } // END for all events
-      dtimesFile << std::endl;
-      } // END for all ranks
-
-    dtimesFile.close();
-
-    } // END if rank==0
-
-  this->Barrier();
-}
-
 //------------------------------------------------------------------------------
 void InSituAnalysisManager::CoProcess()
 {
@@ -684,14 +500,14 @@ void InSituAnalysisManager::CoProcess()
 
   if( !this->ConfigurationIsRead )
     {
-    this->StartTimer(this->Particles->TimeStep,"ReadConfiguration");
+    Profiler::Begin("ReadConfiguration");
 
     // STEP 0: Parse the configuration file
     this->ParseConfigurationFile();
 
     // STEP 1: Create a vector of analysis tools
     this->CreateInSituAlgorithms();
-    this->EndTimer(this->Particles->TimeStep,"ReadConfiguration");
+    Profiler::End("ReadConfiguration");
     this->Barrier();
     }
 
@@ -710,7 +526,7 @@ void InSituAnalysisManager::CoProcess()
   // given at the configuration file and execute it. After the analysis is
   // executed, check if the output should be generated and if output is
   // requested, write it to disk.
-  this->StartTimer(this->Particles->TimeStep,"TotalInSituExecution");
+  Profiler::Begin(Profiler::GetPhaseRegion("TotalInSituExecution"));
   std::map<std::string,InSituAlgorithm*>::iterator toolIter;
   toolIter=this->InSituAlgorithms.begin();
   for( ;toolIter!=this->InSituAlgorithms.end(); ++toolIter)
@@ -723,32 +539,39 @@ void InSituAnalysisManager::CoProcess()
 
     if( tool->ShouldExecute(this->Particles->TimeStep) )
       {
+      // NOTE: tools are timed by their name in the configuration file, so
+      // that several instances of the same algorithm are timed separately.
       PRINT(<< "Executing: " << tool->GetName() << "...");
-      this->StartTimer(this->Particles->TimeStep,tool->GetName());
+      Profiler::Begin(Profiler::GetPhaseRegion(toolName));
       tool->Execute(this->Particles);
-      this->EndTimer(this->Particles->TimeStep,tool->GetName());
+      Profiler::End(toolName);
       PRINTLN(<< "[DONE]");
 
       if(tool->GetGenerateOutput() == true)
         {
         PRINT(<<"Writing output...");
-        this->StartTimer(this->Particles->TimeStep,tool->GetName()+"IO");
+        Profiler::Begin(Profiler::GetPhaseRegion(toolName+"IO"));
         tool->WriteOutput();
-        this->EndTimer(this->Particles->TimeStep,tool->GetName()+"IO");
+        Profiler::End(toolName+"IO");
         PRINTLN(<< "[DONE]");
         } // END if should write output
 
       if(this->Configuration->GetVisualization() &&
           tool->IsVisible())
         {
-        this->StartTimer(this->Particles->TimeStep,tool->GetName()+"VIZ");
+        Profiler::Begin(toolName+"VIZ");
         // TODO: implement this
-        this->EndTimer(this->Particles->TimeStep,tool->GetName()+"VIZ");
+        Profiler::End(toolName+"VIZ");
         } // END if the tool is visible
       } // END if the tool should execute
 
     } // END for all tools
-  this->EndTimer(this->Particles->TimeStep,"TotalInSituExecution");
+  Profiler::End("TotalInSituExecution");
+
+#ifdef ENABLESTATS
+  Profiler::WriteTimeStep(
+      this->Communicator,this->Particles->TimeStep,"InSituTimes");
+#endif
 
   // STEP 3: Synchronize all ranks
   PRINTLN(<< "Finished co-processing @t=" << this->Particles->TimeStep);
@@ -1,5 +1,7 @@
 #include "LANLHaloFinderInSituAlgorithm.h"
 #include "Partition.h"
+#include "Profiler.h"
+#include "bigchunk.h"
 
 #include <iostream>
 #include <cassert>
@@ -28,6 +30,11 @@ LANLHaloFinderInSituAlgorithm::LANLHaloFinderInSituAlgorithm()
 
   this->HaloFinder = new cosmologytools::CosmoHaloFinderP();
 
+  // Phases record the bytes held through bigchunk along with the RSS
+  Profiler::SetMemoryTracker(bigchunk_get_tracked,
+                             bigchunk_get_tracked_peak,
+                             bigchunk_reset_tracked_peak);
+
   this->HaloParticleStatistics.resize(0);
 }
 
@@ -129,11 +136,15 @@ void LANLHaloFinderInSituAlgorithm::Execute(SimulationParticles *particles)
       numParticles);
 
   // STEP 5: Run the halo-finder at each rank
+  Profiler::Begin(Profiler::GetPhaseRegion("ExecuteHaloFinder"));
   this->HaloFinder->executeHaloFinder();
+  Profiler::End("ExecuteHaloFinder");
 
   // STEP 6: Merge results across ranks
+  Profiler::Begin(Profiler::GetPhaseRegion("MergeHalos"));
   this->HaloFinder->collectHalos(this->GenerateOutput /*clearSerial*/);
   this->HaloFinder->mergeHalos();
+  Profiler::End("MergeHalos");
 
 
 
@@ -1,19 +1,19 @@
 #include "CosmologyTools.h"
-#include "CosmologyToolsManager.h"
+#include "InSituAnalysisManager.h"
 #include <iostream>
 #include <cassert>
 
-static cosmotk::CosmologyToolsManager *CosmoToolsManager = NULL;
+static cosmotk::InSituAnalysisManager *CosmoToolsManager = NULL;
 
 void cosmotools_initialize(MPI_Comm *comm)
 {
-  CosmoToolsManager = new cosmotk::CosmologyToolsManager();
+  CosmoToolsManager = new cosmotk::InSituAnalysisManager();
   assert(CosmoToolsManager != NULL);
   CosmoToolsManager->Initialize( *comm );
 }
 
 //------------------------------------------------------------------------------
-void cosmotools_fortran_intialize(MPI_Fint *fcomm)
+void cosmotools_fortran_initialize(MPI_Fint *fcomm)
 {
   MPI_Comm comm = MPI_Comm_f2c(*fcomm);
   cosmotools_initialize(&comm);
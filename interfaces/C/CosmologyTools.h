@@ -8,7 +8,7 @@
  #include "CosmologyToolsAPIMangling.h" // auto-generated for Fortran interface
 #endif
 
-#include "CosmologyToolsDefinitions.h"
+#include "CosmoToolsDefinitions.h"
 
 #include <mpi.h>
 
@@ -26,8 +26,10 @@
 #include "GenericIOPosixReader.h"
 #include "GenericIOReader.h"
 #include "Halo.h"
+#include "HaloKeyMap.h"
+#include "HaloNeighborExchange.h"
 #include "MPIUtilities.h"
-#include "TaskTimer.h"
+#include "Profiler.h"
 
 //==============================================================================
 // Global variables
@@ -49,10 +51,21 @@ bool Verify = false;
 bool Synthetic = false;
 bool NewLayout = false;
 bool UsePosix  = false;
+std::string SegmentPrefix = "";
+
+// The catalogs carry no halo radius, so when set, only halos whose center
+// comes within this distance of a block face are sent to the neighbors
+// across it. It must cover the extent of the halos plus how far their
+// particles move between time-steps. Negative to send all halos.
+POSVEL_T ExchangeMargin = -1.;
+
+// The bounds of the block of this rank
+POSVEL_T BlockMin[3];
+POSVEL_T BlockMax[3];
 
 std::vector< int > timesteps;
 std::vector<cosmotk::Halo> Halos;
-std::map<std::string,int> Halo2Idx;
+cosmotk::HaloKeyMap<int> Halo2Idx;
 
 std::map<int,int> NumHalosAtTimeStep;
 
@@ -209,10 +222,9 @@ int main(int argc, char **argv)
   cosmotk::MPIUtilities::Printf(
       comm,"- Read in analysis time-steps...[DONE]\n");
 
-  // STEP 6: Initialize timers, and the timers vector.
+  // STEP 6: Initialize the timers vector.
   // For each timestep, we measure the time to read the halos and the time
   // to track them.
-  cosmotk::TaskTimer IOTimer,MergerTreeTimer;
   std::vector<double> timers;
   std::vector<double> walltimers;
   timers.resize(timesteps.size()*2,0.0);
@@ -227,6 +239,14 @@ int main(int argc, char **argv)
   HaloTracker = new cosmologytools::ForwardHaloTracker();
   HaloTracker->SetCommunicator( comm );
   HaloTracker->SetMergerTreeThreshold( MergerTreeThreshold );
+  HaloTracker->GetHaloEvolutionTree()->SetSegmentFilePrefix( SegmentPrefix );
+  if( ExchangeMargin >= 0. )
+    {
+    cosmotk::HaloNeighborExchange *exchange =
+        HaloTracker->GetHaloMergerTree()->GetNeighborExchange();
+    exchange->SetBlockBounds( BlockMin, BlockMax );
+    exchange->SetMargin( ExchangeMargin );
+    }
   for(int t=0; t < timesteps.size(); ++t)
     {
     REAL z = ComputeRedShift(timesteps[t]);
@@ -234,10 +254,9 @@ int main(int argc, char **argv)
         comm,"t=%d, redshift=%f\n", timesteps[t], z);
 
     cosmotk::MPIUtilities::Printf(comm,"Read halos...\n");
-    IOTimer.StartTimer();
+    cosmotk::ProfilerRegion IOTimer("ReadHalos");
     ReadHalosAtTimeStep( timesteps[t] );
-    IOTimer.StopTimer();
-    timers[ t*2 ] = IOTimer.GetEllapsedTime();
+    timers[ t*2 ] = IOTimer.Stop();
 
     MPI_Allreduce(&timers[t*2],&walltimers[t*2],1,MPI_DOUBLE,MPI_MAX,comm);
     cosmotk::MPIUtilities::Printf(comm,"[DONE]\n");
@@ -247,10 +266,9 @@ int main(int argc, char **argv)
     NumHalosAtTimeStep[ timesteps[t] ] = numHalos;
 
     cosmotk::MPIUtilities::Printf(comm,"Track halos...\n");
-    MergerTreeTimer.StartTimer();
+    cosmotk::ProfilerRegion MergerTreeTimer("TrackHalos");
     HaloTracker->TrackHalos(timesteps[t],z,Halos);
-    MergerTreeTimer.StopTimer();
-    timers[ t*2+1 ] = MergerTreeTimer.GetEllapsedTime();
+    timers[ t*2+1 ] = MergerTreeTimer.Stop();
 
     MPI_Allreduce(
         &timers[t*2+1],&walltimers[t*2+1],1,MPI_DOUBLE,MPI_MAX,comm);
@@ -266,13 +284,17 @@ int main(int argc, char **argv)
         HaloTracker->GetHaloEvolutionTree()->GetTotalNumberOfBytes();
 
 
+    cosmotk::Profiler::WriteTimeStep(comm,timesteps[t],"halotracker-timings");
+
     cosmotk::MPIUtilities::Printf(
         comm,"\t - Processed timestep %d/%d SIM TSTEP=%d\n",
               t+1,timesteps.size(),timesteps[t]);
     Halos.clear();
+    Halo2Idx.clear();
     } // END for all time-step
 
-  // STEP 9: Write the tree
+  // STEP 9: Write the tree. A streamed tree only writes its last segment,
+  // the segments are joined into MergerTree.dat by mergertreestitch.
   HaloTracker->WriteMergerTree("MergerTree.dat");
 
   // STEP 10: Write statistics
@@ -313,6 +335,7 @@ int main(int argc, char **argv)
 
   // STEP 11: Write statistics
   WriteStatistics();
+  cosmotk::Profiler::Print(comm);
   MPI_Barrier(comm);
 
   // STEP 11: Finalize
@@ -373,7 +396,7 @@ void CreateSyntheticHalo(
   halo.Redshift = ComputeRedShift( tstep );
   for(ID_T idx=start; idx <= end; ++idx)
     {
-    halo.ParticleIds.insert( idx );
+    halo.ParticleIds.push_back( idx );
     }
   Halos.push_back( halo );
 }
@@ -472,6 +495,14 @@ void ParseArguments(int argc, char **argv)
       {
       UsePosix = true;
       }
+    else if(strcmp(argv[i],"--segments")==0)
+      {
+      SegmentPrefix = std::string(argv[++i]);
+      }
+    else if(strcmp(argv[i],"--exchange-margin")==0)
+      {
+      ExchangeMargin = atof(argv[++i]);
+      }
     else
       {
       std::cerr << "ERROR: invalid argument " << argv[i] << std::endl;
@@ -630,10 +661,12 @@ REAL ComputeRedShift(const int tstep)
 //------------------------------------------------------------------------------
 int GetHaloIndex(int tstep,ID_T haloTag)
 {
-  std::string hashCode = cosmotk::Halo::GetHashCodeForHalo(haloTag,tstep);
-  if( Halo2Idx.find(hashCode) != Halo2Idx.end() )
+  cosmotk::HaloKey hashCode =
+      cosmotk::Halo::GetHashCodeForHalo(haloTag,tstep);
+  cosmotk::HaloKeyMap<int>::iterator iter = Halo2Idx.find(hashCode);
+  if( iter != Halo2Idx.end() )
     {
-    return( Halo2Idx[hashCode] );
+    return( iter->second );
     }
   else
     {
@@ -777,6 +810,10 @@ void ReadHalosAtTimeStep(int tstep)
         Halos[idx].AverageVelocity[1] = halo_vy[i];
         Halos[idx].AverageVelocity[2] = halo_vz[i];
         Halos[idx].HaloMass = halomass[i];
+        if( ExchangeMargin >= 0. )
+          {
+          Halos[idx].Radius = 0.;
+          }
         }
 
       delete [] haloTags;
@@ -816,7 +853,12 @@ void ReadHalosAtTimeStep(int tstep)
 //      std::cout << "halo_tags: " << halo_tags[i] << std::endl;
 //      std::cout.flush();
       int idx = GetHaloIndex(tstep,halo_tags[i]);
-      Halos[idx].ParticleIds.insert(particleIds[i]);
+      Halos[idx].ParticleIds.push_back(particleIds[i]);
+      }
+
+    for(unsigned int hidx=0; hidx < Halos.size(); ++hidx)
+      {
+      Halos[hidx].SortParticleIds();
       }
 
     // STEP 3: Close files
@@ -983,6 +1025,8 @@ void MPICart2DIYDecomposition(MPI_Comm mycomm)
    {
    bb.min[i] = min[i];
    bb.max[i] = min[i] + dx[i];
+   BlockMin[i] = bb.min[i];
+   BlockMax[i] = bb.max[i];
    }
 
   // STEP 4: data overall extents
@@ -0,0 +1,297 @@
+/**
+ * @brief C++ program to join the segment files of a streamed merger-tree,
+ * written by halotracker with --segments, into a single merger-tree file.
+ */
+
+// C++ includes
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+// MPI include
+#include <mpi.h>
+
+// CosmologyTools includes
+#include "CosmoToolsMacros.h"
+#include "DistributedHaloEvolutionTree.h"
+#include "GenericIO.h"
+#include "GenericIODefinitions.hpp"
+#include "GenericIOMPIReader.h"
+#include "GenericIOPosixReader.h"
+#include "GenericIOReader.h"
+#include "Halo.h"
+#include "MergerTreeFileFormat.h"
+#include "MPIUtilities.h"
+
+//==============================================================================
+// Global variables
+//==============================================================================
+int rank;
+int size;
+MPI_Comm comm = MPI_COMM_WORLD;
+
+// Command line parameters
+std::string SegmentPrefix = "";
+std::string OutputFile = "MergerTree.dat";
+bool UsePosix = false;
+int MergerTreeFormat = cosmotk::MergerTreeFileFormat::GENERIC_IO_POSIX;
+
+// The tree nodes read by this rank from all segments
+std::vector< HaloInfo > Nodes;
+std::vector< ID_T > Descendants;
+std::vector< unsigned char > EventMasks;
+
+void ParseArguments(int argc, char **argv);
+void ReadSegmentIndex(std::vector<std::string> &segments);
+void ReadSegment(const std::string &segment);
+cosmotk::GenericIOReader* GetReader();
+
+//------------------------------------------------------------------------------
+
+/**
+ * @brief Program main
+ * @param argc the argument counter
+ * @param argv the argument vector
+ * @return rc return code
+ */
+int main(int argc, char **argv)
+{
+  // STEP 0: Initialize MPI
+  MPI_Init(&argc,&argv);
+  MPI_Comm_rank(comm,&rank);
+  MPI_Comm_size(comm,&size);
+
+  // STEP 1: Parse arguments
+  ParseArguments(argc,argv);
+
+  // STEP 2: Get the segments, in the order they were written
+  std::vector< std::string > segments;
+  ReadSegmentIndex(segments);
+  cosmotk::MPIUtilities::Printf(
+      comm,"- Found %d segments...[DONE]\n", static_cast<int>(segments.size()));
+
+  // STEP 3: Read the nodes of all segments
+  for(unsigned int i=0; i < segments.size(); ++i)
+    {
+    ReadSegment(segments[i]);
+    cosmotk::MPIUtilities::Printf(
+        comm,"- Read %s...[DONE]\n",segments[i].c_str());
+    } // END for all segments
+
+  // STEP 4: Write the merger-tree
+  int N = static_cast<int>(Nodes.size());
+  cosmotk::DistributedHaloEvolutionTree::WriteNodes(
+      comm,MergerTreeFormat,OutputFile,
+      (N > 0)? &Nodes[0] : NULL,
+      (N > 0)? &Descendants[0] : NULL,
+      (N > 0)? &EventMasks[0] : NULL,
+      N);
+
+  int total = 0;
+  MPI_Allreduce(&N,&total,1,MPI_INT,MPI_SUM,comm);
+  cosmotk::MPIUtilities::Printf(
+      comm,"- Wrote %d nodes to %s...[DONE]\n",total,OutputFile.c_str());
+
+  // STEP 5: Finalize
+  MPI_Finalize();
+  return 0;
+}
+
+//------------------------------------------------------------------------------
+void ParseArguments(int argc, char **argv)
+{
+  for(int i=1; i < argc; ++i )
+    {
+    if(strcmp(argv[i],"--segments")==0)
+      {
+      SegmentPrefix = std::string(argv[++i]);
+      }
+    else if(strcmp(argv[i],"--output")==0)
+      {
+      OutputFile = std::string(argv[++i]);
+      }
+    else if(strcmp(argv[i],"--use-posix")==0)
+      {
+      UsePosix = true;
+      }
+    else if(strcmp(argv[i],"--write-mpi")==0)
+      {
+      MergerTreeFormat = cosmotk::MergerTreeFileFormat::GENERIC_IO_MPI;
+      }
+    else
+      {
+      std::cerr << "ERROR: invalid argument " << argv[i] << std::endl;
+      MPI_Abort(comm,-1);
+      }
+    } // END for all arguments
+
+  if( SegmentPrefix == "" )
+    {
+    std::cerr << "ERROR: specify [--segments <prefix>] arg\n";
+    MPI_Abort(comm,-1);
+    }
+}
+
+//------------------------------------------------------------------------------
+void ReadSegmentIndex(std::vector<std::string> &segments)
+{
+  // STEP 0: Rank 0 reads the index
+  std::string index;
+  if( rank == 0 )
+    {
+    std::string fileName =
+        cosmotk::DistributedHaloEvolutionTree::GetSegmentIndexFileName(
+            SegmentPrefix);
+    std::ifstream ifs;
+    ifs.open(fileName.c_str());
+    if( !ifs.is_open() )
+      {
+      std::cerr << "ERROR: cannot open " << fileName << std::endl;
+      MPI_Abort(comm,-1);
+      }
+
+    // Each segment holds the nodes of a distinct range of time-steps, so a
+    // segment listed twice would duplicate its nodes in the merger-tree
+    std::set< std::string > listed;
+    std::string segment;
+    while( std::getline(ifs,segment) )
+      {
+      if( segment.empty() )
+        {
+        continue;
+        }
+      if( !listed.insert(segment).second )
+        {
+        std::cerr << "ERROR: segment " << segment << " is listed twice in "
+                  << fileName << std::endl;
+        MPI_Abort(comm,-1);
+        }
+      index += segment + "\n";
+      }
+    ifs.close();
+    } // END if rank 0
+
+  // STEP 1: Broadcast it to all ranks
+  int length = static_cast<int>(index.size());
+  MPI_Bcast(&length,1,MPI_INT,0,comm);
+  std::vector< char > buffer(length+1,'\0');
+  if( rank == 0 )
+    {
+    index.copy(&buffer[0],length);
+    }
+  MPI_Bcast(&buffer[0],length,MPI_CHAR,0,comm);
+
+  // STEP 2: Split it into segment names
+  segments.clear();
+  std::string segment;
+  for(int i=0; i < length; ++i)
+    {
+    if( buffer[i] == '\n' )
+      {
+      segments.push_back(segment);
+      segment.clear();
+      }
+    else
+      {
+      segment += buffer[i];
+      }
+    } // END for all characters
+}
+
+//------------------------------------------------------------------------------
+void ReadSegment(const std::string &segment)
+{
+  // STEP 0: Open the segment
+  cosmotk::GenericIOReader* reader = GetReader();
+  reader->SetFileName(segment);
+  reader->SetCommunicator(comm);
+  reader->OpenAndReadHeader();
+  int N = reader->GetNumberOfElements();
+
+  // STEP 1: Register the variables written by
+  // DistributedHaloEvolutionTree::WriteNodes
+  std::vector< ID_T > treeNodeIds(N+(cosmotk::CRCSize/sizeof(ID_T)));
+  std::vector< ID_T > haloTags(N+(cosmotk::CRCSize/sizeof(ID_T)));
+  std::vector< REAL > haloMass(N+(cosmotk::CRCSize/sizeof(REAL)));
+  std::vector< int > tsteps(N+(cosmotk::CRCSize/sizeof(int)));
+  std::vector< REAL > redshift(N+(cosmotk::CRCSize/sizeof(REAL)));
+  std::vector< POSVEL_T > center_x(N+(cosmotk::CRCSize/sizeof(POSVEL_T)));
+  std::vector< POSVEL_T > center_y(N+(cosmotk::CRCSize/sizeof(POSVEL_T)));
+  std::vector< POSVEL_T > center_z(N+(cosmotk::CRCSize/sizeof(POSVEL_T)));
+  std::vector< POSVEL_T > mcx(N+(cosmotk::CRCSize/sizeof(POSVEL_T)));
+  std::vector< POSVEL_T > mcy(N+(cosmotk::CRCSize/sizeof(POSVEL_T)));
+  std::vector< POSVEL_T > mcz(N+(cosmotk::CRCSize/sizeof(POSVEL_T)));
+  std::vector< POSVEL_T > vx(N+(cosmotk::CRCSize/sizeof(POSVEL_T)));
+  std::vector< POSVEL_T > vy(N+(cosmotk::CRCSize/sizeof(POSVEL_T)));
+  std::vector< POSVEL_T > vz(N+(cosmotk::CRCSize/sizeof(POSVEL_T)));
+  std::vector< ID_T > descendant(N+(cosmotk::CRCSize/sizeof(ID_T)));
+  std::vector< unsigned char > eventMask(
+      N+(cosmotk::CRCSize/sizeof(unsigned char)));
+
+  int flag = cosmotk::GenericIOBase::ValueHasExtraSpace;
+  reader->AddVariable("tree_node_id",&treeNodeIds[0],flag);
+  reader->AddVariable("halo_tag",&haloTags[0],flag);
+  reader->AddVariable("halo_mass",&haloMass[0],flag);
+  reader->AddVariable("timestep",&tsteps[0],flag);
+  reader->AddVariable("redshift",&redshift[0],flag);
+  reader->AddVariable("center_x",&center_x[0],flag);
+  reader->AddVariable("center_y",&center_y[0],flag);
+  reader->AddVariable("center_z",&center_z[0],flag);
+  reader->AddVariable("mean_center_x",&mcx[0],flag);
+  reader->AddVariable("mean_center_y",&mcy[0],flag);
+  reader->AddVariable("mean_center_z",&mcz[0],flag);
+  reader->AddVariable("v_x",&vx[0],flag);
+  reader->AddVariable("v_y",&vy[0],flag);
+  reader->AddVariable("v_z",&vz[0],flag);
+  reader->AddVariable("descendant_id",&descendant[0],flag);
+  reader->AddVariable("event_mask",&eventMask[0],flag);
+
+  // STEP 2: Read the data
+  reader->ReadData();
+  reader->Close();
+  delete reader;
+
+  // STEP 3: Append the nodes
+  HaloInfo node;
+  memset(&node,0,sizeof(HaloInfo));
+  for(int i=0; i < N; ++i)
+    {
+    node.GlobalID              = treeNodeIds[ i ];
+    node.Tag                   = haloTags[ i ];
+    node.HaloMass              = haloMass[ i ];
+    node.TimeStep              = tsteps[ i ];
+    node.Redshift              = redshift[ i ];
+    node.Center[ 0 ]           = center_x[ i ];
+    node.Center[ 1 ]           = center_y[ i ];
+    node.Center[ 2 ]           = center_z[ i ];
+    node.MeanCenter[ 0 ]       = mcx[ i ];
+    node.MeanCenter[ 1 ]       = mcy[ i ];
+    node.MeanCenter[ 2 ]       = mcz[ i ];
+    node.AverageVelocity[ 0 ]  = vx[ i ];
+    node.AverageVelocity[ 1 ]  = vy[ i ];
+    node.AverageVelocity[ 2 ]  = vz[ i ];
+    Nodes.push_back( node );
+    Descendants.push_back( descendant[ i ] );
+    EventMasks.push_back( eventMask[ i ] );
+    } // END for all nodes
+}
+
+//------------------------------------------------------------------------------
+cosmotk::GenericIOReader* GetReader()
+{
+  cosmotk::GenericIOReader* reader = NULL;
+  if( UsePosix )
+    {
+    reader = new cosmotk::GenericIOPosixReader();
+    }
+  else
+    {
+    reader = new cosmotk::GenericIOMPIReader();
+    }
+  return( reader );
+}